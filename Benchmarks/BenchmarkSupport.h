@@ -0,0 +1,52 @@
+//
+//  BenchmarkSupport.h
+//  Benchmarks
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Argument parsing and printing shared by the benchmarks.
+// Every benchmark takes its parameters as positional numbers, so the quick runs registered with CTest only differ in their arguments.
+//
+
+#ifndef BenchmarkSupport_h
+#define BenchmarkSupport_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <LatencyHistogram.h>
+
+/// The positional argument at `index`, or `fallback` if there are not that many arguments.
+inline uint64_t BenchmarkArgument(int argc, const char* argv[], int index, uint64_t fallback)
+{
+	return (argc > index) ? strtoull(argv[index], nullptr, 0) : fallback;
+}
+
+/// `count` over `nanoseconds`, per second.
+inline uint64_t BenchmarkRate(uint64_t count, uint64_t nanoseconds)
+{
+	return (nanoseconds != 0) ? (uint64_t)((double)count * 1e9 / (double)nanoseconds) : 0;
+}
+
+/// A percentile of a histogram, no larger than the largest value recorded, since the histogram only knows the bucket it fell in.
+inline uint64_t BenchmarkPercentile(const latency_histogram* histogram, uint32_t permille)
+{
+	uint64_t percentile = LatencyHistogramPercentile(histogram, permille);
+
+	return (percentile < histogram->max) ? percentile : histogram->max;
+}
+
+/// Prints the median, 99th and 99.9th percentiles, and largest value of a histogram of nanoseconds.
+inline void BenchmarkPrintHistogram(const char* name, const latency_histogram* histogram)
+{
+	printf("\t%-24s count %10llu  p50 %9llu ns  p99 %9llu ns  p99.9 %9llu ns  max %9llu ns\n", name,
+		   (unsigned long long)histogram->count,
+		   (unsigned long long)BenchmarkPercentile(histogram, 500),
+		   (unsigned long long)BenchmarkPercentile(histogram, 990),
+		   (unsigned long long)BenchmarkPercentile(histogram, 999),
+		   (unsigned long long)histogram->max);
+}
+
+#endif /* BenchmarkSupport_h */
@@ -0,0 +1,257 @@
+//
+//  CaptureReplayBenchmark.cpp
+//  Benchmarks
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Measures the protocol core on a packet capture, replayed with `XboxOneReplay` as fast as it can run.
+// Without a capture file, a simulated controller fills a `packet_ring`, which is drained into a capture file the way `UserClientTester capture` does,
+// and the file is read back with `PacketCaptureOpen`, so the whole path from ring to replay is exercised.
+// Every round must deliver the same reports, or the replay is not deterministic and the benchmark fails.
+// Given a number of seconds, the start of the capture is also replayed once at its original timing, which must deliver the same reports as at full speed,
+// and the time packets were processed after their original timing is printed.
+// A capture recorded with a different report descriptor than this driver's is replayed anyway, with a warning.
+// Run with `[rounds] [capture file, or - for the simulated controller] [seconds at original timing]`.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <PacketCapture.h>
+
+#include "BenchmarkSupport.h"
+#include "SimulationSupport.h"
+#include "XboxOneReplay.h"
+#include "XboxOneSimulatedController.h"
+
+namespace XboxOne {
+#include "XboxOneDescriptors.h"
+}
+
+/// The number of polls of the simulated controller recorded into a capture.
+static constexpr uint32_t kCapturePolls = 1 << 16;
+
+/// The time between polls of the simulated controller, in nanoseconds.
+static constexpr uint64_t kPollInterval = 1000000;
+
+/// Records the simulated controller into `file` through a packet ring, returning the number of records written.
+static uint64_t RecordCapture(FILE* file, packet_ring* ring)
+{
+	const xboxone_model_info* model = &XBOXONE_MODELS[XBOXONE_MODEL_ONE_S];
+	xboxone_simulated_controller_config controllerConfig = {
+		.buttonRate = 20000,
+		.guideRate = 100,
+		.unknownRate = 1000,
+		.repeatRate = 5000,
+		.idleRate = 0,
+		.stickNoise = 300,
+		.reportSize = 0,
+		.seed = 1,
+	};
+	xboxone_simulated_controller controller = {};
+	packet_ring_producer producer = {};
+	packet_capture_header header = {};
+	packet_ring_record record = {};
+	uint8_t packet[PACKET_RING_MAX_DATA] = {};
+	uint64_t written = 0;
+
+	XboxOneSimulatedControllerInit(&controller, &controllerConfig);
+	PacketRingInit(&producer, ring);
+	PacketRingDescribe(ring, 0x045e, model->productID, PacketCaptureHash(XboxOne::ReportDescriptor, XboxOne::REPORT_DESCRIPTOR_SIZE));
+
+	PacketCaptureInitHeader(&header, ring);
+	if (fwrite(&header, sizeof(header), 1, file) != 1)
+	{
+		return 0;
+	}
+
+	for (uint32_t poll = 0; poll < kCapturePolls; ++poll)
+	{
+		uint64_t timestamp = (poll + 1) * kPollInterval;
+		uint32_t length = XboxOneSimulatedControllerProduce(&controller, timestamp, packet, sizeof(packet));
+
+		if (length != 0)
+		{
+			PacketRingPush(&producer, timestamp, 0, packet, length);
+		}
+
+		// The client drains the ring whenever it is half full, so no packet is lost to an overflow.
+		if (poll == kCapturePolls - 1 || producer.head - ring->tail >= PACKET_RING_RECORDS / 2)
+		{
+			while (PacketRingPop(ring, &record) == true)
+			{
+				if (fwrite(&record, sizeof(record), 1, file) != 1)
+				{
+					return 0;
+				}
+				written++;
+			}
+		}
+	}
+
+	// The count is only known once the ring is drained, so the header is written again with it.
+	header.recordCount = written;
+	if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1 || fflush(file) != 0)
+	{
+		return 0;
+	}
+
+	return (ring->overflows == 0) ? written : 0;
+}
+
+/// Reads the whole of `file` into memory, returning `nullptr` if it could not be read.
+static uint8_t* ReadCapture(FILE* file, size_t* length)
+{
+	uint8_t* capture = nullptr;
+	long size = 0;
+
+	if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) <= 0 || fseek(file, 0, SEEK_SET) != 0)
+	{
+		return nullptr;
+	}
+
+	capture = (uint8_t*)malloc((size_t)size);
+	if (capture != nullptr && fread(capture, 1, (size_t)size, file) != (size_t)size)
+	{
+		free(capture);
+		return nullptr;
+	}
+
+	*length = (size_t)size;
+	return capture;
+}
+
+int main(int argc, const char* argv[])
+{
+	uint64_t rounds = BenchmarkArgument(argc, argv, 1, 100);
+	const char* path = (argc > 2 && strcmp(argv[2], "-") != 0) ? argv[2] : nullptr;
+	uint64_t timedSeconds = BenchmarkArgument(argc, argv, 3, 0);
+	packet_ring* ring = (packet_ring*)aligned_alloc(alignof(packet_ring), sizeof(packet_ring));
+	xboxone_protocol* protocol = (xboxone_protocol*)calloc(1, sizeof(xboxone_protocol));
+	const xboxone_replay_config config = {
+		.mode = XBOXONE_REPLAY_FULL_SPEED,
+		.clock = SimulationNow,
+		.waitUntil = nullptr,
+		.numer = 1,
+		.denom = 1,
+		.coalesceWindow = 0,
+	};
+	const xboxone_replay_config timedConfig = {
+		.mode = XBOXONE_REPLAY_ORIGINAL_TIMING,
+		.clock = SimulationNow,
+		.waitUntil = SimulationWaitUntil,
+		.numer = 1,
+		.denom = 1,
+		.coalesceWindow = 0,
+	};
+	const packet_capture_header* header = nullptr;
+	const packet_capture_record* records = nullptr;
+	const xboxone_model_info* model = nullptr;
+	xboxone_replay_stats first = {};
+	xboxone_replay_stats timed = {};
+	uint64_t hash = 0;
+	uint64_t count = 0;
+	uint64_t timedCount = 0;
+	uint64_t elapsed = 0;
+	uint8_t* capture = nullptr;
+	size_t length = 0;
+	FILE* file = nullptr;
+	bool consistent = true;
+
+	if (ring == nullptr || protocol == nullptr)
+	{
+		printf("Failed to allocate the packet ring.\n");
+		return EXIT_FAILURE;
+	}
+
+	file = (path != nullptr) ? fopen(path, "rb") : tmpfile();
+	if (file == nullptr)
+	{
+		printf("Failed to open the capture file.\n");
+		return EXIT_FAILURE;
+	}
+	if (path == nullptr && RecordCapture(file, ring) == 0)
+	{
+		printf("Failed to record the simulated controller into a capture.\n");
+		return EXIT_FAILURE;
+	}
+
+	capture = ReadCapture(file, &length);
+	fclose(file);
+	count = (capture != nullptr) ? PacketCaptureOpen(capture, length, &header, &records) : 0;
+	if (count == 0)
+	{
+		printf("The capture is not valid, or holds no records.\n");
+		free(capture);
+		return EXIT_FAILURE;
+	}
+
+	model = XboxOneFindModel(header->productID);
+	if (model == nullptr)
+	{
+		printf("The capture is of an unsupported product 0x%04x, replaying it as a %s.\n", header->productID, XBOXONE_MODELS[XBOXONE_MODEL_ONE_S].name);
+		model = &XBOXONE_MODELS[XBOXONE_MODEL_ONE_S];
+	}
+
+	if (header->descriptorHash != PacketCaptureHash(XboxOne::ReportDescriptor, XboxOne::REPORT_DESCRIPTOR_SIZE))
+	{
+		printf("The capture was recorded with a different report descriptor, 0x%016llx, so its reports may not match this driver's.\n", (unsigned long long)header->descriptorHash);
+	}
+
+	printf("Capture replay: %llu rounds of %llu records from %s, %s, descriptor 0x%016llx.\n", (unsigned long long)rounds, (unsigned long long)count,
+		   (path != nullptr) ? path : "the simulated controller", model->name, (unsigned long long)header->descriptorHash);
+
+	for (uint64_t round = 0; round < rounds; ++round)
+	{
+		xboxone_replay_stats stats = {};
+
+		XboxOneProtocolInit(protocol, model, nullptr, nullptr);
+		XboxOneReplay(protocol, records, count, &config, &stats);
+
+		elapsed += stats.elapsedNanoseconds;
+		if (round == 0)
+		{
+			first = stats;
+			hash = stats.reportHash;
+		}
+		consistent = consistent && (stats.reportHash == hash) && (stats.packets == count);
+	}
+
+	printf("\t%llu packets/s  %.2f ns/packet\n", (unsigned long long)BenchmarkRate(count * rounds, elapsed), (double)elapsed / (double)(count * rounds));
+	printf("\t%llu delivered  %llu suppressed  %llu repeated  %llu ignored  %llu errors  %llu guide responses  report hash 0x%016llx\n",
+		   (unsigned long long)first.delivered, (unsigned long long)first.suppressed, (unsigned long long)first.repeated,
+		   (unsigned long long)first.ignored, (unsigned long long)first.errors, (unsigned long long)first.responses, (unsigned long long)hash);
+
+	if (timedSeconds != 0)
+	{
+		xboxone_replay_stats fullSpeed = {};
+
+		// The timestamps are taken as nanoseconds, as they are for every round above.
+		while (timedCount < count && records[timedCount].timestamp - records[0].timestamp < timedSeconds * 1000000000ULL)
+		{
+			timedCount++;
+		}
+
+		XboxOneProtocolInit(protocol, model, nullptr, nullptr);
+		XboxOneReplay(protocol, records, timedCount, &config, &fullSpeed);
+		XboxOneProtocolInit(protocol, model, nullptr, nullptr);
+		XboxOneReplay(protocol, records, timedCount, &timedConfig, &timed);
+		consistent = consistent && (timed.reportHash == fullSpeed.reportHash) && (timed.packets == timedCount);
+
+		printf("\t%llu records at original timing in %.3f s: %.2f us late on average, %.2f us at most, report hash 0x%016llx\n",
+			   (unsigned long long)timedCount, (double)timed.elapsedNanoseconds / 1e9, (double)timed.lateNanoseconds / 1000.0 / (double)timedCount,
+			   (double)timed.maxLateNanoseconds / 1000.0, (unsigned long long)timed.reportHash);
+	}
+
+	if (consistent == false)
+	{
+		printf("\tRounds delivered different reports from the same capture, or at original timing than at full speed.\n");
+	}
+
+	free(capture);
+	free(protocol);
+	free(ring);
+	return (consistent == true) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
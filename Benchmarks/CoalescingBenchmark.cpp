@@ -0,0 +1,107 @@
+//
+//  CoalescingBenchmark.cpp
+//  Benchmarks
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Measures what coalescing button reports saves and what it costs, on the simulated input path reading a simulated controller through the mock pipe.
+// The controller sends a report on every poll with its sticks wandering, as a controller in use does, and changes a button now and then.
+// For each window, the delivery rate is the number of reports handed to `handleReport` per simulated second,
+// and the added latency is the simulated time from a read completing to its report, or the newer one coalesced in its place, being handed over,
+// which only coalescing adds here. A window's latency runs from the first report held in it, since that is the oldest state the consumer is kept from.
+// Every report offered must be delivered or replaced by a newer one, and none may be held longer than the window.
+// Run with `[simulated seconds]`.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "BenchmarkSupport.h"
+#include "XboxOneSimulatedController.h"
+#include "XboxOneSimulatedInput.h"
+
+/// The windows measured, in nanoseconds. 0 delivers every report, and 16 ms is about a frame at 60 Hz.
+static const uint64_t kWindows[] = { 0, 2000000, 4000000, 8000000, 16000000 };
+
+/// Runs the input path with a coalescing window for `duration`, returning false if a report was lost or held past the window.
+static bool RunWindow(xboxone_simulated_input* input, uint64_t window, uint64_t duration)
+{
+	xboxone_simulated_controller_config controllerConfig = {
+		.buttonRate = 5000,
+		.guideRate = 0,
+		.unknownRate = 0,
+		.repeatRate = 0,
+		.idleRate = 0,
+		.stickNoise = 300,
+		.reportSize = 0,
+		.seed = 1,
+	};
+	// No jitter, reordering, or errors, so the input ring never holds a completion back and all of the delay is coalescing.
+	xboxone_simulated_input_config inputConfig = {
+		.slotCount = INPUT_RING_DEFAULT_SLOTS,
+		.pipe = {
+			.interval = 1000000,
+			.jitter = 0,
+			.errorRate = 0,
+			.stallRate = 0,
+			.reorderRate = 0,
+			.seed = 1,
+		},
+		.recovery = PIPE_RECOVERY_DEFAULT_CONFIG,
+		.coalesceWindow = window,
+		.timed = false,
+	};
+	xboxone_simulated_controller controller = {};
+	xboxone_coalescer_stats coalescing = {};
+	const xboxone_simulated_input_stats* stats = &input->stats;
+	uint64_t held = 0;
+	bool consistent = false;
+
+	XboxOneSimulatedControllerInit(&controller, &controllerConfig);
+	XboxOneSimulatedInputInit(input, &inputConfig, &XBOXONE_MODELS[XBOXONE_MODEL_ONE_S], XboxOneSimulatedControllerProduce, &controller);
+	XboxOneSimulatedInputStart(input);
+	XboxOneSimulatedInputRun(input, duration);
+	XboxOneCoalescerRead(&input->coalescer, &coalescing);
+
+	held = (input->coalescer.pending == true) ? 1 : 0;
+	consistent = (coalescing.offered == coalescing.delivered + coalescing.saved + held) && (stats->handleReports == coalescing.delivered)
+				 && (stats->delay.max <= window) && (stats->outOfOrder == 0);
+
+	printf("  window %llu us\n", (unsigned long long)(window / 1000));
+	printf("\t%llu deliveries/s of %llu reports/s  %.1f%% saved  %llu delivered at once for a button change  %llu flushed when the window closed\n",
+		   (unsigned long long)BenchmarkRate(stats->handleReports, duration), (unsigned long long)BenchmarkRate(coalescing.offered, duration),
+		   (coalescing.offered != 0) ? 100.0 * (double)coalescing.saved / (double)coalescing.offered : 0.0,
+		   (unsigned long long)coalescing.edges, (unsigned long long)coalescing.flushes);
+	BenchmarkPrintHistogram("added latency", &stats->delay);
+
+	if (consistent == false)
+	{
+		printf("\tReports were lost, or held longer than the window.\n");
+	}
+
+	return consistent;
+}
+
+int main(int argc, const char* argv[])
+{
+	uint64_t seconds = BenchmarkArgument(argc, argv, 1, 600);
+	xboxone_simulated_input* input = (xboxone_simulated_input*)calloc(1, sizeof(xboxone_simulated_input));
+	bool consistent = true;
+
+	if (input == nullptr)
+	{
+		printf("Failed to allocate the input path.\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("Coalescing: %llu simulated seconds for each window, a report every millisecond.\n", (unsigned long long)seconds);
+
+	for (uint64_t window : kWindows)
+	{
+		consistent = RunWindow(input, window, seconds * 1000000000) && consistent;
+	}
+
+	free(input);
+	return (consistent == true) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,229 @@
+//
+//  ControllerScalingBenchmark.cpp
+//  Benchmarks
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Measures how the input path scales with the number of controllers, with 1, 4, 16 and 64 simulated controllers at once.
+// Each controller runs on its own thread, as each runs on its own dispatch queue in the driver,
+// and takes its buffers from a `buffer_pool` and registers in a `location_registry` shared by every controller, under one lock.
+// Controllers are spread over several host controllers, and a buffer is only reused as is by a controller on the host controller it was created for.
+// Throughput is every packet handled over the wall time of the round. Latency is the real time taken to handle each completion,
+// so it grows once there are more controllers than processors to run them.
+// Run with `[simulated seconds per controller]`.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <BufferPool.h>
+#include <LocationRegistry.h>
+#include <OutputQueue.h>
+
+#include "BenchmarkSupport.h"
+#include "XboxOneSimulatedController.h"
+#include "XboxOneSimulatedInput.h"
+
+/// The numbers of controllers measured.
+static const uint32_t kControllerCounts[] = { 1, 4, 16, 64 };
+
+/// The buffers each controller takes from the pool: one for each pipe, and one for each input and output slot.
+static constexpr uint32_t kBuffersPerController = 2 + INPUT_RING_DEFAULT_SLOTS + OUTPUT_QUEUE_MAX_SLOTS;
+
+/// What every controller shares, as the driver shares them between every instance in the process.
+///
+/// `lock` - Serializes every use of `pool` and `registry`, as the driver's shared lock does.
+/// `pool` - The buffer pool.
+/// `registry` - The running controllers, keyed by location ID.
+typedef struct {
+	std::mutex lock;
+	buffer_pool pool;
+	location_registry registry;
+} shared_state;
+
+/// A simulated controller and its input path.
+///
+/// `controller` - The simulated controller.
+/// `input` - The input path reading from it.
+/// `locationID` - The location ID it is registered under.
+/// `buffers` - The pool indexes it took.
+/// `bufferCount` - The number of entries in `buffers`.
+/// `found` - Whether it found itself in the registry while running.
+typedef struct {
+	xboxone_simulated_controller controller;
+	xboxone_simulated_input* input;
+	uint32_t locationID;
+	uint32_t buffers[kBuffersPerController];
+	uint32_t bufferCount;
+	bool found;
+} scaling_controller;
+
+/// Starts a controller the way `handleStart` does, runs its input path for `duration` of simulated time, and stops it.
+static void RunController(shared_state* shared, scaling_controller* controller, uint64_t duration)
+{
+	{
+		std::lock_guard<std::mutex> guard(shared->lock);
+
+		uint32_t hostController = LocationRegistryHostController(controller->locationID);
+		bool reusable = false;
+
+		while (controller->bufferCount < kBuffersPerController
+			   && BufferPoolTake(&shared->pool, hostController, &controller->buffers[controller->bufferCount], &reusable) == true)
+		{
+			controller->bufferCount++;
+		}
+		LocationRegistryInsert(&shared->registry, controller->locationID, controller);
+	}
+
+	XboxOneSimulatedInputStart(controller->input);
+	XboxOneSimulatedInputRun(controller->input, duration);
+
+	{
+		std::lock_guard<std::mutex> guard(shared->lock);
+
+		controller->found = (LocationRegistryFind(&shared->registry, controller->locationID) == controller);
+		LocationRegistryRemove(&shared->registry, controller->locationID, controller);
+		for (uint32_t index = 0; index < controller->bufferCount; ++index)
+		{
+			BufferPoolGive(&shared->pool, controller->buffers[index]);
+		}
+		controller->bufferCount = 0;
+	}
+}
+
+/// Adds the values recorded in `histogram` to `total`.
+static void MergeHistogram(latency_histogram* total, const latency_histogram* histogram)
+{
+	total->count += histogram->count;
+	total->max = (histogram->max > total->max) ? histogram->max : total->max;
+	for (uint32_t bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; ++bucket)
+	{
+		total->buckets[bucket] += histogram->buckets[bucket];
+	}
+}
+
+/// Runs `count` controllers at once, returning false if any of them lost track of packet order or could not be found in the registry.
+static bool RunRound(shared_state* shared, scaling_controller* controllers, uint32_t count, uint64_t duration)
+{
+	xboxone_simulated_controller_config controllerConfig = {
+		.buttonRate = 20000,
+		.guideRate = 100,
+		.unknownRate = 1000,
+		.repeatRate = 5000,
+		.idleRate = 0,
+		.stickNoise = 300,
+		.reportSize = 0,
+		.seed = 0,
+	};
+	xboxone_simulated_input_config inputConfig = {
+		.slotCount = INPUT_RING_DEFAULT_SLOTS,
+		.pipe = {
+			.interval = 1000000,
+			.jitter = 250000,
+			.errorRate = 100,
+			.stallRate = 10,
+			.reorderRate = 1000,
+			.seed = 0,
+		},
+		.recovery = PIPE_RECOVERY_DEFAULT_CONFIG,
+		.coalesceWindow = 0,
+		.timed = true,
+	};
+	latency_histogram* handling = (latency_histogram*)calloc(1, sizeof(latency_histogram));
+	std::vector<std::thread> threads;
+	uint64_t packets = 0;
+	uint64_t outOfOrder = 0;
+	uint32_t lost = 0;
+	uint64_t reusedBefore = shared->pool.reused;
+	uint64_t rekeyedBefore = shared->pool.rekeyed;
+	uint64_t start = 0;
+	uint64_t elapsed = 0;
+
+	if (handling == nullptr)
+	{
+		printf("Failed to allocate the histogram.\n");
+		return false;
+	}
+
+	for (uint32_t index = 0; index < count; ++index)
+	{
+		scaling_controller* controller = &controllers[index];
+
+		controllerConfig.seed = index + 1;
+		inputConfig.pipe.seed = index + 1001;
+		XboxOneSimulatedControllerInit(&controller->controller, &controllerConfig);
+		XboxOneSimulatedInputInit(controller->input, &inputConfig, &XBOXONE_MODELS[XBOXONE_MODEL_ONE_S], XboxOneSimulatedControllerProduce, &controller->controller);
+		// Eight controllers to a host controller, numbered in the top byte, with ports below it, as location IDs of controllers behind hubs look.
+		controller->locationID = ((0x14 + index / 8) << 24) | ((index % 8 + 1) << 20);
+		controller->found = false;
+	}
+
+	start = SimulationNow();
+	for (uint32_t index = 0; index < count; ++index)
+	{
+		threads.emplace_back(RunController, shared, &controllers[index], duration);
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	elapsed = SimulationNow() - start;
+
+	for (uint32_t index = 0; index < count; ++index)
+	{
+		const xboxone_simulated_input_stats* stats = &controllers[index].input->stats;
+
+		packets += stats->packets;
+		outOfOrder += stats->outOfOrder;
+		lost += (controllers[index].found == true) ? 0 : 1;
+		MergeHistogram(handling, &stats->handling);
+	}
+
+	printf("  %u controllers\n", count);
+	printf("\t%llu packets/s  %llu packets  %llu buffers reused from earlier rounds  %llu replaced for another host controller  %llu out of order  %u not found in the registry\n",
+		   (unsigned long long)BenchmarkRate(packets, elapsed), (unsigned long long)packets,
+		   (unsigned long long)(shared->pool.reused - reusedBefore), (unsigned long long)(shared->pool.rekeyed - rekeyedBefore),
+		   (unsigned long long)outOfOrder, lost);
+	BenchmarkPrintHistogram("handling", handling);
+
+	free(handling);
+	return outOfOrder == 0 && lost == 0;
+}
+
+int main(int argc, const char* argv[])
+{
+	uint64_t seconds = BenchmarkArgument(argc, argv, 1, 60);
+	uint32_t maxCount = kControllerCounts[sizeof(kControllerCounts) / sizeof(kControllerCounts[0]) - 1];
+	shared_state* shared = new shared_state();
+	std::vector<scaling_controller> controllers(maxCount);
+	bool consistent = true;
+
+	for (scaling_controller& controller : controllers)
+	{
+		controller.input = (xboxone_simulated_input*)calloc(1, sizeof(xboxone_simulated_input));
+		if (controller.input == nullptr)
+		{
+			printf("Failed to allocate the input paths.\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("Controller scaling: %llu simulated seconds for each controller, %u hardware threads.\n",
+		   (unsigned long long)seconds, std::thread::hardware_concurrency());
+
+	for (uint32_t count : kControllerCounts)
+	{
+		consistent = RunRound(shared, controllers.data(), count, seconds * 1000000000) && consistent;
+	}
+
+	for (scaling_controller& controller : controllers)
+	{
+		free(controller.input);
+	}
+	delete shared;
+	return (consistent == true) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
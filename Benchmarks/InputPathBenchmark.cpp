@@ -0,0 +1,119 @@
+//
+//  InputPathBenchmark.cpp
+//  Benchmarks
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Runs the driver's input path against a simulated controller on a simulated pipe, and measures its throughput and latency.
+// Throughput is how fast the input path handles packets in real time, with simulated time skipping straight from one event to the next.
+// Latency is how long a report waits in simulated time between its read completing and `handleReport`,
+// which includes waiting behind an earlier read that completed late, and any coalescing.
+// Run with `[seconds] [jitter us] [errors per million] [stalls per million] [reorders per million] [coalesce us] [slots]`.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "BenchmarkSupport.h"
+#include "XboxOneSimulatedController.h"
+#include "XboxOneSimulatedInput.h"
+
+/// The name of each `xboxone_latency_stage`.
+static const char* const kStageNames[XBOXONE_LATENCY_COUNT] = { "end to end", "dispatch", "validation", "transform", "delivery", "rearm" };
+
+int main(int argc, const char* argv[])
+{
+	uint64_t seconds = BenchmarkArgument(argc, argv, 1, 600);
+	xboxone_simulated_controller_config controllerConfig = {
+		.buttonRate = 20000,
+		.guideRate = 100,
+		.unknownRate = 1000,
+		.repeatRate = 5000,
+		.idleRate = 0,
+		.stickNoise = 300,
+		.reportSize = 0,
+		.seed = 1,
+	};
+	xboxone_simulated_input_config inputConfig = {
+		.slotCount = (uint32_t)BenchmarkArgument(argc, argv, 7, INPUT_RING_DEFAULT_SLOTS),
+		.pipe = {
+			.interval = 1000000,
+			.jitter = BenchmarkArgument(argc, argv, 2, 250) * 1000,
+			.errorRate = (uint32_t)BenchmarkArgument(argc, argv, 3, 100),
+			.stallRate = (uint32_t)BenchmarkArgument(argc, argv, 4, 10),
+			.reorderRate = (uint32_t)BenchmarkArgument(argc, argv, 5, 1000),
+			.seed = 2,
+		},
+		.recovery = PIPE_RECOVERY_DEFAULT_CONFIG,
+		.coalesceWindow = BenchmarkArgument(argc, argv, 6, 0) * 1000,
+		.timed = true,
+	};
+	xboxone_simulated_controller controller = {};
+	xboxone_simulated_input* input = (xboxone_simulated_input*)calloc(1, sizeof(xboxone_simulated_input));
+	xboxone_latency_stats stages = {};
+	pipe_recovery_stats recovery = {};
+	uint64_t start = 0;
+	uint64_t elapsed = 0;
+
+	if (input == nullptr)
+	{
+		printf("Failed to allocate the input path.\n");
+		return EXIT_FAILURE;
+	}
+
+	XboxOneSimulatedControllerInit(&controller, &controllerConfig);
+	XboxOneSimulatedInputInit(input, &inputConfig, &XBOXONE_MODELS[XBOXONE_MODEL_ONE_S], XboxOneSimulatedControllerProduce, &controller);
+
+	start = SimulationNow();
+	XboxOneSimulatedInputStart(input);
+	XboxOneSimulatedInputRun(input, seconds * 1000000000);
+	elapsed = SimulationNow() - start;
+
+	XboxOneLatencySummarize(&input->latency, 1, 1, &stages);
+	PipeRecoveryRead(&input->path.recovery, input->now, &recovery);
+
+	printf("Input path: %llu simulated seconds, %u slots, %llu us jitter, coalescing %llu us.\n",
+		   (unsigned long long)seconds, input->path.ring.slotCount,
+		   (unsigned long long)(inputConfig.pipe.jitter / 1000), (unsigned long long)(inputConfig.coalesceWindow / 1000));
+	printf("\tthroughput               %llu packets/s, %llu ns/packet over %llu completions\n",
+		   (unsigned long long)BenchmarkRate(input->stats.packets, elapsed),
+		   (unsigned long long)((input->stats.packets != 0) ? elapsed / input->stats.packets : 0),
+		   (unsigned long long)input->stats.completions);
+	BenchmarkPrintHistogram("handling", &input->stats.handling);
+	BenchmarkPrintHistogram("simulated delay", &input->stats.delay);
+
+	for (uint32_t stage = 0; stage < XBOXONE_LATENCY_COUNT; ++stage)
+	{
+		if (stages.stages[stage].count != 0)
+		{
+			printf("\t%-24s count %10llu  p50 %9llu ns  p99 %9llu ns  p99.9 %9llu ns  max %9llu ns\n", kStageNames[stage],
+				   (unsigned long long)stages.stages[stage].count, (unsigned long long)stages.stages[stage].p50,
+				   (unsigned long long)stages.stages[stage].p99, (unsigned long long)stages.stages[stage].p999,
+				   (unsigned long long)stages.stages[stage].max);
+		}
+	}
+
+	printf("\tverdicts                 %llu delivered, %llu suppressed, %llu repeated, %llu ignored, %llu handed to HID\n",
+		   (unsigned long long)input->stats.delivered, (unsigned long long)input->stats.suppressed,
+		   (unsigned long long)input->stats.repeated, (unsigned long long)input->stats.ignored,
+		   (unsigned long long)input->stats.handleReports);
+	printf("\tpipe                     %llu failed, %llu stalls, %llu aborted, %llu reordered, %llu refused\n",
+		   (unsigned long long)input->pipe.stats.failed, (unsigned long long)input->pipe.stats.stalls,
+		   (unsigned long long)input->pipe.stats.aborted, (unsigned long long)input->pipe.stats.reordered,
+		   (unsigned long long)input->pipe.stats.refused);
+	printf("\trecovery                 %llu back-offs, %llu stall clears, %llu parks, %llu ms not healthy\n",
+		   (unsigned long long)recovery.backoffs, (unsigned long long)recovery.stallClears, (unsigned long long)recovery.parks,
+		   (unsigned long long)((recovery.stateTime[PIPE_RECOVERY_BACKOFF] + recovery.stateTime[PIPE_RECOVERY_CLEARING] + recovery.stateTime[PIPE_RECOVERY_PARKED]) / 1000000));
+
+	// Packets handled out of order would mean the input ring is broken, so the run fails.
+	if (input->stats.outOfOrder != 0 || input->stats.packets == 0)
+	{
+		printf("Handled %llu packets out of order, of %llu.\n", (unsigned long long)input->stats.outOfOrder, (unsigned long long)input->stats.packets);
+		free(input);
+		return EXIT_FAILURE;
+	}
+
+	free(input);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+//
+//  LatencyHistogramBenchmark.cpp
+//  Benchmarks
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Measures what recording into a `latency_histogram` costs the input path, which records several stages for every report,
+// and how long a reader takes to compute a percentile while the writer keeps recording.
+// Values are drawn from the kinds of durations the driver records: a few hundred ticks for a stage, and spread over many powers of two for end to end.
+// Run with `[values]`.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include <LatencyHistogram.h>
+
+#include "BenchmarkSupport.h"
+#include "SimulationSupport.h"
+
+/// The number of values drawn up front, so drawing them is not measured.
+static constexpr uint32_t kValueCount = 1 << 16;
+
+/// Records `count` values from `values` over and over, returning the nanoseconds it took.
+static uint64_t RecordValues(latency_histogram* histogram, const uint64_t* values, uint64_t count)
+{
+	uint64_t start = SimulationNow();
+
+	for (uint64_t index = 0; index < count; ++index)
+	{
+		LatencyHistogramRecord(histogram, values[index % kValueCount]);
+	}
+
+	return SimulationNow() - start;
+}
+
+int main(int argc, const char* argv[])
+{
+	uint64_t count = BenchmarkArgument(argc, argv, 1, 100000000);
+	uint64_t* values = (uint64_t*)calloc(kValueCount, sizeof(uint64_t));
+	latency_histogram* histogram = (latency_histogram*)calloc(1, sizeof(latency_histogram));
+	uint64_t random = 0;
+	uint64_t elapsed = 0;
+	bool consistent = true;
+
+	if (values == nullptr || histogram == nullptr)
+	{
+		printf("Failed to allocate the histogram.\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("Latency histogram: %llu values for each distribution.\n", (unsigned long long)count);
+	SimulationSeed(&random, 1);
+
+	// A single stage: a few hundred ticks, landing in a handful of buckets.
+	for (uint32_t index = 0; index < kValueCount; ++index)
+	{
+		values[index] = 200 + SimulationRandom(&random) % 400;
+	}
+	elapsed = RecordValues(histogram, values, count);
+	printf("\t%-24s %6.2f ns/record  p50 %llu  p99 %llu\n", "stage (200 - 600)", (double)elapsed / (double)count,
+		   (unsigned long long)LatencyHistogramPercentile(histogram, 500), (unsigned long long)LatencyHistogramPercentile(histogram, 990));
+	consistent = consistent && (histogram->count == count);
+
+	// End to end: log-uniform from 1 tick to about a second, touching every bucket.
+	for (uint32_t index = 0; index < kValueCount; ++index)
+	{
+		values[index] = 1ULL << (SimulationRandom(&random) % 30);
+		values[index] += SimulationRandom(&random) % values[index];
+	}
+	memset(histogram, 0, sizeof(*histogram));
+	elapsed = RecordValues(histogram, values, count);
+	printf("\t%-24s %6.2f ns/record  p50 %llu  p99 %llu\n", "end to end (1 - 2^30)", (double)elapsed / (double)count,
+		   (unsigned long long)LatencyHistogramPercentile(histogram, 500), (unsigned long long)LatencyHistogramPercentile(histogram, 990));
+	consistent = consistent && (histogram->count == count);
+
+	// A reader computing percentiles the whole time the writer records, as a user client polling the stats does.
+	// Each read is timed on its own, so time the reader spends descheduled between reads is not counted.
+	{
+		bool done = false;
+		latency_histogram* readTimes = (latency_histogram*)calloc(1, sizeof(latency_histogram));
+		std::thread reader([&]() {
+			while (__atomic_load_n(&done, __ATOMIC_ACQUIRE) == false)
+			{
+				uint64_t readStart = SimulationNow();
+				uint64_t p99 = LatencyHistogramPercentile(histogram, 990);
+
+				LatencyHistogramRecord(readTimes, SimulationNow() - readStart);
+				__asm__ volatile("" : : "r"(p99));
+				std::this_thread::yield();
+			}
+		});
+
+		memset(histogram, 0, sizeof(*histogram));
+		elapsed = RecordValues(histogram, values, count);
+		__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+		reader.join();
+
+		printf("\t%-24s %6.2f ns/record  %llu percentiles read, p50 %llu ns each\n", "with a reader", (double)elapsed / (double)count,
+			   (unsigned long long)readTimes->count, (unsigned long long)BenchmarkPercentile(readTimes, 500));
+		consistent = consistent && (histogram->count == count);
+		free(readTimes);
+	}
+
+	free(histogram);
+	free(values);
+	return (consistent == true) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,154 @@
+//
+//  PacketRingBenchmark.cpp
+//  Benchmarks
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Measures the packet ring with a producer thread standing in for the driver and a consumer thread standing in for the client.
+// First the producer waits whenever the ring is full, which measures throughput and how long a record waits in the ring.
+// Then the producer never waits, as the driver does, which measures how many packets a slow consumer loses to overflows.
+// In both runs the consumer checks that every record arrives in order, and that every packet is either read or counted as an overflow.
+// Run with `[packets]`.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include <PacketRing.h>
+
+#include "BenchmarkSupport.h"
+#include "SimulationSupport.h"
+
+/// The size of the packets pushed, the size of a button report with its header.
+static constexpr uint32_t kPacketLength = 18;
+
+/// What the consumer saw.
+///
+/// `read` - The number of records popped.
+/// `outOfOrder` - The number of records whose sequence number was not larger than the previous one.
+/// `transit` - Nanoseconds from push to pop, for every record.
+typedef struct {
+	uint64_t read;
+	uint64_t outOfOrder;
+	latency_histogram transit;
+} consumer_result;
+
+/// Pushes `count` packets, each carrying its sequence number, pushing again on a full ring if `wait` is true, and dropping the packet otherwise.
+///
+/// Every push to a full ring is counted as an overflow, so this returns how many of them were pushed again rather than dropped.
+static uint64_t Produce(packet_ring_producer* producer, uint64_t count, bool wait)
+{
+	uint8_t packet[kPacketLength] = {};
+	uint64_t retried = 0;
+
+	for (uint64_t sequence = 1; sequence <= count; ++sequence)
+	{
+		memcpy(packet, &sequence, sizeof(sequence));
+		while (PacketRingPush(producer, SimulationNow(), 0, packet, kPacketLength) == false && wait == true)
+		{
+			retried++;
+			std::this_thread::yield();
+		}
+	}
+
+	return retried;
+}
+
+/// Pops records until `done` is set and the ring is empty, checking that sequence numbers only increase.
+static void Consume(packet_ring* ring, const bool* done, consumer_result* result)
+{
+	packet_ring_record record = {};
+	uint64_t last = 0;
+
+	while (true)
+	{
+		if (PacketRingPop(ring, &record) == false)
+		{
+			if (__atomic_load_n(done, __ATOMIC_ACQUIRE) == true && PacketRingPop(ring, &record) == false)
+			{
+				break;
+			}
+			std::this_thread::yield();
+			continue;
+		}
+
+		uint64_t sequence = 0;
+
+		memcpy(&sequence, record.data, sizeof(sequence));
+		LatencyHistogramRecord(&result->transit, SimulationNow() - record.timestamp);
+		result->outOfOrder += (sequence <= last || record.length != kPacketLength) ? 1 : 0;
+		result->read++;
+		last = sequence;
+	}
+}
+
+/// Runs a producer and a consumer over a fresh ring, returning false if a record was lost or reordered.
+static bool RunRing(const char* name, packet_ring* ring, uint64_t count, bool wait)
+{
+	packet_ring_producer producer = {};
+	consumer_result* result = (consumer_result*)calloc(1, sizeof(consumer_result));
+	bool done = false;
+	uint64_t start = 0;
+	uint64_t elapsed = 0;
+	uint64_t retried = 0;
+	uint64_t dropped = 0;
+	bool consistent = false;
+
+	if (result == nullptr)
+	{
+		printf("Failed to allocate the consumer result.\n");
+		return false;
+	}
+
+	PacketRingInit(&producer, ring);
+
+	start = SimulationNow();
+	std::thread consumer(Consume, ring, &done, result);
+	retried = Produce(&producer, count, wait);
+	__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+	consumer.join();
+	elapsed = SimulationNow() - start;
+
+	dropped = producer.overflows - retried;
+	consistent = (result->outOfOrder == 0) && (result->read + dropped == count) && (ring->overflows == producer.overflows);
+
+	printf("  %s\n", name);
+	printf("\t%llu packets/s  %.2f ns/packet  %llu read  %llu dropped (%.3f%%)  %llu pushed again  %llu out of order\n",
+		   (unsigned long long)BenchmarkRate(count, elapsed), (double)elapsed / (double)count,
+		   (unsigned long long)result->read, (unsigned long long)dropped, 100.0 * (double)dropped / (double)count,
+		   (unsigned long long)retried, (unsigned long long)result->outOfOrder);
+	BenchmarkPrintHistogram("push to pop", &result->transit);
+
+	if (consistent == false)
+	{
+		printf("\tRecords were lost without being counted, or arrived out of order.\n");
+	}
+
+	free(result);
+	return consistent;
+}
+
+int main(int argc, const char* argv[])
+{
+	uint64_t count = BenchmarkArgument(argc, argv, 1, 20000000);
+	packet_ring* ring = (packet_ring*)aligned_alloc(alignof(packet_ring), sizeof(packet_ring));
+	bool consistent = true;
+
+	if (ring == nullptr)
+	{
+		printf("Failed to allocate the packet ring.\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("Packet ring: %llu packets of %u bytes, %u records, one producer and one consumer thread.\n",
+		   (unsigned long long)count, kPacketLength, PACKET_RING_RECORDS);
+
+	consistent = RunRing("producer waits for space", ring, count, true) && consistent;
+	consistent = RunRing("producer drops on overflow, as the driver does", ring, count, false) && consistent;
+
+	free(ring);
+	return (consistent == true) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,240 @@
+//
+//  StartupBenchmark.cpp
+//  Benchmarks
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Measures time to first report for a simulated controller, from `Start` to the end of each phase of startup.
+// Each phase takes a random simulated time, and the controller only sends reports some time after it has received the whole handshake.
+// Startup is run in two orders: the serial order the driver used to follow, reading the string descriptors with control transfers
+// and waiting for each handshake packet before arming any reads, and the order it follows now,
+// taking the strings from the device's properties and arming every read before queueing the handshake.
+// The phase costs are assumptions for a full-speed controller, not measurements, so only the difference between the orders means anything.
+// Run with `[runs]`.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "BenchmarkSupport.h"
+#include "XboxOneSimulatedController.h"
+#include "XboxOneSimulatedInput.h"
+
+/// The simulated cost of each step of startup, in nanoseconds. Each run draws every cost at random between the value and twice the value.
+///
+/// `kHIDStart` - Starting `IOUserHIDDevice`, without reading any string descriptors.
+/// `kControlTransfer` - A control transfer, such as reading a descriptor.
+/// `kFindPipes` - Finding the interrupt pipes.
+/// `kCreateBuffers` - Creating every buffer and completion action.
+/// `kSubmitRead` - Submitting a read on one slot.
+/// `kQueuePacket` - Queueing an output packet without waiting for it.
+/// `kSendPacket` - Sending an output packet on the `OUT` pipe, up to its completion.
+/// `kBootDelay` - The time from the controller receiving the handshake to it sending its first report.
+static constexpr uint64_t kHIDStart = 2000000;
+static constexpr uint64_t kControlTransfer = 1000000;
+static constexpr uint64_t kFindPipes = 100000;
+static constexpr uint64_t kCreateBuffers = 200000;
+static constexpr uint64_t kSubmitRead = 10000;
+static constexpr uint64_t kQueuePacket = 5000;
+static constexpr uint64_t kSendPacket = 1000000;
+static constexpr uint64_t kBootDelay = 3000000;
+
+/// The number of string descriptors `newDeviceDescription` reads when they are not in the device's properties.
+static constexpr uint32_t kStringDescriptors = 3;
+
+/// How long to wait for the first report before giving up on a run.
+static constexpr uint64_t kGiveUp = 10000000000;
+
+/// The name of each `xboxone_startup_phase`.
+static const char* const kPhaseNames[XBOXONE_STARTUP_COUNT] = { "hid", "descriptors", "pipes", "buffers", "armed", "handshake", "first report" };
+
+/// An order of startup.
+///
+/// `name` - What the order is.
+/// `readStrings` - Whether the string descriptors are read with control transfers while starting `IOUserHIDDevice`.
+/// `armFirst` - Whether the reads are armed before the handshake is queued, rather than after it has been sent.
+typedef struct {
+	const char* name;
+	bool readStrings;
+	bool armFirst;
+} startup_order;
+
+static const startup_order kOrders[] = {
+	{ "serial, as before", true, false },
+	{ "reads armed first, strings from properties", false, true },
+};
+
+/// A simulated controller that has nothing to send until it is ready.
+///
+/// `controller` - The controller, once it is ready.
+/// `readyAt` - When the controller sends its first packet.
+typedef struct {
+	xboxone_simulated_controller controller;
+	uint64_t readyAt;
+} startup_device;
+
+/// Produces nothing before the controller is ready, and whatever the controller sends after.
+static uint32_t StartupDeviceProduce(void* context, uint64_t timestamp, uint8_t* packet, uint32_t capacity)
+{
+	startup_device* device = (startup_device*)context;
+
+	return (timestamp < device->readyAt) ? 0 : XboxOneSimulatedControllerProduce(&device->controller, timestamp, packet, capacity);
+}
+
+/// A cost drawn at random between `base` and twice `base`.
+static uint64_t StartupCost(uint64_t* random, uint64_t base)
+{
+	return base + SimulationRandom(random) % (base + 1);
+}
+
+/// Runs the input path for `cost`, then marks the end of `phase`.
+static void StartupAdvance(xboxone_simulated_input* input, uint64_t cost, xboxone_startup_phase phase)
+{
+	XboxOneSimulatedInputRun(input, input->now + cost);
+	XboxOneStartupMark(&input->latency, phase, input->now);
+}
+
+/// Starts the controller once in `order`, returning the time from `Start` to the end of each phase, or false if no report arrived.
+static bool RunStartup(xboxone_simulated_input* input, startup_device* device, const startup_order* order, uint64_t seed, xboxone_latency_stats* stats)
+{
+	const xboxone_model_info* model = &XBOXONE_MODELS[XBOXONE_MODEL_ONE_S];
+	xboxone_simulated_controller_config controllerConfig = {
+		.buttonRate = 20000,
+		.guideRate = 100,
+		.unknownRate = 1000,
+		.repeatRate = 0,
+		.idleRate = 0,
+		.stickNoise = 300,
+		.reportSize = 0,
+		.seed = seed,
+	};
+	xboxone_simulated_input_config inputConfig = {
+		.slotCount = INPUT_RING_DEFAULT_SLOTS,
+		.pipe = {
+			.interval = 1000000,
+			.jitter = 100000,
+			.errorRate = 0,
+			.stallRate = 0,
+			.reorderRate = 0,
+			.seed = seed,
+		},
+		.recovery = PIPE_RECOVERY_DEFAULT_CONFIG,
+		.coalesceWindow = 0,
+		.timed = false,
+	};
+	uint64_t random = 0;
+	uint64_t cost = 0;
+	uint64_t handshakeSent = 0;
+
+	SimulationSeed(&random, seed);
+	XboxOneSimulatedControllerInit(&device->controller, &controllerConfig);
+	device->readyAt = UINT64_MAX;
+	XboxOneSimulatedInputInit(input, &inputConfig, model, StartupDeviceProduce, device);
+	XboxOneStartupBegin(&input->latency, input->now);
+
+	cost = StartupCost(&random, kHIDStart);
+	for (uint32_t string = 0; string < kStringDescriptors && order->readStrings == true; ++string)
+	{
+		cost += StartupCost(&random, kControlTransfer);
+	}
+	StartupAdvance(input, cost, XBOXONE_STARTUP_HID);
+	StartupAdvance(input, StartupCost(&random, kControlTransfer), XBOXONE_STARTUP_DESCRIPTORS);
+	StartupAdvance(input, StartupCost(&random, kFindPipes), XBOXONE_STARTUP_PIPES);
+	StartupAdvance(input, StartupCost(&random, kCreateBuffers), XBOXONE_STARTUP_BUFFERS);
+
+	if (order->armFirst == true)
+	{
+		XboxOneSimulatedInputStart(input);
+		StartupAdvance(input, StartupCost(&random, kSubmitRead) * input->path.ring.slotCount, XBOXONE_STARTUP_ARMED);
+
+		// The packets are queued at once, and go out on the `OUT` pipe one after another while startup carries on.
+		handshakeSent = input->now;
+		for (uint32_t packet = 0; packet < model->handshakeCount; ++packet)
+		{
+			handshakeSent += StartupCost(&random, kSendPacket);
+		}
+		device->readyAt = handshakeSent + StartupCost(&random, kBootDelay);
+		StartupAdvance(input, StartupCost(&random, kQueuePacket) * model->handshakeCount, XBOXONE_STARTUP_HANDSHAKE);
+	}
+	else
+	{
+		cost = 0;
+		for (uint32_t packet = 0; packet < model->handshakeCount; ++packet)
+		{
+			cost += StartupCost(&random, kSendPacket);
+		}
+		device->readyAt = input->now + cost + StartupCost(&random, kBootDelay);
+		StartupAdvance(input, cost, XBOXONE_STARTUP_HANDSHAKE);
+
+		XboxOneSimulatedInputStart(input);
+		StartupAdvance(input, StartupCost(&random, kSubmitRead) * input->path.ring.slotCount, XBOXONE_STARTUP_ARMED);
+	}
+
+	while (input->stats.handleReports == 0 && XboxOneSimulatedInputStep(input, kGiveUp) == true)
+	{
+	}
+	if (input->stats.handleReports != 0)
+	{
+		XboxOneStartupMark(&input->latency, XBOXONE_STARTUP_FIRST_REPORT, input->now);
+	}
+
+	XboxOneLatencySummarize(&input->latency, 1, 1, stats);
+	return input->stats.handleReports != 0;
+}
+
+int main(int argc, const char* argv[])
+{
+	uint64_t runs = BenchmarkArgument(argc, argv, 1, 10000);
+	xboxone_simulated_input* input = (xboxone_simulated_input*)calloc(1, sizeof(xboxone_simulated_input));
+	latency_histogram* phases = (latency_histogram*)calloc(XBOXONE_STARTUP_COUNT, sizeof(latency_histogram));
+	startup_device device = {};
+	bool started = true;
+
+	if (input == nullptr || phases == nullptr)
+	{
+		printf("Failed to allocate the input path.\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("Startup: %llu simulated runs of each order, time from Start to the end of each phase.\n", (unsigned long long)runs);
+
+	for (uint32_t orderIndex = 0; orderIndex < sizeof(kOrders) / sizeof(kOrders[0]); ++orderIndex)
+	{
+		const startup_order* order = &kOrders[orderIndex];
+		uint64_t failed = 0;
+
+		memset(phases, 0, XBOXONE_STARTUP_COUNT * sizeof(latency_histogram));
+
+		for (uint64_t run = 0; run < runs; ++run)
+		{
+			xboxone_latency_stats stats = {};
+
+			if (RunStartup(input, &device, order, run + 1, &stats) == false)
+			{
+				failed++;
+				continue;
+			}
+
+			for (uint32_t phase = 0; phase < XBOXONE_STARTUP_COUNT; ++phase)
+			{
+				LatencyHistogramRecord(&phases[phase], stats.startup[phase]);
+			}
+		}
+
+		printf("  %s\n", order->name);
+		for (uint32_t phase = 0; phase < XBOXONE_STARTUP_COUNT; ++phase)
+		{
+			BenchmarkPrintHistogram(kPhaseNames[phase], &phases[phase]);
+		}
+		if (failed != 0)
+		{
+			printf("\t%llu runs never delivered a report.\n", (unsigned long long)failed);
+			started = false;
+		}
+	}
+
+	free(phases);
+	free(input);
+	return (started == true) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
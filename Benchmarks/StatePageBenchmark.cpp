@@ -0,0 +1,203 @@
+//
+//  StatePageBenchmark.cpp
+//  Benchmarks
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Measures the state page with one writer thread publishing button reports as fast as it can,
+// and a growing number of reader threads taking snapshots with `XboxOneStatePageRead`, up to 64.
+// Every report the writer publishes is derived from a single number, so a reader can tell if a snapshot mixes two reports.
+// Each read is timed on its own, so the latency includes retries while the writer was publishing, but not time spent descheduled between reads.
+// Run with `[milliseconds per round] [readers]`.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "BenchmarkSupport.h"
+#include "SimulationSupport.h"
+#include "XboxOneStatePage.h"
+
+/// How many publishes or reads each thread makes before giving up the processor.
+static constexpr uint32_t kBatch = 64;
+
+/// What a reader saw.
+///
+/// `reads` - The number of snapshots taken.
+/// `changes` - The number of snapshots with a different sequence number than the one before.
+/// `torn` - The number of snapshots that mixed two reports.
+/// `latency` - Nanoseconds for each call to `XboxOneStatePageRead`.
+typedef struct {
+	uint64_t reads;
+	uint64_t changes;
+	uint64_t torn;
+	latency_histogram latency;
+} reader_result;
+
+/// Fills a button report from `value`, so each field can be checked against the others.
+static void BuildReport(uint64_t value, xboxone_button_report* report)
+{
+	report->header.counter = (uint8_t)value;
+	report->buttons = (uint16_t)(value >> 16);
+	report->trigL = (uint16_t)(value & 1023);
+	report->trigR = (uint16_t)(~value & 1023);
+	report->leftX = (int16_t)value;
+	report->leftY = (int16_t)~value;
+	report->rightX = (int16_t)(value >> 8);
+	report->rightY = (int16_t)~(value >> 8);
+}
+
+/// Whether a snapshot holds a single report published by the writer.
+static bool IsConsistent(const xboxone_controller_state* state)
+{
+	xboxone_button_report report = {};
+
+	BuildReport(state->timestamp, &report);
+	return state->counter == report.header.counter && state->buttons == report.buttons &&
+		   state->trigL == report.trigL && state->trigR == report.trigR &&
+		   state->leftX == report.leftX && state->leftY == report.leftY &&
+		   state->rightX == report.rightX && state->rightY == report.rightY;
+}
+
+/// Publishes reports until `done` is set, returning how many it published.
+static uint64_t Write(xboxone_state_publisher* publisher, const bool* done)
+{
+	xboxone_button_report report = {};
+	uint64_t value = 0;
+
+	while (__atomic_load_n(done, __ATOMIC_ACQUIRE) == false)
+	{
+		for (uint32_t index = 0; index < kBatch; ++index)
+		{
+			++value;
+			BuildReport(value, &report);
+			XboxOneStatePagePublishButtons(publisher, &report, value);
+		}
+		std::this_thread::yield();
+	}
+
+	return value;
+}
+
+/// Takes snapshots until `done` is set.
+static void Read(const xboxone_state_page* page, const bool* done, reader_result* result)
+{
+	xboxone_controller_state state = {};
+	uint32_t last = 0;
+
+	while (__atomic_load_n(done, __ATOMIC_ACQUIRE) == false)
+	{
+		for (uint32_t index = 0; index < kBatch; ++index)
+		{
+			uint64_t start = SimulationNow();
+			uint32_t sequence = XboxOneStatePageRead(page, &state);
+
+			LatencyHistogramRecord(&result->latency, SimulationNow() - start);
+			result->changes += (sequence != last) ? 1 : 0;
+			result->torn += (IsConsistent(&state) == false) ? 1 : 0;
+			result->reads++;
+			last = sequence;
+		}
+		std::this_thread::yield();
+	}
+}
+
+/// Adds the values recorded in `histogram` to `total`.
+static void MergeHistogram(latency_histogram* total, const latency_histogram* histogram)
+{
+	total->count += histogram->count;
+	total->max = (histogram->max > total->max) ? histogram->max : total->max;
+	for (uint32_t bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; ++bucket)
+	{
+		total->buckets[bucket] += histogram->buckets[bucket];
+	}
+}
+
+/// Runs the writer against `readerCount` readers for `milliseconds`, returning false if any snapshot was torn.
+static bool RunRound(xboxone_state_page* page, uint32_t readerCount, uint64_t milliseconds)
+{
+	xboxone_state_publisher publisher = {};
+	xboxone_button_report first = {};
+	std::vector<reader_result> results(readerCount);
+	std::vector<std::thread> readers;
+	latency_histogram* latency = (latency_histogram*)calloc(1, sizeof(latency_histogram));
+	bool done = false;
+	uint64_t published = 0;
+	uint64_t reads = 0;
+	uint64_t changes = 0;
+	uint64_t torn = 0;
+	uint64_t start = 0;
+	uint64_t elapsed = 0;
+
+	if (latency == nullptr)
+	{
+		printf("Failed to allocate the histogram.\n");
+		return false;
+	}
+
+	// A zeroed page is not a report the writer could have published, so readers start from the report for 0.
+	XboxOneStatePageInit(&publisher, page);
+	BuildReport(0, &first);
+	XboxOneStatePagePublishButtons(&publisher, &first, 0);
+
+	start = SimulationNow();
+	for (uint32_t reader = 0; reader < readerCount; ++reader)
+	{
+		readers.emplace_back(Read, page, &done, &results[reader]);
+	}
+	std::thread writer([&]() { published = Write(&publisher, &done); });
+
+	SimulationWaitUntil(start + milliseconds * 1000000);
+	__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+	writer.join();
+	for (std::thread& reader : readers)
+	{
+		reader.join();
+	}
+	elapsed = SimulationNow() - start;
+
+	for (const reader_result& result : results)
+	{
+		reads += result.reads;
+		changes += result.changes;
+		torn += result.torn;
+		MergeHistogram(latency, &result.latency);
+	}
+
+	printf("  1 writer, %u readers\n", readerCount);
+	printf("\t%llu publishes/s  %llu reads/s  %.1f%% of reads saw a new state  %llu torn\n",
+		   (unsigned long long)BenchmarkRate(published, elapsed), (unsigned long long)BenchmarkRate(reads, elapsed),
+		   (reads != 0) ? 100.0 * (double)changes / (double)reads : 0.0, (unsigned long long)torn);
+	BenchmarkPrintHistogram("read", latency);
+
+	free(latency);
+	return torn == 0;
+}
+
+int main(int argc, const char* argv[])
+{
+	uint64_t milliseconds = BenchmarkArgument(argc, argv, 1, 2000);
+	uint32_t maxReaders = (uint32_t)BenchmarkArgument(argc, argv, 2, 64);
+	xboxone_state_page* page = (xboxone_state_page*)aligned_alloc(alignof(xboxone_state_page), sizeof(xboxone_state_page));
+	bool consistent = true;
+
+	if (page == nullptr)
+	{
+		printf("Failed to allocate the state page.\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("State page: %llu ms for each round, %u hardware threads.\n", (unsigned long long)milliseconds, std::thread::hardware_concurrency());
+
+	for (uint32_t readerCount = 1; readerCount < maxReaders; readerCount *= 4)
+	{
+		consistent = RunRound(page, readerCount, milliseconds) && consistent;
+	}
+	consistent = RunRound(page, maxReaders, milliseconds) && consistent;
+
+	free(page);
+	return (consistent == true) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,208 @@
+//
+//  StickFilterBenchmark.cpp
+//  Benchmarks
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Measures what the stick filter costs on every button report, and what it buys.
+// The cost is the time `XboxOneApplyStickFilter` takes for a report, with the filter disabled and with each configuration below,
+// on a stick resting with noise, as a worn stick does, and on a stick sweeping back and forth.
+// What it buys is how much of the resting noise is left, and what it costs the player is the reports a step takes to cover 90% of its way,
+// with a report every millisecond. A disabled filter must leave every report alone, or the benchmark fails.
+// Run with `[rounds]`.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchmarkSupport.h"
+#include "SimulationSupport.h"
+#include "XboxOneStickFilter.h"
+
+/// The number of reports in each stream.
+static constexpr uint32_t kStreamLength = 4096;
+
+/// The time between reports, in nanoseconds.
+static constexpr uint64_t kInterval = 1000000;
+
+/// The furthest a resting stick wanders from its center, in counts.
+static constexpr int32_t kRestingNoise = 600;
+
+/// A configuration measured.
+///
+/// `name` - What it is called in the output.
+/// `config` - The configuration.
+typedef struct {
+	const char* name;
+	xboxone_stick_filter_config config;
+} filter_case;
+
+static const filter_case kCases[] = {
+	{ "disabled", { XBOXONE_STICK_FILTER_VERSION, 0, 0x0f, {}, 1000, 7000, 1000 } },
+	{ "low-pass 5 Hz", { XBOXONE_STICK_FILTER_VERSION, 1, 0x0f, {}, 5000, 0, 1000 } },
+	{ "adaptive 1 Hz", { XBOXONE_STICK_FILTER_VERSION, 1, 0x0f, {}, 1000, 7000, 1000 } },
+	{ "adaptive, left", { XBOXONE_STICK_FILTER_VERSION, 1, 0x03, {}, 1000, 7000, 1000 } },
+};
+
+/// Fills a stream with a stick resting near its center if `sweeping` is false, or sweeping from one end to the other and back if it is true.
+static void BuildStream(xboxone_button_report* stream, bool sweeping, uint64_t seed)
+{
+	uint64_t random = 0;
+
+	SimulationSeed(&random, seed);
+
+	for (uint32_t index = 0; index < kStreamLength; ++index)
+	{
+		// A full sweep every 512 reports, which is a quick flick of the stick.
+		int32_t phase = (int32_t)(index % 512);
+		int32_t sweep = ((phase < 256) ? phase : 512 - phase) * 256 - 32768;
+		int32_t base = (sweeping == true) ? sweep : 0;
+		int32_t values[4] = {};
+
+		for (int32_t& value : values)
+		{
+			value = base + (int32_t)(SimulationRandom(&random) % (2 * kRestingNoise + 1)) - kRestingNoise;
+			value = (value < INT16_MIN) ? INT16_MIN : (value > INT16_MAX) ? INT16_MAX : value;
+		}
+
+		memset(&stream[index], 0, sizeof(stream[index]));
+		stream[index].leftX = (int16_t)values[0];
+		stream[index].leftY = (int16_t)values[1];
+		stream[index].rightX = (int16_t)values[2];
+		stream[index].rightY = (int16_t)values[3];
+	}
+}
+
+/// Runs a stream through a filter `rounds` times, returning the time taken and adding every output to `sum`.
+static uint64_t TimeStream(const xboxone_stick_filter_plan* plan, const xboxone_button_report* stream, uint64_t rounds, uint64_t* sum)
+{
+	xboxone_stick_filter filter = {};
+	uint64_t timestamp = 0;
+	uint64_t start = SimulationNow();
+
+	for (uint64_t round = 0; round < rounds; ++round)
+	{
+		for (uint32_t index = 0; index < kStreamLength; ++index)
+		{
+			xboxone_button_report report = stream[index];
+
+			timestamp += kInterval;
+			XboxOneApplyStickFilter(&filter, plan, &report, timestamp);
+			*sum += (uint16_t)report.leftX + (uint16_t)report.rightY;
+		}
+		__asm__ volatile("" : "+r"(*sum));
+	}
+
+	return SimulationNow() - start;
+}
+
+/// The average distance of the left stick's X axis from its center while resting, after the filter.
+static double RestingNoise(const xboxone_stick_filter_plan* plan, const xboxone_button_report* stream)
+{
+	xboxone_stick_filter filter = {};
+	uint64_t total = 0;
+
+	for (uint32_t index = 0; index < kStreamLength; ++index)
+	{
+		xboxone_button_report report = stream[index];
+
+		XboxOneApplyStickFilter(&filter, plan, &report, (index + 1) * kInterval);
+		total += (report.leftX < 0) ? -report.leftX : report.leftX;
+	}
+
+	return (double)total / kStreamLength;
+}
+
+/// The reports the left stick's X axis takes to cover 90% of a step from its center to three quarters of the way out, after it has rested.
+static uint32_t StepReports(const xboxone_stick_filter_plan* plan)
+{
+	xboxone_stick_filter filter = {};
+	uint64_t timestamp = 0;
+
+	for (uint32_t index = 0; index < 1000 + kStreamLength; ++index)
+	{
+		xboxone_button_report report = {};
+
+		report.leftX = (index < 1000) ? 0 : 24576;
+		timestamp += kInterval;
+		XboxOneApplyStickFilter(&filter, plan, &report, timestamp);
+
+		if (index >= 1000 && report.leftX >= 24576 * 9 / 10)
+		{
+			return index - 1000 + 1;
+		}
+	}
+
+	return kStreamLength;
+}
+
+int main(int argc, const char* argv[])
+{
+	uint64_t rounds = BenchmarkArgument(argc, argv, 1, 2000);
+	xboxone_button_report* resting = (xboxone_button_report*)calloc(kStreamLength, sizeof(xboxone_button_report));
+	xboxone_button_report* sweeping = (xboxone_button_report*)calloc(kStreamLength, sizeof(xboxone_button_report));
+	uint64_t reports = rounds * kStreamLength;
+	double unfiltered = 0.0;
+	bool consistent = true;
+
+	if (resting == nullptr || sweeping == nullptr)
+	{
+		printf("Failed to allocate the report streams.\n");
+		return EXIT_FAILURE;
+	}
+
+	BuildStream(resting, false, 1);
+	BuildStream(sweeping, true, 2);
+
+	printf("Stick filter: %llu rounds of %u reports, a report every millisecond.\n", (unsigned long long)rounds, kStreamLength);
+
+	for (const filter_case& test : kCases)
+	{
+		xboxone_stick_filter_plan plan = {};
+		uint64_t restingSum = 0;
+		uint64_t sweepingSum = 0;
+		uint64_t restingElapsed = 0;
+		uint64_t sweepingElapsed = 0;
+		double noise = 0.0;
+
+		if (XboxOneCompileStickFilter(&test.config, 1, 1, &plan) == false)
+		{
+			printf("\t%s: the configuration does not compile.\n", test.name);
+			consistent = false;
+			continue;
+		}
+
+		restingElapsed = TimeStream(&plan, resting, rounds, &restingSum);
+		sweepingElapsed = TimeStream(&plan, sweeping, rounds, &sweepingSum);
+		noise = RestingNoise(&plan, resting);
+
+		if (plan.enabled == false)
+		{
+			uint64_t expected = 0;
+
+			// Nothing to compare against but the streams themselves, which the disabled filter must hand back untouched.
+			for (uint32_t index = 0; index < kStreamLength; ++index)
+			{
+				expected += (uint16_t)resting[index].leftX + (uint16_t)resting[index].rightY;
+			}
+			consistent = consistent && (restingSum == expected * rounds);
+			unfiltered = noise;
+		}
+
+		printf("\t%-16s resting %6.2f ns/report  sweeping %6.2f ns/report  (%llu reports/s)  noise %6.1f counts, %5.1f%% of it left  step %4u reports to 90%%\n",
+			   test.name, (double)restingElapsed / (double)reports, (double)sweepingElapsed / (double)reports,
+			   (unsigned long long)BenchmarkRate(reports, sweepingElapsed), noise, (unfiltered != 0.0) ? 100.0 * noise / unfiltered : 0.0,
+			   StepReports(&plan));
+	}
+
+	if (consistent == false)
+	{
+		printf("\tThe disabled filter changed reports, or a configuration did not compile.\n");
+	}
+
+	free(sweeping);
+	free(resting);
+	return (consistent == true) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,424 @@
+//
+//  MockPipe.h
+//  Simulation
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// A simulated interrupt `IN` pipe that stands in for `IOUSBHostPipe`, so the input path can be run and measured without a device.
+// Like a host controller, the pipe polls the device once per interval and completes the oldest outstanding read with whatever the device produced.
+// Each completion reaches the caller after a random dispatch delay, so with enough jitter completions arrive out of submission order.
+// Reads can also be made to fail, stall the endpoint, or be held back behind a later read, either at set rates or on demand.
+// Time is whatever clock the caller advances, and randomness comes from a seeded generator, so a run with the same seed is always the same.
+// This code is not specific to DriverKit in any way, and is only used to simulate a device.
+//
+
+#ifndef MockPipe_h
+#define MockPipe_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include <PipeRecovery.h>
+
+#include "SimulationSupport.h"
+
+/// The most reads that can be outstanding on the pipe at one time.
+constexpr uint32_t MOCK_PIPE_MAX_READS = 16;
+
+/// Enumeration of the statuses a read completes with, one for each way the driver classifies a real status.
+///
+/// `MOCK_PIPE_SUCCESS` - The read produced a packet.
+/// `MOCK_PIPE_ABORTED` - The read was aborted by clearing a stall.
+/// `MOCK_PIPE_TRANSIENT` - The read failed, such as with a timeout or an overrun.
+/// `MOCK_PIPE_STALLED` - The endpoint stalled. Every read fails this way until the stall is cleared.
+/// `MOCK_PIPE_GONE` - The device was disconnected. Every read fails this way from then on.
+typedef enum : int32_t {
+	MOCK_PIPE_SUCCESS = 0,
+	MOCK_PIPE_ABORTED,
+	MOCK_PIPE_TRANSIENT,
+	MOCK_PIPE_STALLED,
+	MOCK_PIPE_GONE,
+} mock_pipe_status;
+
+/// Produces the packet the device sends when it is polled at `timestamp`.
+///
+/// Returns the length of the packet written to `packet`, or 0 if the device has nothing to send, in which case the read stays outstanding.
+typedef uint32_t (*mock_pipe_device)(void* context, uint64_t timestamp, uint8_t* packet, uint32_t capacity);
+
+/// How the pipe behaves, in the units of the caller's clock.
+///
+/// `interval` - The time between two polls of the device. Must not be 0.
+/// `jitter` - The longest delay between a read completing and its completion reaching the caller. Each delay is random up to this.
+/// `errorRate` - How many reads in `SIMULATION_RATE_SCALE` fail with `MOCK_PIPE_TRANSIENT`.
+/// `stallRate` - How many reads in `SIMULATION_RATE_SCALE` stall the endpoint.
+/// `reorderRate` - How many completions in `SIMULATION_RATE_SCALE` are held back until after the completion of the next read.
+/// `seed` - The seed of the random generator.
+typedef struct {
+	uint64_t interval;
+	uint64_t jitter;
+	uint32_t errorRate;
+	uint32_t stallRate;
+	uint32_t reorderRate;
+	uint64_t seed;
+} mock_pipe_config;
+
+/// A completed read, as it reaches the caller.
+///
+/// `slot` - The slot the read was submitted on.
+/// `status` - The `mock_pipe_status` the read completed with.
+/// `length` - The number of bytes written to the read's buffer.
+/// `timestamp` - When the read completed, as the completion timestamp of a real read.
+/// `deliverAt` - When the completion reaches the caller.
+typedef struct {
+	uint32_t slot;
+	int32_t status;
+	uint32_t length;
+	uint64_t timestamp;
+	uint64_t deliverAt;
+} mock_pipe_completion;
+
+/// A read outstanding on the pipe, or completed but not yet taken.
+///
+/// `completion` - The completion, once `completed` is set. Its `slot` is set on submission.
+/// `buffer` - Where the packet is written.
+/// `capacity` - The size of `buffer`.
+/// `completed` - Whether the read has completed.
+typedef struct {
+	mock_pipe_completion completion;
+	uint8_t* buffer;
+	uint32_t capacity;
+	bool completed;
+} mock_pipe_read;
+
+/// What happened on the pipe so far.
+///
+/// `submitted` - The number of reads submitted.
+/// `refused` - The number of reads the pipe refused.
+/// `completed` - The number of reads that completed, in any way.
+/// `packets` - The number of reads that produced a packet.
+/// `naks` - The number of polls the device had nothing to send for.
+/// `failed` - The number of reads that failed with `MOCK_PIPE_TRANSIENT`.
+/// `stalls` - The number of times the endpoint stalled.
+/// `aborted` - The number of reads aborted by clearing a stall.
+/// `reordered` - The number of completions held back behind a later read.
+typedef struct {
+	uint64_t submitted;
+	uint64_t refused;
+	uint64_t completed;
+	uint64_t packets;
+	uint64_t naks;
+	uint64_t failed;
+	uint64_t stalls;
+	uint64_t aborted;
+	uint64_t reordered;
+} mock_pipe_stats;
+
+/// The state of the pipe.
+///
+/// `config` - How the pipe behaves.
+/// `device` - Produces the packet for each poll.
+/// `context` - Passed to `device`.
+/// `random` - The state of the random generator.
+/// `nextPoll` - When the device is polled next.
+/// `stalled` - Whether the endpoint is stalled.
+/// `gone` - Whether the device was disconnected.
+/// `forcedErrors` - How many of the next polls fail with `forcedStatus` whatever the rates say.
+/// `forcedStatus` - The status forced on the next `forcedErrors` polls.
+/// `readCount` - The number of entries in `reads`.
+/// `reads` - The outstanding and completed reads, in submission order.
+/// `stats` - What happened so far.
+typedef struct {
+	mock_pipe_config config;
+	mock_pipe_device device;
+	void* context;
+	uint64_t random;
+	uint64_t nextPoll;
+	bool stalled;
+	bool gone;
+	uint32_t forcedErrors;
+	int32_t forcedStatus;
+	uint32_t readCount;
+	mock_pipe_read reads[MOCK_PIPE_MAX_READS];
+	mock_pipe_stats stats;
+} mock_pipe;
+
+/// Resets the pipe, with the first poll one interval after `now`.
+inline void MockPipeInit(mock_pipe* pipe, const mock_pipe_config* config, mock_pipe_device device, void* context, uint64_t now)
+{
+	memset(pipe, 0, sizeof(*pipe));
+	pipe->config = *config;
+	pipe->device = device;
+	pipe->context = context;
+
+	if (pipe->config.interval == 0)
+	{
+		pipe->config.interval = 1;
+	}
+
+	SimulationSeed(&pipe->random, config->seed);
+	pipe->nextPoll = now + pipe->config.interval;
+}
+
+/// Submits a read on `slot` into `buffer`, returning `MOCK_PIPE_SUCCESS` or the status the pipe refused it with.
+inline int32_t MockPipeSubmit(mock_pipe* pipe, uint32_t slot, uint8_t* buffer, uint32_t capacity)
+{
+	if (pipe->gone == true || pipe->readCount == MOCK_PIPE_MAX_READS)
+	{
+		pipe->stats.refused++;
+		return (pipe->gone == true) ? MOCK_PIPE_GONE : MOCK_PIPE_TRANSIENT;
+	}
+
+	mock_pipe_read* read = &pipe->reads[pipe->readCount++];
+
+	memset(read, 0, sizeof(*read));
+	read->completion.slot = slot;
+	read->buffer = buffer;
+	read->capacity = capacity;
+	pipe->stats.submitted++;
+	return MOCK_PIPE_SUCCESS;
+}
+
+/// Completes a read at `timestamp`, and decides when the completion reaches the caller.
+inline void MockPipeComplete(mock_pipe* pipe, mock_pipe_read* read, int32_t status, uint32_t length, uint64_t timestamp)
+{
+	read->completed = true;
+	read->completion.status = status;
+	read->completion.length = length;
+	read->completion.timestamp = timestamp;
+	read->completion.deliverAt = timestamp;
+
+	if (pipe->config.jitter != 0)
+	{
+		read->completion.deliverAt += SimulationRandom(&pipe->random) % (pipe->config.jitter + 1);
+	}
+
+	// Held back past the latest the next read could be delivered, so it is always overtaken.
+	if (SimulationChance(&pipe->random, pipe->config.reorderRate) == true)
+	{
+		read->completion.deliverAt += pipe->config.interval + pipe->config.jitter + 1;
+		pipe->stats.reordered++;
+	}
+
+	pipe->stats.completed++;
+}
+
+/// Completes every outstanding read at `now` with `status`.
+inline void MockPipeCompleteAll(mock_pipe* pipe, int32_t status, uint64_t now)
+{
+	for (uint32_t index = 0; index < pipe->readCount; ++index)
+	{
+		if (pipe->reads[index].completed == false)
+		{
+			MockPipeComplete(pipe, &pipe->reads[index], status, 0, now);
+		}
+	}
+}
+
+/// Polls the device once at `now`, completing the oldest outstanding read if the poll produced anything.
+inline void MockPipePollOnce(mock_pipe* pipe, uint64_t now)
+{
+	mock_pipe_read* read = nullptr;
+	uint32_t length = 0;
+
+	for (uint32_t index = 0; index < pipe->readCount; ++index)
+	{
+		if (pipe->reads[index].completed == false)
+		{
+			read = &pipe->reads[index];
+			break;
+		}
+	}
+
+	if (read == nullptr)
+	{
+		return;
+	}
+
+	// A stalled endpoint fails every read the host controller tries, not just one per poll.
+	if (pipe->stalled == true)
+	{
+		MockPipeCompleteAll(pipe, MOCK_PIPE_STALLED, now);
+		return;
+	}
+
+	if (pipe->forcedErrors != 0)
+	{
+		pipe->forcedErrors--;
+		if (pipe->forcedStatus == MOCK_PIPE_STALLED)
+		{
+			pipe->stalled = true;
+			pipe->stats.stalls++;
+			MockPipeCompleteAll(pipe, MOCK_PIPE_STALLED, now);
+			return;
+		}
+
+		pipe->stats.failed++;
+		MockPipeComplete(pipe, read, pipe->forcedStatus, 0, now);
+		return;
+	}
+
+	if (SimulationChance(&pipe->random, pipe->config.stallRate) == true)
+	{
+		pipe->stalled = true;
+		pipe->stats.stalls++;
+		MockPipeCompleteAll(pipe, MOCK_PIPE_STALLED, now);
+		return;
+	}
+
+	if (SimulationChance(&pipe->random, pipe->config.errorRate) == true)
+	{
+		pipe->stats.failed++;
+		MockPipeComplete(pipe, read, MOCK_PIPE_TRANSIENT, 0, now);
+		return;
+	}
+
+	length = pipe->device(pipe->context, now, read->buffer, read->capacity);
+	if (length == 0)
+	{
+		pipe->stats.naks++;
+		return;
+	}
+
+	pipe->stats.packets++;
+	MockPipeComplete(pipe, read, MOCK_PIPE_SUCCESS, length, now);
+}
+
+/// Carries out every poll due up to `now`.
+///
+/// The device is only polled while a read is outstanding, so a pipe left without reads skips straight to the next poll after `now`.
+inline void MockPipePoll(mock_pipe* pipe, uint64_t now)
+{
+	while (pipe->nextPoll <= now)
+	{
+		bool outstanding = false;
+
+		for (uint32_t index = 0; index < pipe->readCount && outstanding == false; ++index)
+		{
+			outstanding = (pipe->reads[index].completed == false);
+		}
+
+		if (outstanding == false || pipe->gone == true)
+		{
+			pipe->nextPoll += ((now - pipe->nextPoll) / pipe->config.interval + 1) * pipe->config.interval;
+			break;
+		}
+
+		MockPipePollOnce(pipe, pipe->nextPoll);
+		pipe->nextPoll += pipe->config.interval;
+	}
+}
+
+/// When something next happens on the pipe: a poll that could complete a read, or a completion reaching the caller.
+///
+/// Returns `UINT64_MAX` if nothing will ever happen without another submission.
+inline uint64_t MockPipeNextEvent(const mock_pipe* pipe)
+{
+	uint64_t next = UINT64_MAX;
+
+	for (uint32_t index = 0; index < pipe->readCount; ++index)
+	{
+		const mock_pipe_read* read = &pipe->reads[index];
+		uint64_t candidate = (read->completed == true) ? read->completion.deliverAt : pipe->nextPoll;
+
+		if (read->completed == false && pipe->gone == true)
+		{
+			continue;
+		}
+		next = (candidate < next) ? candidate : next;
+	}
+
+	return next;
+}
+
+/// Takes the completion that reaches the caller first, if it has reached it by `now`, returning false if none has.
+///
+/// Completions that reach the caller at the same time are taken in submission order.
+inline bool MockPipeTake(mock_pipe* pipe, uint64_t now, mock_pipe_completion* completion)
+{
+	uint32_t found = pipe->readCount;
+
+	for (uint32_t index = 0; index < pipe->readCount; ++index)
+	{
+		const mock_pipe_read* read = &pipe->reads[index];
+
+		if (read->completed == true && read->completion.deliverAt <= now &&
+			(found == pipe->readCount || read->completion.deliverAt < pipe->reads[found].completion.deliverAt))
+		{
+			found = index;
+		}
+	}
+
+	if (found == pipe->readCount)
+	{
+		return false;
+	}
+
+	*completion = pipe->reads[found].completion;
+	memmove(&pipe->reads[found], &pipe->reads[found + 1], (pipe->readCount - found - 1) * sizeof(pipe->reads[0]));
+	pipe->readCount--;
+	return true;
+}
+
+/// Aborts every outstanding read at `now`, as `IOUSBHostPipe::Abort` does.
+inline void MockPipeAbort(mock_pipe* pipe, uint64_t now)
+{
+	for (uint32_t index = 0; index < pipe->readCount; ++index)
+	{
+		if (pipe->reads[index].completed == false)
+		{
+			pipe->stats.aborted++;
+		}
+	}
+
+	MockPipeCompleteAll(pipe, MOCK_PIPE_ABORTED, now);
+}
+
+/// Clears a stall at `now`, aborting every outstanding read as `IOUSBHostPipe::ClearStall` does.
+inline void MockPipeClearStall(mock_pipe* pipe, uint64_t now)
+{
+	MockPipeAbort(pipe, now);
+	pipe->stalled = false;
+}
+
+/// Makes the next `count` polls that would complete a read fail with `status`, whatever the rates say.
+///
+/// `MOCK_PIPE_STALLED` stalls the endpoint, which keeps failing reads until the stall is cleared.
+inline void MockPipeInjectErrors(mock_pipe* pipe, uint32_t count, int32_t status)
+{
+	pipe->forcedErrors = count;
+	pipe->forcedStatus = status;
+}
+
+/// Disconnects the device at `now`, failing every outstanding read and refusing every further one.
+inline void MockPipeDisconnect(mock_pipe* pipe, uint64_t now)
+{
+	pipe->gone = true;
+	MockPipeCompleteAll(pipe, MOCK_PIPE_GONE, now);
+}
+
+/// Sorts a status into how `pipe_recovery` should respond to it, as the driver sorts the status of a real read.
+inline pipe_error_class MockPipeClassify(int32_t status)
+{
+	switch ((mock_pipe_status)status)
+	{
+		case MOCK_PIPE_SUCCESS:
+			return PIPE_ERROR_NONE;
+
+		case MOCK_PIPE_ABORTED:
+			return PIPE_ERROR_CANCELED;
+
+		case MOCK_PIPE_TRANSIENT:
+			return PIPE_ERROR_TRANSIENT;
+
+		case MOCK_PIPE_STALLED:
+			return PIPE_ERROR_STALL;
+
+		case MOCK_PIPE_GONE:
+			return PIPE_ERROR_FATAL;
+	}
+
+	return PIPE_ERROR_TRANSIENT;
+}
+
+#endif /* MockPipe_h */
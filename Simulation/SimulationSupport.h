@@ -0,0 +1,72 @@
+//
+//  SimulationSupport.h
+//  Simulation
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// The clock and random numbers shared by the simulated devices, tests, and benchmarks.
+// The clock counts nanoseconds, so everything timed with it uses a ratio of ticks to nanoseconds of 1 / 1.
+// The random generator is seeded explicitly, so a simulation run with the same seed is always the same.
+// This code is not specific to DriverKit in any way, and is only used to simulate a device.
+//
+
+#ifndef SimulationSupport_h
+#define SimulationSupport_h
+
+#include <stdint.h>
+#include <time.h>
+
+/// Rates given as "how many in" are out of this many.
+constexpr uint32_t SIMULATION_RATE_SCALE = 1000000;
+
+/// Reads the monotonic clock, in nanoseconds.
+inline uint64_t SimulationNow(void)
+{
+	timespec now = {};
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/// Sleeps until `SimulationNow` reaches `deadline`, returning at once if it already has.
+inline void SimulationWaitUntil(uint64_t deadline)
+{
+	uint64_t now = SimulationNow();
+
+	while (now < deadline)
+	{
+		timespec delay = {
+			.tv_sec = (time_t)((deadline - now) / 1000000000ULL),
+			.tv_nsec = (long)((deadline - now) % 1000000000ULL),
+		};
+
+		nanosleep(&delay, nullptr);
+		now = SimulationNow();
+	}
+}
+
+/// Seeds a random generator. Any seed is valid, including 0.
+inline void SimulationSeed(uint64_t* state, uint64_t seed)
+{
+	// A zero state would make the generator return zeroes forever.
+	*state = seed ^ 0x9E3779B97F4A7C15ULL;
+	*state = (*state != 0) ? *state : 1;
+}
+
+/// The next number from an xorshift64* generator.
+inline uint64_t SimulationRandom(uint64_t* state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/// Whether something that happens `rate` times in `SIMULATION_RATE_SCALE` happens this time.
+inline bool SimulationChance(uint64_t* state, uint32_t rate)
+{
+	return rate != 0 && (SimulationRandom(state) % SIMULATION_RATE_SCALE) < rate;
+}
+
+#endif /* SimulationSupport_h */
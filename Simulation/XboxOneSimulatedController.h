@@ -0,0 +1,181 @@
+//
+//  XboxOneSimulatedController.h
+//  Simulation
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// A simulated Xbox One controller, which produces the packets a real one sends when its `IN` endpoint is polled.
+// Most polls produce a button report with the sticks and triggers wandering a little, as worn sticks do at rest.
+// At set rates a button changes, the guide button is pressed or released, the same report is sent twice,
+// a packet the driver does not handle is sent, or the controller has nothing to send at all.
+// This code is not specific to DriverKit in any way, and is only used to simulate a device.
+//
+
+#ifndef XboxOneSimulatedController_h
+#define XboxOneSimulatedController_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "SimulationSupport.h"
+#include "XboxOneAxisTransform.h"
+#include "XboxOneInputPackets.h"
+
+/// The packet type of the status packets the controller sends now and then, which the driver does not handle.
+constexpr uint8_t XBOXONE_SIMULATED_STATUS_PACKET = 0x03;
+
+/// How the controller behaves. Every rate is out of `SIMULATION_RATE_SCALE`.
+///
+/// `buttonRate` - How many button reports change a button.
+/// `guideRate` - How many polls are answered with a guide report, which presses or releases the guide button.
+/// `unknownRate` - How many polls are answered with a status packet the driver does not handle.
+/// `repeatRate` - How many button reports are sent again, with the same counter.
+/// `idleRate` - How many polls the controller has nothing to send for.
+/// `stickNoise` - The furthest a stick moves between two reports, in counts. Triggers move a 32nd of this.
+/// `reportSize` - The size in the header of button reports, or 0 for `XBOXONE_BUTTON_REPORT_SIZE`. Newer models send more.
+/// `seed` - The seed of the random generator.
+typedef struct {
+	uint32_t buttonRate;
+	uint32_t guideRate;
+	uint32_t unknownRate;
+	uint32_t repeatRate;
+	uint32_t idleRate;
+	int32_t stickNoise;
+	uint8_t reportSize;
+	uint64_t seed;
+} xboxone_simulated_controller_config;
+
+/// What the controller sent so far.
+///
+/// `buttonReports` - The number of button reports, including repeats.
+/// `buttonChanges` - The number of button reports that changed a button.
+/// `guideReports` - The number of guide reports.
+/// `unknownPackets` - The number of status packets.
+/// `repeats` - The number of button reports that were sent again.
+/// `idlePolls` - The number of polls the controller had nothing to send for.
+typedef struct {
+	uint64_t buttonReports;
+	uint64_t buttonChanges;
+	uint64_t guideReports;
+	uint64_t unknownPackets;
+	uint64_t repeats;
+	uint64_t idlePolls;
+} xboxone_simulated_controller_stats;
+
+/// The state of the controller.
+///
+/// `config` - How the controller behaves.
+/// `random` - The state of the random generator.
+/// `report` - The last button report sent.
+/// `guide` - Whether the guide button is held.
+/// `guideCounter` - The counter of the next guide report.
+/// `statusCounter` - The counter of the next status packet.
+/// `stats` - What the controller sent so far.
+typedef struct {
+	xboxone_simulated_controller_config config;
+	uint64_t random;
+	xboxone_button_report report;
+	bool guide;
+	uint8_t guideCounter;
+	uint8_t statusCounter;
+	xboxone_simulated_controller_stats stats;
+} xboxone_simulated_controller;
+
+/// Resets the controller, with every button released and the sticks and triggers at rest.
+inline void XboxOneSimulatedControllerInit(xboxone_simulated_controller* controller, const xboxone_simulated_controller_config* config)
+{
+	memset(controller, 0, sizeof(*controller));
+	controller->config = *config;
+	SimulationSeed(&controller->random, config->seed);
+
+	controller->report.header.packetType = XBOXONE_IN_BUTTON;
+	controller->report.header.size = (config->reportSize != 0) ? config->reportSize : XBOXONE_BUTTON_REPORT_SIZE;
+}
+
+/// Moves a value by a random amount of at most `noise` either way, keeping it from `low` to `high`.
+inline int32_t XboxOneSimulatedWander(uint64_t* random, int32_t value, int32_t noise, int32_t low, int32_t high)
+{
+	if (noise > 0)
+	{
+		value += (int32_t)(SimulationRandom(random) % (uint64_t)(2 * noise + 1)) - noise;
+	}
+
+	return (value < low) ? low : (value > high) ? high : value;
+}
+
+/// Produces the packet the controller sends when polled, as a `mock_pipe_device` with the controller as its context.
+inline uint32_t XboxOneSimulatedControllerProduce(void* context, uint64_t timestamp, uint8_t* packet, uint32_t capacity)
+{
+	xboxone_simulated_controller* controller = (xboxone_simulated_controller*)context;
+	const xboxone_simulated_controller_config* config = &controller->config;
+	xboxone_button_report* report = &controller->report;
+	uint8_t staging[XBOXONE_REPORT_HEADER_SIZE + UINT8_MAX] = {};
+	uint32_t length = 0;
+
+	(void)timestamp;
+
+	if (SimulationChance(&controller->random, config->idleRate) == true)
+	{
+		controller->stats.idlePolls++;
+		return 0;
+	}
+
+	if (SimulationChance(&controller->random, config->unknownRate) == true)
+	{
+		xboxone_report_header header = { XBOXONE_SIMULATED_STATUS_PACKET, 0x20, controller->statusCounter++, 4 };
+
+		memcpy(staging, &header, sizeof(header));
+		length = XBOXONE_REPORT_HEADER_SIZE + header.size;
+		controller->stats.unknownPackets++;
+	}
+	else if (SimulationChance(&controller->random, config->guideRate) == true)
+	{
+		xboxone_guide_report guide = {
+			.header = { XBOXONE_IN_GUIDE, 0x30, controller->guideCounter++, XBOXONE_GUIDE_REPORT_SIZE },
+			.guide = (uint8_t)(controller->guide ? 0 : 1),
+			._reserved1 = 0,
+		};
+
+		controller->guide = !controller->guide;
+		memcpy(staging, &guide, sizeof(guide));
+		length = sizeof(guide);
+		controller->stats.guideReports++;
+	}
+	else
+	{
+		if (controller->stats.buttonReports != 0 && SimulationChance(&controller->random, config->repeatRate) == true)
+		{
+			controller->stats.repeats++;
+		}
+		else
+		{
+			int32_t noise = config->stickNoise;
+
+			report->header.counter++;
+			report->leftX = (int16_t)XboxOneSimulatedWander(&controller->random, report->leftX, noise, -XBOXONE_STICK_MAX - 1, XBOXONE_STICK_MAX);
+			report->leftY = (int16_t)XboxOneSimulatedWander(&controller->random, report->leftY, noise, -XBOXONE_STICK_MAX - 1, XBOXONE_STICK_MAX);
+			report->rightX = (int16_t)XboxOneSimulatedWander(&controller->random, report->rightX, noise, -XBOXONE_STICK_MAX - 1, XBOXONE_STICK_MAX);
+			report->rightY = (int16_t)XboxOneSimulatedWander(&controller->random, report->rightY, noise, -XBOXONE_STICK_MAX - 1, XBOXONE_STICK_MAX);
+			report->trigL = (uint16_t)XboxOneSimulatedWander(&controller->random, report->trigL, noise / 32, 0, XBOXONE_TRIGGER_MAX);
+			report->trigR = (uint16_t)XboxOneSimulatedWander(&controller->random, report->trigR, noise / 32, 0, XBOXONE_TRIGGER_MAX);
+
+			if (SimulationChance(&controller->random, config->buttonRate) == true)
+			{
+				report->buttons ^= (uint16_t)(1u << (SimulationRandom(&controller->random) % 16));
+				controller->stats.buttonChanges++;
+			}
+		}
+
+		// Anything a newer model appends past the common report is left zero.
+		memcpy(staging, report, sizeof(*report));
+		length = XBOXONE_REPORT_HEADER_SIZE + report->header.size;
+		controller->stats.buttonReports++;
+	}
+
+	length = (length < capacity) ? length : capacity;
+	memcpy(packet, staging, length);
+	return length;
+}
+
+#endif /* XboxOneSimulatedController_h */
@@ -0,0 +1,413 @@
+//
+//  XboxOneSimulatedInput.h
+//  Simulation
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// The input path of `XboxOneInputInterface`, run against a `mock_pipe` instead of a real `IN` pipe.
+// Each function mirrors the driver function of the same name. Reads are armed and recovered by the same `input_path` the driver uses,
+// whose hooks reach the mock pipe here, completions are restored to submission order, and packets go through `XboxOneProtocolProcess`
+// and the report coalescer, with the recovery and coalesce timers fired when simulated time reaches them.
+// Simulated time only moves from one event to the next, so a run takes as long as the input path itself, however long the simulated span.
+// This code is not specific to DriverKit in any way, and is only used to simulate a device.
+//
+
+#ifndef XboxOneSimulatedInput_h
+#define XboxOneSimulatedInput_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include <InputPath.h>
+#include <LatencyHistogram.h>
+#include <PacketCapture.h>
+
+#include "MockPipe.h"
+#include "SimulationSupport.h"
+#include "XboxOneCoalescer.h"
+#include "XboxOneProtocol.h"
+
+/// How the simulated input path is set up.
+///
+/// `slotCount` - The number of input slots, as set by the `XboxOneInputRingDepth` property of the driver.
+/// `pipe` - How the pipe behaves, in nanoseconds.
+/// `recovery` - How the pipe backs off, in nanoseconds.
+/// `coalesceWindow` - The coalescing window for button reports in nanoseconds, or 0 to deliver every report.
+/// `timed` - Whether the protocol core records how long each of its stages takes, as the driver always does.
+typedef struct {
+	uint32_t slotCount;
+	mock_pipe_config pipe;
+	pipe_recovery_config recovery;
+	uint64_t coalesceWindow;
+	bool timed;
+} xboxone_simulated_input_config;
+
+/// What the input path did so far.
+///
+/// `completions` - The number of completions handled, in any way.
+/// `packets` - The number of packets handled.
+/// `errors` - The number of completions of reads that failed.
+/// `delivered`, `suppressed`, `repeated`, `ignored` - The number of packets given each `xboxone_packet_verdict`.
+/// `responses` - The number of guide responses that would have been sent.
+/// `handleReports` - The number of reports that would have been handed to `handleReport`, after coalescing.
+/// `rearmFailures` - The number of reads the pipe refused.
+/// `outOfOrder` - The number of packets handled before a packet that was read earlier. Always 0 unless the input ring is broken.
+/// `reportHash` - A hash of every report handed to `handleReport`, in order, as in `xboxone_replay_stats`.
+/// `delay` - The simulated time from a read completing to its report, or a newer one coalesced in its place, being handed to `handleReport`, in nanoseconds.
+/// `handling` - The real time taken to handle each completion, in nanoseconds.
+typedef struct {
+	uint64_t completions;
+	uint64_t packets;
+	uint64_t errors;
+	uint64_t delivered;
+	uint64_t suppressed;
+	uint64_t repeated;
+	uint64_t ignored;
+	uint64_t responses;
+	uint64_t handleReports;
+	uint64_t rearmFailures;
+	uint64_t outOfOrder;
+	uint64_t reportHash;
+	latency_histogram delay;
+	latency_histogram handling;
+} xboxone_simulated_input_stats;
+
+/// The state of the simulated input path, which stands in for the ivars the driver's input path uses.
+///
+/// `config` - How the input path is set up.
+/// `pipe` - The simulated `IN` pipe.
+/// `path` - Keeps a read outstanding on every slot, restores completions to submission order, and recovers from failed reads.
+/// `slotBuffers` - The buffer each input slot reads into.
+/// `recoveryArmed` - Whether the recovery timer is set.
+/// `recoveryDeadline` - When the recovery timer fires.
+/// `protocol` - The protocol state of the controller.
+/// `latency` - Where the protocol core records how long its stages take, if `config.timed` is set.
+/// `coalescer` - The state of report coalescing.
+/// `coalesceArmed` - Whether the coalesce timer is set.
+/// `coalesceDeadline` - When the coalesce timer fires.
+/// `packet` - Stands in for `inPipe.memory`, where each packet is handled.
+/// `lastTimestamp` - When the last packet handled was read.
+/// `now` - The simulated time.
+/// `stats` - What the input path did so far.
+typedef struct {
+	xboxone_simulated_input_config config;
+	mock_pipe pipe;
+	input_path path;
+	uint8_t slotBuffers[INPUT_RING_MAX_SLOTS][INPUT_RING_MAX_PACKET_SIZE];
+	bool recoveryArmed;
+	uint64_t recoveryDeadline;
+	xboxone_protocol protocol;
+	xboxone_latency_monitor latency;
+	xboxone_coalescer coalescer;
+	bool coalesceArmed;
+	uint64_t coalesceDeadline;
+	uint8_t packet[INPUT_RING_MAX_PACKET_SIZE];
+	uint64_t lastTimestamp;
+	uint64_t now;
+	xboxone_simulated_input_stats stats;
+} xboxone_simulated_input;
+
+
+
+
+// MARK: - Reads
+
+/// Submits a read on an input slot, as `RequestAsyncInterruptData` does. This is the `submit` hook of `path`.
+inline int32_t XboxOneSimulatedInputRequest(void* context, uint32_t slot)
+{
+	xboxone_simulated_input* input = (xboxone_simulated_input*)context;
+	int32_t status = MOCK_PIPE_SUCCESS;
+
+	if (InputRingSubmit(&input->path.ring, slot) == false)
+	{
+		return MOCK_PIPE_SUCCESS;
+	}
+
+	status = MockPipeSubmit(&input->pipe, slot, input->slotBuffers[slot], INPUT_RING_MAX_PACKET_SIZE);
+	if (status != MOCK_PIPE_SUCCESS)
+	{
+		input->stats.rearmFailures++;
+		InputRingCancelSubmit(&input->path.ring, slot);
+	}
+
+	return status;
+}
+
+/// Clears the stall of the pipe. This is the `clearStall` hook of `path`.
+inline void XboxOneSimulatedInputClearStall(void* context)
+{
+	xboxone_simulated_input* input = (xboxone_simulated_input*)context;
+
+	MockPipeClearStall(&input->pipe, input->now);
+}
+
+/// Sets the recovery timer to fire `delay` from now. This is the `armTimer` hook of `path`.
+inline void XboxOneSimulatedInputArmRecoveryTimer(void* context, uint64_t delay)
+{
+	xboxone_simulated_input* input = (xboxone_simulated_input*)context;
+
+	input->recoveryArmed = true;
+	input->recoveryDeadline = input->now + delay;
+}
+
+/// Resumes the pipe and re-arms every slot that was held back, as `RecoveryTimerFired` does.
+inline void XboxOneSimulatedInputRecoveryTimerFired(xboxone_simulated_input* input)
+{
+	input->recoveryArmed = false;
+	InputPathRecoveryTimerFired(&input->path, input->now);
+}
+
+/// Sets up the input path at simulated time 0, polling `device` for packets, without arming any reads yet.
+///
+/// The structure is large, so it is best not kept on the stack.
+inline void XboxOneSimulatedInputInit(xboxone_simulated_input* input, const xboxone_simulated_input_config* config, const xboxone_model_info* model, mock_pipe_device device, void* context)
+{
+	memset(input, 0, sizeof(*input));
+	input->config = *config;
+
+	MockPipeInit(&input->pipe, &config->pipe, device, context, 0);
+	InputRingInit(&input->path.ring, config->slotCount);
+	PipeRecoveryInit(&input->path.recovery, &config->recovery, 0);
+	input->path.enabled = true;
+	input->path.hooks = {
+		.context = input,
+		.submit = XboxOneSimulatedInputRequest,
+		.classify = MockPipeClassify,
+		.clearStall = XboxOneSimulatedInputClearStall,
+		.armTimer = XboxOneSimulatedInputArmRecoveryTimer,
+		.held = nullptr,
+	};
+	XboxOneProtocolInit(&input->protocol, model, &input->latency, (config->timed == true) ? SimulationNow : nullptr);
+	XboxOneCoalescerSetWindow(&input->coalescer, config->coalesceWindow);
+
+	input->stats.reportHash = PacketCaptureHash(nullptr, 0);
+}
+
+/// Arms a read on every slot, as `handleStart` does once the pipes are set up.
+inline void XboxOneSimulatedInputStart(xboxone_simulated_input* input)
+{
+	input->path.idleSlots = (1u << input->path.ring.slotCount) - 1;
+	InputPathArmIdle(&input->path, input->now);
+}
+
+/// Enables or disables the input path, as `ApplyEnable` does.
+///
+/// Disabling aborts every outstanding read, and each slot is left idle as its read completes.
+/// Enabling re-arms the idle slots straight away, unless `recovery` is holding reads back, in which case its timer re-arms them.
+inline void XboxOneSimulatedInputSetEnable(xboxone_simulated_input* input, bool enabled)
+{
+	if (enabled == input->path.enabled)
+	{
+		return;
+	}
+
+	input->path.enabled = enabled;
+	if (enabled == false)
+	{
+		MockPipeAbort(&input->pipe, input->now);
+		return;
+	}
+
+	if (PipeRecoveryCanArm(&input->path.recovery) == true)
+	{
+		InputPathArmIdle(&input->path, input->now);
+	}
+}
+
+
+
+
+// MARK: - Packets
+
+/// Hands a report to `handleReport`, which here only folds it into the results.
+///
+/// `timestamp` is when the oldest read the report stands for completed, which for a coalesced report is the first one held in its window.
+inline void XboxOneSimulatedInputHandleReport(xboxone_simulated_input* input, const uint8_t* report, uint32_t length, uint64_t timestamp)
+{
+	input->stats.handleReports++;
+	for (uint32_t byte = 0; byte < length; ++byte)
+	{
+		input->stats.reportHash ^= report[byte];
+		input->stats.reportHash *= 0x100000001b3;
+	}
+
+	LatencyHistogramRecord(&input->stats.delay, (input->now > timestamp) ? input->now - timestamp : 0);
+}
+
+/// Delivers the report held by the coalescer, as `CoalesceTimerFired` does.
+inline void XboxOneSimulatedInputCoalesceTimerFired(xboxone_simulated_input* input)
+{
+	xboxone_button_report report = {};
+	uint32_t length = 0;
+	uint64_t timestamp = 0;
+	uint64_t since = 0;
+
+	input->coalesceArmed = false;
+
+	if (XboxOneCoalescerFlush(&input->coalescer, input->now, (uint8_t*)&report, &length, &timestamp, &since) == true)
+	{
+		XboxOneSimulatedInputHandleReport(input, (const uint8_t*)&report, length, since);
+	}
+}
+
+/// Hands a button report to `handleReport`, either now or when the coalesce timer fires, as `DeliverControllerReport` does.
+inline void XboxOneSimulatedInputDeliver(xboxone_simulated_input* input, const uint8_t* report, uint32_t length, uint64_t timestamp)
+{
+	uint64_t deadline = 0;
+
+	switch (XboxOneCoalescerOffer(&input->coalescer, report, length, timestamp, input->now, &deadline))
+	{
+		case XBOXONE_COALESCE_DELIVER:
+			XboxOneSimulatedInputHandleReport(input, report, length, timestamp);
+			break;
+
+		case XBOXONE_COALESCE_SCHEDULE:
+			input->coalesceArmed = true;
+			input->coalesceDeadline = deadline;
+			break;
+
+		case XBOXONE_COALESCE_HOLD:
+			break;
+	}
+}
+
+/// Handles a single packet held in `packet`, in the order it was read, as `ProcessPacket` does.
+inline void XboxOneSimulatedInputProcessPacket(xboxone_simulated_input* input, int32_t status, uint32_t length, uint64_t timestamp)
+{
+	xboxone_protocol_result result = {};
+	xboxone_guide_response response = {};
+
+	if (status != MOCK_PIPE_SUCCESS)
+	{
+		input->stats.errors++;
+		return;
+	}
+
+	input->stats.packets++;
+	if (timestamp < input->lastTimestamp)
+	{
+		input->stats.outOfOrder++;
+	}
+	input->lastTimestamp = timestamp;
+
+	XboxOneProtocolProcess(&input->protocol, input->packet, length, timestamp, &result);
+
+	switch (result.verdict)
+	{
+		case XBOXONE_VERDICT_DELIVER:
+			input->stats.delivered++;
+			break;
+
+		case XBOXONE_VERDICT_SUPPRESSED:
+			input->stats.suppressed++;
+			break;
+
+		case XBOXONE_VERDICT_REPEATED:
+			input->stats.repeated++;
+			break;
+
+		case XBOXONE_VERDICT_IGNORE:
+			input->stats.ignored++;
+			break;
+	}
+
+	switch (result.handler)
+	{
+		case XBOXONE_HANDLER_BUTTON:
+			if (result.verdict == XBOXONE_VERDICT_DELIVER)
+			{
+				XboxOneSimulatedInputDeliver(input, input->packet, result.reportLength, timestamp);
+			}
+			break;
+
+		case XBOXONE_HANDLER_GUIDE:
+			XboxOneSimulatedInputHandleReport(input, input->packet, result.reportLength, timestamp);
+			if (XboxOneProtocolGuideResponse((const xboxone_guide_report*)input->packet, &response) == true)
+			{
+				input->stats.responses++;
+			}
+			break;
+
+		case XBOXONE_HANDLER_NONE:
+			break;
+	}
+}
+
+/// Handles a completed read, as `GotData` does: the slot is re-armed first, then every packet that is now in order is handled.
+inline void XboxOneSimulatedInputGotData(xboxone_simulated_input* input, const mock_pipe_completion* completion)
+{
+	const input_ring_entry* entry = nullptr;
+	uint64_t start = SimulationNow();
+
+	input->stats.completions++;
+	InputRingComplete(&input->path.ring, completion->slot, completion->status, input->slotBuffers[completion->slot], completion->length, completion->timestamp);
+	InputPathRecover(&input->path, completion->slot, completion->status, input->now);
+
+	while ((entry = InputRingPeek(&input->path.ring)) != nullptr)
+	{
+		memcpy(input->packet, entry->data, entry->length);
+		XboxOneSimulatedInputProcessPacket(input, entry->status, entry->length, entry->timestamp);
+		InputRingPop(&input->path.ring);
+	}
+
+	InputPathRequestParked(&input->path, input->now);
+	LatencyHistogramRecord(&input->stats.handling, SimulationNow() - start);
+}
+
+
+
+
+// MARK: - Time
+
+/// Moves simulated time to the next event, if there is one by `until`, and handles it.
+///
+/// Returns false, with simulated time moved to `until`, if nothing happens by then.
+inline bool XboxOneSimulatedInputStep(xboxone_simulated_input* input, uint64_t until)
+{
+	mock_pipe_completion completion = {};
+	uint64_t next = MockPipeNextEvent(&input->pipe);
+
+	if (input->recoveryArmed == true && input->recoveryDeadline < next)
+	{
+		next = input->recoveryDeadline;
+	}
+	if (input->coalesceArmed == true && input->coalesceDeadline < next)
+	{
+		next = input->coalesceDeadline;
+	}
+
+	if (next > until)
+	{
+		input->now = (until > input->now) ? until : input->now;
+		return false;
+	}
+	input->now = (next > input->now) ? next : input->now;
+
+	if (input->coalesceArmed == true && input->coalesceDeadline <= input->now)
+	{
+		XboxOneSimulatedInputCoalesceTimerFired(input);
+	}
+	if (input->recoveryArmed == true && input->recoveryDeadline <= input->now)
+	{
+		XboxOneSimulatedInputRecoveryTimerFired(input);
+	}
+
+	MockPipePoll(&input->pipe, input->now);
+	while (MockPipeTake(&input->pipe, input->now, &completion) == true)
+	{
+		XboxOneSimulatedInputGotData(input, &completion);
+	}
+
+	return true;
+}
+
+/// Runs the input path until simulated time reaches `until`.
+inline void XboxOneSimulatedInputRun(xboxone_simulated_input* input, uint64_t until)
+{
+	while (XboxOneSimulatedInputStep(input, until) == true)
+	{
+	}
+}
+
+#endif /* XboxOneSimulatedInput_h */
@@ -0,0 +1,148 @@
+//
+//  AxisTransformTests.cpp
+//  Tests
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Checks that the vectorized stick transform produces exactly the same reports as the scalar reference, bit for bit,
+// for axial and radial deadzones, response curves, and random configurations.
+// Every value of each stick axis is swept against the edges of the other, and random stick positions cover the rest.
+//
+
+#include <string.h>
+
+#include "SimulationSupport.h"
+#include "TestSupport.h"
+#include "XboxOneAxisTransform.h"
+
+/// The stick values each axis is swept against: the edges, the center, and either side of them.
+static const int16_t kEdgeValues[] = { -32768, -32767, -16384, -1, 0, 1, 16384, 32766, 32767 };
+
+/// Transforms a report with both implementations, and counts a failure if they differ.
+///
+/// Only the first few differences are printed, so a broken build does not flood the log.
+static void CheckReport(const xboxone_axis_transform_plan* plan, int16_t leftX, int16_t leftY, int16_t rightX, int16_t rightY)
+{
+	static uint32_t printed = 0;
+	xboxone_button_report scalar = {};
+	xboxone_button_report vector = {};
+
+	scalar.leftX = leftX;
+	scalar.leftY = leftY;
+	scalar.rightX = rightX;
+	scalar.rightY = rightY;
+	vector = scalar;
+
+	XboxOneTransformSticksScalar(plan, &scalar);
+	XboxOneTransformSticks(plan, &vector);
+
+	if (memcmp(&scalar, &vector, sizeof(scalar)) != 0)
+	{
+		if (printed++ < 10)
+		{
+			printf("\t(%d, %d, %d, %d): scalar (%d, %d, %d, %d), vector (%d, %d, %d, %d)\n", leftX, leftY, rightX, rightY,
+				   scalar.leftX, scalar.leftY, scalar.rightX, scalar.rightY, vector.leftX, vector.leftY, vector.rightX, vector.rightY);
+		}
+		testFailures++;
+	}
+}
+
+/// Compares both implementations over the sweeps and `randomCount` random positions.
+static void CheckPlan(const char* name, const xboxone_axis_transform_config* config, uint32_t randomCount, uint64_t seed)
+{
+	xboxone_axis_transform_plan plan = {};
+	uint64_t random = 0;
+	uint32_t before = testFailures;
+
+	CHECK(XboxOneCompileAxisTransform(config, &plan) == true);
+	SimulationSeed(&random, seed);
+
+	for (int32_t value = -32768; value <= 32767; ++value)
+	{
+		for (int16_t edge : kEdgeValues)
+		{
+			CheckReport(&plan, (int16_t)value, edge, edge, (int16_t)value);
+			CheckReport(&plan, edge, (int16_t)value, (int16_t)value, edge);
+		}
+	}
+
+	for (uint32_t index = 0; index < randomCount; ++index)
+	{
+		uint64_t bits = SimulationRandom(&random);
+
+		CheckReport(&plan, (int16_t)bits, (int16_t)(bits >> 16), (int16_t)(bits >> 32), (int16_t)(bits >> 48));
+	}
+
+	if (testFailures != before)
+	{
+		printf("%s: %u reports differ.\n", name, testFailures - before);
+	}
+}
+
+/// A random configuration, with the deadzones and curve points anywhere in range.
+static void RandomConfig(uint64_t* random, xboxone_axis_transform_config* config)
+{
+	memset(config, 0, sizeof(*config));
+	config->version = XBOXONE_AXIS_TRANSFORM_VERSION;
+	config->enabled = 1;
+	config->leftShape = (uint8_t)(SimulationRandom(random) % 2);
+	config->rightShape = (uint8_t)(SimulationRandom(random) % 2);
+
+	for (uint32_t axis = XBOXONE_AXIS_LEFT_X; axis < XBOXONE_AXIS_COUNT; ++axis)
+	{
+		xboxone_axis_response* response = &config->axes[axis];
+
+		response->inner = (uint16_t)(SimulationRandom(random) % 12000);
+		response->outer = (uint16_t)((SimulationRandom(random) % 2 == 0) ? 0 : response->inner + 1 + SimulationRandom(random) % (32767 - response->inner));
+		for (uint32_t point = 0; point < XBOXONE_CURVE_POINTS && SimulationRandom(random) % 3 != 0; ++point)
+		{
+			response->curve[point] = (uint16_t)(SimulationRandom(random) % 32768);
+		}
+	}
+}
+
+int main(void)
+{
+	xboxone_axis_transform_config config = {};
+	uint64_t random = 0;
+
+	config.version = XBOXONE_AXIS_TRANSFORM_VERSION;
+	config.enabled = 1;
+	CheckPlan("linear axial", &config, 200000, 1);
+
+	config.leftShape = XBOXONE_DEADZONE_RADIAL;
+	config.rightShape = XBOXONE_DEADZONE_RADIAL;
+	CheckPlan("linear radial", &config, 200000, 2);
+
+	// Typical deadzones for worn sticks, with an S-shaped curve on the left stick and a steep one on the right.
+	for (uint32_t axis = XBOXONE_AXIS_LEFT_X; axis < XBOXONE_AXIS_COUNT; ++axis)
+	{
+		config.axes[axis].inner = 7849;
+		config.axes[axis].outer = 31000;
+		for (uint32_t point = 0; point < XBOXONE_CURVE_POINTS; ++point)
+		{
+			uint32_t linear = point * 32767 / (XBOXONE_CURVE_POINTS - 1);
+
+			config.axes[axis].curve[point] = (uint16_t)((axis < XBOXONE_AXIS_RIGHT_X) ? linear * linear / 32767 : 32767 - (32767 - linear) * (32767 - linear) / 32767);
+		}
+	}
+	config.leftShape = XBOXONE_DEADZONE_AXIAL;
+	CheckPlan("curved mixed", &config, 200000, 3);
+
+	// The deadzone covers all but the very edge of the stick.
+	config.axes[XBOXONE_AXIS_LEFT_X].inner = 32766;
+	config.axes[XBOXONE_AXIS_LEFT_X].outer = 32767;
+	config.axes[XBOXONE_AXIS_RIGHT_X].inner = 32000;
+	config.axes[XBOXONE_AXIS_RIGHT_X].outer = 0;
+	CheckPlan("extreme deadzones", &config, 200000, 4);
+
+	SimulationSeed(&random, 5);
+	for (uint32_t round = 0; round < 16; ++round)
+	{
+		RandomConfig(&random, &config);
+		CheckPlan("random", &config, 50000, 100 + round);
+	}
+
+	return TestResult("AxisTransformTests");
+}
@@ -0,0 +1,277 @@
+//
+//  CommandBufferTests.cpp
+//  Tests
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Checks how the driver reads command buffers, which come straight from user space and must never be trusted.
+// Buffers are built with the same writer clients use, then cut short, given lengths that run past the end, misaligned, or given unknown tags.
+// A command whose length runs past the end fails along with every command after it, since where they start is no longer known,
+// while a command that is only of an unknown tag or the wrong size fails alone.
+//
+
+#include <string.h>
+
+#include "TestSupport.h"
+#include "XboxOneCommands.h"
+
+/// Builds a buffer of an enable, a coalescing, and a trace categories command, returning its size.
+static uint32_t BuildBuffer(uint8_t* buffer, uint32_t capacity)
+{
+	xboxone_command_writer writer = {};
+	xboxone_enable_command enable = { .enabled = 1 };
+	xboxone_coalescing_command coalescing = { .windowMicroseconds = 4000 };
+	xboxone_trace_categories_command trace = { .categories = 3 };
+
+	CHECK(XboxOneCommandWriterInit(&writer, buffer, capacity) == true);
+	CHECK(XboxOneCommandAppend(&writer, XBOXONE_COMMAND_SET_ENABLE, &enable, sizeof(enable)) == true);
+	CHECK(XboxOneCommandAppend(&writer, XBOXONE_COMMAND_SET_COALESCING, &coalescing, sizeof(coalescing)) == true);
+	CHECK(XboxOneCommandAppend(&writer, XBOXONE_COMMAND_SET_TRACE_CATEGORIES, &trace, sizeof(trace)) == true);
+	return writer.size;
+}
+
+/// Reads a buffer, returning false if its header is refused.
+static bool Parse(const uint8_t* buffer, uint32_t size, xboxone_parsed_command* commands, uint32_t* count)
+{
+	xboxone_command_buffer_header header = {};
+
+	if (XboxOneCommandReadHeader(buffer, size, &header) == false)
+	{
+		return false;
+	}
+
+	*count = header.count;
+	XboxOneCommandParse(buffer, size, header.count, commands);
+	return true;
+}
+
+/// Overwrites the header of the command at `index`, found by walking the lengths written so far.
+static void RewriteCommand(uint8_t* buffer, uint32_t index, uint16_t tag, uint16_t length)
+{
+	uint32_t offset = sizeof(xboxone_command_buffer_header);
+	xboxone_command_header command = {};
+
+	for (uint32_t walked = 0; walked < index; ++walked)
+	{
+		memcpy(&command, buffer + offset, sizeof(command));
+		offset += XboxOneCommandSize(command.length);
+	}
+
+	command = { .tag = tag, .length = length };
+	memcpy(buffer + offset, &command, sizeof(command));
+}
+
+/// A buffer built by the writer reads back whole, with every command aligned and its payload intact.
+static void TestRoundTrip(void)
+{
+	uint8_t buffer[256] = {};
+	xboxone_parsed_command commands[XBOXONE_COMMAND_MAX] = {};
+	xboxone_coalescing_command coalescing = {};
+	uint32_t size = BuildBuffer(buffer, sizeof(buffer));
+	uint32_t count = 0;
+
+	CHECK_EQUAL(size, sizeof(xboxone_command_buffer_header) + 3 * XboxOneCommandSize(4));
+	CHECK(Parse(buffer, size, commands, &count) == true);
+	CHECK_EQUAL(count, 3);
+
+	for (uint32_t index = 0; index < count; ++index)
+	{
+		CHECK_EQUAL(commands[index].status, XBOXONE_COMMAND_VALID);
+		CHECK_EQUAL((commands[index].payload - buffer) % XBOXONE_COMMAND_ALIGNMENT, 0);
+	}
+	CHECK_EQUAL(commands[1].command.tag, XBOXONE_COMMAND_SET_COALESCING);
+	memcpy(&coalescing, commands[1].payload, sizeof(coalescing));
+	CHECK_EQUAL(coalescing.windowMicroseconds, 4000);
+}
+
+/// Payloads that are not a multiple of the alignment are padded, so the command after them still starts aligned,
+/// and a buffer cut off in that padding cannot be read.
+static void TestAlignment(void)
+{
+	uint8_t buffer[256] = {};
+	xboxone_parsed_command commands[XBOXONE_COMMAND_MAX] = {};
+	xboxone_command_writer writer = {};
+	xboxone_rumble_command rumble = {};
+	xboxone_enable_command enable = { .enabled = 0 };
+	uint8_t odd[5] = { 1, 2, 3, 4, 5 };
+	uint32_t count = 0;
+
+	CHECK_EQUAL(XboxOneCommandSize(0), 4);
+	CHECK_EQUAL(XboxOneCommandSize(1), 8);
+	CHECK_EQUAL(XboxOneCommandSize(5), 12);
+
+	XboxOneCommandWriterInit(&writer, buffer, sizeof(buffer));
+	XboxOneCommandAppend(&writer, XBOXONE_COMMAND_SET_ENABLE, odd, sizeof(odd));
+	XboxOneCommandAppend(&writer, XBOXONE_COMMAND_RUMBLE, &rumble, sizeof(rumble));
+	XboxOneCommandAppend(&writer, XBOXONE_COMMAND_SET_ENABLE, &enable, sizeof(enable));
+
+	CHECK(Parse(buffer, writer.size, commands, &count) == true);
+	CHECK_EQUAL(commands[0].status, XBOXONE_COMMAND_BAD_LENGTH);
+	CHECK_EQUAL(commands[1].status, XBOXONE_COMMAND_VALID);
+	CHECK_EQUAL(commands[2].status, XBOXONE_COMMAND_VALID);
+	CHECK_EQUAL(commands[1].payload - buffer, sizeof(xboxone_command_buffer_header) + 12 + sizeof(xboxone_command_header));
+	CHECK_EQUAL((commands[2].payload - buffer) % XBOXONE_COMMAND_ALIGNMENT, 0);
+
+	// Cut off in the padding of the first command: its payload is there, but not the padding that says where the next one starts.
+	CHECK(Parse(buffer, sizeof(xboxone_command_buffer_header) + sizeof(xboxone_command_header) + sizeof(odd), commands, &count) == true);
+	CHECK_EQUAL(commands[0].status, XBOXONE_COMMAND_UNREADABLE);
+	CHECK_EQUAL(commands[2].status, XBOXONE_COMMAND_UNREADABLE);
+}
+
+/// Buffers that are too small, too large, of another version, or hold too many commands are refused as a whole.
+static void TestHeader(void)
+{
+	static uint8_t large[XBOXONE_COMMAND_BUFFER_MAX_SIZE + 4] = {};
+	uint8_t buffer[256] = {};
+	xboxone_command_buffer_header header = {};
+	uint32_t size = BuildBuffer(buffer, sizeof(buffer));
+
+	CHECK(XboxOneCommandReadHeader(buffer, size, &header) == true);
+	CHECK(XboxOneCommandReadHeader(buffer, sizeof(header) - 1, &header) == false);
+	CHECK(XboxOneCommandReadHeader(buffer, 0, &header) == false);
+
+	memcpy(large, buffer, size);
+	CHECK(XboxOneCommandReadHeader(large, XBOXONE_COMMAND_BUFFER_MAX_SIZE, &header) == true);
+	CHECK(XboxOneCommandReadHeader(large, sizeof(large), &header) == false);
+
+	header = { .version = XBOXONE_COMMAND_VERSION + 1, .count = 3 };
+	memcpy(buffer, &header, sizeof(header));
+	CHECK(XboxOneCommandReadHeader(buffer, size, &header) == false);
+
+	header = { .version = XBOXONE_COMMAND_VERSION, .count = XBOXONE_COMMAND_MAX + 1 };
+	memcpy(buffer, &header, sizeof(header));
+	CHECK(XboxOneCommandReadHeader(buffer, size, &header) == false);
+}
+
+/// A buffer cut short fails the command it cuts into and every command after it, but not those before it.
+static void TestTruncated(void)
+{
+	uint8_t buffer[256] = {};
+	xboxone_parsed_command commands[XBOXONE_COMMAND_MAX] = {};
+	xboxone_command_buffer_header header = { .version = XBOXONE_COMMAND_VERSION, .count = 5 };
+	uint32_t size = BuildBuffer(buffer, sizeof(buffer));
+	uint32_t count = 0;
+
+	for (uint32_t cut = sizeof(xboxone_command_buffer_header); cut < size; ++cut)
+	{
+		uint32_t whole = (cut - (uint32_t)sizeof(xboxone_command_buffer_header)) / XboxOneCommandSize(4);
+
+		CHECK(Parse(buffer, cut, commands, &count) == true);
+		for (uint32_t index = 0; index < count; ++index)
+		{
+			CHECK_EQUAL(commands[index].status, (index < whole) ? XBOXONE_COMMAND_VALID : XBOXONE_COMMAND_UNREADABLE);
+			CHECK((commands[index].payload == nullptr) == (index >= whole));
+		}
+	}
+
+	// A header that claims more commands than the buffer holds fails the ones that are not there.
+	memcpy(buffer, &header, sizeof(header));
+	CHECK(Parse(buffer, size, commands, &count) == true);
+	CHECK_EQUAL(commands[2].status, XBOXONE_COMMAND_VALID);
+	CHECK_EQUAL(commands[3].status, XBOXONE_COMMAND_UNREADABLE);
+	CHECK_EQUAL(commands[4].status, XBOXONE_COMMAND_UNREADABLE);
+}
+
+/// A length that runs past the end fails its command and every one after it, even though the bytes after it look like commands.
+static void TestOversizeLength(void)
+{
+	static const uint16_t kLengths[] = { 13, 200, UINT16_MAX };
+
+	for (uint16_t length : kLengths)
+	{
+		uint8_t buffer[256] = {};
+		xboxone_parsed_command commands[XBOXONE_COMMAND_MAX] = {};
+		uint32_t size = BuildBuffer(buffer, sizeof(buffer));
+		uint32_t count = 0;
+
+		RewriteCommand(buffer, 1, XBOXONE_COMMAND_SET_COALESCING, length);
+		CHECK(Parse(buffer, size, commands, &count) == true);
+		CHECK_EQUAL(commands[0].status, XBOXONE_COMMAND_VALID);
+		CHECK_EQUAL(commands[1].status, XBOXONE_COMMAND_UNREADABLE);
+		CHECK_EQUAL(commands[2].status, XBOXONE_COMMAND_UNREADABLE);
+	}
+}
+
+/// A wrong length that still fits in the buffer swallows the command after it, which leaves the last one nowhere to start.
+static void TestSwallowedCommand(void)
+{
+	uint8_t buffer[256] = {};
+	xboxone_parsed_command commands[XBOXONE_COMMAND_MAX] = {};
+	uint32_t size = BuildBuffer(buffer, sizeof(buffer));
+	uint32_t count = 0;
+
+	RewriteCommand(buffer, 1, XBOXONE_COMMAND_SET_COALESCING, 9);
+	CHECK_EQUAL(XboxOneCommandSize(9), size - sizeof(xboxone_command_buffer_header) - XboxOneCommandSize(4));
+	CHECK(Parse(buffer, size, commands, &count) == true);
+	CHECK_EQUAL(commands[1].status, XBOXONE_COMMAND_BAD_LENGTH);
+	CHECK_EQUAL(commands[2].status, XBOXONE_COMMAND_UNREADABLE);
+}
+
+/// An unknown tag, or a known tag with the wrong payload size, fails alone, since its length still says where the next command starts.
+static void TestUnknownAndWrongSize(void)
+{
+	uint8_t buffer[256] = {};
+	xboxone_parsed_command commands[XBOXONE_COMMAND_MAX] = {};
+	uint32_t size = BuildBuffer(buffer, sizeof(buffer));
+	uint32_t count = 0;
+
+	RewriteCommand(buffer, 0, 0, 4);
+	RewriteCommand(buffer, 1, XBOXONE_COMMAND_SET_STICK_FILTER + 1, 4);
+	CHECK(Parse(buffer, size, commands, &count) == true);
+	CHECK_EQUAL(commands[0].status, XBOXONE_COMMAND_UNKNOWN);
+	CHECK_EQUAL(commands[1].status, XBOXONE_COMMAND_UNKNOWN);
+	CHECK_EQUAL(commands[2].status, XBOXONE_COMMAND_VALID);
+
+	// The axis transform expects far more than 4 bytes, and a stick filter payload is not one either.
+	RewriteCommand(buffer, 0, XBOXONE_COMMAND_SET_AXIS_TRANSFORM, 4);
+	RewriteCommand(buffer, 1, XBOXONE_COMMAND_SET_STICK_FILTER, 4);
+	CHECK(Parse(buffer, size, commands, &count) == true);
+	CHECK_EQUAL(commands[0].status, XBOXONE_COMMAND_BAD_LENGTH);
+	CHECK_EQUAL(commands[1].status, XBOXONE_COMMAND_BAD_LENGTH);
+	CHECK_EQUAL(commands[2].status, XBOXONE_COMMAND_VALID);
+	CHECK_EQUAL(commands[2].command.tag, XBOXONE_COMMAND_SET_TRACE_CATEGORIES);
+}
+
+/// The writer refuses commands once the buffer or the command count is full, so what it builds is always readable.
+static void TestWriterLimits(void)
+{
+	static uint8_t buffer[XBOXONE_COMMAND_BUFFER_MAX_SIZE] = {};
+	xboxone_parsed_command commands[XBOXONE_COMMAND_MAX] = {};
+	xboxone_command_writer writer = {};
+	xboxone_enable_command enable = { .enabled = 1 };
+	uint8_t small[4] = {};
+	uint32_t count = 0;
+
+	CHECK(XboxOneCommandWriterInit(&writer, small, sizeof(xboxone_command_buffer_header) - 1) == false);
+	CHECK(XboxOneCommandWriterInit(&writer, small, sizeof(small)) == false);
+
+	CHECK(XboxOneCommandWriterInit(&writer, buffer, sizeof(buffer)) == true);
+	for (uint32_t index = 0; index < XBOXONE_COMMAND_MAX; ++index)
+	{
+		CHECK(XboxOneCommandAppend(&writer, XBOXONE_COMMAND_SET_ENABLE, &enable, sizeof(enable)) == true);
+	}
+	CHECK(XboxOneCommandAppend(&writer, XBOXONE_COMMAND_SET_ENABLE, &enable, sizeof(enable)) == false);
+	CHECK(Parse(buffer, writer.size, commands, &count) == true);
+	CHECK_EQUAL(count, XBOXONE_COMMAND_MAX);
+	CHECK_EQUAL(commands[XBOXONE_COMMAND_MAX - 1].status, XBOXONE_COMMAND_VALID);
+
+	// A payload that would not fit in what is left of the buffer is refused, and leaves the buffer as it was.
+	CHECK(XboxOneCommandWriterInit(&writer, buffer, 16) == true);
+	CHECK(XboxOneCommandAppend(&writer, XBOXONE_COMMAND_SET_ENABLE, &enable, sizeof(enable)) == true);
+	CHECK(XboxOneCommandAppend(&writer, XBOXONE_COMMAND_SET_ENABLE, &enable, sizeof(enable)) == false);
+	CHECK_EQUAL(writer.size, 16);
+}
+
+int main(void)
+{
+	TestRoundTrip();
+	TestAlignment();
+	TestHeader();
+	TestTruncated();
+	TestOversizeLength();
+	TestSwallowedCommand();
+	TestUnknownAndWrongSize();
+	TestWriterLimits();
+	return TestResult("CommandBufferTests");
+}
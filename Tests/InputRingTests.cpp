@@ -0,0 +1,186 @@
+//
+//  InputRingTests.cpp
+//  Tests
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Checks that `input_ring` hands packets on in the order their reads were submitted, whatever order the reads complete in,
+// both when completions are shuffled directly and when a simulated pipe delivers them late and out of order.
+//
+
+#include <stdlib.h>
+
+#include <InputRing.h>
+
+#include "SimulationSupport.h"
+#include "TestSupport.h"
+#include "XboxOneSimulatedController.h"
+#include "XboxOneSimulatedInput.h"
+
+/// Completes every outstanding read in a random order, then checks they are popped in submission order.
+static void TestShuffledCompletions(void)
+{
+	input_ring ring = {};
+	uint64_t random = 0;
+	uint32_t order[INPUT_RING_MAX_SLOTS] = {};
+	uint32_t expected = 0;
+
+	SimulationSeed(&random, 3);
+	InputRingInit(&ring, INPUT_RING_MAX_SLOTS);
+
+	for (uint32_t round = 0; round < 1000; ++round)
+	{
+		for (uint32_t slot = 0; slot < INPUT_RING_MAX_SLOTS; ++slot)
+		{
+			CHECK(InputRingSubmit(&ring, slot) == true);
+			order[slot] = slot;
+		}
+
+		// Fisher-Yates, so every completion order is equally likely.
+		for (uint32_t index = INPUT_RING_MAX_SLOTS - 1; index > 0; --index)
+		{
+			uint32_t other = (uint32_t)(SimulationRandom(&random) % (index + 1));
+			uint32_t swap = order[index];
+
+			order[index] = order[other];
+			order[other] = swap;
+		}
+
+		for (uint32_t index = 0; index < INPUT_RING_MAX_SLOTS; ++index)
+		{
+			uint32_t slot = order[index];
+			uint8_t data = (uint8_t)ring.slotSequence[slot];
+			const input_ring_entry* entry = nullptr;
+
+			InputRingComplete(&ring, slot, 0, &data, sizeof(data), ring.slotSequence[slot]);
+
+			// Nothing is handed on until the oldest read completes, and then everything completed after it is.
+			while ((entry = InputRingPeek(&ring)) != nullptr)
+			{
+				CHECK_EQUAL(entry->sequence, expected);
+				CHECK_EQUAL(entry->timestamp, expected);
+				CHECK_EQUAL(entry->data[0], (uint8_t)expected);
+				InputRingPop(&ring);
+				expected++;
+			}
+		}
+
+		CHECK_EQUAL(ring.deliverSequence, ring.submitSequence);
+	}
+}
+
+/// While the oldest read is outstanding, the others keep cycling until the staging area is full, and then are parked.
+static void TestParkWhileOldestOutstanding(void)
+{
+	input_ring ring = {};
+	uint32_t submitted = 1;
+	uint8_t data = 0;
+
+	InputRingInit(&ring, 2);
+	CHECK(InputRingSubmit(&ring, 0) == true);
+
+	// Slot 1 completes and is re-armed over and over, while slot 0 never completes.
+	while (InputRingSubmit(&ring, 1) == true)
+	{
+		InputRingComplete(&ring, 1, 0, &data, sizeof(data), submitted);
+		CHECK(InputRingPeek(&ring) == nullptr);
+		submitted++;
+	}
+
+	CHECK_EQUAL(submitted, INPUT_RING_STAGING_COUNT);
+	CHECK_EQUAL(ring.parkedSlots, 1u << 1);
+
+	// Once the oldest read completes, the whole backlog drains in order and the parked slot can be submitted again.
+	InputRingComplete(&ring, 0, 0, &data, sizeof(data), 0);
+	for (uint32_t sequence = 0; sequence < INPUT_RING_STAGING_COUNT; ++sequence)
+	{
+		const input_ring_entry* entry = InputRingPeek(&ring);
+
+		CHECK(entry != nullptr);
+		if (entry == nullptr)
+		{
+			return;
+		}
+		CHECK_EQUAL(entry->timestamp, sequence);
+		InputRingPop(&ring);
+	}
+
+	CHECK(InputRingPeek(&ring) == nullptr);
+	CHECK(InputRingSubmit(&ring, 1) == true);
+	CHECK_EQUAL(ring.parkedSlots, 0);
+}
+
+/// A controller that goes quiet after a set number of packets, so a run can drain everything it sent.
+///
+/// `controller` - Produces the packets.
+/// `remaining` - How many more packets it sends.
+typedef struct {
+	xboxone_simulated_controller controller;
+	uint32_t remaining;
+} limited_controller;
+
+/// Produces the next packet of a `limited_controller`, or nothing once it has gone quiet.
+static uint32_t LimitedControllerProduce(void* context, uint64_t timestamp, uint8_t* packet, uint32_t capacity)
+{
+	limited_controller* limited = (limited_controller*)context;
+	uint32_t length = 0;
+
+	if (limited->remaining == 0)
+	{
+		return 0;
+	}
+
+	length = XboxOneSimulatedControllerProduce(&limited->controller, timestamp, packet, capacity);
+	limited->remaining -= (length != 0) ? 1 : 0;
+	return length;
+}
+
+/// Reads completed out of order by the pipe still reach the protocol core in order.
+///
+/// The protocol core only recognizes a repeated report by comparing it with the one before,
+/// so every repeat sent is counted as one exactly when nothing was reordered.
+static void TestSimulatedReordering(uint32_t slotCount, uint64_t jitter, uint32_t reorderRate)
+{
+	xboxone_simulated_controller_config controllerConfig = {
+		.buttonRate = 50000, .guideRate = 2000, .unknownRate = 5000, .repeatRate = 50000, .idleRate = 50000, .stickNoise = 300, .reportSize = 0, .seed = slotCount,
+	};
+	xboxone_simulated_input_config inputConfig = {
+		.slotCount = slotCount,
+		.pipe = { .interval = 1000000, .jitter = jitter, .errorRate = 0, .stallRate = 0, .reorderRate = reorderRate, .seed = jitter + reorderRate },
+		.recovery = PIPE_RECOVERY_DEFAULT_CONFIG,
+		.coalesceWindow = 0,
+		.timed = false,
+	};
+	xboxone_simulated_input* input = (xboxone_simulated_input*)calloc(1, sizeof(xboxone_simulated_input));
+	limited_controller limited = { .controller = {}, .remaining = 20000 };
+	const xboxone_simulated_controller_stats* sent = &limited.controller.stats;
+
+	XboxOneSimulatedControllerInit(&limited.controller, &controllerConfig);
+	XboxOneSimulatedInputInit(input, &inputConfig, &XBOXONE_MODELS[XBOXONE_MODEL_ONE_S], LimitedControllerProduce, &limited);
+	XboxOneSimulatedInputStart(input);
+
+	// Long enough for every packet to be sent, and for the last late completion to arrive.
+	XboxOneSimulatedInputRun(input, 60000000000);
+
+	CHECK(input->pipe.stats.reordered != 0 || reorderRate == 0);
+	CHECK_EQUAL(input->stats.outOfOrder, 0);
+	CHECK_EQUAL(input->stats.packets, 20000);
+	CHECK_EQUAL(input->stats.repeated, sent->repeats);
+	CHECK_EQUAL(input->stats.delivered, sent->buttonReports - sent->repeats + sent->guideReports);
+	CHECK_EQUAL(input->stats.ignored, sent->unknownPackets);
+	CHECK_EQUAL(input->path.ring.deliverSequence, input->stats.completions);
+
+	free(input);
+}
+
+int main(void)
+{
+	TestShuffledCompletions();
+	TestParkWhileOldestOutstanding();
+	TestSimulatedReordering(INPUT_RING_DEFAULT_SLOTS, 0, 0);
+	TestSimulatedReordering(INPUT_RING_DEFAULT_SLOTS, 3000000, 20000);
+	TestSimulatedReordering(INPUT_RING_MAX_SLOTS, 8000000, 100000);
+	TestSimulatedReordering(2, 1500000, 250000);
+	return TestResult("InputRingTests");
+}
@@ -0,0 +1,233 @@
+//
+//  LocationRegistryTests.cpp
+//  Tests
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Checks that removing a device from the location registry shifts the devices after it back into the gap,
+// so every device stays reachable from the slot its location ID hashes to without probing past an empty slot.
+// Location IDs are searched for that hash to the same slot, and to the last slot so their probes wrap around to the first,
+// and random registrations and removals are checked against a plain list of what should be registered.
+//
+
+#include <stdlib.h>
+
+#include <LocationRegistry.h>
+
+#include "SimulationSupport.h"
+#include "TestSupport.h"
+
+/// Fills `locationIDs` with `count` location IDs that all hash to `slot`, starting the search after `after`.
+static void FindColliding(uint32_t slot, uint32_t after, uint32_t* locationIDs, uint32_t count)
+{
+	uint32_t found = 0;
+
+	for (uint32_t locationID = after + 1; found < count; ++locationID)
+	{
+		if (LocationRegistryHash(locationID) == slot)
+		{
+			locationIDs[found++] = locationID;
+		}
+	}
+}
+
+/// A device pointer for a location ID, which is never `nullptr`.
+static void* DeviceFor(uint32_t locationID)
+{
+	return (void*)((uintptr_t)locationID * 16 + 16);
+}
+
+/// Checks that every registered device is reachable from its home slot, with no empty slot on the way, and that the count matches.
+static void CheckProbes(const location_registry* registry)
+{
+	uint32_t count = 0;
+
+	for (uint32_t slot = 0; slot < LOCATION_REGISTRY_SLOTS; ++slot)
+	{
+		const location_registry_slot* entry = &registry->slots[slot];
+
+		if (entry->device == nullptr)
+		{
+			continue;
+		}
+
+		count++;
+		for (uint32_t probe = LocationRegistryHash(entry->locationID); probe != slot; probe = (probe + 1) & (LOCATION_REGISTRY_SLOTS - 1))
+		{
+			if (registry->slots[probe].device == nullptr)
+			{
+				printf("\tslot %u: 0x%08x is past the empty slot %u.\n", slot, entry->locationID, probe);
+				testFailures++;
+				break;
+			}
+		}
+		CHECK(LocationRegistryFind(registry, entry->locationID) == entry->device);
+	}
+
+	CHECK_EQUAL(count, registry->count);
+}
+
+/// Devices that hash to the same slot are all found, and removing any of them leaves the others found.
+static void TestColliding(void)
+{
+	location_registry registry = {};
+	uint32_t locationIDs[4] = {};
+
+	FindColliding(5, 0x14000000, locationIDs, 4);
+
+	for (uint32_t locationID : locationIDs)
+	{
+		CHECK(LocationRegistryInsert(&registry, locationID, DeviceFor(locationID)) == true);
+	}
+	for (uint32_t index = 0; index < 4; ++index)
+	{
+		CHECK(registry.slots[5 + index].locationID == locationIDs[index]);
+	}
+	CheckProbes(&registry);
+
+	// Removing the second shifts the third and fourth back a slot each.
+	LocationRegistryRemove(&registry, locationIDs[1], DeviceFor(locationIDs[1]));
+	CHECK(LocationRegistryFind(&registry, locationIDs[1]) == nullptr);
+	CHECK(registry.slots[6].locationID == locationIDs[2]);
+	CHECK(registry.slots[7].locationID == locationIDs[3]);
+	CHECK(registry.slots[8].device == nullptr);
+	CheckProbes(&registry);
+
+	// Removing the first, which is in its home slot, shifts the rest back again.
+	LocationRegistryRemove(&registry, locationIDs[0], DeviceFor(locationIDs[0]));
+	CHECK(registry.slots[5].locationID == locationIDs[2]);
+	CHECK(registry.slots[6].locationID == locationIDs[3]);
+	CheckProbes(&registry);
+
+	// Removing the last leaves the other alone.
+	LocationRegistryRemove(&registry, locationIDs[3], DeviceFor(locationIDs[3]));
+	CHECK(registry.slots[5].locationID == locationIDs[2]);
+	CHECK(registry.slots[6].device == nullptr);
+	CheckProbes(&registry);
+	CHECK_EQUAL(registry.count, 1);
+}
+
+/// Devices that hash to the last slot wrap around to the first ones, and are shifted back across the end when one before them is removed.
+/// A device whose home is the first slot sits behind them, and may only move back as far as its home.
+static void TestWraparound(void)
+{
+	static constexpr uint32_t kLast = LOCATION_REGISTRY_SLOTS - 1;
+	location_registry registry = {};
+	uint32_t last[3] = {};
+	uint32_t first = 0;
+
+	FindColliding(kLast, 0x14000000, last, 3);
+	FindColliding(0, 0x14000000, &first, 1);
+
+	for (uint32_t locationID : last)
+	{
+		CHECK(LocationRegistryInsert(&registry, locationID, DeviceFor(locationID)) == true);
+	}
+	CHECK(LocationRegistryInsert(&registry, first, DeviceFor(first)) == true);
+
+	CHECK(registry.slots[kLast].locationID == last[0]);
+	CHECK(registry.slots[0].locationID == last[1]);
+	CHECK(registry.slots[1].locationID == last[2]);
+	CHECK(registry.slots[2].locationID == first);
+	CheckProbes(&registry);
+
+	// The two after the end move back across it, and the one whose home is the first slot moves back into it.
+	LocationRegistryRemove(&registry, last[0], DeviceFor(last[0]));
+	CHECK(registry.slots[kLast].locationID == last[1]);
+	CHECK(registry.slots[0].locationID == last[2]);
+	CHECK(registry.slots[1].locationID == first);
+	CHECK(registry.slots[2].device == nullptr);
+	CheckProbes(&registry);
+
+	// Removing the device in the first slot lets the one whose home it is move back into it, while the one in the last slot stays put.
+	LocationRegistryRemove(&registry, last[2], DeviceFor(last[2]));
+	CHECK(registry.slots[kLast].locationID == last[1]);
+	CHECK(registry.slots[0].locationID == first);
+	CHECK(registry.slots[1].device == nullptr);
+	CheckProbes(&registry);
+	CHECK_EQUAL(registry.count, 2);
+}
+
+/// A second device at the same location ID is refused, removing with the wrong device does nothing, and a full registry refuses more.
+static void TestRefusals(void)
+{
+	location_registry* registry = (location_registry*)calloc(1, sizeof(location_registry));
+	uint32_t locationID = 0x14100000;
+
+	CHECK(LocationRegistryInsert(registry, locationID, DeviceFor(locationID)) == true);
+	CHECK(LocationRegistryInsert(registry, locationID, DeviceFor(locationID + 1)) == false);
+	LocationRegistryRemove(registry, locationID, DeviceFor(locationID + 1));
+	CHECK(LocationRegistryFind(registry, locationID) == DeviceFor(locationID));
+	LocationRegistryRemove(registry, locationID + 1, DeviceFor(locationID));
+	CHECK_EQUAL(registry->count, 1);
+
+	for (uint32_t index = 1; index < LOCATION_REGISTRY_MAX_DEVICES; ++index)
+	{
+		CHECK(LocationRegistryInsert(registry, locationID + (index << 20), DeviceFor(locationID + (index << 20))) == true);
+	}
+	CHECK(LocationRegistryInsert(registry, 0x20000000, DeviceFor(0x20000000)) == false);
+	CHECK_EQUAL(registry->count, LOCATION_REGISTRY_MAX_DEVICES);
+	CheckProbes(registry);
+
+	free(registry);
+}
+
+/// Random registrations and removals, crowded into a few home slots so that probes run long and wrap, always find exactly the devices registered.
+static void TestRandomChurn(void)
+{
+	static constexpr uint32_t kCandidates = 96;
+	location_registry* registry = (location_registry*)calloc(1, sizeof(location_registry));
+	uint32_t locationIDs[kCandidates] = {};
+	bool registered[kCandidates] = {};
+	uint64_t random = 0;
+
+	// A third of the candidates hash to each of the last slot, the first slot, and a slot in the middle.
+	FindColliding(LOCATION_REGISTRY_SLOTS - 1, 0x14000000, &locationIDs[0], kCandidates / 3);
+	FindColliding(0, 0x14000000, &locationIDs[kCandidates / 3], kCandidates / 3);
+	FindColliding(LOCATION_REGISTRY_SLOTS / 2, 0x14000000, &locationIDs[2 * kCandidates / 3], kCandidates / 3);
+	SimulationSeed(&random, 7);
+
+	for (uint32_t step = 0; step < 20000; ++step)
+	{
+		uint32_t index = (uint32_t)(SimulationRandom(&random) % kCandidates);
+		uint32_t locationID = locationIDs[index];
+
+		if (registered[index] == true)
+		{
+			LocationRegistryRemove(registry, locationID, DeviceFor(locationID));
+			registered[index] = false;
+		}
+		else
+		{
+			registered[index] = LocationRegistryInsert(registry, locationID, DeviceFor(locationID));
+			CHECK(registered[index] == true || registry->count == LOCATION_REGISTRY_MAX_DEVICES);
+		}
+
+		for (uint32_t candidate = 0; candidate < kCandidates; ++candidate)
+		{
+			void* expected = (registered[candidate] == true) ? DeviceFor(locationIDs[candidate]) : nullptr;
+
+			if (LocationRegistryFind(registry, locationIDs[candidate]) != expected)
+			{
+				printf("\tstep %u: 0x%08x is %s, but not found that way.\n", step, locationIDs[candidate], (expected != nullptr) ? "registered" : "removed");
+				testFailures++;
+			}
+		}
+		if (step % 64 == 0)
+		{
+			CheckProbes(registry);
+		}
+	}
+
+	free(registry);
+}
+
+int main(void)
+{
+	TestColliding();
+	TestWraparound();
+	TestRefusals();
+	TestRandomChurn();
+	return TestResult("LocationRegistryTests");
+}
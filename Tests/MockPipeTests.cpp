@@ -0,0 +1,143 @@
+//
+//  MockPipeTests.cpp
+//  Tests
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Checks that the simulated pipe behaves like the real one where the input path depends on it,
+// and that a simulation is repeatable, since every other test and benchmark relies on both.
+//
+
+#include <stdlib.h>
+
+#include "MockPipe.h"
+#include "TestSupport.h"
+#include "XboxOneSimulatedController.h"
+#include "XboxOneSimulatedInput.h"
+
+/// A device that always sends a packet holding how many times it was polled.
+static uint32_t CountingDevice(void* context, uint64_t timestamp, uint8_t* packet, uint32_t capacity)
+{
+	uint32_t* polls = (uint32_t*)context;
+
+	(void)timestamp;
+	(void)capacity;
+
+	packet[0] = (uint8_t)(*polls)++;
+	return 1;
+}
+
+/// Reads complete one poll apart in submission order, and reach the caller in submission order without jitter.
+static void TestPolling(void)
+{
+	mock_pipe_config config = { .interval = 1000, .jitter = 0, .errorRate = 0, .stallRate = 0, .reorderRate = 0, .seed = 1 };
+	mock_pipe pipe = {};
+	mock_pipe_completion completion = {};
+	uint8_t buffers[4][8] = {};
+	uint32_t polls = 0;
+
+	MockPipeInit(&pipe, &config, CountingDevice, &polls, 0);
+	for (uint32_t slot = 0; slot < 4; ++slot)
+	{
+		CHECK_EQUAL(MockPipeSubmit(&pipe, slot, buffers[slot], sizeof(buffers[slot])), MOCK_PIPE_SUCCESS);
+	}
+
+	CHECK_EQUAL(MockPipeNextEvent(&pipe), 1000);
+	MockPipePoll(&pipe, 4000);
+
+	for (uint32_t slot = 0; slot < 4; ++slot)
+	{
+		CHECK(MockPipeTake(&pipe, 4000, &completion) == true);
+		CHECK_EQUAL(completion.slot, slot);
+		CHECK_EQUAL(completion.status, MOCK_PIPE_SUCCESS);
+		CHECK_EQUAL(completion.timestamp, 1000 * (slot + 1));
+		CHECK_EQUAL(buffers[slot][0], slot);
+	}
+
+	CHECK(MockPipeTake(&pipe, 4000, &completion) == false);
+	CHECK_EQUAL(MockPipeNextEvent(&pipe), UINT64_MAX);
+}
+
+/// A stall fails every outstanding read, and clearing it aborts the reads submitted since.
+static void TestStall(void)
+{
+	mock_pipe_config config = { .interval = 1000, .jitter = 0, .errorRate = 0, .stallRate = 0, .reorderRate = 0, .seed = 1 };
+	mock_pipe pipe = {};
+	mock_pipe_completion completion = {};
+	uint8_t buffer[8] = {};
+	uint32_t polls = 0;
+
+	MockPipeInit(&pipe, &config, CountingDevice, &polls, 0);
+	MockPipeInjectErrors(&pipe, 1, MOCK_PIPE_STALLED);
+	MockPipeSubmit(&pipe, 0, buffer, sizeof(buffer));
+	MockPipeSubmit(&pipe, 1, buffer, sizeof(buffer));
+	MockPipePoll(&pipe, 1000);
+
+	CHECK(MockPipeTake(&pipe, 1000, &completion) == true);
+	CHECK_EQUAL(completion.status, MOCK_PIPE_STALLED);
+	CHECK(MockPipeTake(&pipe, 1000, &completion) == true);
+	CHECK_EQUAL(completion.status, MOCK_PIPE_STALLED);
+	CHECK_EQUAL(MockPipeClassify(completion.status), PIPE_ERROR_STALL);
+
+	MockPipeSubmit(&pipe, 2, buffer, sizeof(buffer));
+	MockPipeClearStall(&pipe, 1500);
+	CHECK(MockPipeTake(&pipe, 1500, &completion) == true);
+	CHECK_EQUAL(completion.status, MOCK_PIPE_ABORTED);
+	CHECK_EQUAL(polls, 0);
+
+	MockPipeSubmit(&pipe, 3, buffer, sizeof(buffer));
+	MockPipePoll(&pipe, 2000);
+	CHECK(MockPipeTake(&pipe, 2000, &completion) == true);
+	CHECK_EQUAL(completion.status, MOCK_PIPE_SUCCESS);
+}
+
+/// Two runs of the input path with the same seeds deliver the same reports, and every packet is handled in order despite jitter and reordering.
+static void TestRepeatable(void)
+{
+	xboxone_simulated_controller_config controllerConfig = {
+		.buttonRate = 50000, .guideRate = 1000, .unknownRate = 5000, .repeatRate = 10000, .idleRate = 20000, .stickNoise = 300, .reportSize = 0, .seed = 7,
+	};
+	xboxone_simulated_input_config inputConfig = {
+		.slotCount = 4,
+		.pipe = { .interval = 1000000, .jitter = 3000000, .errorRate = 2000, .stallRate = 500, .reorderRate = 20000, .seed = 11 },
+		.recovery = PIPE_RECOVERY_DEFAULT_CONFIG,
+		.coalesceWindow = 0,
+		.timed = false,
+	};
+	xboxone_simulated_input* runs[2] = {
+		(xboxone_simulated_input*)calloc(1, sizeof(xboxone_simulated_input)),
+		(xboxone_simulated_input*)calloc(1, sizeof(xboxone_simulated_input)),
+	};
+	xboxone_simulated_controller controllers[2] = {};
+
+	for (uint32_t run = 0; run < 2; ++run)
+	{
+		XboxOneSimulatedControllerInit(&controllers[run], &controllerConfig);
+		XboxOneSimulatedInputInit(runs[run], &inputConfig, &XBOXONE_MODELS[XBOXONE_MODEL_ONE_S], XboxOneSimulatedControllerProduce, &controllers[run]);
+		XboxOneSimulatedInputStart(runs[run]);
+		XboxOneSimulatedInputRun(runs[run], 20000000000);
+	}
+
+	CHECK(runs[0]->stats.packets > 10000);
+	CHECK(runs[0]->pipe.stats.reordered != 0);
+	CHECK(runs[0]->pipe.stats.stalls != 0);
+	CHECK_EQUAL(runs[0]->stats.outOfOrder, 0);
+	CHECK_EQUAL(runs[0]->stats.packets, runs[1]->stats.packets);
+	CHECK_EQUAL(runs[0]->stats.handleReports, runs[1]->stats.handleReports);
+	CHECK_EQUAL(runs[0]->stats.reportHash, runs[1]->stats.reportHash);
+
+	// Every packet handled is given exactly one verdict.
+	CHECK_EQUAL(runs[0]->stats.repeated + runs[0]->stats.delivered + runs[0]->stats.suppressed + runs[0]->stats.ignored, runs[0]->stats.packets);
+
+	free(runs[0]);
+	free(runs[1]);
+}
+
+int main(void)
+{
+	TestPolling();
+	TestStall();
+	TestRepeatable();
+	return TestResult("MockPipeTests");
+}
@@ -0,0 +1,289 @@
+//
+//  PipeRecoveryTests.cpp
+//  Tests
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Checks how `pipe_recovery` responds to sequences of failed reads: the back-off doubling up to its maximum,
+// stalls being cleared, the pipe parking after too many failures in a row, and a parked pipe coming back one failure short of parking again.
+// The last tests inject the same failures into the simulated pipe, to check that the input path carries out what recovery decides,
+// and that a disabled input path leaves its slots idle even when recovery resumes the pipe.
+//
+
+#include <stdlib.h>
+
+#include <PipeRecovery.h>
+
+#include "MockPipe.h"
+#include "TestSupport.h"
+#include "XboxOneSimulatedController.h"
+#include "XboxOneSimulatedInput.h"
+
+/// A short back-off, in arbitrary ticks, that reaches its maximum before the pipe parks.
+static const pipe_recovery_config kConfig = { .baseDelay = 8, .maxDelay = 200, .parkAfter = 8, .parkDelay = 10000 };
+
+/// Completes a read with `error` at `now`, checking the action and the delay it returns.
+static void CheckComplete(pipe_recovery* recovery, pipe_error_class error, uint64_t now, pipe_recovery_action action, uint64_t delay)
+{
+	uint64_t actualDelay = UINT64_MAX;
+
+	CHECK_EQUAL(PipeRecoveryComplete(recovery, error, now, &actualDelay), action);
+	CHECK_EQUAL(actualDelay, delay);
+}
+
+/// Every transient failure in a row doubles the delay up to the maximum, reads of the same incident wait without counting, and a success starts over.
+static void TestBackoffDoubling(void)
+{
+	static const uint64_t kDelays[] = { 8, 16, 32, 64, 128, 200, 200 };
+	pipe_recovery recovery = {};
+	uint64_t now = 0;
+
+	PipeRecoveryInit(&recovery, &kConfig, now);
+
+	for (uint32_t failure = 0; failure < sizeof(kDelays) / sizeof(kDelays[0]); ++failure)
+	{
+		CheckComplete(&recovery, PIPE_ERROR_TRANSIENT, now, PIPE_RECOVERY_BACKOFF_FOR, kDelays[failure]);
+		CHECK_EQUAL(recovery.stats.state, PIPE_RECOVERY_BACKOFF);
+		CHECK(PipeRecoveryCanArm(&recovery) == false);
+
+		// Another read failing before the timer fires belongs to the same incident.
+		CheckComplete(&recovery, PIPE_ERROR_TRANSIENT, now + 1, PIPE_RECOVERY_WAIT, 0);
+		CHECK_EQUAL(recovery.stats.failures, failure + 1);
+
+		now += kDelays[failure];
+		CHECK(PipeRecoveryResume(&recovery, now) == true);
+		CHECK_EQUAL(recovery.stats.state, PIPE_RECOVERY_HEALTHY);
+	}
+
+	CHECK_EQUAL(recovery.stats.backoffs, 7);
+	CHECK_EQUAL(recovery.stats.parks, 0);
+
+	// A successful read resets the count, so the next failure backs off for the base delay again.
+	CheckComplete(&recovery, PIPE_ERROR_NONE, now, PIPE_RECOVERY_REARM, 0);
+	CHECK_EQUAL(recovery.stats.failures, 0);
+	CheckComplete(&recovery, PIPE_ERROR_TRANSIENT, now, PIPE_RECOVERY_BACKOFF_FOR, 8);
+
+	// The timer ends the back-off, and resuming a pipe that is already healthy does nothing.
+	CHECK(PipeRecoveryResume(&recovery, now + 8) == true);
+	CHECK(PipeRecoveryResume(&recovery, now + 8) == false);
+}
+
+/// A stall is cleared after the back-off delay, and reads aborted by clearing it neither count as failures nor end the incident.
+static void TestStallClear(void)
+{
+	pipe_recovery recovery = {};
+	pipe_recovery_stats stats = {};
+
+	PipeRecoveryInit(&recovery, &kConfig, 0);
+
+	CheckComplete(&recovery, PIPE_ERROR_STALL, 100, PIPE_RECOVERY_CLEAR_STALL, 8);
+	CHECK_EQUAL(recovery.stats.state, PIPE_RECOVERY_CLEARING);
+	CHECK_EQUAL(recovery.stats.stallClears, 1);
+
+	// Every read outstanding when the stall is cleared is aborted, and waits for the pipe to resume.
+	CheckComplete(&recovery, PIPE_ERROR_CANCELED, 101, PIPE_RECOVERY_WAIT, 0);
+	CheckComplete(&recovery, PIPE_ERROR_STALL, 102, PIPE_RECOVERY_WAIT, 0);
+	CHECK_EQUAL(recovery.stats.failures, 1);
+	CHECK_EQUAL(recovery.stats.stallClears, 1);
+
+	CHECK(PipeRecoveryResume(&recovery, 108) == true);
+	CHECK_EQUAL(recovery.stats.state, PIPE_RECOVERY_HEALTHY);
+
+	// An aborted read on a healthy pipe is re-armed without counting as a failure.
+	CheckComplete(&recovery, PIPE_ERROR_CANCELED, 110, PIPE_RECOVERY_REARM, 0);
+	CHECK_EQUAL(recovery.stats.failures, 1);
+
+	// A second stall in a row doubles the delay, as any other failure does.
+	CheckComplete(&recovery, PIPE_ERROR_STALL, 120, PIPE_RECOVERY_CLEAR_STALL, 16);
+	CHECK_EQUAL(recovery.stats.stallClears, 2);
+	CHECK_EQUAL(recovery.stats.backoffs, 0);
+
+	PipeRecoveryRead(&recovery, 130, &stats);
+	CHECK_EQUAL(stats.stateTime[PIPE_RECOVERY_HEALTHY], 100 + 12);
+	CHECK_EQUAL(stats.stateTime[PIPE_RECOVERY_CLEARING], 8 + 10);
+}
+
+/// The eighth failure in a row parks the pipe for the cool-down, whatever mix of failures it was, and a fatal error parks it at once.
+static void TestPark(void)
+{
+	pipe_recovery recovery = {};
+	uint64_t now = 0;
+	uint64_t delay = 0;
+
+	PipeRecoveryInit(&recovery, &kConfig, now);
+
+	for (uint32_t failure = 0; failure < kConfig.parkAfter - 1; ++failure)
+	{
+		pipe_error_class error = (failure % 2 == 0) ? PIPE_ERROR_TRANSIENT : PIPE_ERROR_STALL;
+
+		CHECK(PipeRecoveryComplete(&recovery, error, now, &delay) != PIPE_RECOVERY_PARK);
+		now += delay;
+		CHECK(PipeRecoveryResume(&recovery, now) == true);
+	}
+
+	CheckComplete(&recovery, PIPE_ERROR_TRANSIENT, now, PIPE_RECOVERY_PARK, kConfig.parkDelay);
+	CHECK_EQUAL(recovery.stats.state, PIPE_RECOVERY_PARKED);
+	CHECK_EQUAL(recovery.stats.failures, kConfig.parkAfter);
+	CHECK_EQUAL(recovery.stats.parks, 1);
+	CHECK_EQUAL(recovery.stats.backoffs + recovery.stats.stallClears, kConfig.parkAfter - 1);
+	CheckComplete(&recovery, PIPE_ERROR_TRANSIENT, now + 1, PIPE_RECOVERY_WAIT, 0);
+
+	PipeRecoveryInit(&recovery, &kConfig, 0);
+	CheckComplete(&recovery, PIPE_ERROR_FATAL, 0, PIPE_RECOVERY_PARK, kConfig.parkDelay);
+	CHECK_EQUAL(recovery.stats.parks, 1);
+	CHECK_EQUAL(recovery.stats.backoffs, 0);
+
+	// Once stopped, nothing resumes the pipe.
+	PipeRecoveryStop(&recovery, 1);
+	CHECK(PipeRecoveryResume(&recovery, kConfig.parkDelay) == false);
+	CHECK_EQUAL(recovery.stats.state, PIPE_RECOVERY_STOPPED);
+}
+
+/// A pipe resumed from parking is one failure short of parking again, so a single failed trial read parks it for another cool-down.
+static void TestReparkAfterCooldown(void)
+{
+	pipe_recovery recovery = {};
+	uint64_t delay = 0;
+
+	PipeRecoveryInit(&recovery, &kConfig, 0);
+	for (uint32_t failure = 0; failure < kConfig.parkAfter - 1; ++failure)
+	{
+		PipeRecoveryComplete(&recovery, PIPE_ERROR_TRANSIENT, 0, &delay);
+		PipeRecoveryResume(&recovery, 0);
+	}
+	CheckComplete(&recovery, PIPE_ERROR_TRANSIENT, 0, PIPE_RECOVERY_PARK, kConfig.parkDelay);
+
+	// The trial read after the cool-down fails, and the pipe parks again rather than backing off.
+	CHECK(PipeRecoveryResume(&recovery, kConfig.parkDelay) == true);
+	CHECK_EQUAL(recovery.stats.state, PIPE_RECOVERY_HEALTHY);
+	CHECK_EQUAL(recovery.stats.failures, kConfig.parkAfter - 1);
+	CheckComplete(&recovery, PIPE_ERROR_TRANSIENT, kConfig.parkDelay, PIPE_RECOVERY_PARK, kConfig.parkDelay);
+	CHECK_EQUAL(recovery.stats.parks, 2);
+
+	// This time the trial read succeeds, and the next failure only backs off for the base delay.
+	CHECK(PipeRecoveryResume(&recovery, 2 * kConfig.parkDelay) == true);
+	CheckComplete(&recovery, PIPE_ERROR_NONE, 2 * kConfig.parkDelay, PIPE_RECOVERY_REARM, 0);
+	CHECK_EQUAL(recovery.stats.failures, 0);
+	CheckComplete(&recovery, PIPE_ERROR_TRANSIENT, 2 * kConfig.parkDelay, PIPE_RECOVERY_BACKOFF_FOR, kConfig.baseDelay);
+	CHECK_EQUAL(recovery.stats.parks, 2);
+}
+
+/// Failures injected into the simulated pipe back the input path off, park it, and let it read again after the cool-down.
+static void TestInjectedErrors(void)
+{
+	xboxone_simulated_controller_config controllerConfig = {
+		.buttonRate = 0, .guideRate = 0, .unknownRate = 0, .repeatRate = 0, .idleRate = 0, .stickNoise = 300, .reportSize = 0, .seed = 3,
+	};
+	// A single slot, so every injected failure is a failure in a row rather than a read of the same incident.
+	xboxone_simulated_input_config inputConfig = {
+		.slotCount = 1,
+		.pipe = { .interval = 1000000, .jitter = 0, .errorRate = 0, .stallRate = 0, .reorderRate = 0, .seed = 5 },
+		.recovery = PIPE_RECOVERY_DEFAULT_CONFIG,
+		.coalesceWindow = 0,
+		.timed = false,
+	};
+	xboxone_simulated_input* input = (xboxone_simulated_input*)calloc(1, sizeof(xboxone_simulated_input));
+	xboxone_simulated_controller controller = {};
+	pipe_recovery_stats stats = {};
+	uint64_t backingOff = 0;
+
+	XboxOneSimulatedControllerInit(&controller, &controllerConfig);
+	XboxOneSimulatedInputInit(input, &inputConfig, &XBOXONE_MODELS[XBOXONE_MODEL_ONE_S], XboxOneSimulatedControllerProduce, &controller);
+	MockPipeInjectErrors(&input->pipe, inputConfig.recovery.parkAfter, MOCK_PIPE_TRANSIENT);
+	XboxOneSimulatedInputStart(input);
+
+	// Seven back-offs of 8 to 512 ms, then the cool-down, then a second of reads.
+	XboxOneSimulatedInputRun(input, 12000000000);
+	PipeRecoveryRead(&input->path.recovery, input->now, &stats);
+
+	for (uint32_t failure = 0; failure < inputConfig.recovery.parkAfter - 1; ++failure)
+	{
+		backingOff += inputConfig.recovery.baseDelay << failure;
+	}
+
+	CHECK_EQUAL(input->stats.errors, inputConfig.recovery.parkAfter);
+	CHECK_EQUAL(stats.backoffs, inputConfig.recovery.parkAfter - 1);
+	CHECK_EQUAL(stats.parks, 1);
+	CHECK_EQUAL(stats.state, PIPE_RECOVERY_HEALTHY);
+	CHECK_EQUAL(stats.failures, 0);
+	CHECK_EQUAL(stats.stateTime[PIPE_RECOVERY_BACKOFF], backingOff);
+	CHECK_EQUAL(stats.stateTime[PIPE_RECOVERY_PARKED], inputConfig.recovery.parkDelay);
+	CHECK(input->stats.delivered > 0);
+	CHECK_EQUAL(input->stats.outOfOrder, 0);
+
+	free(input);
+}
+
+/// The number of reads outstanding on the simulated pipe.
+static uint32_t OutstandingReads(const mock_pipe* pipe)
+{
+	uint32_t outstanding = 0;
+
+	for (uint32_t index = 0; index < pipe->readCount; ++index)
+	{
+		outstanding += (pipe->reads[index].completed == false) ? 1 : 0;
+	}
+
+	return outstanding;
+}
+
+/// Disabling the input path leaves every slot idle, even when the recovery timer fires in the meantime, and enabling it reads again.
+static void TestDisabledRecovery(void)
+{
+	xboxone_simulated_controller_config controllerConfig = {
+		.buttonRate = 0, .guideRate = 0, .unknownRate = 0, .repeatRate = 0, .idleRate = 0, .stickNoise = 300, .reportSize = 0, .seed = 3,
+	};
+	xboxone_simulated_input_config inputConfig = {
+		.slotCount = 2,
+		.pipe = { .interval = 1000000, .jitter = 0, .errorRate = 0, .stallRate = 0, .reorderRate = 0, .seed = 5 },
+		.recovery = PIPE_RECOVERY_DEFAULT_CONFIG,
+		.coalesceWindow = 0,
+		.timed = false,
+	};
+	xboxone_simulated_input* input = (xboxone_simulated_input*)calloc(1, sizeof(xboxone_simulated_input));
+	xboxone_simulated_controller controller = {};
+	uint64_t packets = 0;
+
+	XboxOneSimulatedControllerInit(&controller, &controllerConfig);
+	XboxOneSimulatedInputInit(input, &inputConfig, &XBOXONE_MODELS[XBOXONE_MODEL_ONE_S], XboxOneSimulatedControllerProduce, &controller);
+	XboxOneSimulatedInputStart(input);
+	XboxOneSimulatedInputRun(input, 100000000);
+	CHECK(input->stats.packets > 0);
+
+	// A failed read backs the pipe off, and the driver is disabled before the recovery timer fires.
+	MockPipeInjectErrors(&input->pipe, 1, MOCK_PIPE_TRANSIENT);
+	XboxOneSimulatedInputRun(input, input->now + 2000000);
+	CHECK_EQUAL(input->path.recovery.stats.state, PIPE_RECOVERY_BACKOFF);
+	CHECK(input->recoveryArmed == true);
+	XboxOneSimulatedInputSetEnable(input, false);
+	packets = input->stats.packets;
+
+	// The timer resumes the pipe, but re-arms nothing while the driver is disabled.
+	XboxOneSimulatedInputRun(input, input->now + 1000000000);
+	CHECK_EQUAL(input->path.recovery.stats.state, PIPE_RECOVERY_HEALTHY);
+	CHECK_EQUAL(input->path.idleSlots, (1u << inputConfig.slotCount) - 1);
+	CHECK_EQUAL(OutstandingReads(&input->pipe), 0);
+	CHECK_EQUAL(input->stats.packets, packets);
+
+	// Enabling re-arms every slot at once.
+	XboxOneSimulatedInputSetEnable(input, true);
+	CHECK_EQUAL(input->path.idleSlots, 0);
+	CHECK_EQUAL(OutstandingReads(&input->pipe), inputConfig.slotCount);
+	XboxOneSimulatedInputRun(input, input->now + 100000000);
+	CHECK(input->stats.packets > packets);
+	CHECK_EQUAL(input->stats.outOfOrder, 0);
+
+	free(input);
+}
+
+int main(void)
+{
+	TestBackoffDoubling();
+	TestStallClear();
+	TestPark();
+	TestReparkAfterCooldown();
+	TestInjectedErrors();
+	TestDisabledRecovery();
+	return TestResult("PipeRecoveryTests");
+}
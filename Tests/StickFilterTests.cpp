@@ -0,0 +1,205 @@
+//
+//  StickFilterTests.cpp
+//  Tests
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Checks the latency the stick filter adds to a step of the stick, against a One Euro filter computed in double precision with the same parameters.
+// Latency is counted in reports from the step until the output has covered 90% of it, with a report every millisecond as the controller sends them.
+// With `beta` at 0 the filter is a plain low-pass filter, whose latency follows from its smoothing factor alone.
+// Also checks that the fixed-point output tracks the reference report by report, and that lanes which are not filtered pass through.
+//
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "TestSupport.h"
+#include "XboxOneStickFilter.h"
+
+/// The time between reports, in nanoseconds, which is also the clock the plans are compiled for.
+static constexpr uint64_t kInterval = 1000000;
+
+/// The most reports a step may take to settle before the test gives up on it.
+static constexpr uint32_t kMaxReports = 5000;
+
+/// The furthest the fixed-point output may be from the reference, in counts, at any report.
+static constexpr double kTolerance = 8.0;
+
+/// The One Euro filter of one lane, in double precision, with the units of `xboxone_stick_filter_config`.
+///
+/// `primed` - Whether the filter has seen a sample yet.
+/// `value` - The filtered value.
+/// `speed` - The filtered speed, in counts per second.
+typedef struct {
+	bool primed;
+	double value;
+	double speed;
+} reference_filter;
+
+/// The smoothing factor of a low-pass filter with a cutoff of `cutoff` hertz, for samples `interval` seconds apart.
+static double ReferenceAlpha(double cutoff, double interval)
+{
+	return 1.0 / (1.0 + 1.0 / (2.0 * M_PI * cutoff * interval));
+}
+
+/// Filters one sample `interval` seconds after the last one.
+static double ReferenceFilter(reference_filter* filter, const xboxone_stick_filter_config* config, double input, double interval)
+{
+	if (filter->primed == false)
+	{
+		filter->primed = true;
+		filter->value = input;
+		filter->speed = 0.0;
+		return input;
+	}
+
+	double speed = (input - filter->value) / interval;
+	double maxCutoff = XBOXONE_STICK_FILTER_MAX_CUTOFF / 1000.0;
+
+	filter->speed += (speed - filter->speed) * ReferenceAlpha(config->derivativeCutoff / 1000.0, interval);
+
+	double cutoff = config->minCutoff / 1000.0 + fabs(filter->speed) * config->beta / 1000000.0;
+	cutoff = (cutoff < maxCutoff) ? cutoff : maxCutoff;
+
+	filter->value += (input - filter->value) * ReferenceAlpha(cutoff, interval);
+	return filter->value;
+}
+
+/// Steps every stick lane from `from` to `to`, returning how many reports after the step each filter took to cover 90% of it.
+///
+/// The stick rests at `from` for a second first, so the filters start the step settled.
+static void MeasureStep(const xboxone_stick_filter_config* config, int16_t from, int16_t to, uint32_t* reports, uint32_t* referenceReports)
+{
+	xboxone_stick_filter_plan plan = {};
+	xboxone_stick_filter filter = {};
+	reference_filter reference = {};
+	double threshold = from + 0.9 * (to - from);
+	double worst = 0.0;
+	uint64_t timestamp = 0;
+
+	CHECK(XboxOneCompileStickFilter(config, 1, 1, &plan) == true);
+	*reports = kMaxReports;
+	*referenceReports = kMaxReports;
+
+	for (uint32_t index = 0; index < 1000 + kMaxReports; ++index)
+	{
+		int16_t input = (index < 1000) ? from : to;
+		xboxone_button_report report = {};
+		double expected = 0.0;
+
+		report.leftX = input;
+		report.leftY = input;
+		report.rightX = input;
+		report.rightY = input;
+		timestamp += kInterval;
+
+		XboxOneApplyStickFilter(&filter, &plan, &report, timestamp);
+		expected = ReferenceFilter(&reference, config, input, kInterval / 1e9);
+
+		// Every filtered lane gets the same input, so every lane must give the same output.
+		CHECK(report.leftY == report.leftX && report.rightX == report.leftX && report.rightY == report.leftX);
+		worst = (fabs(report.leftX - expected) > worst) ? fabs(report.leftX - expected) : worst;
+
+		if (index < 1000)
+		{
+			continue;
+		}
+		if (*reports == kMaxReports && (to - from) * (report.leftX - threshold) >= 0)
+		{
+			*reports = index - 1000 + 1;
+		}
+		if (*referenceReports == kMaxReports && (to - from) * (expected - threshold) >= 0)
+		{
+			*referenceReports = index - 1000 + 1;
+		}
+	}
+
+	if (worst > kTolerance)
+	{
+		printf("\tstep %d to %d: output is %.1f counts from the reference at worst.\n", from, to, worst);
+		testFailures++;
+	}
+}
+
+/// With `beta` at 0, a step settles in the number of reports that follows from the smoothing factor: the smallest n with (1 - alpha)^n <= 0.1.
+static void TestLowPassStep(void)
+{
+	static const uint32_t kCutoffs[] = { 1000, 5000, 20000 };
+
+	for (uint32_t cutoff : kCutoffs)
+	{
+		xboxone_stick_filter_config config = { XBOXONE_STICK_FILTER_VERSION, 1, 0x0f, {}, cutoff, 0, 1000 };
+		double alpha = ReferenceAlpha(cutoff / 1000.0, kInterval / 1e9);
+		uint32_t expected = (uint32_t)ceil(log(0.1) / log(1.0 - alpha));
+		uint32_t reports = 0;
+		uint32_t referenceReports = 0;
+
+		MeasureStep(&config, 0, 20000, &reports, &referenceReports);
+		CHECK_EQUAL(referenceReports, expected);
+		CHECK(reports + 1 >= expected && reports <= expected + 1);
+	}
+}
+
+/// With `beta` set, a fast step raises the cutoff, so it settles much sooner than the same filter without `beta`, and in step with the reference.
+static void TestAdaptiveStep(void)
+{
+	xboxone_stick_filter_config slow = { XBOXONE_STICK_FILTER_VERSION, 1, 0x0f, {}, 1000, 0, 1000 };
+	xboxone_stick_filter_config adaptive = { XBOXONE_STICK_FILTER_VERSION, 1, 0x0f, {}, 1000, 7000, 1000 };
+	uint32_t slowReports = 0;
+	uint32_t reports = 0;
+	uint32_t referenceReports = 0;
+
+	MeasureStep(&slow, 0, 20000, &slowReports, &referenceReports);
+	MeasureStep(&adaptive, 0, 20000, &reports, &referenceReports);
+	CHECK(reports + 1 >= referenceReports && reports <= referenceReports + 1);
+	CHECK(reports * 10 < slowReports);
+
+	// A step down settles just as fast as a step up.
+	MeasureStep(&adaptive, 20000, 0, &reports, &referenceReports);
+	CHECK(reports + 1 >= referenceReports && reports <= referenceReports + 1);
+	CHECK(reports * 10 < slowReports);
+}
+
+/// Lanes that are not filtered pass through untouched, and the first report after starting over passes through whole.
+static void TestPassThrough(void)
+{
+	xboxone_stick_filter_config config = { XBOXONE_STICK_FILTER_VERSION, 1, 0x05, {}, 1000, 0, 1000 };
+	xboxone_stick_filter_plan plan = {};
+	xboxone_stick_filter filter = {};
+	xboxone_button_report report = {};
+
+	CHECK(XboxOneCompileStickFilter(&config, 1, 1, &plan) == true);
+
+	report.leftX = 100;
+	report.leftY = -200;
+	report.rightX = 300;
+	report.rightY = -400;
+	XboxOneApplyStickFilter(&filter, &plan, &report, kInterval);
+	CHECK_EQUAL(report.leftX, 100);
+	CHECK_EQUAL(report.leftY, -200);
+
+	report.leftX = 20000;
+	report.leftY = 20000;
+	report.rightX = 20000;
+	report.rightY = 20000;
+	XboxOneApplyStickFilter(&filter, &plan, &report, 2 * kInterval);
+	CHECK(report.leftX > 100 && report.leftX < 20000);
+	CHECK_EQUAL(report.leftY, 20000);
+	CHECK(report.rightX > 300 && report.rightX < 20000);
+	CHECK_EQUAL(report.rightY, 20000);
+
+	// A disabled plan leaves every lane alone.
+	plan.enabled = false;
+	report.leftX = 5;
+	XboxOneApplyStickFilter(&filter, &plan, &report, 3 * kInterval);
+	CHECK_EQUAL(report.leftX, 5);
+}
+
+int main(void)
+{
+	TestLowPassStep();
+	TestAdaptiveStep();
+	TestPassThrough();
+	return TestResult("StickFilterTests");
+}
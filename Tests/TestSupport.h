@@ -0,0 +1,59 @@
+//
+//  TestSupport.h
+//  Tests
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// The checks shared by the tests, which are plain executables registered with CTest.
+// A failed check prints where it failed and carries on, and the test exits with a failure if any check failed.
+//
+
+#ifndef TestSupport_h
+#define TestSupport_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/// The number of checks that failed so far.
+inline uint32_t testFailures = 0;
+
+/// Checks that a condition holds, printing it with its location if it does not.
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			testFailures++; \
+		} \
+	} while (0)
+
+/// Checks that two integers are equal, printing both if they are not.
+#define CHECK_EQUAL(actual, expected) \
+	do \
+	{ \
+		unsigned long long actualValue = (unsigned long long)(actual); \
+		unsigned long long expectedValue = (unsigned long long)(expected); \
+		if (actualValue != expectedValue) \
+		{ \
+			printf("%s:%d: check failed: %s is %llu, expected %s, %llu\n", __FILE__, __LINE__, #actual, actualValue, #expected, expectedValue); \
+			testFailures++; \
+		} \
+	} while (0)
+
+/// Prints the outcome of a test, and returns what `main` should.
+inline int TestResult(const char* name)
+{
+	if (testFailures != 0)
+	{
+		printf("%s: %u checks failed.\n", name, testFailures);
+		return EXIT_FAILURE;
+	}
+
+	printf("%s: passed.\n", name);
+	return EXIT_SUCCESS;
+}
+
+#endif /* TestSupport_h */
@@ -6,24 +6,590 @@
 //
 // Abstract:
 // A simple C++ program to communicate with the driver's UserClient.
+// Run with no arguments to enable the driver, or with `metrics [seconds]` to poll the driver's counters and print their rates.
+// Run with `bench [iterations]` to compare applying settings one selector call at a time against a single command buffer.
+// Run with `events` to print button presses and releases as they happen, sleeping in between.
+// Run with `trace [categories]` to record the trace categories in the mask, all of them by default, and print each event as it is recorded.
+// Run with `capture <file> [seconds]` to drain the packet ring into a capture file, then replay it through the protocol core and print its cost.
+// Run with `replay <file> [timed]` to replay a capture file without a device, as fast as it can run or at the timing it was captured with.
 //
 
 
 #include <iostream>
+#include <string.h>
+#include <unistd.h>
+#include <mach/mach_time.h>
 #include <IOKit/IOKitLib.h>
 #include <IOKit/hidsystem/IOHIDShared.h>
 
+#include <PacketCapture.h>
+
+#include "XboxOneButtonEvents.h"
+#include "XboxOneCommands.h"
+#include "XboxOneMetrics.h"
+#include "XboxOneReplay.h"
+#include "XboxOneTraceEvents.h"
+
+namespace XboxOne {
+#include "XboxOneDescriptors.h"
+}
+
 #define kIOPrimaryPortDefault 0
 
+/// Selectors of `XboxOneUserClient`, matching `ExternalMethodType`.
+static const uint32_t kLicensingSelector = 1;
+static const uint32_t kSetReportFilterSelector = 2;
+static const uint32_t kSetTraceCategoriesSelector = 8;
+static const uint32_t kGetMetricsSelector = 9;
+static const uint32_t kApplyCommandsSelector = 10;
+static const uint32_t kWaitForButtonEventsSelector = 12;
+
+/// The memory types of `XboxOneUserClient`, matching `ClientMemoryType`.
+static const uint32_t kPacketStreamMemoryType = 0;
+static const uint32_t kTraceRingMemoryType = 2;
+static const uint32_t kButtonEventsMemoryType = 3;
+
+/// Reads every counter of the driver in one call.
+static kern_return_t GetMetrics(io_connect_t connection, xboxone_metrics_stats* stats)
+{
+	size_t size = sizeof(*stats);
+
+	return IOConnectCallStructMethod(connection, kGetMetricsSelector, nullptr, 0, stats, &size);
+}
+
+/// The name of each `pipe_recovery_state`.
+static const char* const kRecoveryStateNames[PIPE_RECOVERY_STATE_COUNT] = { "healthy", "backing off", "clearing stall", "parked", "stopped" };
+
+/// The change in a counter per second between two reads.
+static double Rate(uint64_t previous, uint64_t current, uint64_t nanoseconds)
+{
+	return (nanoseconds != 0) ? (double)(current - previous) * 1e9 / (double)nanoseconds : 0.0;
+}
+
+/// Prints the errors of a pipe that changed between two reads.
+static void PrintErrors(const char* pipe, const xboxone_status_counts* previous, const xboxone_status_counts* current)
+{
+	for (uint32_t index = 0; index < XBOXONE_METRICS_STATUSES; ++index)
+	{
+		const xboxone_status_count* entry = &current->statuses[index];
+		uint64_t before = (previous->statuses[index].status == entry->status) ? previous->statuses[index].count : 0;
+
+		if (entry->status != 0 && entry->count != before)
+		{
+			printf("\t%s error 0x%08x: +%llu (%llu total)\n", pipe, entry->status, entry->count - before, entry->count);
+		}
+	}
+	if (current->otherCount != previous->otherCount)
+	{
+		printf("\t%s other errors: +%llu (%llu total)\n", pipe, current->otherCount - previous->otherCount, current->otherCount);
+	}
+}
+
+/// The number of settings applied in each round of the benchmark.
+static const uint32_t kBenchCommandsPerRound = 3;
+
+/// Applies the benchmark settings with one selector call each.
+static kern_return_t ApplySettingsSeparately(io_connect_t connection)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	uint64_t licensing[1] = { true };
+	uint64_t filter[1 + XBOXONE_AXIS_COUNT] = { false };
+	uint64_t trace[1] = { 0 };
+	uint64_t output[1] = {};
+	uint32_t outputCount = 1;
+
+	ret = IOConnectCallScalarMethod(connection, kLicensingSelector, licensing, 1, output, &outputCount);
+	if (ret == kIOReturnSuccess)
+	{
+		ret = IOConnectCallScalarMethod(connection, kSetReportFilterSelector, filter, 1 + XBOXONE_AXIS_COUNT, nullptr, nullptr);
+	}
+	if (ret == kIOReturnSuccess)
+	{
+		ret = IOConnectCallScalarMethod(connection, kSetTraceCategoriesSelector, trace, 1, nullptr, nullptr);
+	}
+
+	return ret;
+}
+
+/// Applies the same settings as `ApplySettingsSeparately` in a single command buffer.
+static kern_return_t ApplySettingsBatched(io_connect_t connection, const uint8_t* buffer, uint32_t size)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	xboxone_command_results results = {};
+	size_t resultsSize = sizeof(results);
+
+	ret = IOConnectCallStructMethod(connection, kApplyCommandsSelector, buffer, size, &results, &resultsSize);
+	for (uint32_t index = 0; ret == kIOReturnSuccess && index < results.count; ++index)
+	{
+		ret = results.results[index];
+	}
+
+	return ret;
+}
+
+/// Times `iterations` rounds of applying the same settings separately and batched, and prints the throughput of each.
+static int BenchCommands(io_connect_t connection, uint32_t iterations)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	uint8_t buffer[XBOXONE_COMMAND_BUFFER_MAX_SIZE] = {};
+	xboxone_command_writer writer = {};
+	xboxone_enable_command enable = { .enabled = 1 };
+	xboxone_report_filter_command filter = {};
+	xboxone_trace_categories_command trace = {};
+	mach_timebase_info_data_t timebase = {};
+	uint64_t start = 0;
+	uint64_t separateNanoseconds = 0;
+	uint64_t batchedNanoseconds = 0;
+
+	XboxOneCommandWriterInit(&writer, buffer, sizeof(buffer));
+	XboxOneCommandAppend(&writer, XBOXONE_COMMAND_SET_ENABLE, &enable, sizeof(enable));
+	XboxOneCommandAppend(&writer, XBOXONE_COMMAND_SET_REPORT_FILTER, &filter, sizeof(filter));
+	XboxOneCommandAppend(&writer, XBOXONE_COMMAND_SET_TRACE_CATEGORIES, &trace, sizeof(trace));
+	mach_timebase_info(&timebase);
+
+	start = mach_absolute_time();
+	for (uint32_t iteration = 0; ret == kIOReturnSuccess && iteration < iterations; ++iteration)
+	{
+		ret = ApplySettingsSeparately(connection);
+	}
+	separateNanoseconds = (mach_absolute_time() - start) * timebase.numer / timebase.denom;
+	if (ret != kIOReturnSuccess)
+	{
+		printf("Separate calls failed with error: 0x%08x.\n", ret);
+		return EXIT_FAILURE;
+	}
+
+	start = mach_absolute_time();
+	for (uint32_t iteration = 0; ret == kIOReturnSuccess && iteration < iterations; ++iteration)
+	{
+		ret = ApplySettingsBatched(connection, buffer, writer.size);
+	}
+	batchedNanoseconds = (mach_absolute_time() - start) * timebase.numer / timebase.denom;
+	if (ret != kIOReturnSuccess)
+	{
+		printf("Batched call failed with error: 0x%08x.\n", ret);
+		return EXIT_FAILURE;
+	}
+
+	printf("%u rounds of %u settings\n", iterations, kBenchCommandsPerRound);
+	printf("\tseparate: %.0f settings/s, %.2f us per round\n", Rate(0, (uint64_t)iterations * kBenchCommandsPerRound, separateNanoseconds), (double)separateNanoseconds / iterations / 1000.0);
+	printf("\tbatched:  %.0f settings/s, %.2f us per round\n", Rate(0, (uint64_t)iterations * kBenchCommandsPerRound, batchedNanoseconds), (double)batchedNanoseconds / iterations / 1000.0);
+
+	return 0;
+}
+
+/// Polls the driver's counters every `interval` seconds and prints their rates, until the driver goes away.
+static int PollMetrics(io_connect_t connection, unsigned int interval)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	xboxone_metrics_stats previous = {};
+	xboxone_metrics_stats current = {};
+
+	ret = GetMetrics(connection, &previous);
+	if (ret != kIOReturnSuccess)
+	{
+		printf("Failed to read metrics with error: 0x%08x.\n", ret);
+		return EXIT_FAILURE;
+	}
+
+	while (true)
+	{
+		sleep(interval);
+
+		ret = GetMetrics(connection, &current);
+		if (ret != kIOReturnSuccess)
+		{
+			printf("Failed to read metrics with error: 0x%08x.\n", ret);
+			return EXIT_FAILURE;
+		}
+
+		uint64_t elapsed = current.timestamp - previous.timestamp;
+		uint64_t packetsBefore = 0;
+		uint64_t packetsNow = 0;
+
+		for (uint32_t type = 0; type < XBOXONE_METRICS_PACKET_TYPES; ++type)
+		{
+			packetsBefore += previous.input.packets[type];
+			packetsNow += current.input.packets[type];
+		}
+
+		printf("in: %.1f packets/s %.1f bytes/s | out: %.1f packets/s %.1f bytes/s | queue depth %llu high-water %llu\n",
+			Rate(packetsBefore, packetsNow, elapsed), Rate(previous.input.bytes, current.input.bytes, elapsed),
+			Rate(previous.output.packets, current.output.packets, elapsed), Rate(previous.output.bytes, current.output.bytes, elapsed),
+			current.output.queueDepth, current.output.queueHighWater);
+
+		for (uint32_t type = 0; type < XBOXONE_METRICS_PACKET_TYPES; ++type)
+		{
+			if (current.input.packets[type] != previous.input.packets[type])
+			{
+				printf("\ttype 0x%02x: %.1f packets/s\n", type, Rate(previous.input.packets[type], current.input.packets[type], elapsed));
+			}
+		}
+
+		// Each rate is over the time spent in that state, so a period where the driver was switched still gives both rates.
+		printf("\twakeups: %.1f/s enabled, %.1f/s disabled (%.1f%% of the period disabled)\n",
+			Rate(previous.input.wakeups[1], current.input.wakeups[1], current.input.enableTime[1] - previous.input.enableTime[1]),
+			Rate(previous.input.wakeups[0], current.input.wakeups[0], current.input.enableTime[0] - previous.input.enableTime[0]),
+			100.0 * (double)(current.input.enableTime[0] - previous.input.enableTime[0]) / (double)elapsed);
+		printf("\treport failures %llu, re-arm failures %llu, dropped while disabled %llu, output queue drops %llu\n",
+			current.input.reportFailures, current.input.rearmFailures, current.input.disabledDrops, current.output.queueDrops);
+		if (current.coalescing.saved != previous.coalescing.saved)
+		{
+			printf("\tcoalescing: %.1f reports/s offered, %.1f deliveries/s, %.1f deliveries/s saved, %llu button edges, %llu flushes\n",
+				Rate(previous.coalescing.offered, current.coalescing.offered, elapsed), Rate(previous.coalescing.delivered, current.coalescing.delivered, elapsed),
+				Rate(previous.coalescing.saved, current.coalescing.saved, elapsed),
+				current.coalescing.edges - previous.coalescing.edges, current.coalescing.flushes - previous.coalescing.flushes);
+		}
+		PrintErrors("in", &previous.input.errors, &current.input.errors);
+		PrintErrors("out", &previous.output.errors, &current.output.errors);
+		printf("\tin pipe %s, %u failures in a row, %llu back-offs, %llu stall clears, %llu parks\n",
+			(current.recovery.state < PIPE_RECOVERY_STATE_COUNT) ? kRecoveryStateNames[current.recovery.state] : "unknown",
+			current.recovery.failures, current.recovery.backoffs, current.recovery.stallClears, current.recovery.parks);
+		for (uint32_t state = 0; state < PIPE_RECOVERY_STATE_COUNT; ++state)
+		{
+			if (current.recovery.stateTime[state] != previous.recovery.stateTime[state])
+			{
+				printf("\t\t%s: %.1f%% of the period\n", kRecoveryStateNames[state], 100.0 * (double)(current.recovery.stateTime[state] - previous.recovery.stateTime[state]) / (double)elapsed);
+			}
+		}
+
+		previous = current;
+	}
+}
+
+/// Stores the result of an asynchronous call once its completion message is dispatched.
+static void ButtonEventsCompleted(void* refcon, IOReturn result, void** args, uint32_t numArgs)
+{
+	(void)args;
+	(void)numArgs;
+
+	*(IOReturn*)refcon = result;
+}
+
+/// Prints button events as they happen, sleeping until the driver says there are more.
+static int WatchButtonEvents(io_connect_t connection)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	mach_vm_address_t address = 0;
+	mach_vm_size_t size = 0;
+	IONotificationPortRef notificationPort = nullptr;
+	mach_port_t port = MACH_PORT_NULL;
+	uint64_t cursor = 0;
+	uint64_t lost = 0;
+	uint64_t start = 0;
+	mach_timebase_info_data_t timebase = {};
+
+	ret = IOConnectMapMemory64(connection, kButtonEventsMemoryType, mach_task_self(), &address, &size, kIOMapAnywhere);
+	if (ret != kIOReturnSuccess)
+	{
+		printf("Failed to map button events with error: 0x%08x.\n", ret);
+		return EXIT_FAILURE;
+	}
+
+	const trace_ring* ring = (const trace_ring*)address;
+	if (size < sizeof(trace_ring) || ring->version != TRACE_RING_VERSION || ring->recordSize != sizeof(trace_record))
+	{
+		printf("Button event ring has an unknown layout.\n");
+		return EXIT_FAILURE;
+	}
+
+	notificationPort = IONotificationPortCreate(kIOPrimaryPortDefault);
+	port = IONotificationPortGetMachPort(notificationPort);
+	mach_timebase_info(&timebase);
+
+	// Only events from now on are printed.
+	cursor = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	start = mach_absolute_time();
+
+	while (true)
+	{
+		IOReturn result = kIOReturnSuccess;
+		uint64_t asyncReference[kOSAsyncRef64Count] = {};
+		uint64_t input[1] = { cursor };
+		struct {
+			mach_msg_header_t header;
+			uint8_t body[256];
+		} message = {};
+		trace_record record = {};
+		xboxone_button_event event = {};
+
+		asyncReference[kIOAsyncCalloutFuncIndex] = (uint64_t)(uintptr_t)&ButtonEventsCompleted;
+		asyncReference[kIOAsyncCalloutRefconIndex] = (uint64_t)(uintptr_t)&result;
+
+		ret = IOConnectCallAsyncScalarMethod(connection, kWaitForButtonEventsSelector, port, asyncReference, kOSAsyncRef64Count, input, 1, nullptr, nullptr);
+		if (ret != kIOReturnSuccess)
+		{
+			printf("Failed to wait for button events with error: 0x%08x.\n", ret);
+			return EXIT_FAILURE;
+		}
+
+		// Sleeps until the driver completes the wait.
+		ret = mach_msg(&message.header, MACH_RCV_MSG, 0, sizeof(message), port, MACH_MSG_TIMEOUT_NONE, MACH_PORT_NULL);
+		if (ret != KERN_SUCCESS)
+		{
+			printf("Failed to receive completion with error: 0x%08x.\n", ret);
+			return EXIT_FAILURE;
+		}
+		IODispatchCalloutFromMessage(nullptr, &message.header, notificationPort);
+
+		if (result != kIOReturnSuccess)
+		{
+			printf("Wait for button events ended with error: 0x%08x.\n", result);
+			return (result == kIOReturnAborted) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+
+		while (TraceRingRead(ring, &cursor, &record, &lost) == true)
+		{
+			if (XboxOneButtonEventDecode(&record, &event) == false)
+			{
+				continue;
+			}
+
+			printf("%10.3f ms: pressed 0x%05x released 0x%05x held 0x%05x\n",
+				(double)((int64_t)(event.timestamp - start) * timebase.numer / timebase.denom) / 1e6, event.pressed, event.released, event.buttons);
+		}
+		if (lost != 0)
+		{
+			printf("\t%llu events lost so far.\n", lost);
+		}
+	}
+}
+
+/// Records the trace categories in `categories` and prints every event as it is recorded, polling the trace ring.
+static int WatchTrace(io_connect_t connection, uint32_t categories)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	mach_vm_address_t address = 0;
+	mach_vm_size_t size = 0;
+	uint64_t input[1] = { categories };
+	uint64_t cursor = 0;
+	uint64_t lost = 0;
+	uint64_t reported = 0;
+	uint64_t start = 0;
+	mach_timebase_info_data_t timebase = {};
+	char text[128] = {};
+
+	ret = IOConnectMapMemory64(connection, kTraceRingMemoryType, mach_task_self(), &address, &size, kIOMapAnywhere);
+	if (ret != kIOReturnSuccess)
+	{
+		printf("Failed to map the trace ring with error: 0x%08x.\n", ret);
+		return EXIT_FAILURE;
+	}
+
+	const trace_ring* ring = (const trace_ring*)address;
+	if (size < sizeof(trace_ring) || ring->version != TRACE_RING_VERSION || ring->recordSize != sizeof(trace_record))
+	{
+		printf("Trace ring has an unknown layout.\n");
+		return EXIT_FAILURE;
+	}
+
+	ret = IOConnectCallScalarMethod(connection, kSetTraceCategoriesSelector, input, 1, nullptr, nullptr);
+	if (ret != kIOReturnSuccess)
+	{
+		printf("Failed to set trace categories with error: 0x%08x.\n", ret);
+		return EXIT_FAILURE;
+	}
+
+	mach_timebase_info(&timebase);
+	printf("Tracing categories 0x%02x...\n", categories);
+
+	// Only events from now on are printed.
+	cursor = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	start = mach_absolute_time();
+
+	while (true)
+	{
+		trace_record record = {};
+
+		while (TraceRingRead(ring, &cursor, &record, &lost) == true)
+		{
+			XboxOneTraceFormat(&record, text, sizeof(text));
+			printf("%10.3f ms: %s\n", (double)((int64_t)(record.timestamp - start) * timebase.numer / timebase.denom) / 1e6, text);
+		}
+		if (lost != reported)
+		{
+			printf("\t%llu events lost so far.\n", lost);
+			reported = lost;
+		}
+
+		// The ring holds a couple of thousand events, which is a couple of seconds of every category while buttons are pressed.
+		usleep(10000);
+	}
+}
+
+/// Waits for `mach_absolute_time` to reach `deadline`, for replaying at a capture's original timing.
+static void ReplayWaitUntil(uint64_t deadline)
+{
+	mach_wait_until(deadline);
+}
+
+/// Replays a capture file through the protocol core, as fast as it can or at its original timing if `timed` is true, and prints what it cost.
+static int ReplayCapture(const char* path, bool timed)
+{
+	FILE* file = fopen(path, "rb");
+	uint8_t* capture = nullptr;
+	long length = 0;
+	const packet_capture_header* header = nullptr;
+	const packet_capture_record* records = nullptr;
+	const xboxone_model_info* model = nullptr;
+	xboxone_protocol protocol = {};
+	xboxone_replay_config config = {};
+	xboxone_replay_stats stats = {};
+	mach_timebase_info_data_t timebase = {};
+	uint64_t count = 0;
+
+	if (file == nullptr)
+	{
+		printf("Failed to open %s.\n", path);
+		return EXIT_FAILURE;
+	}
+	if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0)
+	{
+		capture = (uint8_t*)malloc((size_t)length);
+	}
+	if (capture == nullptr || fread(capture, 1, (size_t)length, file) != (size_t)length)
+	{
+		printf("Failed to read %s.\n", path);
+		fclose(file);
+		free(capture);
+		return EXIT_FAILURE;
+	}
+	fclose(file);
+
+	count = PacketCaptureOpen(capture, (size_t)length, &header, &records);
+	if (count == 0)
+	{
+		printf("%s is not a valid capture, or holds no records.\n", path);
+		free(capture);
+		return EXIT_FAILURE;
+	}
+
+	model = XboxOneFindModel(header->productID);
+	if (model == nullptr)
+	{
+		printf("%s is a capture of an unsupported product 0x%04x.\n", path, header->productID);
+		free(capture);
+		return EXIT_FAILURE;
+	}
+
+	if (header->descriptorHash != PacketCaptureHash(XboxOne::ReportDescriptor, XboxOne::REPORT_DESCRIPTOR_SIZE))
+	{
+		printf("Warning: %s was captured with a different report descriptor, so its reports may not match this driver's.\n", path);
+	}
+
+	mach_timebase_info(&timebase);
+	config.mode = (timed == true) ? XBOXONE_REPLAY_ORIGINAL_TIMING : XBOXONE_REPLAY_FULL_SPEED;
+	config.clock = mach_absolute_time;
+	config.waitUntil = ReplayWaitUntil;
+	config.numer = timebase.numer;
+	config.denom = timebase.denom;
+
+	XboxOneProtocolInit(&protocol, model, nullptr, nullptr);
+	XboxOneReplay(&protocol, records, count, &config, &stats);
+
+	printf("Replayed %llu packets of a %s (0x%04x:0x%04x), descriptor 0x%016llx\n", stats.packets, model->name, header->vendorID, header->productID, header->descriptorHash);
+	printf("\t%llu packets/s, %llu ns/packet\n", stats.packetsPerSecond, stats.nanosecondsPerPacket);
+	if (timed == true)
+	{
+		printf("\tPackets were processed %llu ns after their original timing on average, %llu ns at most.\n",
+			(stats.packets != 0) ? stats.lateNanoseconds / stats.packets : 0, stats.maxLateNanoseconds);
+	}
+	printf("\t%llu delivered, %llu suppressed, %llu repeated, %llu ignored, %llu errors, %llu guide responses, report hash 0x%016llx\n",
+		stats.delivered, stats.suppressed, stats.repeated, stats.ignored, stats.errors, stats.responses, stats.reportHash);
+
+	free(capture);
+	return 0;
+}
+
+/// Drains the packet ring into a capture file for `seconds`, then replays the capture.
+static int CapturePackets(io_connect_t connection, const char* path, unsigned int seconds)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	mach_vm_address_t address = 0;
+	mach_vm_size_t size = 0;
+	mach_timebase_info_data_t timebase = {};
+	packet_capture_header header = {};
+	packet_ring_record record = {};
+	uint64_t overflows = 0;
+	uint64_t deadline = 0;
+	FILE* file = nullptr;
+
+	ret = IOConnectMapMemory64(connection, kPacketStreamMemoryType, mach_task_self(), &address, &size, kIOMapAnywhere);
+	if (ret != kIOReturnSuccess)
+	{
+		printf("Failed to map the packet ring with error: 0x%08x.%s\n", ret, (ret == kIOReturnExclusiveAccess) ? " Another client is capturing from this controller." : "");
+		return EXIT_FAILURE;
+	}
+
+	packet_ring* ring = (packet_ring*)address;
+	if (size < sizeof(packet_ring) || ring->version != PACKET_RING_VERSION || ring->recordSize != sizeof(packet_ring_record))
+	{
+		printf("Packet ring has an unknown layout.\n");
+		return EXIT_FAILURE;
+	}
+
+	file = fopen(path, "wb");
+	if (file == nullptr)
+	{
+		printf("Failed to create %s.\n", path);
+		return EXIT_FAILURE;
+	}
+
+	PacketCaptureInitHeader(&header, ring);
+	fwrite(&header, sizeof(header), 1, file);
+
+	// Only packets from now on are captured.
+	__atomic_store_n(&ring->tail, __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+	overflows = __atomic_load_n(&ring->overflows, __ATOMIC_RELAXED);
+
+	printf("Capturing for %u seconds...\n", seconds);
+	mach_timebase_info(&timebase);
+	deadline = mach_absolute_time() + (uint64_t)seconds * 1000000000 * timebase.denom / timebase.numer;
+	while (mach_absolute_time() < deadline)
+	{
+		while (PacketRingPop(ring, &record) == true)
+		{
+			fwrite(&record, sizeof(record), 1, file);
+			header.recordCount++;
+		}
+		// A controller sends at most a packet a millisecond, so the ring holds about a second of packets.
+		usleep(10000);
+	}
+
+	// The count is only known once the capture is done, so the header is written again with it.
+	fseek(file, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, file);
+	if (fclose(file) != 0)
+	{
+		printf("Failed to write %s.\n", path);
+		return EXIT_FAILURE;
+	}
+
+	printf("Captured %llu packets, %llu lost to overflows.\n", header.recordCount, __atomic_load_n(&ring->overflows, __ATOMIC_RELAXED) - overflows);
+	return ReplayCapture(path, false);
+}
+
 int main(int argc, const char* argv[])
 {
 	static const char* dextIdentifier = "XboxOneInputInterface";
 
 	kern_return_t ret = kIOReturnSuccess;
+	bool pollMetrics = (argc > 1 && strcmp(argv[1], "metrics") == 0);
+	bool benchCommands = (argc > 1 && strcmp(argv[1], "bench") == 0);
+	bool watchButtonEvents = (argc > 1 && strcmp(argv[1], "events") == 0);
+	bool watchTrace = (argc > 1 && strcmp(argv[1], "trace") == 0);
+	bool capturePackets = (argc > 2 && strcmp(argv[1], "capture") == 0);
+	unsigned int count = (argc > 2) ? (unsigned int)atoi(argv[2]) : 0;
 	io_iterator_t iterator = IO_OBJECT_NULL;
 	io_service_t service = IO_OBJECT_NULL;
 	io_connect_t connection = IO_OBJECT_NULL;
 
+	// Replaying needs nothing but the capture.
+	if (argc > 2 && strcmp(argv[1], "replay") == 0)
+	{
+		return ReplayCapture(argv[2], argc > 3 && strcmp(argv[3], "timed") == 0);
+	}
+
 	ret = IOServiceGetMatchingServices(kIOPrimaryPortDefault, IOServiceNameMatching(dextIdentifier), &iterator);
 	if (ret != kIOReturnSuccess)
 	{
@@ -55,8 +621,29 @@ int main(int argc, const char* argv[])
 		return EXIT_FAILURE;
 	}
 
+	if (pollMetrics == true)
+	{
+		return PollMetrics(connection, (count != 0) ? count : 1);
+	}
+	if (benchCommands == true)
+	{
+		return BenchCommands(connection, (count != 0) ? count : 10000);
+	}
+	if (watchButtonEvents == true)
+	{
+		return WatchButtonEvents(connection);
+	}
+	if (watchTrace == true)
+	{
+		return WatchTrace(connection, (argc > 2) ? (uint32_t)strtoul(argv[2], nullptr, 0) : XBOXONE_TRACE_ALL);
+	}
+	if (capturePackets == true)
+	{
+		return CapturePackets(connection, argv[2], (argc > 3 && atoi(argv[3]) > 0) ? (unsigned int)atoi(argv[3]) : 10);
+	}
+
 	{
-		const uint32_t selector = 1;
+		const uint32_t selector = kLicensingSelector;
 		const uint32_t arraySize = 1;
 		const uint64_t input[arraySize] = { true };
 
@@ -0,0 +1,113 @@
+//
+//  BufferPool.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Bookkeeping for a pool of small transfer buffers shared by every driver instance in the process.
+// Buffers are handed out by index and are never destroyed, so a controller that connects after another one left reuses its buffers instead of creating new ones.
+// Each index remembers the key it was last taken for, such as the host controller whose DMA requirements its buffer was created to meet,
+// and is only handed back out as reusable for the same key.
+// The pool only tracks which indexes are free; the caller owns whatever each index refers to,
+// and must serialize every call, such as by holding a lock that every instance shares.
+// This code is not specific to DriverKit in any way, so it can be exercised without a device.
+//
+
+#ifndef BufferPool_h
+#define BufferPool_h
+
+#include <stdint.h>
+
+/// The most buffers the pool hands out at once. Enough for 64 controllers with every input and output slot in use.
+constexpr uint32_t BUFFER_POOL_CAPACITY = 1024;
+/// The size of every buffer in the pool. Full-speed interrupt endpoints are limited to 64 bytes.
+constexpr uint32_t BUFFER_POOL_BUFFER_SIZE = 64;
+
+/// The pool.
+///
+/// A zeroed structure is an empty pool.
+/// `created` - The number of indexes handed out so far. Every index below this has been used before.
+/// `freeCount` - The number of indexes in `freeList`.
+/// `taken` - The number of buffers taken so far.
+/// `reused` - The number of those that were given back by an earlier owner with the same key, and could be used as is.
+/// `rekeyed` - The number of those that were given back by an earlier owner with another key, and had to be replaced.
+/// `freeList` - Indexes that were given back, most recent last.
+/// `keys` - The key each index below `created` was last taken for.
+typedef struct {
+	uint32_t created;
+	uint32_t freeCount;
+	uint64_t taken;
+	uint64_t reused;
+	uint64_t rekeyed;
+	uint32_t freeList[BUFFER_POOL_CAPACITY];
+	uint32_t keys[BUFFER_POOL_CAPACITY];
+} buffer_pool;
+
+/// Takes a buffer index for `key`, returning false if every index is in use.
+///
+/// A given back index that was last taken for the same key still refers to whatever the caller stored for it, so it can be used again as is,
+/// and `*reusable` is set. Of those, the most recently given back is handed out first, since its buffer is the most likely to still be in cache.
+/// Failing that, a new index is handed out, and only once there are none left is an index of another key handed out.
+/// For a new index or one of another key `*reusable` is cleared, and the caller must replace whatever it stored for it.
+inline bool BufferPoolTake(buffer_pool* pool, uint32_t key, uint32_t* index, bool* reusable)
+{
+	uint32_t position = pool->freeCount;
+
+	*reusable = false;
+
+	for (uint32_t candidate = pool->freeCount; candidate > 0; --candidate)
+	{
+		if (pool->keys[pool->freeList[candidate - 1]] == key)
+		{
+			position = candidate - 1;
+			break;
+		}
+	}
+
+	if (position == pool->freeCount && pool->created < BUFFER_POOL_CAPACITY)
+	{
+		*index = pool->created++;
+	}
+	else if (pool->freeCount != 0)
+	{
+		position = (position == pool->freeCount) ? pool->freeCount - 1 : position;
+		*index = pool->freeList[position];
+		*reusable = (pool->keys[*index] == key);
+
+		// Later entries are moved down, so the list stays in the order the indexes were given back.
+		for (uint32_t later = position + 1; later < pool->freeCount; ++later)
+		{
+			pool->freeList[later - 1] = pool->freeList[later];
+		}
+		pool->freeCount--;
+
+		if (*reusable == true)
+		{
+			pool->reused++;
+		}
+		else
+		{
+			pool->rekeyed++;
+		}
+	}
+	else
+	{
+		return false;
+	}
+
+	pool->keys[*index] = key;
+	pool->taken++;
+	return true;
+}
+
+/// Gives a buffer index back to the pool. The caller must not use the buffer afterwards.
+inline void BufferPoolGive(buffer_pool* pool, uint32_t index)
+{
+	if (index < pool->created && pool->freeCount < BUFFER_POOL_CAPACITY)
+	{
+		pool->freeList[pool->freeCount++] = index;
+	}
+}
+
+#endif /* BufferPool_h */
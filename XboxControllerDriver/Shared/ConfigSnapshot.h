@@ -0,0 +1,48 @@
+//
+//  ConfigSnapshot.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// A single atomic pointer to an immutable configuration, shared between the threads that change it and the one hot path that reads it.
+// The reader loads the pointer once per unit of work and never takes a lock, so it always sees a whole configuration, either the old one or the new one.
+// A writer builds a new configuration from a copy of the current one, and publishes it with a single atomic exchange.
+// The previous configuration is returned to the writer, which must not free it until the reader can no longer be using it,
+// for example by waiting for the reader's serial queue to finish what it is running. Writers must be serialized by the caller.
+// This code is not specific to DriverKit in any way, so it can be exercised without a device.
+//
+
+#ifndef ConfigSnapshot_h
+#define ConfigSnapshot_h
+
+#include <stdint.h>
+
+/// The current configuration of something. A zeroed structure has no configuration, so `ConfigSnapshotInit` must be called before the first read.
+///
+/// `current` - The configuration the reader uses. It is never changed in place, only replaced.
+typedef struct {
+	const void* current;
+} config_snapshot;
+
+/// Sets the configuration before anyone reads it.
+inline void ConfigSnapshotInit(config_snapshot* snapshot, const void* initial)
+{
+	__atomic_store_n(&snapshot->current, initial, __ATOMIC_RELEASE);
+}
+
+/// Reads the current configuration.
+///
+/// The acquire pairs with the release in `ConfigSnapshotPublish`, so everything written to the configuration before it was published is visible.
+inline const void* ConfigSnapshotRead(const config_snapshot* snapshot)
+{
+	return __atomic_load_n(&snapshot->current, __ATOMIC_ACQUIRE);
+}
+
+/// Replaces the configuration, returning the previous one, which the reader may still be using.
+inline const void* ConfigSnapshotPublish(config_snapshot* snapshot, const void* next)
+{
+	return __atomic_exchange_n(&snapshot->current, next, __ATOMIC_ACQ_REL);
+}
+
+#endif /* ConfigSnapshot_h */
@@ -0,0 +1,147 @@
+//
+//  DescriptorCache.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// A small cache of the device details used to build a HID device description,
+// keyed by vendor, product, release and serial number, so a device that reconnects does not need them read again.
+// The cache is shared by every driver instance in the process, so the caller must serialize every call that takes the cache, such as by holding a lock.
+// This code is not specific to DriverKit in any way, so it can be exercised without a device.
+//
+
+#ifndef DescriptorCache_h
+#define DescriptorCache_h
+
+#include <stdint.h>
+#include <string.h>
+
+/// The number of devices remembered. The least recently used device is forgotten first.
+constexpr uint32_t DESCRIPTOR_CACHE_ENTRIES = 8;
+/// The longest string that is cached, including the terminator. Longer strings are not cached.
+constexpr uint32_t DESCRIPTOR_CACHE_STRING_SIZE = 128;
+
+/// The identity of a device.
+///
+/// `vendorID` - `idVendor` from the device descriptor.
+/// `productID` - `idProduct` from the device descriptor.
+/// `release` - `bcdDevice` from the device descriptor.
+/// `serial` - The serial number string.
+typedef struct {
+	uint16_t vendorID;
+	uint16_t productID;
+	uint16_t release;
+	char serial[DESCRIPTOR_CACHE_STRING_SIZE];
+} descriptor_cache_key;
+
+/// Everything remembered about a device.
+///
+/// `key` - The identity of the device.
+/// `manufacturer` - The manufacturer string, or empty if the device has none.
+/// `product` - The product string, or empty if the device has none.
+/// `missTicks` - How long it took to read these details from the device, in whatever units the caller records.
+/// `lastUsed` - When the entry was last used, as a count of cache accesses. 0 if the entry is empty.
+typedef struct {
+	descriptor_cache_key key;
+	char manufacturer[DESCRIPTOR_CACHE_STRING_SIZE];
+	char product[DESCRIPTOR_CACHE_STRING_SIZE];
+	uint64_t missTicks;
+	uint64_t lastUsed;
+} descriptor_cache_entry;
+
+/// The cache.
+///
+/// A zeroed structure is an empty cache.
+/// `clock` - The number of cache accesses so far.
+/// `hits` - The number of lookups that found their device.
+/// `misses` - The number of lookups that did not.
+/// `entries` - The remembered devices.
+typedef struct {
+	uint64_t clock;
+	uint64_t hits;
+	uint64_t misses;
+	descriptor_cache_entry entries[DESCRIPTOR_CACHE_ENTRIES];
+} descriptor_cache;
+
+/// Copies a string into a fixed-size cache field, returning false if it does not fit.
+inline bool DescriptorCacheCopyString(char* destination, const char* source)
+{
+	size_t length = (source != nullptr) ? strlen(source) : 0;
+
+	if (length >= DESCRIPTOR_CACHE_STRING_SIZE)
+	{
+		return false;
+	}
+
+	memcpy(destination, (source != nullptr) ? source : "", length);
+	destination[length] = '\0';
+	return true;
+}
+
+/// Fills in a key, returning false if the serial number does not fit.
+inline bool DescriptorCacheMakeKey(descriptor_cache_key* key, uint16_t vendorID, uint16_t productID, uint16_t release, const char* serial)
+{
+	memset(key, 0, sizeof(*key));
+	key->vendorID = vendorID;
+	key->productID = productID;
+	key->release = release;
+
+	return DescriptorCacheCopyString(key->serial, serial);
+}
+
+/// Copies the entry for `key` into `entry`, returning false if the device is not cached.
+inline bool DescriptorCacheFind(descriptor_cache* cache, const descriptor_cache_key* key, descriptor_cache_entry* entry)
+{
+	bool found = false;
+
+	for (uint32_t index = 0; index < DESCRIPTOR_CACHE_ENTRIES; ++index)
+	{
+		descriptor_cache_entry* candidate = &cache->entries[index];
+
+		if (candidate->lastUsed != 0 && memcmp(&candidate->key, key, sizeof(*key)) == 0)
+		{
+			candidate->lastUsed = ++cache->clock;
+			memcpy(entry, candidate, sizeof(*entry));
+			found = true;
+			break;
+		}
+	}
+
+	if (found == true)
+	{
+		cache->hits++;
+	}
+	else
+	{
+		cache->misses++;
+	}
+
+	return found;
+}
+
+/// Remembers `entry`, replacing any entry with the same key or else the least recently used one.
+inline void DescriptorCacheInsert(descriptor_cache* cache, const descriptor_cache_entry* entry)
+{
+	descriptor_cache_entry* victim = &cache->entries[0];
+
+	for (uint32_t index = 0; index < DESCRIPTOR_CACHE_ENTRIES; ++index)
+	{
+		descriptor_cache_entry* candidate = &cache->entries[index];
+
+		if (candidate->lastUsed != 0 && memcmp(&candidate->key, &entry->key, sizeof(entry->key)) == 0)
+		{
+			victim = candidate;
+			break;
+		}
+		if (candidate->lastUsed < victim->lastUsed)
+		{
+			victim = candidate;
+		}
+	}
+
+	memcpy(victim, entry, sizeof(*victim));
+	victim->lastUsed = ++cache->clock;
+}
+
+#endif /* DescriptorCache_h */
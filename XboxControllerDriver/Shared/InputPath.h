@@ -0,0 +1,191 @@
+//
+//  InputPath.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Keeps reads outstanding on every slot of an `input_ring`, and holds slots back while `pipe_recovery` waits for the pipe to recover.
+// A slot whose read completes is re-armed at once while the pipe is healthy, or left idle until the recovery timer resumes the pipe.
+// While the path is disabled no slot is re-armed at all, so an idle controller does not wake the driver at the polling rate.
+// The pipe itself is reached through hooks, which submit a read, clear a stall, and start the recovery timer,
+// so the driver and the simulated input path arm and recover their slots with the very same code.
+// This code is not specific to DriverKit in any way, so it can be exercised without a device.
+//
+
+#ifndef InputPath_h
+#define InputPath_h
+
+#include <stdint.h>
+
+#include "InputRing.h"
+#include "PipeRecovery.h"
+
+/// How the input path reaches its pipe. Statuses are the caller's own, with 0 for success.
+///
+/// `context` - Handed to every hook.
+/// `submit` - Submits a read on a slot, parking it in `ring` if its staging area is full, and returns the status the pipe refused it with.
+/// `classify` - Sorts the status of a read, or of a refusal, into how `recovery` should respond to it.
+/// `clearStall` - Clears the stall of the pipe, which aborts every other read outstanding on it.
+/// `armTimer` - Starts the recovery timer, which must call `InputPathRecoveryTimerFired` after `delay`.
+/// `held` - Called whenever a slot is held back, with what `recovery` decided and the status that led to it. May be `nullptr`.
+typedef struct {
+	void* context;
+	int32_t (*submit)(void* context, uint32_t slot);
+	pipe_error_class (*classify)(int32_t status);
+	void (*clearStall)(void* context);
+	void (*armTimer)(void* context, uint64_t delay);
+	void (*held)(void* context, uint32_t slot, pipe_recovery_action action, int32_t status);
+} input_path_hooks;
+
+/// The state of the reads kept outstanding on an `IN` pipe.
+///
+/// Only one thread may change it, but `enabled` may be read from any thread.
+/// `ring` - Orders and stages the outstanding reads.
+/// `recovery` - Error backoff, stall clearing, and parking of the pipe.
+/// `idleSlots` - A bitmask of slots held back by `recovery`, or because the path is disabled, to be re-armed when the pipe resumes.
+/// `enabled` - Whether reads are re-armed at all. While it is false, every slot is left idle as its read completes.
+/// `hooks` - How the path reaches its pipe.
+typedef struct {
+	input_ring ring;
+	pipe_recovery recovery;
+	uint32_t idleSlots;
+	bool enabled;
+	input_path_hooks hooks;
+} input_path;
+
+/// Holds a slot back, and carries out whatever else `recovery` decided, such as clearing a stall or starting the recovery timer.
+inline void InputPathStartRecovery(input_path* path, uint32_t slot, pipe_recovery_action action, int32_t status, uint64_t delay)
+{
+	path->idleSlots |= 1u << slot;
+	if (path->hooks.held != nullptr)
+	{
+		path->hooks.held(path->hooks.context, slot, action, status);
+	}
+
+	switch (action)
+	{
+		case PIPE_RECOVERY_REARM:
+		case PIPE_RECOVERY_WAIT:
+			return;
+
+		case PIPE_RECOVERY_CLEAR_STALL:
+			path->hooks.clearStall(path->hooks.context);
+			break;
+
+		case PIPE_RECOVERY_BACKOFF_FOR:
+		case PIPE_RECOVERY_PARK:
+			break;
+	}
+
+	path->hooks.armTimer(path->hooks.context, delay);
+}
+
+/// Submits a read on a slot at `now`.
+///
+/// A read the pipe refuses is handed to `recovery` just like a read that failed, so a pipe that refuses every read is not retried in a loop.
+inline void InputPathArm(input_path* path, uint32_t slot, uint64_t now)
+{
+	pipe_error_class error = PIPE_ERROR_NONE;
+	uint64_t delay = 0;
+	int32_t status = path->hooks.submit(path->hooks.context, slot);
+
+	if (status == 0)
+	{
+		return;
+	}
+
+	// A refused read is a failure, whatever its status says.
+	error = path->hooks.classify(status);
+	if (error == PIPE_ERROR_NONE || error == PIPE_ERROR_CANCELED)
+	{
+		error = PIPE_ERROR_TRANSIENT;
+	}
+
+	InputPathStartRecovery(path, slot, PipeRecoveryComplete(&path->recovery, error, now, &delay), status, delay);
+}
+
+/// Re-arms any slots that were parked while the staging area was full.
+///
+/// Parked slots stay parked while `recovery` is holding reads back, or while the path is disabled, and are re-armed when the pipe resumes.
+inline void InputPathRequestParked(input_path* path, uint64_t now)
+{
+	uint32_t parkedSlots = path->ring.parkedSlots;
+
+	while (parkedSlots != 0 && InputRingCanSubmit(&path->ring) && PipeRecoveryCanArm(&path->recovery) && path->enabled == true)
+	{
+		uint32_t slot = (uint32_t)__builtin_ctz(parkedSlots);
+		parkedSlots &= parkedSlots - 1;
+
+		InputPathArm(path, slot, now);
+	}
+}
+
+/// Re-arms every slot that was held back, then any that were parked.
+///
+/// Must only be called while the path is enabled.
+inline void InputPathArmIdle(input_path* path, uint64_t now)
+{
+	uint32_t idleSlots = path->idleSlots;
+
+	path->idleSlots = 0;
+	while (idleSlots != 0)
+	{
+		uint32_t slot = (uint32_t)__builtin_ctz(idleSlots);
+		idleSlots &= idleSlots - 1;
+
+		// If a re-armed slot is refused, the pipe is backing off again, so the rest stay held back.
+		if (PipeRecoveryCanArm(&path->recovery) == false)
+		{
+			path->idleSlots |= 1u << slot;
+			continue;
+		}
+
+		InputPathArm(path, slot, now);
+	}
+
+	InputPathRequestParked(path, now);
+}
+
+/// Decides whether a slot whose read just completed at `now` with `status` is re-armed now, or held back by `recovery`.
+///
+/// While the path is disabled, the slot is left idle whatever happened to its read, and is re-armed when the path is enabled again.
+inline void InputPathRecover(input_path* path, uint32_t slot, int32_t status, uint64_t now)
+{
+	uint64_t delay = 0;
+	pipe_recovery_action action = PIPE_RECOVERY_REARM;
+
+	if (path->enabled == false)
+	{
+		path->idleSlots |= 1u << slot;
+		return;
+	}
+
+	action = PipeRecoveryComplete(&path->recovery, path->hooks.classify(status), now, &delay);
+	if (action == PIPE_RECOVERY_REARM)
+	{
+		InputPathArm(path, slot, now);
+		return;
+	}
+
+	InputPathStartRecovery(path, slot, action, status, delay);
+}
+
+/// Resumes the pipe when the recovery timer fires at `now`, returning false if it was not held back.
+///
+/// Every slot that was held back is re-armed, unless the path was disabled in the meantime.
+inline bool InputPathRecoveryTimerFired(input_path* path, uint64_t now)
+{
+	if (PipeRecoveryResume(&path->recovery, now) == false)
+	{
+		return false;
+	}
+
+	if (path->enabled == true)
+	{
+		InputPathArmIdle(path, now);
+	}
+	return true;
+}
+
+#endif /* InputPath_h */
@@ -0,0 +1,159 @@
+//
+//  InputRing.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Bookkeeping for keeping several interrupt `IN` reads outstanding on a single pipe.
+// Each slot owns its own buffer and `AsyncIO`. Completed reads are copied into a staging area,
+// so the slot can be re-armed right away, and are then released strictly in submission order.
+// This code is not specific to DriverKit in any way, so it can be exercised without a device.
+//
+
+#ifndef InputRing_h
+#define InputRing_h
+
+#include <stdint.h>
+#include <string.h>
+
+/// The most reads that can be outstanding on the `IN` pipe at one time.
+constexpr uint32_t INPUT_RING_MAX_SLOTS = 8;
+/// The number of outstanding reads used when the personality does not specify one.
+constexpr uint32_t INPUT_RING_DEFAULT_SLOTS = 4;
+/// The largest packet that will be staged. Full-speed interrupt endpoints are limited to 64 bytes.
+constexpr uint32_t INPUT_RING_MAX_PACKET_SIZE = 64;
+/// Completed reads can be held for up to this many submissions while an older read is still outstanding.
+constexpr uint32_t INPUT_RING_STAGING_COUNT = INPUT_RING_MAX_SLOTS * 2;
+
+/// A completed read waiting to be delivered.
+///
+/// `sequence` - The submission sequence of the read that produced this entry.
+/// `status` - The completion status of the read.
+/// `length` - The number of valid bytes in `data`.
+/// `timestamp` - The completion timestamp of the read.
+/// `completed` - Whether this entry holds a completion that has not been delivered yet.
+/// `data` - A copy of the bytes the read produced.
+typedef struct {
+	uint32_t sequence;
+	int32_t status;
+	uint32_t length;
+	uint64_t timestamp;
+	bool completed;
+	uint8_t data[INPUT_RING_MAX_PACKET_SIZE];
+} input_ring_entry;
+
+/// The state of every outstanding and staged read on a pipe.
+///
+/// A zeroed structure is valid, but `InputRingInit` should be called before the first submission.
+/// `slotCount` - The number of slots in use, from 1 to `INPUT_RING_MAX_SLOTS`.
+/// `submitSequence` - The sequence that will be given to the next submitted read.
+/// `deliverSequence` - The sequence of the next read to be delivered.
+/// `parkedSlots` - A bitmask of slots that could not be re-armed because the staging area was full.
+/// `slotSequence` - The sequence of the read currently outstanding on each slot.
+/// `staging` - Completed reads, indexed by sequence.
+typedef struct {
+	uint32_t slotCount;
+	uint32_t submitSequence;
+	uint32_t deliverSequence;
+	uint32_t parkedSlots;
+	uint32_t slotSequence[INPUT_RING_MAX_SLOTS];
+	input_ring_entry staging[INPUT_RING_STAGING_COUNT];
+} input_ring;
+
+/// Resets the ring and clamps `slotCount` to a supported value.
+inline void InputRingInit(input_ring* ring, uint32_t slotCount)
+{
+	memset(ring, 0, sizeof(*ring));
+
+	if (slotCount == 0)
+	{
+		slotCount = INPUT_RING_DEFAULT_SLOTS;
+	}
+	if (slotCount > INPUT_RING_MAX_SLOTS)
+	{
+		slotCount = INPUT_RING_MAX_SLOTS;
+	}
+
+	ring->slotCount = slotCount;
+}
+
+/// Whether another read can be submitted without overrunning the staging area.
+inline bool InputRingCanSubmit(const input_ring* ring)
+{
+	return (ring->submitSequence - ring->deliverSequence) < INPUT_RING_STAGING_COUNT;
+}
+
+/// Records that a read is about to be submitted on `slot`.
+///
+/// Returns false, and parks the slot, if the staging area has no room for the read.
+/// Parked slots should be resubmitted after the ring has been drained.
+inline bool InputRingSubmit(input_ring* ring, uint32_t slot)
+{
+	if (InputRingCanSubmit(ring) == false)
+	{
+		ring->parkedSlots |= (1u << slot);
+		return false;
+	}
+
+	ring->parkedSlots &= ~(1u << slot);
+	ring->slotSequence[slot] = ring->submitSequence++;
+	return true;
+}
+
+/// Undoes the `InputRingSubmit` on `slot`, for when the pipe refused the read.
+///
+/// Must be called before any other read is submitted, so the sequence is left without a hole.
+inline void InputRingCancelSubmit(input_ring* ring, uint32_t slot)
+{
+	if (ring->slotSequence[slot] + 1 == ring->submitSequence)
+	{
+		ring->submitSequence--;
+	}
+}
+
+/// Stages the completion of the read outstanding on `slot`.
+///
+/// The data is copied, so the slot's buffer can be handed back to the pipe immediately.
+inline void InputRingComplete(input_ring* ring, uint32_t slot, int32_t status, const uint8_t* data, uint32_t length, uint64_t timestamp)
+{
+	uint32_t sequence = ring->slotSequence[slot];
+	input_ring_entry* entry = &ring->staging[sequence % INPUT_RING_STAGING_COUNT];
+
+	if (length > INPUT_RING_MAX_PACKET_SIZE)
+	{
+		length = INPUT_RING_MAX_PACKET_SIZE;
+	}
+
+	entry->sequence = sequence;
+	entry->status = status;
+	entry->length = length;
+	entry->timestamp = timestamp;
+	entry->completed = true;
+
+	if (length > 0)
+	{
+		memcpy(entry->data, data, length);
+	}
+}
+
+/// Returns the next entry in submission order, or `nullptr` if it has not completed yet.
+inline const input_ring_entry* InputRingPeek(const input_ring* ring)
+{
+	const input_ring_entry* entry = &ring->staging[ring->deliverSequence % INPUT_RING_STAGING_COUNT];
+	if (entry->completed == false || entry->sequence != ring->deliverSequence)
+	{
+		return nullptr;
+	}
+
+	return entry;
+}
+
+/// Releases the entry returned by `InputRingPeek`.
+inline void InputRingPop(input_ring* ring)
+{
+	ring->staging[ring->deliverSequence % INPUT_RING_STAGING_COUNT].completed = false;
+	ring->deliverSequence++;
+}
+
+#endif /* InputRing_h */
@@ -0,0 +1,117 @@
+//
+//  LatencyHistogram.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// A fixed-size, log-linear histogram that is cheap enough to record into on every report.
+// Each power of two is split into 8 linear buckets, which keeps the relative error of any percentile under 12.5%.
+// There is a single writer, so recording needs no atomic read-modify-write, and readers may sample it at any time.
+// This code is not specific to DriverKit in any way, so it can be exercised without a device.
+//
+
+#ifndef LatencyHistogram_h
+#define LatencyHistogram_h
+
+#include <stdint.h>
+
+/// The number of linear buckets in each power of two, as a power of two.
+constexpr uint32_t LATENCY_HISTOGRAM_SUB_BITS = 3;
+/// The number of buckets. Values beyond what the last bucket can hold are counted in the last bucket.
+constexpr uint32_t LATENCY_HISTOGRAM_BUCKETS = 40 << LATENCY_HISTOGRAM_SUB_BITS;
+
+/// A histogram of durations, in whatever units the caller records.
+///
+/// A zeroed structure is an empty histogram.
+/// `count` - The number of values recorded.
+/// `max` - The largest value recorded.
+/// `buckets` - The number of values recorded in each bucket.
+typedef struct {
+	uint64_t count;
+	uint64_t max;
+	uint64_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+} latency_histogram;
+
+/// The bucket a value is counted in.
+inline uint32_t LatencyHistogramBucket(uint64_t value)
+{
+	constexpr uint64_t subCount = 1u << LATENCY_HISTOGRAM_SUB_BITS;
+
+	if (value < subCount)
+	{
+		return (uint32_t)value;
+	}
+
+	uint32_t shift = (uint32_t)(63 - __builtin_clzll(value)) - LATENCY_HISTOGRAM_SUB_BITS;
+	uint32_t bucket = ((shift + 1) << LATENCY_HISTOGRAM_SUB_BITS) + (uint32_t)((value >> shift) - subCount);
+
+	return (bucket < LATENCY_HISTOGRAM_BUCKETS) ? bucket : LATENCY_HISTOGRAM_BUCKETS - 1;
+}
+
+/// The largest value counted in a bucket.
+inline uint64_t LatencyHistogramBucketLimit(uint32_t bucket)
+{
+	constexpr uint64_t subCount = 1u << LATENCY_HISTOGRAM_SUB_BITS;
+
+	if (bucket < subCount)
+	{
+		return bucket;
+	}
+
+	uint32_t shift = (bucket >> LATENCY_HISTOGRAM_SUB_BITS) - 1;
+	uint64_t sub = (bucket & (subCount - 1)) + subCount;
+
+	return ((sub + 1) << shift) - 1;
+}
+
+/// Records a value. Must only be called from a single thread at a time.
+///
+/// Every field is written with a relaxed atomic store, so concurrent readers never see a torn value.
+inline void LatencyHistogramRecord(latency_histogram* histogram, uint64_t value)
+{
+	uint64_t* bucket = &histogram->buckets[LatencyHistogramBucket(value)];
+
+	__atomic_store_n(bucket, __atomic_load_n(bucket, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&histogram->count, __atomic_load_n(&histogram->count, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+	if (value > __atomic_load_n(&histogram->max, __ATOMIC_RELAXED))
+	{
+		__atomic_store_n(&histogram->max, value, __ATOMIC_RELAXED);
+	}
+}
+
+/// Returns the value below which `permille` thousandths of the recorded values fall, or 0 if nothing was recorded.
+///
+/// May be called while the writer is recording. The result is then as of some moment during the call.
+inline uint64_t LatencyHistogramPercentile(const latency_histogram* histogram, uint32_t permille)
+{
+	uint64_t total = 0;
+	uint64_t seen = 0;
+	uint64_t target = 0;
+
+	for (uint32_t bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; ++bucket)
+	{
+		total += __atomic_load_n(&histogram->buckets[bucket], __ATOMIC_RELAXED);
+	}
+
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	// Round up, so that the 99.9th percentile of a small sample is its largest value rather than the one before it.
+	target = (total * permille + 999) / 1000;
+
+	for (uint32_t bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; ++bucket)
+	{
+		seen += __atomic_load_n(&histogram->buckets[bucket], __ATOMIC_RELAXED);
+		if (seen >= target)
+		{
+			return LatencyHistogramBucketLimit(bucket);
+		}
+	}
+
+	return LatencyHistogramBucketLimit(LATENCY_HISTOGRAM_BUCKETS - 1);
+}
+
+#endif /* LatencyHistogram_h */
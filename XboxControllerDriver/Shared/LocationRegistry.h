@@ -0,0 +1,153 @@
+//
+//  LocationRegistry.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// A registry of the devices handled by the driver process, keyed by their USB location ID.
+// Lookups hash straight to the device's slot, so they take the same time no matter how many devices are attached.
+// The registry is shared by every driver instance in the process, so the caller must serialize every call, such as by holding a lock.
+// This code is not specific to DriverKit in any way, so it can be exercised without a device.
+//
+
+#ifndef LocationRegistry_h
+#define LocationRegistry_h
+
+#include <stdint.h>
+
+/// The number of slots in the registry. Must be a power of two, and is kept at twice the supported number of devices so probes stay short.
+constexpr uint32_t LOCATION_REGISTRY_SLOTS = 128;
+/// The most devices that can be registered at once.
+constexpr uint32_t LOCATION_REGISTRY_MAX_DEVICES = LOCATION_REGISTRY_SLOTS / 2;
+
+static_assert((LOCATION_REGISTRY_SLOTS & (LOCATION_REGISTRY_SLOTS - 1)) == 0, "LOCATION_REGISTRY_SLOTS must be a power of two.");
+
+/// A registered device.
+///
+/// `locationID` - The USB location ID of the device.
+/// `device` - The object handling the device, or `nullptr` if the slot is empty.
+typedef struct {
+	uint32_t locationID;
+	void* device;
+} location_registry_slot;
+
+/// The registry, an open-addressed hash table with linear probing.
+///
+/// A zeroed structure is an empty registry.
+/// `count` - The number of registered devices.
+/// `slots` - The registered devices, each in the first empty slot at or after the hash of its location ID.
+typedef struct {
+	uint32_t count;
+	location_registry_slot slots[LOCATION_REGISTRY_SLOTS];
+} location_registry;
+
+/// The slot a location ID hashes to.
+///
+/// Location IDs differ mostly in their top bits, so a multiplicative hash is used to spread them over the low bits.
+inline uint32_t LocationRegistryHash(uint32_t locationID)
+{
+	return (locationID * 0x9E3779B1u) >> (32 - __builtin_ctz(LOCATION_REGISTRY_SLOTS));
+}
+
+/// The host controller a location ID is on, which is numbered by the top byte of the location ID.
+inline uint32_t LocationRegistryHostController(uint32_t locationID)
+{
+	return locationID >> 24;
+}
+
+/// Finds the device at a location ID, or returns `nullptr` if none is registered.
+///
+/// The caller must take its own reference to the device before it stops serializing access, since the device may be removed right after.
+inline void* LocationRegistryFind(const location_registry* registry, uint32_t locationID)
+{
+	for (uint32_t probe = 0, slot = LocationRegistryHash(locationID); probe < LOCATION_REGISTRY_SLOTS; ++probe, slot = (slot + 1) & (LOCATION_REGISTRY_SLOTS - 1))
+	{
+		const location_registry_slot* candidate = &registry->slots[slot];
+
+		if (candidate->device == nullptr)
+		{
+			break;
+		}
+		if (candidate->locationID == locationID)
+		{
+			return candidate->device;
+		}
+	}
+
+	return nullptr;
+}
+
+/// Registers a device, returning false if another device is registered at the same location ID or the registry is full.
+inline bool LocationRegistryInsert(location_registry* registry, uint32_t locationID, void* device)
+{
+	bool result = false;
+
+	if (registry->count < LOCATION_REGISTRY_MAX_DEVICES)
+	{
+		for (uint32_t probe = 0, slot = LocationRegistryHash(locationID); probe < LOCATION_REGISTRY_SLOTS; ++probe, slot = (slot + 1) & (LOCATION_REGISTRY_SLOTS - 1))
+		{
+			location_registry_slot* candidate = &registry->slots[slot];
+
+			if (candidate->device == nullptr)
+			{
+				candidate->locationID = locationID;
+				candidate->device = device;
+				registry->count++;
+				result = true;
+				break;
+			}
+			if (candidate->locationID == locationID)
+			{
+				break;
+			}
+		}
+	}
+
+	return result;
+}
+
+/// Unregisters a device, if it is the one registered at its location ID.
+///
+/// The devices after it are shifted back into the gap, so lookups never need to probe past removed entries.
+inline void LocationRegistryRemove(location_registry* registry, uint32_t locationID, const void* device)
+{
+	for (uint32_t probe = 0, slot = LocationRegistryHash(locationID); probe < LOCATION_REGISTRY_SLOTS; ++probe, slot = (slot + 1) & (LOCATION_REGISTRY_SLOTS - 1))
+	{
+		location_registry_slot* candidate = &registry->slots[slot];
+
+		if (candidate->device == nullptr)
+		{
+			break;
+		}
+		if (candidate->locationID != locationID)
+		{
+			continue;
+		}
+		if (candidate->device != device)
+		{
+			break;
+		}
+
+		uint32_t gap = slot;
+
+		for (uint32_t next = (gap + 1) & (LOCATION_REGISTRY_SLOTS - 1); registry->slots[next].device != nullptr; next = (next + 1) & (LOCATION_REGISTRY_SLOTS - 1))
+		{
+			uint32_t home = LocationRegistryHash(registry->slots[next].locationID);
+
+			// An entry can only move back into the gap if the gap lies between its home slot and where it is now.
+			if (((next - home) & (LOCATION_REGISTRY_SLOTS - 1)) >= ((next - gap) & (LOCATION_REGISTRY_SLOTS - 1)))
+			{
+				registry->slots[gap] = registry->slots[next];
+				gap = next;
+			}
+		}
+
+		registry->slots[gap].locationID = 0;
+		registry->slots[gap].device = nullptr;
+		registry->count--;
+		break;
+	}
+}
+
+#endif /* LocationRegistry_h */
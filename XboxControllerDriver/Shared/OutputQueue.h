@@ -0,0 +1,144 @@
+//
+//  OutputQueue.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Bookkeeping for sending packets on an interrupt `OUT` pipe without ever waiting for a transfer.
+// Packets are queued by priority into preallocated storage, and are handed out to a fixed set of buffers as they become free.
+// Each buffer owns its own `AsyncIO`, so several transfers can be in flight at once.
+// This code is not specific to DriverKit in any way, so it can be exercised without a device.
+//
+
+#ifndef OutputQueue_h
+#define OutputQueue_h
+
+#include <stdint.h>
+#include <string.h>
+
+/// The number of priority classes. Class 0 is the most urgent.
+constexpr uint32_t OUTPUT_QUEUE_PRIORITIES = 3;
+/// The number of packets that can wait in each priority class. Must be a power of two.
+constexpr uint32_t OUTPUT_QUEUE_DEPTH = 8;
+/// The most transfers that can be in flight on the `OUT` pipe at one time.
+constexpr uint32_t OUTPUT_QUEUE_MAX_SLOTS = 4;
+/// The largest packet that can be queued. Full-speed interrupt endpoints are limited to 64 bytes.
+constexpr uint32_t OUTPUT_QUEUE_MAX_PACKET_SIZE = 64;
+
+static_assert((OUTPUT_QUEUE_DEPTH & (OUTPUT_QUEUE_DEPTH - 1)) == 0, "OUTPUT_QUEUE_DEPTH must be a power of two.");
+
+/// A packet waiting to be sent.
+///
+/// `length` - The number of valid bytes in `data`.
+/// `data` - A copy of the packet.
+typedef struct {
+	uint32_t length;
+	uint8_t data[OUTPUT_QUEUE_MAX_PACKET_SIZE];
+} output_queue_packet;
+
+/// The state of every queued packet and in-flight transfer on a pipe.
+///
+/// A zeroed structure is valid, but `OutputQueueInit` should be called before the first packet is queued.
+/// `slotCount` - The number of buffers in use, from 1 to `OUTPUT_QUEUE_MAX_SLOTS`.
+/// `freeSlots` - A bitmask of buffers that have no transfer in flight.
+/// `head` - The number of packets taken from each priority class.
+/// `tail` - The number of packets added to each priority class.
+/// `dropped` - The number of packets refused because their priority class was full.
+/// `packets` - The queued packets of each priority class, indexed by `head` or `tail` modulo `OUTPUT_QUEUE_DEPTH`.
+typedef struct {
+	uint32_t slotCount;
+	uint32_t freeSlots;
+	uint32_t head[OUTPUT_QUEUE_PRIORITIES];
+	uint32_t tail[OUTPUT_QUEUE_PRIORITIES];
+	uint64_t dropped;
+	output_queue_packet packets[OUTPUT_QUEUE_PRIORITIES][OUTPUT_QUEUE_DEPTH];
+} output_queue;
+
+/// Resets the queue and clamps `slotCount` to a supported value.
+inline void OutputQueueInit(output_queue* queue, uint32_t slotCount)
+{
+	memset(queue, 0, sizeof(*queue));
+
+	if (slotCount == 0 || slotCount > OUTPUT_QUEUE_MAX_SLOTS)
+	{
+		slotCount = OUTPUT_QUEUE_MAX_SLOTS;
+	}
+
+	queue->slotCount = slotCount;
+	queue->freeSlots = (1u << slotCount) - 1;
+}
+
+/// Adds a packet to the back of its priority class, returning false if the packet was refused.
+inline bool OutputQueuePush(output_queue* queue, uint32_t priority, const uint8_t* data, uint32_t length)
+{
+	if (priority >= OUTPUT_QUEUE_PRIORITIES || length > OUTPUT_QUEUE_MAX_PACKET_SIZE)
+	{
+		queue->dropped++;
+		return false;
+	}
+
+	if (queue->tail[priority] - queue->head[priority] >= OUTPUT_QUEUE_DEPTH)
+	{
+		queue->dropped++;
+		return false;
+	}
+
+	output_queue_packet* packet = &queue->packets[priority][queue->tail[priority] & (OUTPUT_QUEUE_DEPTH - 1)];
+
+	packet->length = length;
+	memcpy(packet->data, data, length);
+	queue->tail[priority]++;
+	return true;
+}
+
+/// Takes the most urgent queued packet along with a free buffer to send it in.
+///
+/// Returns false if nothing is queued or no buffer is free.
+/// The returned packet stays valid until the next call to `OutputQueuePush`, so it should be copied into the buffer right away.
+inline bool OutputQueueNext(output_queue* queue, uint32_t* slot, const output_queue_packet** packet)
+{
+	if (queue->freeSlots == 0)
+	{
+		return false;
+	}
+
+	for (uint32_t priority = 0; priority < OUTPUT_QUEUE_PRIORITIES; ++priority)
+	{
+		if (queue->head[priority] != queue->tail[priority])
+		{
+			*slot = (uint32_t)__builtin_ctz(queue->freeSlots);
+			*packet = &queue->packets[priority][queue->head[priority] & (OUTPUT_QUEUE_DEPTH - 1)];
+
+			queue->freeSlots &= ~(1u << *slot);
+			queue->head[priority]++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/// The number of packets waiting in every priority class, not counting transfers in flight.
+inline uint32_t OutputQueueDepth(const output_queue* queue)
+{
+	uint32_t depth = 0;
+
+	for (uint32_t priority = 0; priority < OUTPUT_QUEUE_PRIORITIES; ++priority)
+	{
+		depth += queue->tail[priority] - queue->head[priority];
+	}
+
+	return depth;
+}
+
+/// Marks a buffer as free once its transfer has completed or failed to start.
+inline void OutputQueueRelease(output_queue* queue, uint32_t slot)
+{
+	if (slot < queue->slotCount)
+	{
+		queue->freeSlots |= 1u << slot;
+	}
+}
+
+#endif /* OutputQueue_h */
@@ -0,0 +1,109 @@
+//
+//  PacketCapture.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// A file format for captures of the packets read from a device, so that a bug report can be replayed without the device.
+// A capture is a header followed by the same records the driver appends to its `packet_ring`,
+// so a client can write records straight from the ring, and a capture file can be memory mapped and read in place.
+// This code is not specific to DriverKit in any way, so captures can be written and read by any tool.
+//
+
+#ifndef PacketCapture_h
+#define PacketCapture_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "PacketRing.h"
+
+/// The first four bytes of every capture: "XCAP" in file order.
+constexpr uint32_t PACKET_CAPTURE_MAGIC = 0x50414358;
+/// The layout version of `packet_capture_header`. A reader should refuse a capture with any other version.
+constexpr uint32_t PACKET_CAPTURE_VERSION = 1;
+
+/// A single packet in a capture. Identical to a record of the packet ring.
+typedef packet_ring_record packet_capture_record;
+
+/// The start of a capture.
+///
+/// Records start right after the header, at `headerSize`, and are `recordSize` bytes apart.
+/// `magic` - `PACKET_CAPTURE_MAGIC`.
+/// `version` - `PACKET_CAPTURE_VERSION`.
+/// `headerSize` - The size of `packet_capture_header`.
+/// `recordSize` - The size of `packet_capture_record`.
+/// `vendorID` - `idVendor` of the device the packets were read from.
+/// `productID` - `idProduct` of the device the packets were read from.
+/// `descriptorHash` - A hash of the report descriptor the packets were delivered with, see `PacketCaptureHash`.
+/// `recordCount` - The number of records that follow. A capture cut short is still read up to its last whole record.
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t recordSize;
+	uint16_t vendorID;
+	uint16_t productID;
+	uint32_t reserved;
+	uint64_t descriptorHash;
+	uint64_t recordCount;
+} packet_capture_header;
+
+static_assert(sizeof(packet_capture_header) % alignof(packet_capture_record) == 0, "Records must stay aligned after the header.");
+
+/// Hashes a report descriptor with 64-bit FNV-1a, so a capture can be matched to the descriptor it was recorded with.
+inline uint64_t PacketCaptureHash(const uint8_t* data, size_t length)
+{
+	uint64_t hash = 0xcbf29ce484222325;
+
+	for (size_t index = 0; index < length; ++index)
+	{
+		hash ^= data[index];
+		hash *= 0x100000001b3;
+	}
+
+	return hash;
+}
+
+/// Fills in the header of a new capture with no records, copying the device details from a packet ring.
+inline void PacketCaptureInitHeader(packet_capture_header* header, const packet_ring* ring)
+{
+	memset(header, 0, sizeof(*header));
+	header->magic = PACKET_CAPTURE_MAGIC;
+	header->version = PACKET_CAPTURE_VERSION;
+	header->headerSize = sizeof(packet_capture_header);
+	header->recordSize = sizeof(packet_capture_record);
+	header->vendorID = ring->vendorID;
+	header->productID = ring->productID;
+	header->descriptorHash = ring->descriptorHash;
+}
+
+/// Checks a capture that was read or mapped into memory, and finds its records.
+///
+/// Returns the number of whole records in `records`, or 0 if the capture is not valid.
+inline uint64_t PacketCaptureOpen(const void* capture, size_t length, const packet_capture_header** header, const packet_capture_record** records)
+{
+	const packet_capture_header* candidate = (const packet_capture_header*)capture;
+
+	*header = nullptr;
+	*records = nullptr;
+
+	if (length < sizeof(packet_capture_header)
+		|| candidate->magic != PACKET_CAPTURE_MAGIC
+		|| candidate->version != PACKET_CAPTURE_VERSION
+		|| candidate->headerSize != sizeof(packet_capture_header)
+		|| candidate->recordSize != sizeof(packet_capture_record))
+	{
+		return 0;
+	}
+
+	uint64_t available = (length - sizeof(packet_capture_header)) / sizeof(packet_capture_record);
+
+	*header = candidate;
+	*records = (const packet_capture_record*)((const uint8_t*)capture + sizeof(packet_capture_header));
+	return (candidate->recordCount < available) ? candidate->recordCount : available;
+}
+
+#endif /* PacketCapture_h */
@@ -0,0 +1,146 @@
+//
+//  PacketRing.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// A single-producer, single-consumer ring of raw packets that lives in memory shared with a client.
+// The driver appends a record for every packet without any system calls or locks,
+// and the client drains records at its own pace. When the client falls behind, new packets are counted as overflows and dropped.
+// This code is not specific to DriverKit in any way, so the client can use the same header to read the ring.
+//
+
+#ifndef PacketRing_h
+#define PacketRing_h
+
+#include <stdint.h>
+#include <string.h>
+
+/// The layout version of `packet_ring`. A client should refuse a ring with any other version.
+constexpr uint32_t PACKET_RING_VERSION = 2;
+/// The number of records in the ring. Must be a power of two.
+constexpr uint32_t PACKET_RING_RECORDS = 1024;
+/// The largest packet a record can hold. Longer packets are truncated.
+constexpr uint32_t PACKET_RING_MAX_DATA = 64;
+
+static_assert((PACKET_RING_RECORDS & (PACKET_RING_RECORDS - 1)) == 0, "PACKET_RING_RECORDS must be a power of two.");
+
+/// A single packet as read from the device.
+///
+/// `timestamp` - The completion timestamp of the read, in absolute time ticks.
+/// `status` - The status the read completed with.
+/// `length` - The number of valid bytes in `data`.
+/// `data` - The packet.
+typedef struct {
+	uint64_t timestamp;
+	uint32_t status;
+	uint16_t length;
+	uint16_t reserved;
+	uint8_t data[PACKET_RING_MAX_DATA];
+} packet_ring_record;
+
+/// The memory shared between the driver and the client.
+///
+/// The producer and consumer indexes only ever increase, and sit on separate cache lines so neither side invalidates the other's line on every record.
+/// `version` - `PACKET_RING_VERSION`.
+/// `recordCount` - `PACKET_RING_RECORDS`.
+/// `recordSize` - The size of `packet_ring_record`.
+/// `vendorID` - `idVendor` of the device the packets are read from, or 0 if unknown.
+/// `productID` - `idProduct` of the device the packets are read from, or 0 if unknown.
+/// `descriptorHash` - A hash of the report descriptor the packets are delivered with, see `PacketCaptureHash`.
+/// `overflows` - The number of packets dropped because the ring was full. Written by the producer only.
+/// `head` - The number of records written. Written by the producer only.
+/// `tail` - The number of records read. Written by the consumer only.
+/// `records` - The records, indexed by `head` or `tail` modulo `recordCount`.
+typedef struct {
+	uint32_t version;
+	uint32_t recordCount;
+	uint32_t recordSize;
+	uint16_t vendorID;
+	uint16_t productID;
+	uint64_t descriptorHash;
+	uint64_t overflows;
+	alignas(64) uint64_t head;
+	alignas(64) uint64_t tail;
+	alignas(64) packet_ring_record records[PACKET_RING_RECORDS];
+} packet_ring;
+
+/// The producer's private view of a ring.
+///
+/// The producer never reads its own index back from shared memory, so a client scribbling over the ring can lose packets but cannot redirect writes.
+/// `ring` - The shared ring, or `nullptr` if there is none.
+/// `head` - The number of records written.
+/// `overflows` - The number of packets dropped because the ring was full.
+typedef struct {
+	packet_ring* ring;
+	uint64_t head;
+	uint64_t overflows;
+} packet_ring_producer;
+
+/// Resets the shared ring and attaches the producer to it.
+inline void PacketRingInit(packet_ring_producer* producer, packet_ring* ring)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->version = PACKET_RING_VERSION;
+	ring->recordCount = PACKET_RING_RECORDS;
+	ring->recordSize = sizeof(packet_ring_record);
+
+	producer->ring = ring;
+	producer->head = 0;
+	producer->overflows = 0;
+}
+
+/// Records which device the packets in the ring come from, so a client can save them as a self-describing capture.
+inline void PacketRingDescribe(packet_ring* ring, uint16_t vendorID, uint16_t productID, uint64_t descriptorHash)
+{
+	ring->vendorID = vendorID;
+	ring->productID = productID;
+	ring->descriptorHash = descriptorHash;
+}
+
+/// Appends a packet, returning false if the ring was full and the packet was dropped. Must only be called from a single thread at a time.
+inline bool PacketRingPush(packet_ring_producer* producer, uint64_t timestamp, uint32_t status, const uint8_t* data, uint32_t length)
+{
+	packet_ring* ring = producer->ring;
+	uint64_t head = producer->head;
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	// Unsigned arithmetic also catches a tail that is ahead of the head, which only a misbehaving client could write.
+	if (head - tail >= PACKET_RING_RECORDS)
+	{
+		producer->overflows++;
+		__atomic_store_n(&ring->overflows, producer->overflows, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	packet_ring_record* record = &ring->records[head & (PACKET_RING_RECORDS - 1)];
+	uint32_t copied = (length < PACKET_RING_MAX_DATA) ? length : PACKET_RING_MAX_DATA;
+
+	record->timestamp = timestamp;
+	record->status = status;
+	record->length = (uint16_t)copied;
+	memcpy(record->data, data, copied);
+
+	producer->head = head + 1;
+	__atomic_store_n(&ring->head, producer->head, __ATOMIC_RELEASE);
+	return true;
+}
+
+/// Copies the oldest record into `record` and removes it, returning false if the ring was empty. Must only be called from a single thread at a time.
+inline bool PacketRingPop(packet_ring* ring, packet_ring_record* record)
+{
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+	{
+		return false;
+	}
+
+	memcpy(record, &ring->records[tail & (PACKET_RING_RECORDS - 1)], sizeof(*record));
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+#endif /* PacketRing_h */
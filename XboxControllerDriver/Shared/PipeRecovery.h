@@ -0,0 +1,277 @@
+//
+//  PipeRecovery.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Decides what to do after each read on a pipe completes, so that a pipe which keeps failing is not resubmitted in a tight loop.
+// Errors are backed off exponentially, a stalled pipe has its stall cleared first,
+// and a pipe that fails too many times in a row is parked for a long cool-down before a single trial read.
+// Every read that fails during the same incident is held back rather than counted again, and all of them are re-armed together.
+// This code is not specific to DriverKit in any way, so error sequences can be replayed against it without a device.
+//
+
+#ifndef PipeRecovery_h
+#define PipeRecovery_h
+
+#include <stdint.h>
+#include <string.h>
+
+/// Enumeration of the states of a pipe.
+///
+/// `PIPE_RECOVERY_HEALTHY` - Reads are re-armed as soon as they complete.
+/// `PIPE_RECOVERY_BACKOFF` - A read failed, and reads are held back until a timer fires.
+/// `PIPE_RECOVERY_CLEARING` - The pipe stalled, and reads are held back while the stall is cleared and a timer fires.
+/// `PIPE_RECOVERY_PARKED` - Too many reads failed in a row, or the device went away, and reads are held back for a long cool-down.
+/// `PIPE_RECOVERY_STOPPED` - The driver is stopping, and no read is ever re-armed again.
+typedef enum : uint8_t {
+	PIPE_RECOVERY_HEALTHY = 0,
+	PIPE_RECOVERY_BACKOFF,
+	PIPE_RECOVERY_CLEARING,
+	PIPE_RECOVERY_PARKED,
+	PIPE_RECOVERY_STOPPED,
+	PIPE_RECOVERY_STATE_COUNT,
+} pipe_recovery_state;
+
+/// Enumeration of how a read completed, as classified by the driver from its status.
+///
+/// `PIPE_ERROR_NONE` - The read succeeded.
+/// `PIPE_ERROR_CANCELED` - The read was aborted, such as by clearing a stall. Not a failure of the pipe itself.
+/// `PIPE_ERROR_TRANSIENT` - The read failed in a way that may not happen again, such as a timeout or an overrun.
+/// `PIPE_ERROR_STALL` - The endpoint stalled, and will keep failing until the stall is cleared.
+/// `PIPE_ERROR_FATAL` - The device is gone or unusable.
+typedef enum : uint8_t {
+	PIPE_ERROR_NONE = 0,
+	PIPE_ERROR_CANCELED,
+	PIPE_ERROR_TRANSIENT,
+	PIPE_ERROR_STALL,
+	PIPE_ERROR_FATAL,
+} pipe_error_class;
+
+/// Enumeration of what the driver should do with the slot whose read completed.
+///
+/// `PIPE_RECOVERY_REARM` - Re-arm the slot now.
+/// `PIPE_RECOVERY_WAIT` - Leave the slot idle. It is re-armed when the pipe resumes.
+/// `PIPE_RECOVERY_BACKOFF_FOR` - Leave the slot idle, and resume the pipe after the returned delay.
+/// `PIPE_RECOVERY_CLEAR_STALL` - Leave the slot idle, clear the stall of the pipe, and resume the pipe after the returned delay.
+/// `PIPE_RECOVERY_PARK` - Leave the slot idle, and resume the pipe after the returned cool-down.
+typedef enum : uint8_t {
+	PIPE_RECOVERY_REARM = 0,
+	PIPE_RECOVERY_WAIT,
+	PIPE_RECOVERY_BACKOFF_FOR,
+	PIPE_RECOVERY_CLEAR_STALL,
+	PIPE_RECOVERY_PARK,
+} pipe_recovery_action;
+
+/// How a pipe backs off, in whatever units the caller's clock uses.
+///
+/// `baseDelay` - The delay after the first failure. Each further failure in a row doubles it.
+/// `maxDelay` - The longest delay between failures.
+/// `parkAfter` - The number of failures in a row that park the pipe.
+/// `parkDelay` - How long a parked pipe waits before a trial read.
+typedef struct {
+	uint64_t baseDelay;
+	uint64_t maxDelay;
+	uint32_t parkAfter;
+	uint64_t parkDelay;
+} pipe_recovery_config;
+
+/// How the driver backs off its `IN` pipe, in nanoseconds, which the tests and the simulated input path use as well.
+constexpr pipe_recovery_config PIPE_RECOVERY_DEFAULT_CONFIG = {
+	.baseDelay = 8 * 1000000ULL,
+	.maxDelay = 1000 * 1000000ULL,
+	.parkAfter = 8,
+	.parkDelay = 10 * 1000 * 1000000ULL,
+};
+
+/// The results of recovery, as returned through the user client.
+///
+/// `state` - The current `pipe_recovery_state`.
+/// `failures` - The number of failures in a row, which a successful read resets.
+/// `backoffs` - The number of times the pipe backed off.
+/// `stallClears` - The number of times the stall of the pipe was cleared.
+/// `parks` - The number of times the pipe was parked.
+/// `stateTime` - The total time spent in each state, including the current one, indexed by `pipe_recovery_state`.
+typedef struct {
+	uint32_t state;
+	uint32_t failures;
+	uint64_t backoffs;
+	uint64_t stallClears;
+	uint64_t parks;
+	uint64_t stateTime[PIPE_RECOVERY_STATE_COUNT];
+} pipe_recovery_stats;
+
+/// The recovery state of a pipe.
+///
+/// A zeroed structure is valid, but `PipeRecoveryInit` must be called before the first completion.
+/// Only one thread may change it, but `PipeRecoveryRead` may be called from any thread.
+/// `config` - How the pipe backs off.
+/// `stats` - The results so far. Its `stateTime` does not include the time since `stateSince`.
+/// `stateSince` - When the current state was entered.
+typedef struct {
+	pipe_recovery_config config;
+	pipe_recovery_stats stats;
+	uint64_t stateSince;
+} pipe_recovery;
+
+/// Resets the recovery state of a pipe, starting out healthy at `now`.
+inline void PipeRecoveryInit(pipe_recovery* recovery, const pipe_recovery_config* config, uint64_t now)
+{
+	memset(recovery, 0, sizeof(*recovery));
+	recovery->config = *config;
+	recovery->stateSince = now;
+
+	if (recovery->config.parkAfter == 0)
+	{
+		recovery->config.parkAfter = 1;
+	}
+}
+
+/// Moves the pipe to a new state, charging the time spent in the old one.
+inline void PipeRecoveryEnter(pipe_recovery* recovery, pipe_recovery_state state, uint64_t now)
+{
+	uint32_t previous = recovery->stats.state;
+	uint64_t elapsed = (now > recovery->stateSince) ? now - recovery->stateSince : 0;
+
+	__atomic_store_n(&recovery->stats.stateTime[previous], recovery->stats.stateTime[previous] + elapsed, __ATOMIC_RELAXED);
+	__atomic_store_n(&recovery->stats.state, (uint32_t)state, __ATOMIC_RELAXED);
+	__atomic_store_n(&recovery->stateSince, now, __ATOMIC_RELAXED);
+}
+
+/// Adds one to a counter of the results. Only the thread changing the state may call this.
+inline void PipeRecoveryCount(uint64_t* counter)
+{
+	__atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+/// Whether reads may be armed right now.
+inline bool PipeRecoveryCanArm(const pipe_recovery* recovery)
+{
+	return recovery->stats.state == PIPE_RECOVERY_HEALTHY;
+}
+
+/// Decides what to do with a slot whose read completed, or was refused by the pipe, at `now`.
+///
+/// `delay` is set for the actions that resume the pipe later.
+inline pipe_recovery_action PipeRecoveryComplete(pipe_recovery* recovery, pipe_error_class error, uint64_t now, uint64_t* delay)
+{
+	uint32_t failures = 0;
+	uint64_t backoff = 0;
+
+	*delay = 0;
+
+	// Any read still in flight when the pipe left the healthy state belongs to the same incident,
+	// so it waits to be re-armed along with the others instead of counting as another failure.
+	if (recovery->stats.state != PIPE_RECOVERY_HEALTHY)
+	{
+		return PIPE_RECOVERY_WAIT;
+	}
+
+	switch (error)
+	{
+		case PIPE_ERROR_NONE:
+			__atomic_store_n(&recovery->stats.failures, 0, __ATOMIC_RELAXED);
+			return PIPE_RECOVERY_REARM;
+
+		case PIPE_ERROR_CANCELED:
+			return PIPE_RECOVERY_REARM;
+
+		case PIPE_ERROR_FATAL:
+			__atomic_store_n(&recovery->stats.failures, recovery->stats.failures + 1, __ATOMIC_RELAXED);
+			PipeRecoveryCount(&recovery->stats.parks);
+			PipeRecoveryEnter(recovery, PIPE_RECOVERY_PARKED, now);
+			*delay = recovery->config.parkDelay;
+			return PIPE_RECOVERY_PARK;
+
+		case PIPE_ERROR_TRANSIENT:
+		case PIPE_ERROR_STALL:
+			break;
+	}
+
+	failures = recovery->stats.failures + 1;
+	__atomic_store_n(&recovery->stats.failures, failures, __ATOMIC_RELAXED);
+
+	if (failures >= recovery->config.parkAfter)
+	{
+		PipeRecoveryCount(&recovery->stats.parks);
+		PipeRecoveryEnter(recovery, PIPE_RECOVERY_PARKED, now);
+		*delay = recovery->config.parkDelay;
+		return PIPE_RECOVERY_PARK;
+	}
+
+	// The delay doubles with every failure in a row, up to the maximum.
+	backoff = recovery->config.baseDelay;
+	for (uint32_t step = 1; step < failures && backoff < recovery->config.maxDelay; ++step)
+	{
+		backoff *= 2;
+	}
+	*delay = (backoff < recovery->config.maxDelay) ? backoff : recovery->config.maxDelay;
+
+	if (error == PIPE_ERROR_STALL)
+	{
+		PipeRecoveryCount(&recovery->stats.stallClears);
+		PipeRecoveryEnter(recovery, PIPE_RECOVERY_CLEARING, now);
+		return PIPE_RECOVERY_CLEAR_STALL;
+	}
+
+	PipeRecoveryCount(&recovery->stats.backoffs);
+	PipeRecoveryEnter(recovery, PIPE_RECOVERY_BACKOFF, now);
+	return PIPE_RECOVERY_BACKOFF_FOR;
+}
+
+/// Ends a back-off, stall clear, or cool-down when its delay has passed, returning true if idle slots should be re-armed.
+///
+/// A parked pipe comes back one failure short of parking again, so a single further failure parks it for another cool-down.
+inline bool PipeRecoveryResume(pipe_recovery* recovery, uint64_t now)
+{
+	switch ((pipe_recovery_state)recovery->stats.state)
+	{
+		case PIPE_RECOVERY_BACKOFF:
+		case PIPE_RECOVERY_CLEARING:
+			PipeRecoveryEnter(recovery, PIPE_RECOVERY_HEALTHY, now);
+			return true;
+
+		case PIPE_RECOVERY_PARKED:
+			__atomic_store_n(&recovery->stats.failures, recovery->config.parkAfter - 1, __ATOMIC_RELAXED);
+			PipeRecoveryEnter(recovery, PIPE_RECOVERY_HEALTHY, now);
+			return true;
+
+		case PIPE_RECOVERY_HEALTHY:
+		case PIPE_RECOVERY_STOPPED:
+		case PIPE_RECOVERY_STATE_COUNT:
+			break;
+	}
+
+	return false;
+}
+
+/// Stops the pipe for good, so nothing is re-armed while the driver shuts down.
+inline void PipeRecoveryStop(pipe_recovery* recovery, uint64_t now)
+{
+	PipeRecoveryEnter(recovery, PIPE_RECOVERY_STOPPED, now);
+}
+
+/// Copies the results, with the time spent in the current state up to `now` included.
+inline void PipeRecoveryRead(const pipe_recovery* recovery, uint64_t now, pipe_recovery_stats* stats)
+{
+	uint64_t since = __atomic_load_n(&recovery->stateSince, __ATOMIC_RELAXED);
+
+	stats->state = __atomic_load_n(&recovery->stats.state, __ATOMIC_RELAXED);
+	stats->failures = __atomic_load_n(&recovery->stats.failures, __ATOMIC_RELAXED);
+	stats->backoffs = __atomic_load_n(&recovery->stats.backoffs, __ATOMIC_RELAXED);
+	stats->stallClears = __atomic_load_n(&recovery->stats.stallClears, __ATOMIC_RELAXED);
+	stats->parks = __atomic_load_n(&recovery->stats.parks, __ATOMIC_RELAXED);
+
+	for (uint32_t state = 0; state < PIPE_RECOVERY_STATE_COUNT; ++state)
+	{
+		stats->stateTime[state] = __atomic_load_n(&recovery->stats.stateTime[state], __ATOMIC_RELAXED);
+	}
+
+	if (stats->state < PIPE_RECOVERY_STATE_COUNT && now > since)
+	{
+		stats->stateTime[stats->state] += now - since;
+	}
+}
+
+#endif /* PipeRecovery_h */
@@ -0,0 +1,182 @@
+//
+//  TraceRing.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// A ring of fixed-size binary trace records that lives in memory shared read-only with clients.
+// Recording an event is a handful of stores with no locks, system calls, or string formatting,
+// and checking whether its category is enabled is a single load, so trace points can stay in the input path of release builds.
+// The newest records overwrite the oldest, so a reader that falls behind loses records rather than holding up the driver.
+// This code is not specific to DriverKit in any way, so clients can use the same header to read the ring.
+//
+
+#ifndef TraceRing_h
+#define TraceRing_h
+
+#include <stdint.h>
+#include <string.h>
+
+/// The layout version of `trace_ring`. A client should refuse a ring with any other version.
+constexpr uint32_t TRACE_RING_VERSION = 1;
+/// The number of records in the ring. Must be a power of two.
+constexpr uint32_t TRACE_RING_RECORDS = 2048;
+
+static_assert((TRACE_RING_RECORDS & (TRACE_RING_RECORDS - 1)) == 0, "TRACE_RING_RECORDS must be a power of two.");
+
+/// A single trace event.
+///
+/// `sequence` - One more than the index of the record, or 0 while it is being written.
+/// `timestamp` - When the event happened, in absolute time ticks.
+/// `event` - Which event happened. The meaning of the arguments depends on the event.
+/// `args` - The arguments of the event.
+typedef struct {
+	uint64_t sequence;
+	uint64_t timestamp;
+	uint32_t event;
+	uint32_t args[3];
+} trace_record;
+
+/// The number of 64-bit words a record is copied in.
+constexpr uint32_t TRACE_RECORD_WORDS = sizeof(trace_record) / sizeof(uint64_t);
+
+static_assert(sizeof(trace_record) % sizeof(uint64_t) == 0, "trace_record must be a whole number of words.");
+
+/// The memory shared between the driver and its readers.
+///
+/// `version` - `TRACE_RING_VERSION`.
+/// `recordCount` - `TRACE_RING_RECORDS`.
+/// `recordSize` - The size of `trace_record`.
+/// `categories` - A bitmask of the categories being recorded, for information only.
+/// `head` - The number of records written.
+/// `records` - The records as words, so that each can be copied atomically, indexed by their index modulo `recordCount`.
+typedef struct {
+	uint32_t version;
+	uint32_t recordCount;
+	uint32_t recordSize;
+	uint32_t categories;
+	alignas(64) uint64_t head;
+	alignas(64) uint64_t records[TRACE_RING_RECORDS][TRACE_RECORD_WORDS];
+} trace_ring;
+
+/// The writer's private view of a ring.
+///
+/// The writer never reads anything back from shared memory, so a ring is safe to map into any number of clients.
+/// `ring` - The shared ring, or `nullptr` if there is none.
+/// `head` - The number of records written.
+/// `categories` - A bitmask of the categories being recorded.
+typedef struct {
+	trace_ring* ring;
+	uint64_t head;
+	uint32_t categories;
+} trace_ring_writer;
+
+/// Resets the shared ring and attaches the writer to it, with every category off.
+inline void TraceRingInit(trace_ring_writer* writer, trace_ring* ring)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->version = TRACE_RING_VERSION;
+	ring->recordCount = TRACE_RING_RECORDS;
+	ring->recordSize = sizeof(trace_record);
+
+	writer->ring = ring;
+	writer->head = 0;
+	writer->categories = 0;
+}
+
+/// Sets which categories are recorded. Safe to call from any thread.
+inline void TraceRingSetCategories(trace_ring_writer* writer, uint32_t categories)
+{
+	__atomic_store_n(&writer->categories, categories, __ATOMIC_RELAXED);
+	if (writer->ring != nullptr)
+	{
+		__atomic_store_n(&writer->ring->categories, categories, __ATOMIC_RELAXED);
+	}
+}
+
+/// Whether any of `categories` are being recorded. This is the only cost of a trace point that is off.
+inline bool TraceRingEnabled(const trace_ring_writer* writer, uint32_t categories)
+{
+	return (__atomic_load_n(&writer->categories, __ATOMIC_RELAXED) & categories) != 0;
+}
+
+/// Appends a record, overwriting the oldest one. Must only be called from a single thread at a time.
+inline void TraceRingWrite(trace_ring_writer* writer, uint32_t event, uint64_t timestamp, uint32_t arg0, uint32_t arg1, uint32_t arg2)
+{
+	trace_ring* ring = writer->ring;
+
+	if (ring == nullptr)
+	{
+		return;
+	}
+
+	uint64_t head = writer->head;
+	uint64_t* slot = ring->records[head & (TRACE_RING_RECORDS - 1)];
+	trace_record record = {
+		.sequence = head + 1,
+		.timestamp = timestamp,
+		.event = event,
+		.args = { arg0, arg1, arg2 },
+	};
+	uint64_t words[TRACE_RECORD_WORDS];
+
+	memcpy(words, &record, sizeof(words));
+
+	// The sequence is cleared first and set last, so a reader can tell a record that was overwritten while it was being copied.
+	__atomic_store_n(&slot[0], 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	for (uint32_t word = 1; word < TRACE_RECORD_WORDS; ++word)
+	{
+		__atomic_store_n(&slot[word], words[word], __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&slot[0], words[0], __ATOMIC_RELEASE);
+
+	writer->head = head + 1;
+	__atomic_store_n(&ring->head, writer->head, __ATOMIC_RELEASE);
+}
+
+/// Copies the record at `*cursor` into `record` and advances the cursor, returning false if there are no new records.
+///
+/// A reader that fell behind skips ahead to the oldest record still in the ring, and `lost` is increased by the number of records it missed.
+inline bool TraceRingRead(const trace_ring* ring, uint64_t* cursor, trace_record* record, uint64_t* lost)
+{
+	uint64_t words[TRACE_RECORD_WORDS];
+
+	while (true)
+	{
+		uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+		if (*cursor >= head)
+		{
+			return false;
+		}
+		if (head - *cursor > TRACE_RING_RECORDS)
+		{
+			*lost += head - TRACE_RING_RECORDS - *cursor;
+			*cursor = head - TRACE_RING_RECORDS;
+		}
+
+		const uint64_t* slot = ring->records[*cursor & (TRACE_RING_RECORDS - 1)];
+
+		words[0] = __atomic_load_n(&slot[0], __ATOMIC_ACQUIRE);
+		for (uint32_t word = 1; word < TRACE_RECORD_WORDS; ++word)
+		{
+			words[word] = __atomic_load_n(&slot[word], __ATOMIC_RELAXED);
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (words[0] == *cursor + 1 && __atomic_load_n(&slot[0], __ATOMIC_RELAXED) == words[0])
+		{
+			memcpy(record, words, sizeof(words));
+			*cursor += 1;
+			return true;
+		}
+
+		// The record was overwritten while it was being copied, so it is lost.
+		*lost += 1;
+		*cursor += 1;
+	}
+}
+
+#endif /* TraceRing_h */
@@ -0,0 +1,345 @@
+//
+//  XboxOneAxisTransform.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Deadzones and response curves for the sticks and triggers of the Xbox One controller.
+// A configuration is compiled into lookup tables when it is uploaded,
+// so the per-report work is a table lookup and a few integer operations per axis, without branches.
+// This code is not specific to DriverKit in any way, and is simply part of the driver functionality.
+//
+
+#ifndef XboxOneAxisTransform_h
+#define XboxOneAxisTransform_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "XboxOneInputPackets.h"
+
+// MARK: - Configuration
+
+/// The version of `xboxone_axis_transform_config` this driver understands.
+constexpr uint32_t XBOXONE_AXIS_TRANSFORM_VERSION = 1;
+/// The number of evenly spaced points that describe a response curve.
+constexpr uint32_t XBOXONE_CURVE_POINTS = 9;
+/// The full scale of a curve point, and of a stick.
+constexpr int32_t XBOXONE_STICK_MAX = 32767;
+/// The full scale of a trigger.
+constexpr int32_t XBOXONE_TRIGGER_MAX = 1023;
+
+/// Enumeration defining how the deadzone of a stick is shaped.
+///
+/// `XBOXONE_DEADZONE_AXIAL` - Each axis of the stick is handled on its own.
+/// `XBOXONE_DEADZONE_RADIAL` - The distance of the stick from center is handled, keeping the stick's direction.
+typedef enum : uint8_t {
+	XBOXONE_DEADZONE_AXIAL = 0,
+	XBOXONE_DEADZONE_RADIAL = 1,
+} xboxone_deadzone_shape;
+
+/// The response of a single axis, in the units of that axis.
+///
+/// `inner` - Inputs at or below this value produce 0.
+/// `outer` - Inputs at or above this value produce full scale. 0 means the full scale of the axis.
+/// `curve` - The output at evenly spaced inputs from `inner` to `outer`, from 0 to 32767. All zeroes means a linear response.
+typedef struct {
+	uint16_t inner;
+	uint16_t outer;
+	uint16_t curve[XBOXONE_CURVE_POINTS];
+} xboxone_axis_response;
+
+/// The configuration uploaded through the user client.
+///
+/// `version` - Must be `XBOXONE_AXIS_TRANSFORM_VERSION`.
+/// `enabled` - Whether reports are transformed at all.
+/// `leftShape` - The `xboxone_deadzone_shape` of the left stick.
+/// `rightShape` - The `xboxone_deadzone_shape` of the right stick.
+/// `axes` - The response of each axis, indexed by `xboxone_axis`. For a radial stick, the X axis response applies to the distance from center, and the Y axis response is unused.
+typedef struct {
+	uint32_t version;
+	uint8_t enabled;
+	uint8_t leftShape;
+	uint8_t rightShape;
+	uint8_t _reserved;
+	xboxone_axis_response axes[XBOXONE_AXIS_COUNT];
+} xboxone_axis_transform_config;
+
+
+
+
+// MARK: - Compiled Plan
+
+/// The number of entries in a stick table. Inputs are looked up by their top 8 bits and interpolated by the low 7 bits.
+constexpr uint32_t XBOXONE_STICK_LUT_SIZE = 257;
+/// The number of entries in a trigger table, one for every possible trigger value.
+constexpr uint32_t XBOXONE_TRIGGER_LUT_SIZE = XBOXONE_TRIGGER_MAX + 1;
+
+/// The lookup tables compiled from an `xboxone_axis_transform_config`.
+///
+/// The four stick lanes are in report order: left X, left Y, right X, right Y.
+/// `enabled` - Whether reports are transformed at all.
+/// `radialMask` - -1 for lanes that belong to a radial stick, 0 otherwise.
+/// `stickLut` - The output magnitude of each stick lane, for an input magnitude of `index * 128`.
+/// `triggerLut` - The output of each trigger, for every input value.
+typedef struct {
+	bool enabled;
+	int32_t radialMask[4];
+	int32_t stickLut[4][XBOXONE_STICK_LUT_SIZE];
+	uint16_t triggerLut[2][XBOXONE_TRIGGER_LUT_SIZE];
+} xboxone_axis_transform_plan;
+
+/// Evaluates a response for an input magnitude from 0 to `fullScale`.
+///
+/// Only used while compiling a plan, so it is free to branch and divide.
+inline int32_t XboxOneEvaluateResponse(const xboxone_axis_response* response, int32_t magnitude, int32_t fullScale)
+{
+	int32_t inner = response->inner;
+	int32_t outer = (response->outer == 0 || response->outer > fullScale) ? fullScale : response->outer;
+	bool linear = true;
+
+	if (magnitude <= inner)
+	{
+		return 0;
+	}
+	if (magnitude >= outer || outer <= inner)
+	{
+		return fullScale;
+	}
+
+	// Position within the live zone, from 0 to 32767.
+	int32_t position = (int32_t)((int64_t)(magnitude - inner) * XBOXONE_STICK_MAX / (outer - inner));
+	int32_t shaped = position;
+
+	for (uint32_t point = 0; point < XBOXONE_CURVE_POINTS; ++point)
+	{
+		linear = linear && (response->curve[point] == 0);
+	}
+
+	if (linear == false)
+	{
+		int64_t scaled = (int64_t)position * (XBOXONE_CURVE_POINTS - 1);
+		uint32_t segment = (uint32_t)(scaled / XBOXONE_STICK_MAX);
+		int32_t fraction = (int32_t)(scaled % XBOXONE_STICK_MAX);
+
+		if (segment >= XBOXONE_CURVE_POINTS - 1)
+		{
+			shaped = response->curve[XBOXONE_CURVE_POINTS - 1];
+		}
+		else
+		{
+			int32_t from = response->curve[segment];
+			int32_t to = response->curve[segment + 1];
+			shaped = from + (int32_t)((int64_t)(to - from) * fraction / XBOXONE_STICK_MAX);
+		}
+	}
+
+	if (shaped > XBOXONE_STICK_MAX)
+	{
+		shaped = XBOXONE_STICK_MAX;
+	}
+
+	return (int32_t)((int64_t)shaped * fullScale / XBOXONE_STICK_MAX);
+}
+
+/// Compiles a configuration into lookup tables.
+///
+/// Returns false if the configuration is not a version this driver understands.
+inline bool XboxOneCompileAxisTransform(const xboxone_axis_transform_config* config, xboxone_axis_transform_plan* plan)
+{
+	if (config->version != XBOXONE_AXIS_TRANSFORM_VERSION)
+	{
+		return false;
+	}
+
+	memset(plan, 0, sizeof(*plan));
+
+	const bool radial[2] = {
+		config->leftShape == XBOXONE_DEADZONE_RADIAL,
+		config->rightShape == XBOXONE_DEADZONE_RADIAL,
+	};
+
+	for (uint32_t lane = 0; lane < 4; ++lane)
+	{
+		bool laneRadial = radial[lane / 2];
+		// A radial stick shapes its distance from center with the response of its X axis.
+		uint32_t axis = XBOXONE_AXIS_LEFT_X + (laneRadial ? (lane & ~1u) : lane);
+
+		plan->radialMask[lane] = laneRadial ? -1 : 0;
+		for (uint32_t index = 0; index < XBOXONE_STICK_LUT_SIZE; ++index)
+		{
+			int32_t magnitude = (int32_t)(index * 128);
+			if (magnitude > XBOXONE_STICK_MAX)
+			{
+				magnitude = XBOXONE_STICK_MAX;
+			}
+
+			plan->stickLut[lane][index] = XboxOneEvaluateResponse(&config->axes[axis], magnitude, XBOXONE_STICK_MAX);
+		}
+	}
+
+	for (uint32_t trigger = 0; trigger < 2; ++trigger)
+	{
+		for (uint32_t value = 0; value < XBOXONE_TRIGGER_LUT_SIZE; ++value)
+		{
+			plan->triggerLut[trigger][value] = (uint16_t)XboxOneEvaluateResponse(&config->axes[XBOXONE_AXIS_TRIGGER_LEFT + trigger], (int32_t)value, XBOXONE_TRIGGER_MAX);
+		}
+	}
+
+	plan->enabled = (config->enabled != 0);
+	return true;
+}
+
+
+
+
+// MARK: - Hot Path
+
+/// Branch-free integer square root of a value up to 2^31.
+inline uint32_t XboxOneSquareRoot(uint32_t value)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1u << 30;
+
+	for (uint32_t step = 0; step < 16; ++step)
+	{
+		uint32_t trial = root + bit;
+		uint32_t mask = 0u - (uint32_t)(value >= trial);
+
+		value -= trial & mask;
+		root = (root >> 1) + (bit & mask);
+		bit >>= 2;
+	}
+
+	return root;
+}
+
+/// Branch-free minimum of two signed values.
+inline int32_t XboxOneMin(int32_t a, int32_t b)
+{
+	int32_t difference = a - b;
+	return b + (difference & (difference >> 31));
+}
+
+/// Interpolates a stick table for a magnitude from 0 to 32767.
+inline int32_t XboxOneInterpolateStick(const int32_t* lut, int32_t magnitude)
+{
+	int32_t index = magnitude >> 7;
+	int32_t fraction = magnitude & 127;
+	int32_t low = lut[index];
+
+	return low + (((lut[index + 1] - low) * fraction) >> 7);
+}
+
+/// Transforms the triggers of a report in place.
+inline void XboxOneTransformTriggers(const xboxone_axis_transform_plan* plan, xboxone_button_report* report)
+{
+	report->trigL = plan->triggerLut[0][XboxOneMin(report->trigL, XBOXONE_TRIGGER_MAX)];
+	report->trigR = plan->triggerLut[1][XboxOneMin(report->trigR, XBOXONE_TRIGGER_MAX)];
+}
+
+/// The scalar reference for transforming the sticks of a report in place.
+///
+/// `XboxOneTransformSticks` must produce exactly the same output as this function for every input.
+inline void XboxOneTransformSticksScalar(const xboxone_axis_transform_plan* plan, xboxone_button_report* report)
+{
+	int32_t input[4] = { report->leftX, report->leftY, report->rightX, report->rightY };
+	int32_t output[4] = {};
+
+	for (uint32_t lane = 0; lane < 4; ++lane)
+	{
+		int32_t value = input[lane];
+		int32_t partner = input[lane ^ 1];
+		int32_t radius = (int32_t)XboxOneSquareRoot((uint32_t)(value * value) + (uint32_t)(partner * partner));
+
+		if (plan->radialMask[lane] != 0)
+		{
+			int32_t gain = XboxOneInterpolateStick(plan->stickLut[lane], XboxOneMin(radius, XBOXONE_STICK_MAX));
+			output[lane] = (value * gain) / (radius == 0 ? 1 : radius);
+		}
+		else
+		{
+			int32_t magnitude = XboxOneMin(value < 0 ? -value : value, XBOXONE_STICK_MAX);
+			int32_t shaped = XboxOneInterpolateStick(plan->stickLut[lane], magnitude);
+			output[lane] = value < 0 ? -shaped : shaped;
+		}
+	}
+
+	report->leftX = (int16_t)output[0];
+	report->leftY = (int16_t)output[1];
+	report->rightX = (int16_t)output[2];
+	report->rightY = (int16_t)output[3];
+}
+
+/// Four lanes of 32-bit integers, using the vector extensions shared by Clang and GCC.
+/// These lower to NEON on Apple silicon and SSE on Intel.
+typedef int32_t xboxone_int4 __attribute__((vector_size(16)));
+typedef uint32_t xboxone_uint4 __attribute__((vector_size(16)));
+
+/// Transforms all four stick axes of a report in place at once.
+///
+/// Both the axial and radial results are computed for every lane, and the radial mask selects between them.
+inline void XboxOneTransformSticks(const xboxone_axis_transform_plan* plan, xboxone_button_report* report)
+{
+	const xboxone_int4 value = { report->leftX, report->leftY, report->rightX, report->rightY };
+	const xboxone_int4 partner = { value[1], value[0], value[3], value[2] };
+	const xboxone_int4 radialMask = { plan->radialMask[0], plan->radialMask[1], plan->radialMask[2], plan->radialMask[3] };
+
+	// Distance from center of the stick each lane belongs to.
+	xboxone_uint4 remainder = (xboxone_uint4)(value * value) + (xboxone_uint4)(partner * partner);
+	xboxone_uint4 root = {};
+	xboxone_uint4 bit = { 1u << 30, 1u << 30, 1u << 30, 1u << 30 };
+	for (uint32_t step = 0; step < 16; ++step)
+	{
+		xboxone_uint4 trial = root + bit;
+		xboxone_uint4 mask = (xboxone_uint4)(remainder >= trial);
+
+		remainder -= trial & mask;
+		root = (root >> 1) + (bit & mask);
+		bit >>= 2;
+	}
+	const xboxone_int4 radius = (xboxone_int4)root;
+
+	// Magnitude each lane is looked up with: the distance from center for radial lanes, or the axis itself for axial lanes.
+	const xboxone_int4 sign = value >> 31;
+	xboxone_int4 magnitude = ((value ^ sign) - sign) & ~radialMask;
+	magnitude |= radius & radialMask;
+	xboxone_int4 over = magnitude - XBOXONE_STICK_MAX;
+	magnitude = XBOXONE_STICK_MAX + (over & (over >> 31));
+
+	const xboxone_int4 index = magnitude >> 7;
+	const xboxone_int4 fraction = magnitude & 127;
+	xboxone_int4 low = {};
+	xboxone_int4 high = {};
+	for (uint32_t lane = 0; lane < 4; ++lane)
+	{
+		low[lane] = plan->stickLut[lane][index[lane]];
+		high[lane] = plan->stickLut[lane][index[lane] + 1];
+	}
+	const xboxone_int4 shaped = low + (((high - low) * fraction) >> 7);
+
+	const xboxone_int4 axial = (shaped ^ sign) - sign;
+	// Comparisons produce -1 for true lanes, so this divides by 1 instead of 0 when the stick is centered.
+	const xboxone_int4 radial = (value * shaped) / (radius - (xboxone_int4)(radius == 0));
+	const xboxone_int4 output = (radial & radialMask) | (axial & ~radialMask);
+
+	report->leftX = (int16_t)output[0];
+	report->leftY = (int16_t)output[1];
+	report->rightX = (int16_t)output[2];
+	report->rightY = (int16_t)output[3];
+}
+
+/// Transforms the triggers and sticks of a report in place, if the plan is enabled.
+inline void XboxOneApplyAxisTransform(const xboxone_axis_transform_plan* plan, xboxone_button_report* report)
+{
+	if (plan->enabled == false)
+	{
+		return;
+	}
+
+	XboxOneTransformTriggers(plan, report);
+	XboxOneTransformSticks(plan, report);
+}
+
+#endif /* XboxOneAxisTransform_h */
@@ -0,0 +1,97 @@
+//
+//  XboxOneButtonEvents.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Button presses and releases of the Xbox One controller, worked out once in the driver as edges of the button state.
+// A consumer that only cares about presses and releases would otherwise have to diff the buttons of every report itself,
+// including the many reports that only move a stick.
+// Each change is recorded as a single event in a `trace_ring` of its own, which clients map read-only and read with `TraceRingRead`.
+// The "guide" button arrives in a separate packet, but is folded into the same state as one more bit.
+// This code is not specific to DriverKit in any way, so clients can use the same header to decode events.
+//
+
+#ifndef XboxOneButtonEvents_h
+#define XboxOneButtonEvents_h
+
+#include <stdint.h>
+
+#include <TraceRing.h>
+
+#include "XboxOneInputPackets.h"
+
+/// The bit of the button state that holds the "guide" button, above the bits of `xboxone_button_report::buttons`.
+constexpr uint32_t XBOXONE_BUTTON_EVENT_GUIDE = 1u << 16;
+
+/// The event ID of every record in the button event ring, "BTN1" in ASCII, so a client can tell it mapped the right ring.
+constexpr uint32_t XBOXONE_BUTTON_EVENT = 0x42544e31;
+
+/// A single change of the button state, as decoded from a ring record.
+///
+/// `sequence` - One more than the index of the event in the ring.
+/// `timestamp` - When the packet that changed the state was read from the controller, in absolute time ticks.
+/// `pressed` - The buttons that went down, as bits of `xboxone_buttons` plus `XBOXONE_BUTTON_EVENT_GUIDE`.
+/// `released` - The buttons that went up, in the same bits.
+/// `buttons` - Every button held down after the change, in the same bits.
+typedef struct {
+	uint64_t sequence;
+	uint64_t timestamp;
+	uint32_t pressed;
+	uint32_t released;
+	uint32_t buttons;
+} xboxone_button_event;
+
+/// The driver's record of the button state, used to find edges.
+///
+/// A zeroed structure is valid, and has every button up.
+/// `buttons` - Every button held down, in the bits of `xboxone_button_event`.
+typedef struct {
+	uint32_t buttons;
+} xboxone_button_edges;
+
+/// Updates the button state and records an event if any button changed, returning whether it did.
+inline bool XboxOneButtonEventsUpdate(xboxone_button_edges* edges, trace_ring_writer* writer, uint32_t buttons, uint64_t timestamp)
+{
+	uint32_t changed = buttons ^ edges->buttons;
+
+	if (changed == 0)
+	{
+		return false;
+	}
+
+	edges->buttons = buttons;
+	TraceRingWrite(writer, XBOXONE_BUTTON_EVENT, timestamp, buttons & changed, ~buttons & changed, buttons);
+	return true;
+}
+
+/// Records the buttons of a button report. The "guide" button is left as it was.
+inline bool XboxOneButtonEventsReport(xboxone_button_edges* edges, trace_ring_writer* writer, const xboxone_button_report* report, uint64_t timestamp)
+{
+	return XboxOneButtonEventsUpdate(edges, writer, (edges->buttons & XBOXONE_BUTTON_EVENT_GUIDE) | report->buttons, timestamp);
+}
+
+/// Records the "guide" button of a guide report. The other buttons are left as they were.
+inline bool XboxOneButtonEventsGuide(xboxone_button_edges* edges, trace_ring_writer* writer, const xboxone_guide_report* report, uint64_t timestamp)
+{
+	return XboxOneButtonEventsUpdate(edges, writer, (edges->buttons & ~XBOXONE_BUTTON_EVENT_GUIDE) | ((report->guide != 0) ? XBOXONE_BUTTON_EVENT_GUIDE : 0), timestamp);
+}
+
+/// Decodes a record read from the button event ring, returning false if it is not a button event.
+inline bool XboxOneButtonEventDecode(const trace_record* record, xboxone_button_event* event)
+{
+	if (record->event != XBOXONE_BUTTON_EVENT)
+	{
+		return false;
+	}
+
+	event->sequence = record->sequence;
+	event->timestamp = record->timestamp;
+	event->pressed = record->args[0];
+	event->released = record->args[1];
+	event->buttons = record->args[2];
+	return true;
+}
+
+#endif /* XboxOneButtonEvents_h */
@@ -0,0 +1,200 @@
+//
+//  XboxOneCoalescer.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Optional coalescing of button reports in time, so that at most one report per window is handed to the HID stack.
+// Only the latest state of the controller matters to a consumer that samples it once a frame,
+// so when several reports arrive inside one window only the newest is kept, and it is delivered when the window closes.
+// A report whose buttons differ from the last one delivered is always delivered at once, so presses and releases are never delayed or lost.
+// Reports that arrive after a quiet spell are also delivered at once, so coalescing only adds latency while reports are arriving faster than the window.
+// This code is not specific to DriverKit in any way, so coalescing can be measured against a replayed capture.
+//
+
+#ifndef XboxOneCoalescer_h
+#define XboxOneCoalescer_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "XboxOneInputPackets.h"
+
+/// The longest coalescing window a client may set. Anything longer would hold reports back for a noticeable time.
+constexpr uint32_t XBOXONE_COALESCE_MAX_WINDOW_MICROSECONDS = 1000000;
+
+/// Enumeration of what should be done with a report offered to the coalescer.
+///
+/// `XBOXONE_COALESCE_DELIVER` - Deliver the report now.
+/// `XBOXONE_COALESCE_HOLD` - The report is held in place of an older one, whose flush is already scheduled.
+/// `XBOXONE_COALESCE_SCHEDULE` - The report is held, and `XboxOneCoalescerFlush` must be called at the returned deadline.
+typedef enum : uint8_t {
+	XBOXONE_COALESCE_DELIVER = 0,
+	XBOXONE_COALESCE_HOLD,
+	XBOXONE_COALESCE_SCHEDULE,
+} xboxone_coalesce_action;
+
+/// The results of coalescing, as returned through the user client.
+///
+/// `offered` - The number of reports offered.
+/// `delivered` - The number of reports delivered, either at once or by a flush.
+/// `saved` - The number of reports replaced by a newer one before they were delivered. Each one is a HID delivery saved.
+/// `edges` - The number of reports delivered at once because their buttons changed.
+/// `flushes` - The number of held reports delivered when their window closed.
+typedef struct {
+	uint64_t offered;
+	uint64_t delivered;
+	uint64_t saved;
+	uint64_t edges;
+	uint64_t flushes;
+} xboxone_coalescer_stats;
+
+/// The state of report coalescing.
+///
+/// A zeroed structure is valid, and delivers every report at once.
+/// Only one thread may change it, but `XboxOneCoalescerRead` may be called from any thread.
+/// `window` - The shortest time between two deliveries, or 0 to not coalesce. In whatever units the caller's clock uses.
+/// `stats` - The results so far.
+/// `hasLast` - Whether a report has been delivered yet.
+/// `lastButtons` - The buttons of the last report delivered.
+/// `lastDelivery` - When the last report was delivered.
+/// `pending` - Whether a report is being held.
+/// `pendingLength` - How many bytes of `pendingReport` are the held report.
+/// `pendingTimestamp` - When the held report was read from the controller.
+/// `pendingSince` - When the first report held in this window was read, which newer reports replace but never move.
+/// `pendingReport` - The held report.
+typedef struct {
+	uint64_t window;
+	xboxone_coalescer_stats stats;
+	bool hasLast;
+	uint16_t lastButtons;
+	uint64_t lastDelivery;
+	bool pending;
+	uint32_t pendingLength;
+	uint64_t pendingTimestamp;
+	uint64_t pendingSince;
+	xboxone_button_report pendingReport;
+} xboxone_coalescer;
+
+/// Adds one to a counter of the results. Only the thread changing the state may call this.
+inline void XboxOneCoalescerCount(uint64_t* counter)
+{
+	__atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+/// Sets the window. A report already held is still delivered at the deadline it was given.
+inline void XboxOneCoalescerSetWindow(xboxone_coalescer* coalescer, uint64_t window)
+{
+	coalescer->window = window;
+}
+
+/// Records that a report with `buttons` was delivered at `now`.
+inline void XboxOneCoalescerDelivered(xboxone_coalescer* coalescer, uint16_t buttons, uint64_t now)
+{
+	coalescer->hasLast = true;
+	coalescer->lastButtons = buttons;
+	coalescer->lastDelivery = now;
+	XboxOneCoalescerCount(&coalescer->stats.delivered);
+}
+
+/// Decides whether a button report that should be delivered is delivered now, or held until the window closes.
+///
+/// `report` is the report as it would be handed to the HID stack, starting with its header.
+/// `timestamp` is when it was read from the controller, and `now` is the current time.
+/// `deadline` is set for `XBOXONE_COALESCE_SCHEDULE`.
+inline xboxone_coalesce_action XboxOneCoalescerOffer(xboxone_coalescer* coalescer, const uint8_t* report, uint32_t length, uint64_t timestamp, uint64_t now, uint64_t* deadline)
+{
+	uint16_t buttons = 0;
+	bool wasPending = coalescer->pending;
+
+	XboxOneCoalescerCount(&coalescer->stats.offered);
+
+	// Anything too short to hold the buttons, or too long to hold, is not worth coalescing.
+	if (length < XBOXONE_REPORT_HEADER_SIZE + sizeof(buttons) || length > sizeof(coalescer->pendingReport))
+	{
+		goto Deliver;
+	}
+
+	memcpy(&buttons, report + XBOXONE_REPORT_HEADER_SIZE, sizeof(buttons));
+	if (coalescer->window == 0)
+	{
+		goto Deliver;
+	}
+
+	// A button edge carries the whole state of the controller, so it also replaces any report being held.
+	if (coalescer->hasLast == false || buttons != coalescer->lastButtons)
+	{
+		if (wasPending == true)
+		{
+			coalescer->pending = false;
+			XboxOneCoalescerCount(&coalescer->stats.saved);
+		}
+		XboxOneCoalescerCount(&coalescer->stats.edges);
+		goto Deliver;
+	}
+
+	if (wasPending == false && now - coalescer->lastDelivery >= coalescer->window)
+	{
+		goto Deliver;
+	}
+
+	if (wasPending == true)
+	{
+		XboxOneCoalescerCount(&coalescer->stats.saved);
+	}
+
+	memcpy(&coalescer->pendingReport, report, length);
+	coalescer->pendingLength = length;
+	coalescer->pendingTimestamp = timestamp;
+	coalescer->pendingSince = (wasPending == true) ? coalescer->pendingSince : timestamp;
+	coalescer->pending = true;
+
+	if (wasPending == true)
+	{
+		return XBOXONE_COALESCE_HOLD;
+	}
+
+	*deadline = coalescer->lastDelivery + coalescer->window;
+	return XBOXONE_COALESCE_SCHEDULE;
+
+Deliver:
+	XboxOneCoalescerDelivered(coalescer, buttons, now);
+	return XBOXONE_COALESCE_DELIVER;
+}
+
+/// Takes the held report when its window closes at `now`, returning false if there is none.
+///
+/// `report` must have room for an `xboxone_button_report`.
+/// `timestamp` is set to when the held report was read, and `since` to when the first report of the window was,
+/// so `now` minus `since` is the latency coalescing added to the window.
+/// A button edge may have already replaced the held report, so a scheduled flush can find nothing to deliver.
+inline bool XboxOneCoalescerFlush(xboxone_coalescer* coalescer, uint64_t now, uint8_t* report, uint32_t* length, uint64_t* timestamp, uint64_t* since)
+{
+	if (coalescer->pending == false)
+	{
+		return false;
+	}
+
+	memcpy(report, &coalescer->pendingReport, coalescer->pendingLength);
+	*length = coalescer->pendingLength;
+	*timestamp = coalescer->pendingTimestamp;
+	*since = coalescer->pendingSince;
+	coalescer->pending = false;
+
+	XboxOneCoalescerCount(&coalescer->stats.flushes);
+	XboxOneCoalescerDelivered(coalescer, coalescer->pendingReport.buttons, now);
+	return true;
+}
+
+/// Copies the results.
+inline void XboxOneCoalescerRead(const xboxone_coalescer* coalescer, xboxone_coalescer_stats* stats)
+{
+	stats->offered = __atomic_load_n(&coalescer->stats.offered, __ATOMIC_RELAXED);
+	stats->delivered = __atomic_load_n(&coalescer->stats.delivered, __ATOMIC_RELAXED);
+	stats->saved = __atomic_load_n(&coalescer->stats.saved, __ATOMIC_RELAXED);
+	stats->edges = __atomic_load_n(&coalescer->stats.edges, __ATOMIC_RELAXED);
+	stats->flushes = __atomic_load_n(&coalescer->stats.flushes, __ATOMIC_RELAXED);
+}
+
+#endif /* XboxOneCoalescer_h */
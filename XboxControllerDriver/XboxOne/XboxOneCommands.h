@@ -0,0 +1,357 @@
+//
+//  XboxOneCommands.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// A versioned buffer of tagged configuration commands, applied by the driver in a single user client call.
+// A control tool that changes many settings at connect time would otherwise make one round trip to the driver per setting.
+// Every command gets its own result, so one bad command does not hide whether the rest were applied.
+// This code is not specific to DriverKit in any way, so clients can use the same header to build command buffers.
+//
+
+#ifndef XboxOneCommands_h
+#define XboxOneCommands_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "XboxOneAxisTransform.h"
+#include "XboxOneInputPackets.h"
+#include "XboxOneRemap.h"
+#include "XboxOneStickFilter.h"
+
+/// The version of the command buffer layout this driver understands.
+constexpr uint32_t XBOXONE_COMMAND_VERSION = 1;
+/// The largest command buffer, which is the most that can be passed inline as a structure input.
+constexpr uint32_t XBOXONE_COMMAND_BUFFER_MAX_SIZE = 4096;
+/// The most commands in a single buffer.
+constexpr uint32_t XBOXONE_COMMAND_MAX = 64;
+/// Every command starts on a multiple of this many bytes.
+constexpr uint32_t XBOXONE_COMMAND_ALIGNMENT = 4;
+
+/// The start of a command buffer, followed by `count` commands.
+///
+/// `version` - Must be `XBOXONE_COMMAND_VERSION`.
+/// `count` - The number of commands that follow, up to `XBOXONE_COMMAND_MAX`.
+typedef struct {
+	uint32_t version;
+	uint32_t count;
+} xboxone_command_buffer_header;
+
+/// Enumeration of the commands, with the payload each one carries.
+///
+/// `XBOXONE_COMMAND_SET_ENABLE` - Enables or disables the driver. `xboxone_enable_command`.
+/// `XBOXONE_COMMAND_SET_REPORT_FILTER` - Configures the change-threshold report filter. `xboxone_report_filter_command`.
+/// `XBOXONE_COMMAND_SET_AXIS_TRANSFORM` - Uploads deadzones and response curves. `xboxone_axis_transform_config`.
+/// `XBOXONE_COMMAND_SET_TRACE_CATEGORIES` - Switches trace categories on and off. `xboxone_trace_categories_command`.
+/// `XBOXONE_COMMAND_RUMBLE` - Drives the rumble motors. `xboxone_rumble_command`.
+/// `XBOXONE_COMMAND_SET_COALESCING` - Sets the coalescing window for button reports. `xboxone_coalescing_command`.
+/// `XBOXONE_COMMAND_SET_REMAP` - Uploads button remapping and axis swaps. `xboxone_remap_config`.
+/// `XBOXONE_COMMAND_SET_STICK_FILTER` - Configures the smoothing of stick jitter. `xboxone_stick_filter_config`.
+typedef enum : uint16_t {
+	XBOXONE_COMMAND_SET_ENABLE = 1,
+	XBOXONE_COMMAND_SET_REPORT_FILTER,
+	XBOXONE_COMMAND_SET_AXIS_TRANSFORM,
+	XBOXONE_COMMAND_SET_TRACE_CATEGORIES,
+	XBOXONE_COMMAND_RUMBLE,
+	XBOXONE_COMMAND_SET_COALESCING,
+	XBOXONE_COMMAND_SET_REMAP,
+	XBOXONE_COMMAND_SET_STICK_FILTER,
+} xboxone_command_tag;
+
+/// The start of a single command, followed by its payload and then padding up to `XBOXONE_COMMAND_ALIGNMENT`.
+///
+/// `tag` - An `xboxone_command_tag`.
+/// `length` - The size of the payload, not counting padding.
+typedef struct {
+	uint16_t tag;
+	uint16_t length;
+} xboxone_command_header;
+
+/// The payload of `XBOXONE_COMMAND_SET_ENABLE`.
+///
+/// `enabled` - Non-zero to send reports onward.
+typedef struct {
+	uint32_t enabled;
+} xboxone_enable_command;
+
+/// The payload of `XBOXONE_COMMAND_SET_REPORT_FILTER`.
+///
+/// `enabled` - Non-zero to filter reports.
+/// `thresholds` - The threshold of each axis, indexed by `xboxone_axis`.
+typedef struct {
+	uint32_t enabled;
+	uint16_t thresholds[XBOXONE_AXIS_COUNT];
+} xboxone_report_filter_command;
+
+/// The payload of `XBOXONE_COMMAND_SET_TRACE_CATEGORIES`.
+///
+/// `categories` - A mask of `xboxone_trace_category`.
+typedef struct {
+	uint32_t categories;
+} xboxone_trace_categories_command;
+
+/// The payload of `XBOXONE_COMMAND_RUMBLE`. The fields are those of `xboxone_rumble_packet`.
+typedef struct {
+	uint8_t motors;
+	uint8_t leftTrigger;
+	uint8_t rightTrigger;
+	uint8_t left;
+	uint8_t right;
+	uint8_t duration;
+	uint8_t delay;
+	uint8_t repeat;
+} xboxone_rumble_command;
+
+/// The payload of `XBOXONE_COMMAND_SET_COALESCING`.
+///
+/// `windowMicroseconds` - The window, up to `XBOXONE_COALESCE_MAX_WINDOW_MICROSECONDS`, or 0 to not coalesce.
+typedef struct {
+	uint32_t windowMicroseconds;
+} xboxone_coalescing_command;
+
+/// The result of every command in a buffer, as returned through the user client.
+///
+/// `version` - `XBOXONE_COMMAND_VERSION`.
+/// `count` - The number of entries of `results` that were filled in, which is the `count` of the buffer.
+/// `results` - The `IOReturn` of each command, in order.
+typedef struct {
+	uint32_t version;
+	uint32_t count;
+	int32_t results[XBOXONE_COMMAND_MAX];
+} xboxone_command_results;
+
+/// The payload size of a command, or 0 if the tag is unknown.
+constexpr uint32_t XboxOneCommandPayloadSize(uint16_t tag)
+{
+	switch (tag)
+	{
+		case XBOXONE_COMMAND_SET_ENABLE:
+			return sizeof(xboxone_enable_command);
+		case XBOXONE_COMMAND_SET_REPORT_FILTER:
+			return sizeof(xboxone_report_filter_command);
+		case XBOXONE_COMMAND_SET_AXIS_TRANSFORM:
+			return sizeof(xboxone_axis_transform_config);
+		case XBOXONE_COMMAND_SET_TRACE_CATEGORIES:
+			return sizeof(xboxone_trace_categories_command);
+		case XBOXONE_COMMAND_RUMBLE:
+			return sizeof(xboxone_rumble_command);
+		case XBOXONE_COMMAND_SET_COALESCING:
+			return sizeof(xboxone_coalescing_command);
+		case XBOXONE_COMMAND_SET_REMAP:
+			return sizeof(xboxone_remap_config);
+		case XBOXONE_COMMAND_SET_STICK_FILTER:
+			return sizeof(xboxone_stick_filter_config);
+		default:
+			return 0;
+	}
+}
+
+/// Whether a command changes the `xboxone_config`, so a batch can apply every such command to one copy and publish it once.
+constexpr bool XboxOneCommandChangesConfig(uint16_t tag)
+{
+	switch (tag)
+	{
+		case XBOXONE_COMMAND_SET_REPORT_FILTER:
+		case XBOXONE_COMMAND_SET_AXIS_TRANSFORM:
+		case XBOXONE_COMMAND_SET_REMAP:
+		case XBOXONE_COMMAND_SET_STICK_FILTER:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// The space a command takes in a buffer, including its header and padding.
+constexpr uint32_t XboxOneCommandSize(uint32_t length)
+{
+	return (uint32_t)((sizeof(xboxone_command_header) + length + XBOXONE_COMMAND_ALIGNMENT - 1) & ~(XBOXONE_COMMAND_ALIGNMENT - 1));
+}
+
+
+
+
+// MARK: - Building
+
+/// A command buffer being built by a client.
+///
+/// `buffer` - Where the buffer is built.
+/// `capacity` - The size of `buffer`.
+/// `size` - The number of bytes of `buffer` used so far.
+typedef struct {
+	uint8_t* buffer;
+	uint32_t capacity;
+	uint32_t size;
+} xboxone_command_writer;
+
+/// Starts an empty command buffer in `buffer`, returning false if it is too small to hold even the buffer header.
+inline bool XboxOneCommandWriterInit(xboxone_command_writer* writer, uint8_t* buffer, uint32_t capacity)
+{
+	xboxone_command_buffer_header header = { .version = XBOXONE_COMMAND_VERSION, .count = 0 };
+
+	writer->buffer = buffer;
+	writer->capacity = (capacity > XBOXONE_COMMAND_BUFFER_MAX_SIZE) ? XBOXONE_COMMAND_BUFFER_MAX_SIZE : capacity;
+	writer->size = 0;
+
+	if (writer->capacity < sizeof(header))
+	{
+		return false;
+	}
+
+	memcpy(buffer, &header, sizeof(header));
+	writer->size = sizeof(header);
+	return true;
+}
+
+/// Appends a command, returning false if the buffer is full.
+inline bool XboxOneCommandAppend(xboxone_command_writer* writer, xboxone_command_tag tag, const void* payload, uint32_t length)
+{
+	xboxone_command_buffer_header header = {};
+	xboxone_command_header command = { .tag = tag, .length = (uint16_t)length };
+	uint32_t size = XboxOneCommandSize(length);
+
+	if (writer->size < sizeof(header) || length > UINT16_MAX || size > writer->capacity - writer->size)
+	{
+		return false;
+	}
+
+	memcpy(&header, writer->buffer, sizeof(header));
+	if (header.count >= XBOXONE_COMMAND_MAX)
+	{
+		return false;
+	}
+
+	memset(writer->buffer + writer->size, 0, size);
+	memcpy(writer->buffer + writer->size, &command, sizeof(command));
+	memcpy(writer->buffer + writer->size + sizeof(command), payload, length);
+	writer->size += size;
+
+	header.count++;
+	memcpy(writer->buffer, &header, sizeof(header));
+	return true;
+}
+
+
+
+
+// MARK: - Reading
+
+/// Reads the buffer header, returning false if the buffer is too small, of another version, or holds too many commands.
+inline bool XboxOneCommandReadHeader(const uint8_t* buffer, uint32_t size, xboxone_command_buffer_header* header)
+{
+	if (size < sizeof(*header) || size > XBOXONE_COMMAND_BUFFER_MAX_SIZE)
+	{
+		return false;
+	}
+
+	memcpy(header, buffer, sizeof(*header));
+	return header->version == XBOXONE_COMMAND_VERSION && header->count <= XBOXONE_COMMAND_MAX;
+}
+
+/// Reads the command at `*offset` and advances the offset past it, returning false if the command runs past the end of the buffer.
+///
+/// `*offset` should start at `sizeof(xboxone_command_buffer_header)`.
+/// Once this returns false, the boundaries of any later commands are unknown, so they cannot be read either.
+inline bool XboxOneCommandNext(const uint8_t* buffer, uint32_t size, uint32_t* offset, xboxone_command_header* command, const uint8_t** payload)
+{
+	if (*offset > size || size - *offset < sizeof(*command))
+	{
+		return false;
+	}
+
+	memcpy(command, buffer + *offset, sizeof(*command));
+	if (XboxOneCommandSize(command->length) > size - *offset)
+	{
+		return false;
+	}
+
+	*payload = buffer + *offset + sizeof(*command);
+	*offset += XboxOneCommandSize(command->length);
+	return true;
+}
+
+/// Enumeration of what reading a command found.
+///
+/// `XBOXONE_COMMAND_VALID` - The command can be applied.
+/// `XBOXONE_COMMAND_UNREADABLE` - The command runs past the end of the buffer, or follows one that did, so where it starts is unknown.
+/// `XBOXONE_COMMAND_UNKNOWN` - The tag is not an `xboxone_command_tag`. Later commands are still read.
+/// `XBOXONE_COMMAND_BAD_LENGTH` - The payload is not the size the tag expects. Later commands are still read.
+typedef enum : uint8_t {
+	XBOXONE_COMMAND_VALID = 0,
+	XBOXONE_COMMAND_UNREADABLE,
+	XBOXONE_COMMAND_UNKNOWN,
+	XBOXONE_COMMAND_BAD_LENGTH,
+} xboxone_command_status;
+
+/// A command read from a buffer.
+///
+/// `command` - Its header. Only meaningful if `status` is not `XBOXONE_COMMAND_UNREADABLE`.
+/// `payload` - Its payload, within the buffer, or `nullptr` if it could not be read.
+/// `status` - Whether it can be applied.
+typedef struct {
+	xboxone_command_header command;
+	const uint8_t* payload;
+	xboxone_command_status status;
+} xboxone_parsed_command;
+
+/// Reads the `count` commands of a buffer whose header was accepted by `XboxOneCommandReadHeader`, filling in one entry of `commands` for each.
+///
+/// A command with an unknown tag or the wrong payload size fails alone, since its length still says where the next command starts.
+/// A command that runs past the end of the buffer fails along with every command after it.
+inline void XboxOneCommandParse(const uint8_t* buffer, uint32_t size, uint32_t count, xboxone_parsed_command* commands)
+{
+	uint32_t offset = sizeof(xboxone_command_buffer_header);
+	bool readable = true;
+
+	for (uint32_t index = 0; index < count; ++index)
+	{
+		xboxone_parsed_command* parsed = &commands[index];
+
+		*parsed = {};
+		readable = readable && XboxOneCommandNext(buffer, size, &offset, &parsed->command, &parsed->payload);
+
+		if (readable == false)
+		{
+			parsed->payload = nullptr;
+			parsed->status = XBOXONE_COMMAND_UNREADABLE;
+		}
+		else if (XboxOneCommandPayloadSize(parsed->command.tag) == 0)
+		{
+			parsed->status = XBOXONE_COMMAND_UNKNOWN;
+		}
+		else if (parsed->command.length != XboxOneCommandPayloadSize(parsed->command.tag))
+		{
+			parsed->status = XBOXONE_COMMAND_BAD_LENGTH;
+		}
+		else
+		{
+			parsed->status = XBOXONE_COMMAND_VALID;
+		}
+	}
+}
+
+/// Builds the rumble packet for a rumble command. The counter is stamped when the packet is sent.
+inline void XboxOneCommandRumblePacket(const xboxone_rumble_command* command, xboxone_rumble_packet* packet)
+{
+	*packet = {
+		.header = {
+			.packetType = 0x09,
+			.version = 0x00,
+			.counter = 0x00,
+			.size = XBOXONE_RUMBLE_PACKET_SIZE - XBOXONE_REPORT_HEADER_SIZE,
+		},
+		.reserved = 0x00,
+		.motors = command->motors,
+		.leftTrigger = command->leftTrigger,
+		.rightTrigger = command->rightTrigger,
+		.left = command->left,
+		.right = command->right,
+		.duration = command->duration,
+		.delay = command->delay,
+		.repeat = command->repeat,
+	};
+}
+
+#endif /* XboxOneCommands_h */
@@ -0,0 +1,42 @@
+//
+//  XboxOneConfig.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Everything about how a single Xbox One controller's reports are processed that is set through the user client, in one immutable snapshot.
+// The input path reads the whole snapshot through one atomic pointer, so it never sees a filter, transform, or remap that is only half applied.
+// This code is not specific to DriverKit in any way, so a configuration can be replayed without a device.
+//
+
+#ifndef XboxOneConfig_h
+#define XboxOneConfig_h
+
+#include <stdint.h>
+
+#include "XboxOneAxisTransform.h"
+#include "XboxOneRemap.h"
+#include "XboxOneReportFilter.h"
+#include "XboxOneStickFilter.h"
+
+/// The processing configuration of a controller.
+///
+/// Once published, a configuration is never changed. A change is made to a copy, which replaces it.
+/// `generation` - One more than the generation of the configuration it replaced, so the input path can tell when it changed.
+/// `reportFilter` - Which button reports barely differ from the last one delivered.
+/// `stickFilter` - The smoothing of stick jitter, applied to button reports before anything else.
+/// `axisTransform` - Deadzones and response curves applied to button reports.
+/// `remap` - Button remapping, and axis swaps and inversions, applied to button reports after `axisTransform`.
+typedef struct {
+	uint64_t generation;
+	xboxone_report_filter_config reportFilter;
+	xboxone_stick_filter_plan stickFilter;
+	xboxone_axis_transform_plan axisTransform;
+	xboxone_remap_plan remap;
+} xboxone_config;
+
+/// The configuration of a newly connected controller, which filters, transforms, and remaps nothing. It is never freed.
+inline constexpr xboxone_config XBOXONE_DEFAULT_CONFIG = {};
+
+#endif /* XboxOneConfig_h */
@@ -17,13 +17,41 @@
 //
 
 #include <os/log.h>
+#include <mach/mach_time.h>
 #include <DriverKit/DriverKit.h>
 #include <USBDriverKit/USBDriverKit.h>
 #include <HIDDriverKit/HIDDriverKit.h>
 
 #include <HIDConstants.h>
+#include <BufferPool.h>
+#include <ConfigSnapshot.h>
+#include <DescriptorCache.h>
+#include <InputPath.h>
+#include <InputRing.h>
+#include <LocationRegistry.h>
+#include <OutputQueue.h>
+#include <PacketCapture.h>
+#include <PacketRing.h>
+#include <PipeRecovery.h>
+#include <TraceRing.h>
 #include "XboxOneInputInterface.h"
+#include "XboxOneAxisTransform.h"
+#include "XboxOneButtonEvents.h"
+#include "XboxOneCoalescer.h"
+#include "XboxOneCommands.h"
+#include "XboxOneConfig.h"
 #include "XboxOneInputPackets.h"
+#include "XboxOneLatency.h"
+#include "XboxOneLinkMonitor.h"
+#include "XboxOneMetrics.h"
+#include "XboxOnePacketDispatch.h"
+#include "XboxOneProtocol.h"
+#include "XboxOneRemap.h"
+#include "XboxOneReportFilter.h"
+#include "XboxOneStatePage.h"
+#include "XboxOneStickFilter.h"
+#include "XboxOneTraceEvents.h"
+#include "XboxOneTraits.h"
 #include "XboxOneUserClient.h"
 
 namespace XboxOne {
@@ -44,47 +72,93 @@ namespace XboxOne {
 #define DebugLog(fmt, ...)
 #endif
 
-#if DEBUG
-void DebugPrintButtonPacket(const uint8_t* data)
-{
-	Log("HandleControllerReport() - "
-		"[ 0x%x 0x%x 0x%x 0x%x ] "
-		"Button: [ 0x%x 0x%x ] "
-		"TrigL: [ 0x%x 0x%x ] "
-		"TrigR: [ 0x%x 0x%x ] "
-		"LeftX: [ 0x%x 0x%x ] "
-		"LeftY: [ 0x%x 0x%x ] "
-		"RightX: [ 0x%x 0x%x ] "
-		"RightY: [ 0x%x 0x%x ]",
-		data[0], data[1], data[2], data[3],
-		data[4], data[5],
-		data[6], data[7],
-		data[8], data[9],
-		data[10], data[11],
-		data[12], data[13],
-		data[14], data[15],
-		data[16], data[17]
-	);
-}
-#else
-#define DebugPrintButtonPacket(data)
-#endif
+/// Records a trace event in the instance's trace ring, if its category is switched on.
+/// The arguments and the timestamp are only evaluated when the event is recorded.
+#define Trace(event, arg0, arg1, arg2) \
+	do { \
+		if (TraceRingEnabled(&ivars->trace, XboxOneTraceCategory(event))) \
+		{ \
+			TraceRingWrite(&ivars->trace, (event), mach_absolute_time(), (uint32_t)(arg0), (uint32_t)(arg1), (uint32_t)(arg2)); \
+		} \
+	} while (0)
 
 
 
 
 // MARK: - Driver Lifecycle
 
-constexpr uint8_t INIT_PACKET[] = { 0x05, 0x20, 0x00, 0x01, 0x00 };
-constexpr uint8_t INIT_PACKET_SIZE = sizeof(INIT_PACKET);
-constexpr uint8_t SWAP_TO_WIRED_PACKET[] = { 0x05, 0x20, 0x00, 0x0f, 0x06 };
-constexpr uint8_t SWAP_TO_WIRED_PACKET_SIZE = sizeof(SWAP_TO_WIRED_PACKET);
+/// The personality key that sets how many reads are kept outstanding on the `IN` pipe.
+constexpr const char* kXboxOneInputRingDepthKey = "XboxOneInputRingDepth";
+
+/// Strings that the USB host stack already read from the device during enumeration, published as properties of the `IOUSBHostDevice`.
+constexpr const char* kUSBDeviceVendorNameKey = "USB Vendor Name";
+constexpr const char* kUSBDeviceProductNameKey = "USB Product Name";
+constexpr const char* kUSBDeviceSerialNumberKey = "USB Serial Number";
+/// Fields of the device descriptor, published as properties of the `IOUSBHostDevice` and `IOUSBHostInterface` for matching.
+constexpr const char* kUSBDeviceVendorIDKey = "idVendor";
+constexpr const char* kUSBDeviceProductIDKey = "idProduct";
+constexpr const char* kUSBDeviceReleaseKey = "bcdDevice";
+
+/// The name of the serial queue each controller runs on.
+constexpr const char* kXboxOneInputQueueName = "XboxOneInput";
+
+/// The most clients that can wait for button events at once on a single controller.
+constexpr uint32_t kXboxOneMaxButtonEventWaiters = 8;
+
+/// The most buffers a single controller takes from `bufferPool`: one for each pipe, and one for each input and output slot.
+constexpr uint32_t kXboxOneMaxPooledBuffers = 2 + INPUT_RING_MAX_SLOTS + OUTPUT_QUEUE_MAX_SLOTS;
+
+/// Device details shared by every controller handled by this driver process, keyed by serial number.
+static descriptor_cache descriptorCache;
+/// Transfer buffers shared by every controller handled by this driver process.
+static buffer_pool bufferPool;
+/// The buffer behind each index of `bufferPool`, keyed by the host controller it was created for.
+/// A buffer is created the first time its index is taken, and is kept for as long as the process runs, unless a controller on another host controller takes its index.
+static buffer_memory_descriptor pooledBuffers[BUFFER_POOL_CAPACITY];
+/// Every running controller handled by this driver process, keyed by USB location ID.
+static location_registry controllerRegistry;
+/// Serializes every use of `descriptorCache`, `bufferPool` and `controllerRegistry`, none of which is ever touched by the input path.
+/// It is created by the first controller to be initialized, and kept for as long as the process runs.
+static IOLock* sharedLock;
+
+/// The reference stored in each `GotData` action, identifying which input slot completed.
+typedef struct {
+	uint32_t slot;
+} input_slot_reference;
+
+/// The reference stored in each `SentData` action, identifying which output slot completed.
+typedef struct {
+	uint32_t slot;
+} output_slot_reference;
+
+/// A client waiting for button events past `cursor`, which is completed once and then forgotten.
+///
+/// `client` - The user client the wait came through, which `action` is completed on.
+/// `action` - The completion the client is waiting on.
+/// `cursor` - The number of events the client has already read.
+typedef struct {
+	IOUserClient* client;
+	OSAction* action;
+	uint64_t cursor;
+} button_event_waiter;
+
+static_assert(OUTPUT_QUEUE_PRIORITIES == XBOXONE_OUTPUT_PRIORITY_COUNT, "Every xboxone_output_priority needs its own output queue class.");
 
 /// Stored variables of the Xbox One controller interface
 struct XboxOneInputInterface_IVars
 {
 	/// The handle to the controller USB interface.
 	IOUSBHostInterface* interface;
+	/// The serial queue that this controller's callbacks run on, separate from every other controller in the process.
+	IODispatchQueue* queue;
+	/// `idVendor` of the controller.
+	uint16_t vendorID;
+	/// `idProduct` of the controller.
+	uint16_t productID;
+	/// The USB location ID of the controller, which it is registered under in `controllerRegistry`.
+	uint32_t locationID;
+	/// Whether the controller is registered in `controllerRegistry`.
+	bool registered;
 
 	/// The USB configuration descriptor provided by the Xbox One controller.
 	const IOUSBConfigurationDescriptor* configurationDescriptor;
@@ -92,18 +166,102 @@ struct XboxOneInputInterface_IVars
 	const IOUSBInterfaceDescriptor* interfaceDescriptor;
 
 	/// Objects related to the pipes sending data from the Xbox One controller to the Apple device.
+	/// Its `memory` holds the report currently being delivered to `handleReport`.
 	usb_pipe_data inPipe;
 	/// Objects related to the pipes sending data from the Apple device to the Xbox One controller.
+	/// Packets are sent from `outputSlots` rather than its `memory`, so that several can be in flight.
 	usb_pipe_data outPipe;
-	/// Function pointer to the data callback `GotData_Impl`.
-	OSAction* gotDataAction;
 
-	/// Incrementing counter important for Xbox One controller-specific behavior.
-	uint8_t outCounter;
-	/// Whether on not the driver should send packets onward. This is controlled via the user client.
-	bool enabled;
+	/// The buffers that each outstanding read on the `IN` pipe is completed into.
+	buffer_memory_descriptor inputSlots[INPUT_RING_MAX_SLOTS];
+	/// Function pointers to the data callback `GotData_Impl`, one for each input slot.
+	OSAction* gotDataActions[INPUT_RING_MAX_SLOTS];
+	/// Ordering, staging, arming and recovery of the reads outstanding on the `IN` pipe.
+	/// Its `enabled` says whether or not the driver should send packets onward. This is controlled via the user client.
+	/// While it is false, no reads are outstanding on the `IN` pipe, and every input slot is held in its `idleSlots`.
+	input_path inputPath;
+	/// The timer that resumes the `IN` pipe once `inputPath.recovery` has waited long enough.
+	IOTimerDispatchSource* recoveryTimer;
+	/// Function pointer to the timer callback `RecoveryTimerFired_Impl`.
+	OSAction* recoveryTimerAction;
+	/// Holds back button reports that arrive faster than its window. The window is controlled via the user client.
+	xboxone_coalescer coalescer;
+	/// The timer that delivers the report held by `coalescer` when its window closes.
+	IOTimerDispatchSource* coalesceTimer;
+	/// Function pointer to the timer callback `CoalesceTimerFired_Impl`.
+	OSAction* coalesceTimerAction;
+	/// The buffers that each transfer in flight on the `OUT` pipe is sent from.
+	buffer_memory_descriptor outputSlots[OUTPUT_QUEUE_MAX_SLOTS];
+	/// Function pointers to the send callback `SentData_Impl`, one for each output slot.
+	OSAction* sentDataActions[OUTPUT_QUEUE_MAX_SLOTS];
+	/// Packets waiting for a free output slot, by priority.
+	output_queue outputQueue;
+	/// The `bufferPool` indexes of every buffer this controller took, to give back when it is freed.
+	uint32_t pooledIndexes[kXboxOneMaxPooledBuffers];
+	/// The number of indexes in `pooledIndexes`.
+	uint32_t pooledIndexCount;
+	/// The number of `GotData` and `SentData` actions still waiting to be canceled during `Stop`.
+	uint32_t pendingCancels;
+	/// The protocol state of the controller, including its model. Its configuration is replaced via the user client.
+	xboxone_protocol protocol;
+	/// Serializes changes to the configuration in `protocol`, so that two made at once do not lose one. The input path never takes it.
+	IOLock* configLock;
+	/// Packet loss and arrival jitter of the `IN` pipe. This is read via the user client.
+	xboxone_link_monitor linkMonitor;
+	/// Latency histograms of the input path. This is read via the user client.
+	xboxone_latency_monitor latency;
+	/// The ratio of absolute time ticks to nanoseconds.
+	mach_timebase_info_data_t timebase;
+	/// Whether the strings of the device description that would have been read from the device came from `descriptorCache`. This is read via the user client.
+	bool descriptorCacheHit;
+	/// The number of string descriptors read from the device with control transfers to build the device description. This is read via the user client.
+	uint32_t descriptorStringsRead;
+	/// How much faster the device description was built than when the device was first seen, in absolute time ticks.
+	uint64_t descriptorCacheSavedTicks;
+	/// How long it took to gather the details for the device description, in absolute time ticks.
+	uint64_t descriptionTicks;
+	/// The memory holding the raw packet ring, which is mapped into the user client on request.
+	IOBufferMemoryDescriptor* packetStream;
+	/// The driver's side of the raw packet ring.
+	packet_ring_producer packetProducer;
+	/// The user client that has mapped the raw packet ring, or `nullptr` if none has, in which case nothing is appended to it.
+	/// It is only compared and never used, so it is not retained. The user client releases the ring when it stops.
+	IOUserClient* packetStreamClient;
+	/// The memory holding the latest controller state, which is mapped read-only into user clients on request.
+	IOBufferMemoryDescriptor* statePage;
+	/// The driver's side of the state page.
+	xboxone_state_publisher statePublisher;
+	/// The memory holding the binary trace ring, which is mapped read-only into user clients on request.
+	IOBufferMemoryDescriptor* traceBuffer;
+	/// The driver's side of the trace ring. Which categories are recorded is controlled via the user client.
+	trace_ring_writer trace;
+	/// The memory holding the button event ring, which is mapped read-only into user clients on request.
+	IOBufferMemoryDescriptor* buttonEventBuffer;
+	/// The driver's side of the button event ring.
+	trace_ring_writer buttonEvents;
+	/// The button state that each report is compared against to find presses and releases.
+	xboxone_button_edges buttonEdges;
+	/// Clients waiting for the next button event. Only touched on the controller's own queue.
+	button_event_waiter buttonEventWaiters[kXboxOneMaxButtonEventWaiters];
+	/// The number of entries of `buttonEventWaiters` in use.
+	uint32_t buttonEventWaiterCount;
+
+	/// The allocation `metrics` was placed in, which is larger than `xboxone_metrics` so that `metrics` can be aligned to a cache line.
+	void* metricsAllocation;
+	/// Operational counters of the input and output paths. This is read via the user client.
+	xboxone_metrics* metrics;
+
+	/// When `inputPath.enabled` last changed, in absolute time ticks.
+	uint64_t enabledSince;
 };
 
+/// The hooks through which `inputPath` reaches the `IN` pipe, each given the `ivars` as its context. They are defined with the rest of the input path.
+static int32_t RequestAsyncInterruptData(void* context, uint32_t slot);
+static pipe_error_class ClassifyPipeStatus(int32_t status);
+static void ClearInterruptStall(void* context);
+static void StartRecoveryTimer(void* context, uint64_t delay);
+static void TraceRecovery(void* context, uint32_t slot, pipe_recovery_action action, int32_t status);
+
 
 
 
@@ -130,7 +288,41 @@ bool XboxOneInputInterface::init(void)
 		goto Exit;
 	}
 
-	ivars->enabled = true;
+	// IOMallocZero makes no promise beyond the alignment of a pointer, so the counters are placed on the first cache line boundary inside a larger allocation.
+	ivars->metricsAllocation = IOMallocZero(sizeof(xboxone_metrics) + XBOXONE_METRICS_ALIGNMENT);
+	if (ivars->metricsAllocation == nullptr)
+	{
+		Log("init() - Failed to allocate memory for metrics.");
+		goto Exit;
+	}
+	ivars->metrics = (xboxone_metrics*)(((uintptr_t)ivars->metricsAllocation + XBOXONE_METRICS_ALIGNMENT - 1) & ~(uintptr_t)(XBOXONE_METRICS_ALIGNMENT - 1));
+
+	ivars->configLock = IOLockAlloc();
+	if (ivars->configLock == nullptr)
+	{
+		Log("init() - Failed to allocate configuration lock.");
+		goto Exit;
+	}
+
+	// Controllers can be initialized at the same time, so only the first to publish its lock keeps it.
+	if (__atomic_load_n(&sharedLock, __ATOMIC_ACQUIRE) == nullptr)
+	{
+		IOLock* lock = IOLockAlloc();
+		IOLock* expected = nullptr;
+
+		if (lock == nullptr)
+		{
+			Log("init() - Failed to allocate shared lock.");
+			goto Exit;
+		}
+		if (__atomic_compare_exchange_n(&sharedLock, &expected, lock, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == false)
+		{
+			IOLockFree(lock);
+		}
+	}
+
+	ivars->inputPath.enabled = true;
+	ivars->enabledSince = mach_absolute_time();
 
 	TraceLog("<< init()");
 	return true;
@@ -147,6 +339,24 @@ kern_return_t XboxOneInputInterface::Start_Impl(IOService* provider)
 
 	TraceLog(">> Start()");
 
+	XboxOneStartupBegin(&ivars->latency, mach_absolute_time());
+
+	// Many controllers can share this driver process, so each one gets its own serial queue.
+	// That way a busy controller can only delay its own completions, never those of another controller.
+	ret = IODispatchQueue::Create(kXboxOneInputQueueName, 0, 0, &ivars->queue);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("Start() - Failed to create dispatch queue with error: 0x%08x.", ret);
+		goto Exit;
+	}
+
+	ret = SetDispatchQueue(kIOServiceDefaultQueueName, ivars->queue);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("Start() - Failed to set dispatch queue with error: 0x%08x.", ret);
+		goto Exit;
+	}
+
 	ivars->interface = OSDynamicCast(IOUSBHostInterface, provider);
 	if (ivars->interface == nullptr)
 	{
@@ -200,6 +410,101 @@ Exit:
 	return false;
 }
 
+/// Looks up the traits of the connected controller model from its product ID.
+///
+/// Matching only lets supported models through, so an unknown model is treated as an Xbox One S rather than refused.
+inline bool XboxOneInputInterface::InitModel(void)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	OSDictionary* properties = nullptr;
+	const xboxone_model_info* model = nullptr;
+
+	TraceLog(">> initModel()");
+
+	ret = ivars->interface->CopyProperties(&properties);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("initModel() - Failed to copy interface properties with error: 0x%08x.", ret);
+		TraceLog("<< initModel()");
+		return false;
+	}
+
+	ivars->vendorID = (uint16_t)OSDictionaryGetUInt64Value(properties, kUSBDeviceVendorIDKey);
+	ivars->productID = (uint16_t)OSDictionaryGetUInt64Value(properties, kUSBDeviceProductIDKey);
+	OSSafeReleaseNULL(properties);
+
+	model = XboxOneFindModel(ivars->productID);
+	if (model == nullptr)
+	{
+		Log("initModel() - Unknown product ID 0x%04x, treating it as an %{public}s.", ivars->productID, XBOXONE_MODELS[XBOXONE_MODEL_ONE_S].name);
+		model = &XBOXONE_MODELS[XBOXONE_MODEL_ONE_S];
+	}
+	DebugLog("initModel() - Connected to an %{public}s.", model->name);
+
+	XboxOneProtocolInit(&ivars->protocol, model, &ivars->latency, mach_absolute_time);
+
+	TraceLog("<< initModel()");
+	return true;
+}
+
+/// Registers the controller in `controllerRegistry` under its USB location ID, so it can be found with `CopyControllerAtLocation`.
+///
+/// A controller that cannot be registered still works normally, it just cannot be looked up.
+inline void XboxOneInputInterface::RegisterController(void)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	OSDictionary* properties = nullptr;
+
+	TraceLog(">> registerController()");
+
+	ret = ivars->interface->CopyProperties(&properties);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("registerController() - Failed to copy interface properties with error: 0x%08x.", ret);
+		TraceLog("<< registerController()");
+		return;
+	}
+
+	ivars->locationID = (uint32_t)OSDictionaryGetUInt64Value(properties, kUSBHostPropertyLocationID);
+	OSSafeReleaseNULL(properties);
+
+	IOLockLock(sharedLock);
+	ivars->registered = LocationRegistryInsert(&controllerRegistry, ivars->locationID, this);
+	IOLockUnlock(sharedLock);
+	if (ivars->registered == false)
+	{
+		Log("registerController() - Failed to register the controller at location 0x%08x.", ivars->locationID);
+	}
+
+	TraceLog("<< registerController()");
+}
+
+/// Finds the running controller at a USB location ID, or returns `nullptr` if there is none.
+///
+/// The caller must release the returned controller.
+XboxOneInputInterface* XboxOneInputInterface::CopyControllerAtLocation(uint32_t locationID)
+{
+	XboxOneInputInterface* controller = nullptr;
+	IOLock* lock = __atomic_load_n(&sharedLock, __ATOMIC_ACQUIRE);
+
+	// Without the lock, no controller was ever initialized, let alone registered.
+	if (lock == nullptr)
+	{
+		return nullptr;
+	}
+
+	// The controller is retained before the lock is dropped, since `Stop` unregisters it under the same lock before it can be freed.
+	IOLockLock(lock);
+	controller = (XboxOneInputInterface*)LocationRegistryFind(&controllerRegistry, locationID);
+	if (controller != nullptr)
+	{
+		controller->retain();
+	}
+	IOLockUnlock(lock);
+
+	return controller;
+}
+
 /// Finds the `IN` and `OUT` interrupt pipes and their descriptors.
 inline bool XboxOneInputInterface::InitPipes(void)
 {
@@ -254,11 +559,92 @@ inline bool XboxOneInputInterface::InitPipes(void)
 	return false;
 }
 
+/// Fills in `memory` with a buffer of `size` bytes for transfers on one of the pipes.
+///
+/// Buffers are taken from `bufferPool`, so a controller that connects after another one on the same host controller left reuses its buffers
+/// instead of creating new ones. A buffer that is larger than the pool's, or that does not fit in the pool, is created for this controller alone.
+/// Either way, `memory` holds its own reference to the buffer.
+///
+/// Must be called after `RegisterController`, since the pool is keyed by the host controller in the location ID.
+inline bool XboxOneInputInterface::CreatePooledBuffer(uint64_t size, buffer_memory_descriptor* memory)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	uint64_t address = 0;
+	uint32_t index = 0;
+	bool taken = false;
+	bool reusable = false;
+
+	if (size <= BUFFER_POOL_BUFFER_SIZE && ivars->pooledIndexCount < kXboxOneMaxPooledBuffers)
+	{
+		IOLockLock(sharedLock);
+		taken = BufferPoolTake(&bufferPool, LocationRegistryHostController(ivars->locationID), &index, &reusable);
+		IOLockUnlock(sharedLock);
+	}
+
+	if (taken == true)
+	{
+		buffer_memory_descriptor* pooled = &pooledBuffers[index];
+
+		// The index is only ever used by one controller at a time, so its buffer can be created without holding the shared lock.
+		// Each buffer is created by an interface on the host controller it is reused on, so the memory meets that host controller's DMA requirements
+		// the same way as a buffer created outside the pool. One created for another host controller is replaced.
+		if (reusable == false)
+		{
+			OSSafeReleaseNULL(pooled->buffer);
+		}
+		if (pooled->buffer == nullptr)
+		{
+			ret = ivars->interface->CreateIOBuffer(kIOMemoryDirectionInOut, BUFFER_POOL_BUFFER_SIZE, &pooled->buffer);
+			if (ret == kIOReturnSuccess)
+			{
+				ret = pooled->buffer->Map(0, 0, 0, 0, &address, &pooled->length);
+			}
+			if (ret != kIOReturnSuccess)
+			{
+				Log("createPooledBuffer() - Failed to create pooled buffer %u with error: 0x%08x.", index, ret);
+				OSSafeReleaseNULL(pooled->buffer);
+				IOLockLock(sharedLock);
+				BufferPoolGive(&bufferPool, index);
+				IOLockUnlock(sharedLock);
+				return false;
+			}
+			pooled->address = (uint8_t*)address;
+		}
+
+		ivars->pooledIndexes[ivars->pooledIndexCount++] = index;
+
+		pooled->buffer->retain();
+		memory->buffer = pooled->buffer;
+		memory->address = pooled->address;
+		memory->length = size;
+		memset(memory->address, 0, BUFFER_POOL_BUFFER_SIZE);
+		return true;
+	}
+
+	DebugLog("createPooledBuffer() - Creating a %llu byte buffer outside of the pool.", size);
+
+	ret = ivars->interface->CreateIOBuffer(kIOMemoryDirectionInOut, size, &memory->buffer);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("createPooledBuffer() - Failed to create buffer with error: 0x%08x.", ret);
+		return false;
+	}
+
+	ret = memory->buffer->Map(0, 0, 0, 0, &address, &memory->length);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("createPooledBuffer() - Failed to map buffer with error: 0x%08x.", ret);
+		return false;
+	}
+	memory->address = (uint8_t*)address;
+
+	return true;
+}
+
 /// Collects all of the relevant data for a pipe into the passed data.
 inline bool XboxOneInputInterface::SetupPipe(usb_pipe_data* pipeData)
 {
 	kern_return_t ret = kIOReturnSuccess;
-	uint64_t address = 0;
 
 	TraceLog(">> setupPipe()");
 
@@ -283,22 +669,12 @@ inline bool XboxOneInputInterface::SetupPipe(usb_pipe_data* pipeData)
 		return false;
 	}
 
-	ret = ivars->interface->CreateIOBuffer(kIOMemoryDirectionInOut, pipeData->maxPacketSize, &pipeData->memory.buffer);
-	if (ret != kIOReturnSuccess)
-	{
-		Log("setupPipe() - Failed to create buffer with error: 0x%08x.", ret);
-		return false;
-	}
-
-	ret = (pipeData->memory.buffer)->Map(0, 0, 0, 0, &address, &pipeData->memory.length);
-	if (ret != kIOReturnSuccess)
+	if (CreatePooledBuffer(pipeData->maxPacketSize, &pipeData->memory) == false)
 	{
-		Log("setupPipe() - Failed to create buffer with error: 0x%08x.", ret);
+		Log("setupPipe() - Failed to create buffer.");
 		return false;
 	}
 
-	pipeData->memory.address = (uint8_t*)address;
-
 	TraceLog("<< setupPipe()");
 	return true;
 }
@@ -327,628 +703,2267 @@ inline bool XboxOneInputInterface::SetupPipes(void)
 	}
 	ivars->inPipe.reportSize = OSDictionaryGetUInt64Value(properties, kIOHIDMaxInputReportSizeKey);
 
-	result = SetupPipe(&ivars->outPipe);
+	// Completion timestamps are in absolute time, so the link monitor needs the polling interval in the same units.
+	{
+		mach_timebase_info_data_t* timebase = &ivars->timebase;
+		uint64_t intervalNanoseconds = (uint64_t)ivars->inPipe.interval * 1000000;
+
+		mach_timebase_info(timebase);
+		XboxOneLinkMonitorInit(&ivars->linkMonitor, (timebase->numer != 0) ? intervalNanoseconds * timebase->denom / timebase->numer : intervalNanoseconds);
+	}
+
+	result = SetupInputRing((uint32_t)OSDictionaryGetUInt64Value(properties, kXboxOneInputRingDepthKey));
 	if (result == false)
 	{
-		Log("setupPipes() - Failed to setup output pipe.");
+		Log("setupPipes() - Failed to setup input ring.");
 		goto Exit;
 	}
-	ivars->inPipe.reportSize = OSDictionaryGetUInt64Value(properties, kIOHIDMaxOutputReportSizeKey);
-
-	OSSafeReleaseNULL(properties);
-	TraceLog("<< setupPipes()");
-	return true;
-
-Exit:
-	OSSafeReleaseNULL(properties);
-	TraceLog("<< setupPipes()");
-	return false;
-}
 
-/// Called by DriverKit on startup of the driver, due to being a subclass of `IOUserHIDDevice`.
-///
-/// This is called toward the end for `Start_Impl` of `IOUserHIDDevice`. So it can be used to do final initialization after the rest of the driver is initialized.
-bool XboxOneInputInterface::handleStart(IOService* provider)
-{
-	bool result = false;
-	kern_return_t ret = kIOReturnSuccess;
-
-	TraceLog(">> handleStart()");
-
-	result = super::handleStart(provider);
+	result = SetupRecovery();
 	if (result == false)
 	{
-		Log("handleStart() - super::handleStart() failed.");
+		Log("setupPipes() - Failed to setup recovery.");
 		goto Exit;
 	}
 
-	result = InitDescriptors();
+	result = SetupCoalescing();
 	if (result == false)
 	{
-		Log("handleStart() - Failed to init descriptors.");
+		Log("setupPipes() - Failed to setup coalescing.");
 		goto Exit;
 	}
 
-	result = InitPipes();
+	result = SetupPacketStream();
 	if (result == false)
 	{
-		Log("handleStart() - Failed to init pipes.");
+		Log("setupPipes() - Failed to setup packet stream.");
 		goto Exit;
 	}
 
-	result = SetupPipes();
+	result = SetupStatePage();
 	if (result == false)
 	{
-		Log("handleStart() - Failed to setup pipes.");
+		Log("setupPipes() - Failed to setup state page.");
 		goto Exit;
 	}
 
-	// This is a generated function name.
-	// When `TYPE(IOUSBHostPipe::CompleteAsyncIO)` is added to a function in the `.iig`, this function will be generated.
-	// Some Apple documentation that references this behavior can be found here: https://developer.apple.com/documentation/driverkit/type
-	ret = CreateActionGotData(ivars->inPipe.memory.length, &(ivars->gotDataAction));
-	if (ret != kIOReturnSuccess)
+	result = SetupTraceRing();
+	if (result == false)
 	{
-		Log("handleStart() - Failed to establish callback object for receiving data with error: 0x%08x.", ret);
+		Log("setupPipes() - Failed to setup trace ring.");
 		goto Exit;
 	}
 
-	// This is specific to the Xbox One controller, which requires special packets to start up and send data.
-	SendInterruptData(INIT_PACKET, INIT_PACKET_SIZE);
-	SendInterruptData(SWAP_TO_WIRED_PACKET, SWAP_TO_WIRED_PACKET_SIZE);
+	result = SetupButtonEvents();
+	if (result == false)
+	{
+		Log("setupPipes() - Failed to setup button events.");
+		goto Exit;
+	}
 
-	// Starts listening for USB packets.
-	RequestAsyncInterruptData();
+	result = SetupPipe(&ivars->outPipe);
+	if (result == false)
+	{
+		Log("setupPipes() - Failed to setup output pipe.");
+		goto Exit;
+	}
 
-	ivars->interface->retain();
+	result = SetupOutputQueue();
+	if (result == false)
+	{
+		Log("setupPipes() - Failed to setup output queue.");
+		goto Exit;
+	}
+	ivars->inPipe.reportSize = OSDictionaryGetUInt64Value(properties, kIOHIDMaxOutputReportSizeKey);
 
-	TraceLog("<< handleStart()");
+	OSSafeReleaseNULL(properties);
+	TraceLog("<< setupPipes()");
 	return true;
 
 Exit:
-	TraceLog("<< handleStart()");
+	OSSafeReleaseNULL(properties);
+	TraceLog("<< setupPipes()");
 	return false;
 }
 
-
-
-
-// MARK: Driver Lifecycle - Shutdown
-
-/// Shutdown of the Xbox One controller interface
-kern_return_t XboxOneInputInterface::Stop_Impl(IOService* provider)
+/// Creates a buffer and a `GotData` action for each read that will be kept outstanding on the `IN` pipe.
+///
+/// A `slotCount` of 0 selects the default depth.
+inline bool XboxOneInputInterface::SetupInputRing(uint32_t slotCount)
 {
 	kern_return_t ret = kIOReturnSuccess;
 
-	TraceLog(">> Stop()");
+	TraceLog(">> setupInputRing()");
 
-	// If there's somehow nothing to cancel, "Stop" quickly and exit.
-	if (ivars->gotDataAction == nullptr)
+	InputRingInit(&ivars->inputPath.ring, slotCount);
+	DebugLog("setupInputRing() - Using %u input slots.", ivars->inputPath.ring.slotCount);
+
+	for (uint32_t slot = 0; slot < ivars->inputPath.ring.slotCount; ++slot)
 	{
-		ret = Stop(provider, SUPERDISPATCH);
-		if (ret != kIOReturnSuccess)
+		if (CreatePooledBuffer(ivars->inPipe.maxPacketSize, &ivars->inputSlots[slot]) == false)
 		{
-			Log("Stop() - super::Stop failed with error: 0x%08x.", ret);
+			Log("setupInputRing() - Failed to create buffer for slot %u.", slot);
+			return false;
 		}
 
-		TraceLog("<< Stop()");
-
-		return ret;
+		// This is a generated function name.
+		// When `TYPE(IOUSBHostPipe::CompleteAsyncIO)` is added to a function in the `.iig`, this function will be generated.
+		// Some Apple documentation that references this behavior can be found here: https://developer.apple.com/documentation/driverkit/type
+		// The action's reference is used to tell the completions of each slot apart.
+		ret = CreateActionGotData(sizeof(input_slot_reference), &ivars->gotDataActions[slot]);
+		if (ret != kIOReturnSuccess)
+		{
+			Log("setupInputRing() - Failed to establish callback object for slot %u with error: 0x%08x.", slot, ret);
+			return false;
+		}
+		((input_slot_reference*)ivars->gotDataActions[slot]->GetReference())->slot = slot;
 	}
-	// Otherwise, wait for some Cancels to get completed.
-
-
 
-	// Retain the driver instance and the provider so the finalization can properly stop the driver
-	this->retain();
-	provider->retain();
+	TraceLog("<< setupInputRing()");
+	return true;
+}
 
-	void (^finalize)(void) = ^{
+/// Creates the timer that resumes the `IN` pipe after an error, and resets its recovery state.
+///
+/// Must be called after the timebase is known, since the delays are kept in absolute time ticks.
+inline bool XboxOneInputInterface::SetupRecovery(void)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	uint32_t numer = (ivars->timebase.denom != 0) ? ivars->timebase.numer : 1;
+	uint32_t denom = (ivars->timebase.denom != 0) ? ivars->timebase.denom : 1;
+	pipe_recovery_config config = {
+		.baseDelay = PIPE_RECOVERY_DEFAULT_CONFIG.baseDelay * denom / numer,
+		.maxDelay = PIPE_RECOVERY_DEFAULT_CONFIG.maxDelay * denom / numer,
+		.parkAfter = PIPE_RECOVERY_DEFAULT_CONFIG.parkAfter,
+		.parkDelay = PIPE_RECOVERY_DEFAULT_CONFIG.parkDelay * denom / numer,
+	};
 
-		kern_return_t status = Stop(provider, SUPERDISPATCH);
-		if (status != kIOReturnSuccess)
-		{
-			Log("Stop() - super::Stop failed with error: 0x%08x.", status);
-		}
+	TraceLog(">> setupRecovery()");
+
+	PipeRecoveryInit(&ivars->inputPath.recovery, &config, mach_absolute_time());
+	ivars->inputPath.idleSlots = 0;
+	ivars->inputPath.hooks = {
+		.context = ivars,
+		.submit = RequestAsyncInterruptData,
+		.classify = ClassifyPipeStatus,
+		.clearStall = ClearInterruptStall,
+		.armTimer = StartRecoveryTimer,
+		.held = TraceRecovery,
+	};
 
-		TraceLog("<< Stop()");
+	ret = IOTimerDispatchSource::Create(ivars->queue, &ivars->recoveryTimer);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("setupRecovery() - Failed to create timer with error: 0x%08x.", ret);
+		return false;
+	}
 
-		this->release();
-		provider->release();
-	};
-	ivars->gotDataAction->Cancel(finalize);
+	// Generated from `TYPE(IOTimerDispatchSource::TimerOccurred)` in the `.iig`, just like `CreateActionGotData`.
+	ret = CreateActionRecoveryTimerFired(0, &ivars->recoveryTimerAction);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("setupRecovery() - Failed to establish timer callback with error: 0x%08x.", ret);
+		return false;
+	}
 
-	DebugLog("Stop() - Cancels started, they will stop the dext later.");
+	ret = ivars->recoveryTimer->SetHandler(ivars->recoveryTimerAction);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("setupRecovery() - Failed to set timer handler with error: 0x%08x.", ret);
+		return false;
+	}
 
-	return ret;
+	TraceLog("<< setupRecovery()");
+	return true;
 }
 
-/// Cleanup of the Xbox Controller interface
-void XboxOneInputInterface::free(void)
+/// Creates the timer that delivers coalesced reports. Coalescing starts out off, so every report is delivered at once.
+inline bool XboxOneInputInterface::SetupCoalescing(void)
 {
-	TraceLog("free()");
+	kern_return_t ret = kIOReturnSuccess;
 
-	if (ivars != nullptr)
+	TraceLog(">> setupCoalescing()");
+
+	ret = IOTimerDispatchSource::Create(ivars->queue, &ivars->coalesceTimer);
+	if (ret != kIOReturnSuccess)
 	{
-		if (ivars->configurationDescriptor != nullptr)
-		{
-			IOUSBHostFreeDescriptor(ivars->configurationDescriptor);
+		Log("setupCoalescing() - Failed to create timer with error: 0x%08x.", ret);
+		return false;
+	}
+
+	ret = CreateActionCoalesceTimerFired(0, &ivars->coalesceTimerAction);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("setupCoalescing() - Failed to establish timer callback with error: 0x%08x.", ret);
+		return false;
+	}
+
+	ret = ivars->coalesceTimer->SetHandler(ivars->coalesceTimerAction);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("setupCoalescing() - Failed to set timer handler with error: 0x%08x.", ret);
+		return false;
+	}
+
+	TraceLog("<< setupCoalescing()");
+	return true;
+}
+
+/// Creates a buffer and a `SentData` action for each transfer that can be in flight on the `OUT` pipe.
+inline bool XboxOneInputInterface::SetupOutputQueue(void)
+{
+	kern_return_t ret = kIOReturnSuccess;
+
+	TraceLog(">> setupOutputQueue()");
+
+	OutputQueueInit(&ivars->outputQueue, OUTPUT_QUEUE_MAX_SLOTS);
+
+	for (uint32_t slot = 0; slot < ivars->outputQueue.slotCount; ++slot)
+	{
+		if (CreatePooledBuffer(ivars->outPipe.maxPacketSize, &ivars->outputSlots[slot]) == false)
+		{
+			Log("setupOutputQueue() - Failed to create buffer for slot %u.", slot);
+			return false;
 		}
 
-		// NOTE: interfaceDescriptor is a `get`, not a `copy`, so doesn't need to be freed.
+		// Generated from `TYPE(IOUSBHostPipe::CompleteAsyncIO)` in the `.iig`, just like `CreateActionGotData`.
+		ret = CreateActionSentData(sizeof(output_slot_reference), &ivars->sentDataActions[slot]);
+		if (ret != kIOReturnSuccess)
+		{
+			Log("setupOutputQueue() - Failed to establish callback object for slot %u with error: 0x%08x.", slot, ret);
+			return false;
+		}
+		((output_slot_reference*)ivars->sentDataActions[slot]->GetReference())->slot = slot;
+	}
 
-		OSSafeReleaseNULL(ivars->inPipe.pipe);
-		OSSafeReleaseNULL(ivars->inPipe.memory.buffer);
-		OSSafeReleaseNULL(ivars->outPipe.pipe);
-		OSSafeReleaseNULL(ivars->outPipe.memory.buffer);
+	TraceLog("<< setupOutputQueue()");
+	return true;
+}
 
-		// NOTE: Pipe descriptors are a 'get', not a 'copy', so don't need to be freed.
+/// Creates the memory for the raw packet ring that user clients can map.
+///
+/// Nothing is appended to the ring until a user client maps it with `CopyPacketStream`.
+inline bool XboxOneInputInterface::SetupPacketStream(void)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	uint64_t address = 0;
+	uint64_t length = 0;
 
-		OSSafeReleaseNULL(ivars->gotDataAction);
-		OSSafeReleaseNULL(ivars->interface);
+	TraceLog(">> setupPacketStream()");
+
+	ret = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, sizeof(packet_ring), 0, &ivars->packetStream);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("setupPacketStream() - Failed to create buffer with error: 0x%08x.", ret);
+		return false;
 	}
 
-	IOSafeDeleteNULL(ivars, XboxOneInputInterface_IVars, 1);
+	ret = ivars->packetStream->SetLength(sizeof(packet_ring));
+	if (ret != kIOReturnSuccess)
+	{
+		Log("setupPacketStream() - Failed to set buffer length with error: 0x%08x.", ret);
+		return false;
+	}
 
-	super::free();
+	ret = ivars->packetStream->Map(0, 0, 0, 0, &address, &length);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("setupPacketStream() - Failed to map buffer with error: 0x%08x.", ret);
+		return false;
+	}
+
+	PacketRingInit(&ivars->packetProducer, (packet_ring*)address);
+
+	// A client saving the ring as a capture needs to know which device and report descriptor the packets belong to.
+	PacketRingDescribe((packet_ring*)address, ivars->vendorID, ivars->productID, PacketCaptureHash(XboxOne::ReportDescriptor, XboxOne::REPORT_DESCRIPTOR_SIZE));
+
+	TraceLog("<< setupPacketStream()");
+	return true;
 }
 
+/// Creates the memory for the controller state page that user clients can map.
+inline bool XboxOneInputInterface::SetupStatePage(void)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	uint64_t address = 0;
+	uint64_t length = 0;
+
+	TraceLog(">> setupStatePage()");
 
+	ret = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, sizeof(xboxone_state_page), 0, &ivars->statePage);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("setupStatePage() - Failed to create buffer with error: 0x%08x.", ret);
+		return false;
+	}
 
+	ret = ivars->statePage->SetLength(sizeof(xboxone_state_page));
+	if (ret != kIOReturnSuccess)
+	{
+		Log("setupStatePage() - Failed to set buffer length with error: 0x%08x.", ret);
+		return false;
+	}
 
-// MARK: - HID Lifecycle
+	ret = ivars->statePage->Map(0, 0, 0, 0, &address, &length);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("setupStatePage() - Failed to map buffer with error: 0x%08x.", ret);
+		return false;
+	}
 
-/// Helper function that creates an OSString for a particular descriptor index and language.
-OSString* XboxOneInputInterface::CopyStringAtIndex(uint8_t descriptorIndex, uint16_t descriptorLanguage)
+	XboxOneStatePageInit(&ivars->statePublisher, (xboxone_state_page*)address);
+
+	TraceLog("<< setupStatePage()");
+	return true;
+}
+
+/// Creates the memory for the binary trace ring that user clients can map.
+///
+/// Nothing is recorded until a user client switches on at least one category with `SetTraceCategories`.
+inline bool XboxOneInputInterface::SetupTraceRing(void)
 {
-	const uint8_t descriptorHeaderSize = sizeof(IOUSBDescriptorHeader);
-	const IOUSBStringDescriptor* descriptor = nullptr;
-	OSString* string = nullptr;
-	uint_fast8_t index = 0;
-	char result[256] = {};
+	kern_return_t ret = kIOReturnSuccess;
+	uint64_t address = 0;
+	uint64_t length = 0;
 
-	TraceLog(">> CopyStringAtIndex()");
+	TraceLog(">> setupTraceRing()");
 
-	if (descriptorIndex == 0)
+	ret = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, sizeof(trace_ring), 0, &ivars->traceBuffer);
+	if (ret != kIOReturnSuccess)
 	{
-		DebugLog("CopyStringAtIndex() - Asked for index 0.");
-		goto Exit;
+		Log("setupTraceRing() - Failed to create buffer with error: 0x%08x.", ret);
+		return false;
 	}
 
-	descriptor = ivars->interface->CopyStringDescriptor(descriptorIndex, descriptorLanguage);
-	if (descriptor == nullptr)
+	ret = ivars->traceBuffer->SetLength(sizeof(trace_ring));
+	if (ret != kIOReturnSuccess)
 	{
-		Log("CopyStringAtIndex() - Failed to copy string at index %d with language %d.", descriptorIndex, descriptorLanguage);
-		goto Exit;
+		Log("setupTraceRing() - Failed to set buffer length with error: 0x%08x.", ret);
+		return false;
 	}
 
-	if (descriptor->bLength < descriptorHeaderSize)
+	ret = ivars->traceBuffer->Map(0, 0, 0, 0, &address, &length);
+	if (ret != kIOReturnSuccess)
 	{
-		Log("CopyStringAtIndex() - Descriptor bLength invalid %d.", descriptor->bLength);
-		goto Exit;
+		Log("setupTraceRing() - Failed to map buffer with error: 0x%08x.", ret);
+		return false;
 	}
 
+	TraceRingInit(&ivars->trace, (trace_ring*)address);
 
-	{
-		uint8_t length = (descriptor->bLength - descriptorHeaderSize) / 2;
-		uint16_t* bString = (uint16_t*)descriptor->bString;
-		for (; index < length; ++index)
-		{
-			uint16_t value = bString[index];
-			if (value == 0)
-			{
-				break;
-			}
+	TraceLog("<< setupTraceRing()");
+	return true;
+}
 
-			result[index] = (uint8_t)value;
-		}
+/// Creates the memory holding the button event ring, which is shared read-only with user clients.
+inline bool XboxOneInputInterface::SetupButtonEvents(void)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	uint64_t address = 0;
+	uint64_t length = 0;
 
-		string = OSStringCreate(result, index);
+	TraceLog(">> setupButtonEvents()");
+
+	ret = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, sizeof(trace_ring), 0, &ivars->buttonEventBuffer);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("setupButtonEvents() - Failed to create buffer with error: 0x%08x.", ret);
+		return false;
 	}
 
+	ret = ivars->buttonEventBuffer->SetLength(sizeof(trace_ring));
+	if (ret != kIOReturnSuccess)
+	{
+		Log("setupButtonEvents() - Failed to set buffer length with error: 0x%08x.", ret);
+		return false;
+	}
 
-Exit:
-	if (descriptor != nullptr)
+	ret = ivars->buttonEventBuffer->Map(0, 0, 0, 0, &address, &length);
+	if (ret != kIOReturnSuccess)
 	{
-		IOUSBHostFreeDescriptor(descriptor);
+		Log("setupButtonEvents() - Failed to map buffer with error: 0x%08x.", ret);
+		return false;
 	}
 
-	TraceLog("<< CopyStringAtIndex()");
-	return string;
+	// Unlike the trace ring, every button event is always recorded, so its category mask is only set for the information of readers.
+	TraceRingInit(&ivars->buttonEvents, (trace_ring*)address);
+	TraceRingSetCategories(&ivars->buttonEvents, UINT32_MAX);
+	ivars->buttonEdges = {};
+
+	TraceLog("<< setupButtonEvents()");
+	return true;
 }
 
-/// Override of the `newDeviceDescription` function from `IOUserHIDDevice`.
-/// This is specific to the Xbox One controller, since it doesn't report a HID-compliant USB device description. So this function generates a new device description that is HID-compliant.
-/// Most USB drivers shouldn't need to override this function.
-OSDictionary* XboxOneInputInterface::newDeviceDescription(void)
+/// Called by DriverKit on startup of the driver, due to being a subclass of `IOUserHIDDevice`.
+///
+/// This is called toward the end for `Start_Impl` of `IOUserHIDDevice`. So it can be used to do final initialization after the rest of the driver is initialized.
+bool XboxOneInputInterface::handleStart(IOService* provider)
 {
-	OSDictionary* dict = nullptr;
-	OSDictionary* properties = nullptr;
-	IOUSBHostDevice* device = nullptr;
-	const IOUSBDeviceDescriptor* deviceDescriptor = nullptr;
+	bool result = false;
+	kern_return_t ret = kIOReturnSuccess;
 
-	TraceLog(">> newDeviceDescription");
+	TraceLog(">> handleStart()");
 
-	if (ivars->interface == nullptr)
+	result = super::handleStart(provider);
+	if (result == false)
 	{
-		Log("newDeviceDescription() - Interface is null. Something has gone terribly wrong.");
+		Log("handleStart() - super::handleStart() failed.");
 		goto Exit;
 	}
+	XboxOneStartupMark(&ivars->latency, XBOXONE_STARTUP_HID, mach_absolute_time());
 
-	ivars->interface->CopyProperties(&properties);
-	if (properties == nullptr)
+	result = InitDescriptors();
+	if (result == false)
 	{
-		Log("newDeviceDescription() - Failed to copy interface properties.");
+		Log("handleStart() - Failed to init descriptors.");
 		goto Exit;
 	}
+	XboxOneStartupMark(&ivars->latency, XBOXONE_STARTUP_DESCRIPTORS, mach_absolute_time());
 
-	ivars->interface->CopyDevice(&device);
-	if (device == nullptr)
+	result = InitModel();
+	if (result == false)
 	{
-		Log("newDeviceDescription() - Failed to copy the device.");
+		Log("handleStart() - Failed to init model.");
 		goto Exit;
 	}
 
-	deviceDescriptor = device->CopyDeviceDescriptor();
-	if (deviceDescriptor == nullptr)
+	RegisterController();
+
+	result = InitPipes();
+	if (result == false)
 	{
-		Log("newDeviceDescription() - Failed to copy device descriptor.");
+		Log("handleStart() - Failed to init pipes.");
 		goto Exit;
 	}
+	XboxOneStartupMark(&ivars->latency, XBOXONE_STARTUP_PIPES, mach_absolute_time());
 
-	// NOTE: This is saved to last in order to make cleanup easier.
-	dict = OSDictionary::withCapacity(16);
-	if (dict == nullptr)
+	result = SetupPipes();
+	if (result == false)
 	{
-		Log("newDeviceDescription() - Failed to create OSDictionary.");
+		Log("handleStart() - Failed to setup pipes.");
 		goto Exit;
 	}
+	XboxOneStartupMark(&ivars->latency, XBOXONE_STARTUP_BUFFERS, mach_absolute_time());
 
-	OSDictionarySetValue(dict, kIOHIDRegisterServiceKey, kOSBooleanTrue);
-	OSDictionarySetValue(dict, "HIDDefaultBehavior", kOSBooleanTrue);
-	OSDictionarySetValue(dict, "AppleVendorSupported", kOSBooleanTrue);
-
-	OSDictionarySetUInt64Value(dict, kIOHIDReportIntervalKey, ivars->inPipe.interval);
-	OSDictionarySetUInt64Value(dict, kIOHIDVendorIDKey, USBToHost16(deviceDescriptor->idVendor));
-	OSDictionarySetUInt64Value(dict, kIOHIDProductIDKey, USBToHost16(deviceDescriptor->idProduct));
-	OSDictionarySetStringValue(dict, kIOHIDTransportKey, "USB");
-	OSDictionarySetUInt64Value(dict, kIOHIDVersionNumberKey, USBToHost16(deviceDescriptor->bcdDevice));
-	OSDictionarySetUInt64Value(dict, kIOHIDCountryCodeKey, 0);
-	OSDictionarySetUInt64Value(dict, kIOHIDRequestTimeoutKey, kUSBHostClassRequestCompletionTimeout * 1000);
-	OSDictionarySetUInt64Value(dict, kIOHIDPrimaryUsagePageKey, XboxOne::ReportDescriptor[1]);
-	OSDictionarySetUInt64Value(dict, kIOHIDPrimaryUsageKey, XboxOne::ReportDescriptor[3]);
-
+	// Starts listening for USB packets, keeping a read outstanding on every slot.
+	// The reads are armed before the handshake is sent, so the first report is never waiting on a read to be submitted.
+	for (uint32_t slot = 0; slot < ivars->inputPath.ring.slotCount; ++slot)
 	{
-		OSObjectPtr value = OSDictionaryGetValue(properties, kUSBHostPropertyLocationID);
-		if (value != nullptr)
+		ret = RequestAsyncInterruptData(ivars, slot);
+		if (ret != kIOReturnSuccess)
 		{
-			OSDictionarySetValue(dict, kIOHIDLocationIDKey, value);
+			Log("handleStart() - Failed to request data on slot %u with error: 0x%08x.", slot, ret);
+			goto Exit;
 		}
 	}
+	XboxOneStartupMark(&ivars->latency, XBOXONE_STARTUP_ARMED, mach_absolute_time());
+
+	// This is specific to the Xbox One controller, which requires special packets to start up and send data.
+	// They are all queued in the same class, so they are still sent in this order.
+	for (uint32_t packet = 0; packet < ivars->protocol.model->handshakeCount; ++packet)
 	{
-		OSObjectPtr value = CopyStringAtIndex(deviceDescriptor->iManufacturer, kLanguageIDEnglishUS);
-		if (value != nullptr)
-		{
-			OSDictionarySetValue(dict, kIOHIDManufacturerKey, value);
-			OSSafeReleaseNULL(value);
-		}
+		SendInterruptData(ivars->protocol.model->handshake[packet].data, ivars->protocol.model->handshake[packet].size, XBOXONE_OUTPUT_HANDSHAKE);
+	}
+	XboxOneStartupMark(&ivars->latency, XBOXONE_STARTUP_HANDSHAKE, mach_absolute_time());
+
+	ivars->interface->retain();
+
+	TraceLog("<< handleStart()");
+	return true;
+
+Exit:
+	TraceLog("<< handleStart()");
+	return false;
+}
+
+
+
+
+// MARK: Driver Lifecycle - Shutdown
+
+/// Shutdown of the Xbox One controller interface
+kern_return_t XboxOneInputInterface::Stop_Impl(IOService* provider)
+{
+	kern_return_t ret = kIOReturnSuccess;
+
+	TraceLog(">> Stop()");
+
+	// Nothing should find the controller once it starts shutting down.
+	if (ivars->registered == true)
+	{
+		IOLockLock(sharedLock);
+		LocationRegistryRemove(&controllerRegistry, ivars->locationID, this);
+		IOLockUnlock(sharedLock);
+		ivars->registered = false;
 	}
+
+	// No more button events will be recorded, so nobody should be left waiting for one.
+	CompleteButtonEventWaits(nullptr, kIOReturnAborted);
+
+	// Reads aborted by the shutdown must not be re-armed, and a pending back-off must not resume the pipe.
+	PipeRecoveryStop(&ivars->inputPath.recovery, mach_absolute_time());
+	if (ivars->recoveryTimer != nullptr)
 	{
-		OSObjectPtr value = CopyStringAtIndex(deviceDescriptor->iProduct, kLanguageIDEnglishUS);
-		if (value != nullptr)
-		{
-			OSDictionarySetValue(dict, kIOHIDProductKey, value);
-			OSSafeReleaseNULL(value);
-		}
+		ivars->recoveryTimer->SetEnable(false);
 	}
+	// A report still held back is dropped, since there is nothing left to deliver it to.
+	if (ivars->coalesceTimer != nullptr)
 	{
-		OSObjectPtr value = CopyStringAtIndex(deviceDescriptor->iSerialNumber, kLanguageIDEnglishUS);
-		if (value != nullptr)
+		ivars->coalesceTimer->SetEnable(false);
+	}
+
+	// If there's somehow nothing to cancel, "Stop" quickly and exit.
+	if (ivars->gotDataActions[0] == nullptr)
+	{
+		ret = Stop(provider, SUPERDISPATCH);
+		if (ret != kIOReturnSuccess)
 		{
-			OSDictionarySetValue(dict, kIOHIDSerialNumberKey, value);
-			OSSafeReleaseNULL(value);
+			Log("Stop() - super::Stop failed with error: 0x%08x.", ret);
 		}
+
+		TraceLog("<< Stop()");
+
+		return ret;
 	}
+	// Otherwise, wait for some Cancels to get completed.
+
+
+
+	// Retain the driver instance and the provider so the finalization can properly stop the driver
+	this->retain();
+	provider->retain();
+
+	void (^finalize)(void) = ^{
+
+		kern_return_t status = Stop(provider, SUPERDISPATCH);
+		if (status != kIOReturnSuccess)
+		{
+			Log("Stop() - super::Stop failed with error: 0x%08x.", status);
+		}
+
+		TraceLog("<< Stop()");
+
+		this->release();
+		provider->release();
+	};
+
+	void (^canceled)(void) = ^{
+		if (__atomic_sub_fetch(&ivars->pendingCancels, 1, __ATOMIC_ACQ_REL) == 0)
+		{
+			finalize();
+		}
+	};
+
+	// Every input and output slot has its own action, as do both timers, so only finalize once the last of them has been canceled.
+	ivars->pendingCancels = 0;
+	if (ivars->recoveryTimerAction != nullptr)
+	{
+		ivars->pendingCancels++;
+	}
+	if (ivars->coalesceTimerAction != nullptr)
+	{
+		ivars->pendingCancels++;
+	}
+	for (uint32_t slot = 0; slot < INPUT_RING_MAX_SLOTS; ++slot)
+	{
+		if (ivars->gotDataActions[slot] != nullptr)
+		{
+			ivars->pendingCancels++;
+		}
+	}
+	for (uint32_t slot = 0; slot < OUTPUT_QUEUE_MAX_SLOTS; ++slot)
+	{
+		if (ivars->sentDataActions[slot] != nullptr)
+		{
+			ivars->pendingCancels++;
+		}
+	}
+	if (ivars->recoveryTimerAction != nullptr)
+	{
+		ivars->recoveryTimerAction->Cancel(canceled);
+	}
+	if (ivars->coalesceTimerAction != nullptr)
+	{
+		ivars->coalesceTimerAction->Cancel(canceled);
+	}
+	for (uint32_t slot = 0; slot < INPUT_RING_MAX_SLOTS; ++slot)
+	{
+		if (ivars->gotDataActions[slot] != nullptr)
+		{
+			ivars->gotDataActions[slot]->Cancel(canceled);
+		}
+	}
+	for (uint32_t slot = 0; slot < OUTPUT_QUEUE_MAX_SLOTS; ++slot)
+	{
+		if (ivars->sentDataActions[slot] != nullptr)
+		{
+			ivars->sentDataActions[slot]->Cancel(canceled);
+		}
+	}
+
+	DebugLog("Stop() - Cancels started, they will stop the dext later.");
+
+	return ret;
+}
+
+/// Cleanup of the Xbox Controller interface
+void XboxOneInputInterface::free(void)
+{
+	TraceLog("free()");
+
+	if (ivars != nullptr)
+	{
+		if (ivars->configurationDescriptor != nullptr)
+		{
+			IOUSBHostFreeDescriptor(ivars->configurationDescriptor);
+		}
+
+		// NOTE: interfaceDescriptor is a `get`, not a `copy`, so doesn't need to be freed.
+
+		OSSafeReleaseNULL(ivars->inPipe.pipe);
+		OSSafeReleaseNULL(ivars->inPipe.memory.buffer);
+		OSSafeReleaseNULL(ivars->outPipe.pipe);
+		OSSafeReleaseNULL(ivars->outPipe.memory.buffer);
+
+		// NOTE: Pipe descriptors are a 'get', not a 'copy', so don't need to be freed.
+
+		for (uint32_t slot = 0; slot < INPUT_RING_MAX_SLOTS; ++slot)
+		{
+			OSSafeReleaseNULL(ivars->inputSlots[slot].buffer);
+			OSSafeReleaseNULL(ivars->gotDataActions[slot]);
+		}
+		for (uint32_t slot = 0; slot < OUTPUT_QUEUE_MAX_SLOTS; ++slot)
+		{
+			OSSafeReleaseNULL(ivars->outputSlots[slot].buffer);
+			OSSafeReleaseNULL(ivars->sentDataActions[slot]);
+		}
+		// Every transfer has completed by now, so the pooled buffers can be handed to the next controller.
+		if (ivars->pooledIndexCount != 0)
+		{
+			IOLockLock(sharedLock);
+			for (uint32_t index = 0; index < ivars->pooledIndexCount; ++index)
+			{
+				BufferPoolGive(&bufferPool, ivars->pooledIndexes[index]);
+			}
+			IOLockUnlock(sharedLock);
+		}
+		OSSafeReleaseNULL(ivars->packetStream);
+		OSSafeReleaseNULL(ivars->statePage);
+		OSSafeReleaseNULL(ivars->traceBuffer);
+		OSSafeReleaseNULL(ivars->buttonEventBuffer);
+		OSSafeReleaseNULL(ivars->recoveryTimer);
+		OSSafeReleaseNULL(ivars->recoveryTimerAction);
+		OSSafeReleaseNULL(ivars->coalesceTimer);
+		OSSafeReleaseNULL(ivars->coalesceTimerAction);
+		OSSafeReleaseNULL(ivars->interface);
+		OSSafeReleaseNULL(ivars->queue);
+
+		// Nothing reads the configuration any more, so the current one can be freed straight away.
+		xboxone_config* config = (xboxone_config*)ConfigSnapshotRead(&ivars->protocol.config);
+		if (config != nullptr && config != &XBOXONE_DEFAULT_CONFIG)
+		{
+			IOSafeDeleteNULL(config, xboxone_config, 1);
+		}
+		if (ivars->configLock != nullptr)
+		{
+			IOLockFree(ivars->configLock);
+			ivars->configLock = nullptr;
+		}
+
+		if (ivars->metricsAllocation != nullptr)
+		{
+			IOFree(ivars->metricsAllocation, sizeof(xboxone_metrics) + XBOXONE_METRICS_ALIGNMENT);
+			ivars->metricsAllocation = nullptr;
+			ivars->metrics = nullptr;
+		}
+	}
+
+	IOSafeDeleteNULL(ivars, XboxOneInputInterface_IVars, 1);
+
+	super::free();
+}
+
+
+
+
+// MARK: - HID Lifecycle
+
+/// Helper function that creates an OSString for a particular descriptor index and language.
+OSString* XboxOneInputInterface::CopyStringAtIndex(uint8_t descriptorIndex, uint16_t descriptorLanguage)
+{
+	const uint8_t descriptorHeaderSize = sizeof(IOUSBDescriptorHeader);
+	const IOUSBStringDescriptor* descriptor = nullptr;
+	OSString* string = nullptr;
+	uint_fast8_t index = 0;
+	char result[256] = {};
+
+	TraceLog(">> CopyStringAtIndex()");
+
+	if (descriptorIndex == 0)
+	{
+		DebugLog("CopyStringAtIndex() - Asked for index 0.");
+		goto Exit;
+	}
+
+	descriptor = ivars->interface->CopyStringDescriptor(descriptorIndex, descriptorLanguage);
+	if (descriptor == nullptr)
+	{
+		Log("CopyStringAtIndex() - Failed to copy string at index %d with language %d.", descriptorIndex, descriptorLanguage);
+		goto Exit;
+	}
+
+	if (descriptor->bLength < descriptorHeaderSize)
+	{
+		Log("CopyStringAtIndex() - Descriptor bLength invalid %d.", descriptor->bLength);
+		goto Exit;
+	}
+
+
+	{
+		uint8_t length = (descriptor->bLength - descriptorHeaderSize) / 2;
+		uint16_t* bString = (uint16_t*)descriptor->bString;
+		for (; index < length; ++index)
+		{
+			uint16_t value = bString[index];
+			if (value == 0)
+			{
+				break;
+			}
+
+			result[index] = (uint8_t)value;
+		}
+
+		string = OSStringCreate(result, index);
+	}
+
+
+Exit:
+	if (descriptor != nullptr)
+	{
+		IOUSBHostFreeDescriptor(descriptor);
+	}
+
+	TraceLog("<< CopyStringAtIndex()");
+	return string;
+}
+
+/// Helper function that copies a device string the USB host stack published when the device was enumerated.
+/// Returns `nullptr` if that property is missing, in which case the string can only be read from the device with `CopyStringAtIndex`, which is a control transfer.
+OSString* XboxOneInputInterface::CopyPublishedString(OSDictionary* deviceProperties, const char* key)
+{
+	OSString* string = nullptr;
+
+	if (deviceProperties != nullptr)
+	{
+		string = OSDynamicCast(OSString, OSDictionaryGetValue(deviceProperties, key));
+		if (string != nullptr)
+		{
+			string->retain();
+			return string;
+		}
+	}
+
+	DebugLog("CopyPublishedString() - No %{public}s property.", key);
+	return nullptr;
+}
+
+/// Override of the `newDeviceDescription` function from `IOUserHIDDevice`.
+/// This is specific to the Xbox One controller, since it doesn't report a HID-compliant USB device description. So this function generates a new device description that is HID-compliant.
+/// Most USB drivers shouldn't need to override this function.
+///
+/// Strings that had to be read from the device are remembered in `descriptorCache`, so a controller that reconnects can skip reading them again.
+OSDictionary* XboxOneInputInterface::newDeviceDescription(void)
+{
+	OSDictionary* dict = nullptr;
+	OSDictionary* properties = nullptr;
+	OSDictionary* deviceProperties = nullptr;
+	IOUSBHostDevice* device = nullptr;
+	const IOUSBDeviceDescriptor* deviceDescriptor = nullptr;
+	OSString* manufacturer = nullptr;
+	OSString* product = nullptr;
+	OSString* serialNumber = nullptr;
+	descriptor_cache_entry cached = {};
+	bool cacheable = false;
+	bool needsManufacturer = false;
+	bool needsProduct = false;
+	bool found = false;
+	uint64_t descriptionStart = 0;
+
+	TraceLog(">> newDeviceDescription");
+
+	if (ivars->interface == nullptr)
+	{
+		Log("newDeviceDescription() - Interface is null. Something has gone terribly wrong.");
+		goto Exit;
+	}
+
+	ivars->interface->CopyProperties(&properties);
+	if (properties == nullptr)
+	{
+		Log("newDeviceDescription() - Failed to copy interface properties.");
+		goto Exit;
+	}
+
+	ivars->interface->CopyDevice(&device);
+	if (device == nullptr)
+	{
+		Log("newDeviceDescription() - Failed to copy the device.");
+		goto Exit;
+	}
+
+	// The strings below are read from here where possible, to avoid a control transfer for each of them during startup.
+	device->CopyProperties(&deviceProperties);
+	if (deviceProperties == nullptr)
+	{
+		DebugLog("newDeviceDescription() - Failed to copy device properties.");
+	}
+
+	deviceDescriptor = device->CopyDeviceDescriptor();
+	if (deviceDescriptor == nullptr)
+	{
+		Log("newDeviceDescription() - Failed to copy device descriptor.");
+		goto Exit;
+	}
+
+	descriptionStart = mach_absolute_time();
+	ivars->descriptorCacheHit = false;
+	ivars->descriptorCacheSavedTicks = 0;
+	ivars->descriptorStringsRead = 0;
+
+	manufacturer = CopyPublishedString(deviceProperties, kUSBDeviceVendorNameKey);
+	product = CopyPublishedString(deviceProperties, kUSBDeviceProductNameKey);
+	serialNumber = CopyPublishedString(deviceProperties, kUSBDeviceSerialNumberKey);
+
+	// The serial number tells the device apart from other controllers of the same model, so it can only be cached if it has one.
+	if (serialNumber == nullptr && deviceDescriptor->iSerialNumber != 0)
+	{
+		serialNumber = CopyStringAtIndex(deviceDescriptor->iSerialNumber, kLanguageIDEnglishUS);
+		ivars->descriptorStringsRead++;
+	}
+	cacheable = (serialNumber != nullptr) && DescriptorCacheMakeKey(&cached.key,
+		USBToHost16(deviceDescriptor->idVendor),
+		USBToHost16(deviceDescriptor->idProduct),
+		USBToHost16(deviceDescriptor->bcdDevice),
+		serialNumber->getCStringNoCopy());
+
+	// Strings the USB host stack published cost nothing to read, so the cache is only used for strings that are a control transfer away.
+	needsManufacturer = (manufacturer == nullptr && deviceDescriptor->iManufacturer != 0);
+	needsProduct = (product == nullptr && deviceDescriptor->iProduct != 0);
+	if ((needsManufacturer == true || needsProduct == true) && cacheable == true)
+	{
+		IOLockLock(sharedLock);
+		found = DescriptorCacheFind(&descriptorCache, &cached.key, &cached);
+		IOLockUnlock(sharedLock);
+	}
+
+	if (found == true)
+	{
+		uint64_t hitTicks = 0;
+
+		if (needsManufacturer == true)
+		{
+			manufacturer = OSStringCreate(cached.manufacturer, strlen(cached.manufacturer));
+		}
+		if (needsProduct == true)
+		{
+			product = OSStringCreate(cached.product, strlen(cached.product));
+		}
+
+		hitTicks = mach_absolute_time() - descriptionStart;
+		ivars->descriptorCacheHit = true;
+		ivars->descriptorCacheSavedTicks = (cached.missTicks > hitTicks) ? cached.missTicks - hitTicks : 0;
+		ivars->descriptionTicks = hitTicks;
+		DebugLog("newDeviceDescription() - Found device strings in descriptor cache.");
+	}
+	else
+	{
+		if (needsManufacturer == true)
+		{
+			manufacturer = CopyStringAtIndex(deviceDescriptor->iManufacturer, kLanguageIDEnglishUS);
+			ivars->descriptorStringsRead++;
+		}
+		if (needsProduct == true)
+		{
+			product = CopyStringAtIndex(deviceDescriptor->iProduct, kLanguageIDEnglishUS);
+			ivars->descriptorStringsRead++;
+		}
+
+		ivars->descriptionTicks = mach_absolute_time() - descriptionStart;
+
+		if ((needsManufacturer == true || needsProduct == true) && cacheable == true &&
+			DescriptorCacheCopyString(cached.manufacturer, (manufacturer != nullptr) ? manufacturer->getCStringNoCopy() : nullptr) == true &&
+			DescriptorCacheCopyString(cached.product, (product != nullptr) ? product->getCStringNoCopy() : nullptr) == true)
+		{
+			cached.missTicks = ivars->descriptionTicks;
+			IOLockLock(sharedLock);
+			DescriptorCacheInsert(&descriptorCache, &cached);
+			IOLockUnlock(sharedLock);
+		}
+	}
+
+	if (ivars->descriptorStringsRead != 0)
+	{
+		DebugLog("newDeviceDescription() - Read %u string descriptors from the device.", ivars->descriptorStringsRead);
+	}
+
+	// NOTE: This is saved to last in order to make cleanup easier.
+	dict = OSDictionary::withCapacity(16);
+	if (dict == nullptr)
+	{
+		Log("newDeviceDescription() - Failed to create OSDictionary.");
+		goto Exit;
+	}
+
+	OSDictionarySetValue(dict, kIOHIDRegisterServiceKey, kOSBooleanTrue);
+	OSDictionarySetValue(dict, "HIDDefaultBehavior", kOSBooleanTrue);
+	OSDictionarySetValue(dict, "AppleVendorSupported", kOSBooleanTrue);
+
+	OSDictionarySetUInt64Value(dict, kIOHIDReportIntervalKey, ivars->inPipe.interval);
+	OSDictionarySetUInt64Value(dict, kIOHIDVendorIDKey, USBToHost16(deviceDescriptor->idVendor));
+	OSDictionarySetUInt64Value(dict, kIOHIDProductIDKey, USBToHost16(deviceDescriptor->idProduct));
+	OSDictionarySetStringValue(dict, kIOHIDTransportKey, "USB");
+	OSDictionarySetUInt64Value(dict, kIOHIDVersionNumberKey, USBToHost16(deviceDescriptor->bcdDevice));
+	OSDictionarySetUInt64Value(dict, kIOHIDCountryCodeKey, 0);
+	OSDictionarySetUInt64Value(dict, kIOHIDRequestTimeoutKey, kUSBHostClassRequestCompletionTimeout * 1000);
+	OSDictionarySetUInt64Value(dict, kIOHIDPrimaryUsagePageKey, XboxOne::ReportDescriptor[1]);
+	OSDictionarySetUInt64Value(dict, kIOHIDPrimaryUsageKey, XboxOne::ReportDescriptor[3]);
+
+	{
+		OSObjectPtr value = OSDictionaryGetValue(properties, kUSBHostPropertyLocationID);
+		if (value != nullptr)
+		{
+			OSDictionarySetValue(dict, kIOHIDLocationIDKey, value);
+		}
+	}
+	if (manufacturer != nullptr && manufacturer->getLength() != 0)
+	{
+		OSDictionarySetValue(dict, kIOHIDManufacturerKey, manufacturer);
+	}
+	if (product != nullptr && product->getLength() != 0)
+	{
+		OSDictionarySetValue(dict, kIOHIDProductKey, product);
+	}
+	if (serialNumber != nullptr)
+	{
+		OSDictionarySetValue(dict, kIOHIDSerialNumberKey, serialNumber);
+	}
+	{
+		uint64_t portType = OSDictionaryGetUInt64Value(properties, kUSBHostMatchingPropertyPortType);
+		if (portType == kIOUSBHostPortTypeInternal)
+		{
+			OSDictionarySetValue(dict, kIOHIDBuiltInKey, kOSBooleanTrue);
+		}
+	}
+
+Exit:
+	OSSafeReleaseNULL(manufacturer);
+	OSSafeReleaseNULL(product);
+	OSSafeReleaseNULL(serialNumber);
+	if (properties != nullptr)
+	{
+		properties->release();
+		properties = nullptr;
+	}
+	if (deviceProperties != nullptr)
+	{
+		deviceProperties->release();
+		deviceProperties = nullptr;
+	}
+	if (deviceDescriptor != nullptr)
+	{
+		IOUSBHostFreeDescriptor(deviceDescriptor);
+		deviceDescriptor = nullptr;
+	}
+	if (device != nullptr)
+	{
+		device->release();
+		device = nullptr;
+	}
+
+	TraceLog("<< newDeviceDescription");
+	return dict;
+}
+
+/// Override of the `newReportDescriptor` function from `IOUserHIDDevice`.
+/// This is specific to the Xbox One controller, since it doesn't report a HID-compliant USB report descriptor. So this function generates a new report descriptor that is HID-compliant.
+/// Most USB drivers shouldn't need to override this function.
+OSData* XboxOneInputInterface::newReportDescriptor(void)
+{
+	TraceLog("newReportDescriptor");
+
+	return OSData::withBytesNoCopy(XboxOne::ReportDescriptor, XboxOne::REPORT_DESCRIPTOR_SIZE);
+}
+
+
+
+
+// MARK: - Interface Communication
+// MARK: Interface Communication - Data from Device
+
+/// Queues a handler for incoming USB data on one of the input slots.
+/// Calls whatever function is stored in the slot's entry of `gotDataActions` in the `ivars`.
+/// This is the `submit` hook of `inputPath`, whose `context` is the `ivars`.
+///
+/// If too many completions are still waiting on an older read, the slot is parked instead, and `InputPathRequestParked` will re-arm it.
+static int32_t RequestAsyncInterruptData(void* context, uint32_t slot)
+{
+	XboxOneInputInterface_IVars* ivars = (XboxOneInputInterface_IVars*)context;
+	kern_return_t ret = kIOReturnSuccess;
+	buffer_memory_descriptor* memory = &ivars->inputSlots[slot];
+
+	if (InputRingSubmit(&ivars->inputPath.ring, slot) == false)
+	{
+		Trace(XBOXONE_TRACE_READ_PARKED, slot, 0, 0);
+		goto Exit;
+	}
+
+	ret = ivars->inPipe.pipe->AsyncIO(memory->buffer, (uint32_t)memory->length, ivars->gotDataActions[slot], 0);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("RequestAsyncInterruptData() - Failed to request packets from the device on slot %u with error: 0x%08x.", slot, ret);
+		Trace(XBOXONE_TRACE_READ_FAILED, slot, ret, 0);
+		XboxOneMetricsAdd(&ivars->metrics->input.rearmFailures, 1);
+		InputRingCancelSubmit(&ivars->inputPath.ring, slot);
+		goto Exit;
+	}
+
+Exit:
+	return ret;
+}
+
+/// Sorts the status of a transfer on the `IN` pipe into how `recovery` should respond to it. This is the `classify` hook of `inputPath`.
+static pipe_error_class ClassifyPipeStatus(int32_t status)
+{
+	switch (status)
+	{
+		case kIOReturnSuccess:
+			return PIPE_ERROR_NONE;
+
+		case kIOReturnAborted:
+			return PIPE_ERROR_CANCELED;
+
+		case kUSBHostReturnPipeStalled:
+			return PIPE_ERROR_STALL;
+
+		case kIOReturnNoDevice:
+		case kIOReturnNotAttached:
+		case kIOReturnOffline:
+			return PIPE_ERROR_FATAL;
+
+		default:
+			return PIPE_ERROR_TRANSIENT;
+	}
+}
+
+/// Clears the stall of the `IN` pipe. This is the `clearStall` hook of `inputPath`.
+///
+/// This aborts every other read on the pipe, and `inputPath` holds them back along with the one that stalled.
+static void ClearInterruptStall(void* context)
+{
+	XboxOneInputInterface_IVars* ivars = (XboxOneInputInterface_IVars*)context;
+	kern_return_t ret = ivars->inPipe.pipe->ClearStall(true);
+
+	if (ret != kIOReturnSuccess)
+	{
+		Log("ClearInterruptStall() - Failed to clear stall with error: 0x%08x.", ret);
+	}
+}
+
+/// Starts the timer that calls `RecoveryTimerFired` after `delay`. This is the `armTimer` hook of `inputPath`.
+static void StartRecoveryTimer(void* context, uint64_t delay)
+{
+	XboxOneInputInterface_IVars* ivars = (XboxOneInputInterface_IVars*)context;
+	kern_return_t ret = kIOReturnSuccess;
+
+	// The leeway lets the wake be coalesced with others, since a back-off does not need to be precise.
+	ret = ivars->recoveryTimer->WakeAtTime(kIOTimerClockMachAbsoluteTime, mach_absolute_time() + delay, delay / 8);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("StartRecoveryTimer() - Failed to start recovery timer with error: 0x%08x.", ret);
+	}
+}
+
+/// Records that an input slot was held back, and logs the pipe being parked. This is the `held` hook of `inputPath`.
+static void TraceRecovery(void* context, uint32_t slot, pipe_recovery_action action, int32_t status)
+{
+	XboxOneInputInterface_IVars* ivars = (XboxOneInputInterface_IVars*)context;
+
+	Trace(XBOXONE_TRACE_READ_RECOVERY, slot, action, status);
+
+	if (action == PIPE_RECOVERY_PARK)
+	{
+		Log("TraceRecovery() - Parking the input pipe after %u failures in a row, last with error: 0x%08x.", ivars->inputPath.recovery.stats.failures, status);
+	}
+}
+
+/// Called when the recovery timer fires.
+/// This only works because the timer was created in `SetupRecovery` and this function was established as a callback via `CreateActionRecoveryTimerFired`.
+///
+/// Resumes the `IN` pipe and re-arms every slot that was held back, unless the driver was disabled in the meantime.
+void XboxOneInputInterface::RecoveryTimerFired_Impl(OSAction* action, uint64_t time)
+{
+	(void)action;
+	(void)time;
+
+	uint32_t idleSlots = ivars->inputPath.idleSlots;
+
+	XboxOneMetricsCountWakeup(ivars->metrics, ivars->inputPath.enabled);
+
+	if (InputPathRecoveryTimerFired(&ivars->inputPath, mach_absolute_time()) == true)
+	{
+		Trace(XBOXONE_TRACE_READ_RESUME, idleSlots, ivars->inputPath.recovery.stats.failures, 0);
+	}
+}
+
+
+/// An example of generic USB packet handling.
+/// Passes the packet on to `IOUserHIDDevice` via `handleReport`.
+/// The OS will then treat the packets according to the HID report descriptor for that packet.
+///
+/// The packet type and size have already been validated by `XboxOneClassifyPacket`.
+/// This is on the input path, so it records trace events rather than logging.
+bool XboxOneInputInterface::HandleReportGeneric(void* data, uint32_t actualByteCount, uint64_t completionTimestamp)
+{
+	(void)data;
+
+	bool result = true;
+	kern_return_t ret = kIOReturnSuccess;
+	uint64_t deliveryStart = 0;
+	uint64_t deliveryEnd = 0;
+
+	deliveryStart = mach_absolute_time();
+	ret = handleReport(completionTimestamp, ivars->inPipe.memory.buffer, actualByteCount);
+	deliveryEnd = mach_absolute_time();
+
+	XboxOneLatencyRecord(&ivars->latency, XBOXONE_LATENCY_DELIVERY, deliveryStart, deliveryEnd);
+	XboxOneLatencyRecord(&ivars->latency, XBOXONE_LATENCY_END_TO_END, completionTimestamp, deliveryEnd);
+	XboxOneStartupMark(&ivars->latency, XBOXONE_STARTUP_FIRST_REPORT, deliveryEnd);
+	Trace(XBOXONE_TRACE_REPORT_DELIVERED, actualByteCount, ret, 0);
+
+	if (ret != kIOReturnSuccess)
+	{
+		XboxOneMetricsAdd(&ivars->metrics->input.reportFailures, 1);
+		result = false;
+	}
+
+	return result;
+}
+
+/// An example of generic USB packet handling.
+/// Passes the packet on to `IOUserHIDDevice` via `HandleReportGeneric`.
+///
+/// `actualByteCount` has already been cut down by `XboxOneProtocolProcess` to the part of the report the report descriptor describes.
+bool XboxOneInputInterface::HandleControllerReport(void* data, uint32_t actualByteCount, uint64_t completionTimestamp)
+{
+	bool result = false;
+	const xboxone_button_report* report = (const xboxone_button_report*)data;
+
+	result = HandleReportGeneric(data, actualByteCount, completionTimestamp);
+	if (result == true)
+	{
+		Trace(XBOXONE_TRACE_REPORT_BUTTONS, report->buttons, report->trigL, report->trigR);
+	}
+
+	return result;
+}
+
+/// Hands a button report to `HandleControllerReport`, either now or when `coalescer` flushes it.
+///
+/// While coalescing, a report that arrives less than a window after the last delivery is held, replacing any report already held,
+/// and the coalesce timer delivers it when the window closes. A button change is always delivered at once.
+void XboxOneInputInterface::DeliverControllerReport(void* data, uint32_t actualByteCount, uint64_t completionTimestamp)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	uint64_t deadline = 0;
+
+	switch (XboxOneCoalescerOffer(&ivars->coalescer, (const uint8_t*)data, actualByteCount, completionTimestamp, mach_absolute_time(), &deadline))
+	{
+		case XBOXONE_COALESCE_DELIVER:
+			HandleControllerReport(data, actualByteCount, completionTimestamp);
+			break;
+
+		case XBOXONE_COALESCE_SCHEDULE:
+			// No leeway, since the held report is already as late as the window allows.
+			ret = ivars->coalesceTimer->WakeAtTime(kIOTimerClockMachAbsoluteTime, deadline, 0);
+			if (ret != kIOReturnSuccess)
+			{
+				Log("DeliverControllerReport() - Failed to start coalesce timer with error: 0x%08x.", ret);
+				FlushCoalescedReport();
+			}
+			break;
+
+		case XBOXONE_COALESCE_HOLD:
+			break;
+	}
+}
+
+/// Delivers the report held by `coalescer`, if there is one.
+///
+/// The report is copied into `inPipe.memory`, since that is what `HandleReportGeneric` hands to `handleReport`.
+/// This always runs on the controller's own queue, between packets, so `inPipe.memory` is not in use.
+void XboxOneInputInterface::FlushCoalescedReport(void)
+{
+	uint32_t length = 0;
+	uint64_t timestamp = 0;
+	uint64_t since = 0;
+
+	if (XboxOneCoalescerFlush(&ivars->coalescer, mach_absolute_time(), ivars->inPipe.memory.address, &length, &timestamp, &since) == true)
+	{
+		HandleControllerReport(ivars->inPipe.memory.address, length, timestamp);
+	}
+}
+
+/// Called when the coalesce timer fires.
+/// This only works because the timer was created in `SetupCoalescing` and this function was established as a callback via `CreateActionCoalesceTimerFired`.
+void XboxOneInputInterface::CoalesceTimerFired_Impl(OSAction* action, uint64_t time)
+{
+	(void)action;
+	(void)time;
+
+	XboxOneMetricsCountWakeup(ivars->metrics, ivars->inputPath.enabled);
+	FlushCoalescedReport();
+}
+
+/// Handles Xbox One controller "guide" button reports.
+/// Generates a response packet to the "guide" button report, and sends it to the controller.
+bool XboxOneInputInterface::HandleGuideReport(void* data, uint32_t actualByteCount, uint64_t completionTimestamp)
+{
+	bool result = false;
+	const xboxone_guide_report* report = (const xboxone_guide_report*)data;
+
+	result = HandleReportGeneric(data, actualByteCount, completionTimestamp);
+	if (result == true)
+	{
+		Trace(XBOXONE_TRACE_REPORT_GUIDE, report->guide, report->header.version, 0);
+
+		xboxone_guide_response response = {};
+
+		if (XboxOneProtocolGuideResponse(report, &response) == true)
+		{
+			SendInterruptData((const uint8_t*)(&response), XBOXONE_GUIDE_RESPONSE_SIZE, XBOXONE_OUTPUT_ACK);
+		}
+	}
+
+	return result;
+}
+
+/// Handles a single packet, in the order it was read from the device.
+/// The packet has already been copied into `inPipe.memory` by `GotData_Impl`.
+///
+/// Every outcome is recorded as a trace event rather than logged, since this runs for every packet.
+void XboxOneInputInterface::ProcessPacket(kern_return_t status, uint32_t actualByteCount, uint64_t completionTimestamp)
+{
+	xboxone_report_header* header = (xboxone_report_header*)ivars->inPipe.memory.address;
+	xboxone_protocol_result result = {};
+
+	if (status != kIOReturnSuccess)
+	{
+		Trace(XBOXONE_TRACE_PACKET_ERROR, status, 0, 0);
+
+		// Reads aborted by disabling the driver did not fail.
+		if (status != kIOReturnAborted || ivars->inputPath.enabled == true)
+		{
+			XboxOneMetricsCountError(&ivars->metrics->input.errors, (uint32_t)status);
+		}
+		return;
+	}
+
+	XboxOneMetricsCountInput(ivars->metrics, ivars->inPipe.memory.address, actualByteCount);
+
+	// The link is monitored even while disabled, since it says nothing about what the driver does with the packet.
+	if (actualByteCount >= XBOXONE_REPORT_HEADER_SIZE)
+	{
+		XboxOneLinkMonitorRecord(&ivars->linkMonitor, (const xboxone_report_header*)ivars->inPipe.memory.address, completionTimestamp);
+	}
+
+	if (ivars->inputPath.enabled == false)
+	{
+		Trace(XBOXONE_TRACE_PACKET_DISABLED, actualByteCount, 0, 0);
+		XboxOneMetricsAdd(&ivars->metrics->input.disabledDrops, 1);
+		return;
+	}
+
+	XboxOneProtocolProcess(&ivars->protocol, ivars->inPipe.memory.address, actualByteCount, completionTimestamp, &result);
+	Trace(XBOXONE_TRACE_PACKET_VERDICT, result.handler, result.verdict, header->counter);
+
+	switch (result.handler)
+	{
+		case XBOXONE_HANDLER_BUTTON:
+			if (result.verdict == XBOXONE_VERDICT_REPEATED)
+			{
+				break;
+			}
+
+			// Edges are found whether or not the report is delivered, since a button change is never worth losing.
+			XboxOneButtonEventsReport(&ivars->buttonEdges, &ivars->buttonEvents, (const xboxone_button_report*)header, completionTimestamp);
+
+			// Suppressed reports still change the state, they are just not worth a HID report.
+			XboxOneStatePagePublishButtons(&ivars->statePublisher, (const xboxone_button_report*)header, completionTimestamp);
+
+			if (result.verdict == XBOXONE_VERDICT_DELIVER)
+			{
+				DeliverControllerReport(header, result.reportLength, completionTimestamp);
+			}
+			break;
+
+		case XBOXONE_HANDLER_GUIDE:
+			XboxOneButtonEventsGuide(&ivars->buttonEdges, &ivars->buttonEvents, (const xboxone_guide_report*)header, completionTimestamp);
+			XboxOneStatePagePublishGuide(&ivars->statePublisher, (const xboxone_guide_report*)header, completionTimestamp);
+			HandleGuideReport(header, result.reportLength, completionTimestamp);
+			break;
+
+		case XBOXONE_HANDLER_NONE:
+			break;
+	}
+}
+
+/// Called when input data received.
+/// This only works because a read was established in `RequestAsyncInterruptData` and this function was established as a callback via `CreateActionGotData`.
+///
+/// The completed slot is re-armed before its packet is handled, so the pipe is never left without a read outstanding,
+/// unless the read failed and `recovery` holds the slot back until the pipe has had time to recover.
+/// Packets are then handled in the order their reads were submitted, which may release packets staged by earlier completions.
+/// If a user client has mapped the raw packet ring, each packet is appended to it in that same order before it is handled.
+void XboxOneInputInterface::GotData_Impl(OSAction* action, kern_return_t status, uint32_t actualByteCount, uint64_t completionTimestamp)
+{
+	uint32_t slot = ((input_slot_reference*)action->GetReference())->slot;
+	const input_ring_entry* entry = nullptr;
+	uint64_t rearmStart = 0;
+
+	XboxOneMetricsCountWakeup(ivars->metrics, ivars->inputPath.enabled);
+	Trace(XBOXONE_TRACE_READ_COMPLETE, slot, status, actualByteCount);
+
+	InputRingComplete(&ivars->inputPath.ring, slot, status, ivars->inputSlots[slot].address, actualByteCount, completionTimestamp);
+
+	rearmStart = mach_absolute_time();
+	InputPathRecover(&ivars->inputPath, slot, status, rearmStart);
+	XboxOneLatencyRecord(&ivars->latency, XBOXONE_LATENCY_REARM, rearmStart, mach_absolute_time());
+
+	while ((entry = InputRingPeek(&ivars->inputPath.ring)) != nullptr)
+	{
+		if (__atomic_load_n(&ivars->packetStreamClient, __ATOMIC_ACQUIRE) != nullptr)
+		{
+			PacketRingPush(&ivars->packetProducer, entry->timestamp, (uint32_t)entry->status, entry->data, entry->length);
+		}
+
+		memcpy(ivars->inPipe.memory.address, entry->data, entry->length);
+		ProcessPacket(entry->status, entry->length, entry->timestamp);
+		InputRingPop(&ivars->inputPath.ring);
+	}
+
+	// Waiting clients are woken once for the whole batch, rather than once for each event.
+	if (ivars->buttonEventWaiterCount != 0)
+	{
+		CompleteButtonEventWaits(nullptr, kIOReturnSuccess);
+	}
+
+	InputPathRequestParked(&ivars->inputPath, mach_absolute_time());
+}
+
+/// Completes the waits of `client`, or of every client if it is `nullptr`, then forgets them.
+///
+/// With `kIOReturnSuccess` only the waits that have new events past their cursor are completed, and the rest keep waiting.
+/// Each completion carries the number of events recorded so far, which is where the client's next read should stop.
+void XboxOneInputInterface::CompleteButtonEventWaits(IOUserClient* client, kern_return_t status)
+{
+	IOUserClientAsyncArgumentsArray arguments = {};
+	uint64_t head = ivars->buttonEvents.head;
+	uint32_t index = 0;
+
+	arguments[0] = head;
+
+	while (index < ivars->buttonEventWaiterCount)
+	{
+		button_event_waiter* waiter = &ivars->buttonEventWaiters[index];
+
+		if ((client != nullptr && waiter->client != client) || (status == kIOReturnSuccess && waiter->cursor >= head))
+		{
+			index++;
+			continue;
+		}
+
+		waiter->client->AsyncCompletion(waiter->action, status, arguments, 1);
+		OSSafeReleaseNULL(waiter->action);
+		OSSafeReleaseNULL(waiter->client);
+
+		// The last waiter fills the gap, so the array stays packed.
+		ivars->buttonEventWaiterCount--;
+		*waiter = ivars->buttonEventWaiters[ivars->buttonEventWaiterCount];
+		ivars->buttonEventWaiters[ivars->buttonEventWaiterCount] = {};
+	}
+}
+
+
+
+
+// MARK: Interface Communication - Data to Device
+
+/// Queues data to be sent on the `OUT` interrupt pipe to the Xbox One controller, and starts sending it if an output slot is free.
+///
+/// This never waits on the device, so it is safe to call from the input completion path.
+/// `priority` is an `xboxone_output_priority`. Packets of a more urgent class are always sent before less urgent ones.
+kern_return_t XboxOneInputInterface::SendInterruptData(const uint8_t* data, uint8_t size, uint32_t priority)
+{
+	kern_return_t ret = kIOReturnSuccess;
+
+	if (size > ivars->outPipe.maxPacketSize)
+	{
+		// NOTE: This is a pretty cowardly thing to do. But its safe to assume that no packet requires more than one packet size.
+		Log("SendInterruptData() - Size of requested packet (%d) is larger than the max packet size allowed for this pipe (%llu). Refusing to send packet.", size, ivars->outPipe.maxPacketSize);
+		return kIOReturnBadArgument;
+	}
+
+	if (OutputQueuePush(&ivars->outputQueue, priority, data, size) == false)
+	{
+		Log("SendInterruptData() - Output queue is full for priority %u. Dropping packet.", priority);
+		XboxOneMetricsAdd(&ivars->metrics->output.queueDrops, 1);
+		ret = kIOReturnNoResources;
+		goto Exit;
+	}
+
+	XboxOneMetricsSetQueueDepth(ivars->metrics, OutputQueueDepth(&ivars->outputQueue));
+	SendQueuedInterruptData();
+
+Exit:
+	Trace(XBOXONE_TRACE_SEND_QUEUED, priority, size, ret);
+	return ret;
+}
+
+/// Starts a transfer for each queued packet that has a free output slot to go in.
+void XboxOneInputInterface::SendQueuedInterruptData(void)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	const output_queue_packet* packet = nullptr;
+	uint32_t slot = 0;
+
+	while (OutputQueueNext(&ivars->outputQueue, &slot, &packet) == true)
+	{
+		buffer_memory_descriptor* memory = &ivars->outputSlots[slot];
+
+		// The counter is assigned here rather than when the packet is queued, so it always matches the order packets go out on the pipe.
+		memcpy(memory->address, packet->data, packet->length);
+		XboxOneProtocolStampOutPacket(&ivars->protocol, memory->address);
+
+		ret = ivars->outPipe.pipe->AsyncIO(memory->buffer, packet->length, ivars->sentDataActions[slot], 0);
+		if (ret != kIOReturnSuccess)
+		{
+			Log("SendQueuedInterruptData() - Failed to send packet on slot %u with error: 0x%08x.", slot, ret);
+			XboxOneMetricsCountError(&ivars->metrics->output.errors, (uint32_t)ret);
+			OutputQueueRelease(&ivars->outputQueue, slot);
+			continue;
+		}
+
+		Trace(XBOXONE_TRACE_SEND_STARTED, slot, packet->length, ((const xboxone_report_header*)memory->address)->counter);
+	}
+
+	XboxOneMetricsSetQueueDepth(ivars->metrics, OutputQueueDepth(&ivars->outputQueue));
+}
+
+/// Called when a transfer on the `OUT` pipe completes.
+/// This only works because the transfer was started in `SendQueuedInterruptData` and this function was established as a callback via `CreateActionSentData`.
+///
+/// Frees the output slot and starts sending the next queued packet, if any.
+void XboxOneInputInterface::SentData_Impl(OSAction* action, kern_return_t status, uint32_t actualByteCount, uint64_t completionTimestamp)
+{
+	(void)completionTimestamp;
+
+	uint32_t slot = ((output_slot_reference*)action->GetReference())->slot;
+
+	XboxOneMetricsCountWakeup(ivars->metrics, ivars->inputPath.enabled);
+	Trace(XBOXONE_TRACE_SEND_COMPLETE, slot, status, actualByteCount);
+
+	if (status != kIOReturnSuccess)
+	{
+		Log("SentData() - Transfer on slot %u failed with error: 0x%08x.", slot, status);
+		XboxOneMetricsCountError(&ivars->metrics->output.errors, (uint32_t)status);
+	}
+	else
+	{
+		XboxOneMetricsAdd(&ivars->metrics->output.packets, 1);
+		XboxOneMetricsAdd(&ivars->metrics->output.bytes, actualByteCount);
+	}
+
+	OutputQueueRelease(&ivars->outputQueue, slot);
+
+	// Nothing more should be sent once the driver is stopping.
+	if (status != kIOReturnAborted)
+	{
+		SendQueuedInterruptData();
+	}
+}
+
+
+
+
+// MARK: - UserClient Communication
+
+/// Called by DriverKit when a new UserClient connects to the driver.
+kern_return_t XboxOneInputInterface::NewUserClient_Impl(uint32_t type, IOUserClient** userClient)
+{
+	(void)type;
+
+	kern_return_t ret = kIOReturnSuccess;
+	IOService* client = nullptr;
+
+	TraceLog(">> NewUserClient()");
+
+	ret = Create(this, "UserClientProperties", &client);
+	if (ret != kIOReturnSuccess)
+	{
+		Log("NewUserClient() - Failed to create UserClientProperties with error: 0x%08x.", ret);
+		goto Exit;
+	}
+
+	*userClient = OSDynamicCast(XboxOneUserClient, client);
+	if (*userClient == NULL)
+	{
+		Log("NewUserClient() - Failed to cast new client.");
+		client->release();
+		ret = kIOReturnError;
+		goto Exit;
+	}
+
+	// Gives the user client a pointer back to this object.
+	((XboxOneUserClient*)(*userClient))->SetInputInterface(this);
+
+	TraceLog("<< NewUserClient()");
+
+Exit:
+	return ret;
+}
+
+/// A function available the user client that can enable or disable the driver.
+/// The change is made on this controller's own queue, since that is where the `IN` pipe is armed and its completions run.
+/// See its use in `XboxOneUserClient`.
+void XboxOneInputInterface::SetEnable(bool enabled)
+{
+	TraceLog(">> SetEnable()");
+
+	if (ivars != nullptr && ivars->queue == nullptr)
+	{
+		ivars->inputPath.enabled = enabled;
+	}
+	else if (ivars != nullptr)
+	{
+		// Keep the driver alive until the change has been made.
+		this->retain();
+		ivars->queue->DispatchAsync(^{
+			ApplyEnable(enabled);
+			this->release();
+		});
+	}
+
+	TraceLog("<< SetEnable()");
+}
+
+/// Enables or disables the driver, starting or idling the `IN` pipe to match.
+///
+/// A disabled driver used to keep a read outstanding on every slot and throw each report away,
+/// so an idle controller still woke the driver at the USB polling rate.
+/// Now disabling aborts the outstanding reads, and `InputPathRecover` leaves each slot idle as its read completes.
+/// Enabling re-arms the idle slots straight away, unless `recovery` is holding reads back, in which case its timer re-arms them.
+void XboxOneInputInterface::ApplyEnable(bool enabled)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	uint64_t now = mach_absolute_time();
+
+	if (enabled == ivars->inputPath.enabled)
+	{
+		return;
+	}
+
+	XboxOneMetricsAdd(&ivars->metrics->input.enableTime[ivars->inputPath.enabled ? 1 : 0], now - ivars->enabledSince);
+	__atomic_store_n(&ivars->enabledSince, now, __ATOMIC_RELAXED);
+	__atomic_store_n(&ivars->inputPath.enabled, enabled, __ATOMIC_RELAXED);
+	Trace(XBOXONE_TRACE_READ_ENABLE, enabled, ivars->inputPath.idleSlots, 0);
+
+	// Nothing is armed before the pipes are set up, or after the driver starts stopping.
+	if (ivars->inPipe.pipe == nullptr || ivars->inputPath.recovery.stats.state == PIPE_RECOVERY_STOPPED)
+	{
+		return;
+	}
+
+	if (enabled == false)
+	{
+		ret = ivars->inPipe.pipe->Abort(kIOUSBAbortAsynchronous, kIOReturnAborted, this);
+		if (ret != kIOReturnSuccess)
+		{
+			Log("ApplyEnable() - Failed to abort reads with error: 0x%08x.", ret);
+		}
+		return;
+	}
+
+	if (PipeRecoveryCanArm(&ivars->inputPath.recovery) == true)
+	{
+		InputPathArmIdle(&ivars->inputPath, now);
+	}
+}
+
+/// A function available the user client that starts a change to the configuration,
+/// returning a copy of the current one to change, or `nullptr` if there is no memory for it.
+///
+/// Every change must be finished with `EndConfigUpdate`. Changes are serialized from here until then,
+/// so a change made by one user client at the same time as another is never lost.
+/// The `Update` functions change the copy, so any number of changes can be published at once.
+/// See its use in `XboxOneUserClient`.
+xboxone_config* XboxOneInputInterface::BeginConfigUpdate(void)
+{
+	xboxone_config* config = nullptr;
+
+	if (ivars == nullptr || ivars->configLock == nullptr)
+	{
+		return nullptr;
+	}
+
+	config = IONew(xboxone_config, 1);
+	if (config == nullptr)
+	{
+		Log("BeginConfigUpdate() - Failed to allocate memory for configuration.");
+		return nullptr;
+	}
+
+	IOLockLock(ivars->configLock);
+	memcpy(config, ConfigSnapshotRead(&ivars->protocol.config), sizeof(*config));
+	config->generation++;
+	return config;
+}
+
+/// A function available the user client that finishes a change started by `BeginConfigUpdate`,
+/// publishing `config` if `publish` is true, or discarding it otherwise.
+///
+/// The input path may still be processing a report with the configuration that was replaced, but only ever on this controller's own queue.
+/// So the replaced configuration is freed from that queue, which cannot happen until whatever the queue is running has finished.
+/// See its use in `XboxOneUserClient`.
+void XboxOneInputInterface::EndConfigUpdate(xboxone_config* config, bool publish)
+{
+	xboxone_config* previous = config;
+
+	if (publish == true)
+	{
+		previous = (xboxone_config*)ConfigSnapshotPublish(&ivars->protocol.config, config);
+	}
+	IOLockUnlock(ivars->configLock);
+
+	if (previous == &XBOXONE_DEFAULT_CONFIG)
+	{
+		return;
+	}
+
+	// A discarded configuration was never seen by the input path, and without a queue there is no input path yet.
+	if (publish == false || ivars->queue == nullptr)
+	{
+		IOSafeDeleteNULL(previous, xboxone_config, 1);
+		return;
+	}
+
+	ivars->queue->DispatchAsync(^{
+		xboxone_config* retired = previous;
+		IOSafeDeleteNULL(retired, xboxone_config, 1);
+	});
+}
+
+/// A function available the user client that configures the change-threshold report filter.
+/// `thresholds` is indexed by `xboxone_axis`, and any axes beyond `thresholdCount` are left unchanged.
+/// The filter starts over from the next report, so it is compared against fresh state.
+/// See its use in `XboxOneUserClient`.
+void XboxOneInputInterface::SetReportFilter(bool enabled, const uint16_t* thresholds, uint32_t thresholdCount)
+{
+	xboxone_config* next = nullptr;
+
+	TraceLog(">> SetReportFilter()");
+
+	next = BeginConfigUpdate();
+	if (next != nullptr)
+	{
+		UpdateReportFilter(next, enabled, thresholds, thresholdCount);
+		EndConfigUpdate(next, true);
+	}
+
+	TraceLog("<< SetReportFilter()");
+}
+
+/// A function available the user client that changes the report filter in a configuration started by `BeginConfigUpdate`, as `SetReportFilter` does.
+/// See its use in `XboxOneUserClient`.
+void XboxOneInputInterface::UpdateReportFilter(xboxone_config* next, bool enabled, const uint16_t* thresholds, uint32_t thresholdCount)
+{
+	for (uint32_t axis = 0; axis < thresholdCount && axis < XBOXONE_AXIS_COUNT; ++axis)
+	{
+		next->reportFilter.thresholds[axis] = thresholds[axis];
+	}
+	next->reportFilter.enabled = enabled;
+}
+
+/// A function available the user client that reads how many reports the change-threshold filter forwarded and suppressed.
+/// See its use in `XboxOneUserClient`.
+void XboxOneInputInterface::CopyReportFilterStats(uint64_t* forwarded, uint64_t* suppressed)
+{
+	TraceLog(">> CopyReportFilterStats()");
+
+	*forwarded = 0;
+	*suppressed = 0;
+
+	// The counters are only changed on the controller's queue, so they are read with relaxed atomic loads rather than copied.
+	if (ivars != nullptr)
+	{
+		XboxOneReportFilterRead(&ivars->protocol.reportFilter, forwarded, suppressed);
+	}
+
+	TraceLog("<< CopyReportFilterStats()");
+}
+
+/// A function available the user client that uploads deadzones and response curves.
+/// `config` is an `xboxone_axis_transform_config`, which is compiled into lookup tables here so the input path only does table lookups.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::SetAxisTransform(const void* config, uint32_t length)
+{
+	kern_return_t ret = kIOReturnSuccess;
+	xboxone_config* next = nullptr;
+
+	TraceLog(">> SetAxisTransform()");
+
+	if (ivars == nullptr)
 	{
-		uint64_t portType = OSDictionaryGetUInt64Value(properties, kUSBHostMatchingPropertyPortType);
-		if (portType == kIOUSBHostPortTypeInternal)
-		{
-			OSDictionarySetValue(dict, kIOHIDBuiltInKey, kOSBooleanTrue);
-		}
+		ret = kIOReturnNotReady;
+		goto Exit;
 	}
 
-Exit:
-	if (properties != nullptr)
+	next = BeginConfigUpdate();
+	if (next == nullptr)
 	{
-		properties->release();
-		properties = nullptr;
+		ret = kIOReturnNoMemory;
+		goto Exit;
 	}
-	if (deviceDescriptor != nullptr)
+
+	ret = UpdateAxisTransform(next, config, length);
+	EndConfigUpdate(next, ret == kIOReturnSuccess);
+
+Exit:
+	TraceLog("<< SetAxisTransform()");
+	return ret;
+}
+
+/// A function available the user client that compiles deadzones and response curves into a configuration started by `BeginConfigUpdate`.
+///
+/// The configuration is checked in full before anything is compiled, so a rejected configuration leaves `next` as it was.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::UpdateAxisTransform(xboxone_config* next, const void* config, uint32_t length)
+{
+	if (config == nullptr || length != sizeof(xboxone_axis_transform_config))
 	{
-		IOUSBHostFreeDescriptor(deviceDescriptor);
-		deviceDescriptor = nullptr;
+		Log("UpdateAxisTransform() - Expected %zu bytes of configuration, got %u.", sizeof(xboxone_axis_transform_config), length);
+		return kIOReturnBadArgument;
 	}
-	if (device != nullptr)
+
+	if (XboxOneCompileAxisTransform((const xboxone_axis_transform_config*)config, &next->axisTransform) == false)
 	{
-		device->release();
-		device = nullptr;
+		Log("UpdateAxisTransform() - Unsupported configuration version %u.", ((const xboxone_axis_transform_config*)config)->version);
+		return kIOReturnUnsupported;
 	}
 
-	TraceLog("<< newDeviceDescription");
-	return dict;
+	return kIOReturnSuccess;
 }
 
-/// Override of the `newReportDescriptor` function from `IOUserHIDDevice`.
-/// This is specific to the Xbox One controller, since it doesn't report a HID-compliant USB report descriptor. So this function generates a new report descriptor that is HID-compliant.
-/// Most USB drivers shouldn't need to override this function.
-OSData* XboxOneInputInterface::newReportDescriptor(void)
+/// A function available the user client that uploads button remapping, axis swaps and inversions, and triggers acting as buttons.
+/// `config` is an `xboxone_remap_config`, which is compiled into lookup tables here so the input path only does table lookups.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::SetRemap(const void* config, uint32_t length)
 {
-	TraceLog("newReportDescriptor");
+	kern_return_t ret = kIOReturnSuccess;
+	xboxone_config* next = nullptr;
 
-	return OSData::withBytesNoCopy(XboxOne::ReportDescriptor, XboxOne::REPORT_DESCRIPTOR_SIZE);
-}
+	TraceLog(">> SetRemap()");
 
+	if (ivars == nullptr)
+	{
+		ret = kIOReturnNotReady;
+		goto Exit;
+	}
 
+	next = BeginConfigUpdate();
+	if (next == nullptr)
+	{
+		ret = kIOReturnNoMemory;
+		goto Exit;
+	}
 
+	ret = UpdateRemap(next, config, length);
+	EndConfigUpdate(next, ret == kIOReturnSuccess);
 
-// MARK: - Interface Communication
-// MARK: Interface Communication - Data from Device
+Exit:
+	TraceLog("<< SetRemap()");
+	return ret;
+}
+
+/// A function available the user client that compiles button remapping into a configuration started by `BeginConfigUpdate`.
+///
+/// The configuration is checked in full before anything is compiled, so a rejected configuration leaves `next` as it was.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::UpdateRemap(xboxone_config* next, const void* config, uint32_t length)
+{
+	if (config == nullptr || length != sizeof(xboxone_remap_config))
+	{
+		Log("UpdateRemap() - Expected %zu bytes of configuration, got %u.", sizeof(xboxone_remap_config), length);
+		return kIOReturnBadArgument;
+	}
+
+	if (XboxOneCompileRemap((const xboxone_remap_config*)config, &next->remap) == false)
+	{
+		Log("UpdateRemap() - Unsupported configuration version %u, or lane out of range.", ((const xboxone_remap_config*)config)->version);
+		return kIOReturnUnsupported;
+	}
+
+	return kIOReturnSuccess;
+}
 
-/// Queues a handler for incoming USB data
-/// Calls whatever function is stored in the `gotDataAction` of the `ivars`.
-kern_return_t XboxOneInputInterface::RequestAsyncInterruptData(void)
+/// A function available the user client that configures the smoothing of stick jitter.
+/// `config` is an `xboxone_stick_filter_config`, which is compiled here for the clock that completion timestamps are read with.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::SetStickFilter(const void* config, uint32_t length)
 {
 	kern_return_t ret = kIOReturnSuccess;
+	xboxone_config* next = nullptr;
 
-	TraceLog(">> RequestAsyncInterruptData()");
+	TraceLog(">> SetStickFilter()");
 
-	ret = ivars->inPipe.pipe->AsyncIO(ivars->inPipe.memory.buffer, (uint32_t)ivars->inPipe.memory.length, ivars->gotDataAction, 0);
-	if (ret != kIOReturnSuccess)
+	if (ivars == nullptr)
+	{
+		ret = kIOReturnNotReady;
+		goto Exit;
+	}
+
+	next = BeginConfigUpdate();
+	if (next == nullptr)
 	{
-		Log("RequestAsyncInterruptData() - Failed to request packets from the device with error: 0x%08x.", ret);
+		ret = kIOReturnNoMemory;
 		goto Exit;
 	}
 
+	ret = UpdateStickFilter(next, config, length);
+	EndConfigUpdate(next, ret == kIOReturnSuccess);
+
 Exit:
-	TraceLog("<< RequestAsyncInterruptData()");
+	TraceLog("<< SetStickFilter()");
 	return ret;
 }
 
-
-/// An example of generic USB packet handling.
-/// Passes the packet on to `IOUserHIDDevice` via `handleReport`.
-/// The OS will then treat the packets according to the HID report descriptor for that packet.
-bool XboxOneInputInterface::HandleReportGeneric(void* data, uint32_t actualByteCount, uint64_t completionTimestamp, uint8_t packetType, uint8_t size)
+/// A function available the user client that compiles stick smoothing into a configuration started by `BeginConfigUpdate`.
+///
+/// The configuration is checked in full before anything is compiled, so a rejected configuration leaves `next` as it was.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::UpdateStickFilter(xboxone_config* next, const void* config, uint32_t length)
 {
-	bool result = true;
-	kern_return_t ret = kIOReturnSuccess;
-	xboxone_report_header* header = (xboxone_report_header*)data;
+	uint32_t numer = 1;
+	uint32_t denom = 1;
 
-	TraceLog(">> %{public}s", __PRETTY_FUNCTION__);
-
-	if (header->packetType != packetType)
+	if (config == nullptr || length != sizeof(xboxone_stick_filter_config))
 	{
-		DebugLog("%{public}s - Packet type did not match expected type. Expected: %d, Actual: %d", __PRETTY_FUNCTION__, packetType, header->packetType);
-		result = false;
-		goto Exit;
+		Log("UpdateStickFilter() - Expected %zu bytes of configuration, got %u.", sizeof(xboxone_stick_filter_config), length);
+		return kIOReturnBadArgument;
 	}
 
-	if (header->size != size)
+	if (ivars->timebase.denom != 0)
 	{
-		DebugLog("%{public}s - Header size did not match expected size. Expected: %d, Actual: %d", __PRETTY_FUNCTION__, size, header->size);
-		result = false;
-		goto Exit;
+		numer = ivars->timebase.numer;
+		denom = ivars->timebase.denom;
 	}
 
-	ret = handleReport(completionTimestamp, ivars->inPipe.memory.buffer, actualByteCount);
-	if (ret != kIOReturnSuccess)
+	if (XboxOneCompileStickFilter((const xboxone_stick_filter_config*)config, numer, denom, &next->stickFilter) == false)
 	{
-		DebugLog("%{public}s - handleReport failed with error: 0x%08x.", __PRETTY_FUNCTION__, ret);
-		result = false;
-		goto Exit;
+		Log("UpdateStickFilter() - Unsupported configuration version %u, or cutoff out of range.", ((const xboxone_stick_filter_config*)config)->version);
+		return kIOReturnUnsupported;
 	}
 
-Exit:
-	TraceLog("<< %{public}s", __PRETTY_FUNCTION__);
-	return result;
+	return kIOReturnSuccess;
 }
 
-/// An example of generic USB packet handling.
-/// Passes the packet on to `IOUserHIDDevice` via `HandleReportGeneric`.
-bool XboxOneInputInterface::HandleControllerReport(void* data, uint32_t actualByteCount, uint64_t completionTimestamp)
+/// A function available the user client that drives the rumble motors.
+/// `command` is an `xboxone_rumble_command`.
+/// The packet is queued on this controller's own queue, since the output queue is only ever touched from there.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::SendRumble(const void* command, uint32_t length)
 {
-	bool result = false;
+	xboxone_rumble_packet packet = {};
 
-	TraceLog(">> HandleControllerReport()");
+	TraceLog(">> SendRumble()");
 
-	result = HandleReportGeneric(data, actualByteCount, completionTimestamp, XBOXONE_IN_BUTTON, XBOXONE_BUTTON_REPORT_SIZE);
-	if (result == true)
+	if (ivars == nullptr || ivars->queue == nullptr || ivars->outPipe.pipe == nullptr)
+	{
+		TraceLog("<< SendRumble()");
+		return kIOReturnNotReady;
+	}
+
+	if (command == nullptr || length != sizeof(xboxone_rumble_command))
 	{
-		DebugLog("HandleControllerReport() - Handled");
-		DebugPrintButtonPacket(ivars->inPipe.memory.address);
+		Log("SendRumble() - Expected %zu bytes of command, got %u.", sizeof(xboxone_rumble_command), length);
+		TraceLog("<< SendRumble()");
+		return kIOReturnBadArgument;
 	}
 
-	TraceLog("<< HandleControllerReport()");
+	XboxOneCommandRumblePacket((const xboxone_rumble_command*)command, &packet);
 
-	return result;
+	// Keep the driver alive until the packet has been queued.
+	this->retain();
+	ivars->queue->DispatchAsync(^{
+		SendInterruptData((const uint8_t*)&packet, XBOXONE_RUMBLE_PACKET_SIZE, XBOXONE_OUTPUT_RUMBLE);
+		this->release();
+	});
+
+	TraceLog("<< SendRumble()");
+	return kIOReturnSuccess;
 }
 
-/// Handles Xbox One controller "guide" button reports.
-/// Generates a response packet to the "guide" button report, and sends it to the controller.
-bool XboxOneInputInterface::HandleGuideReport(void* data, uint32_t actualByteCount, uint64_t completionTimestamp)
+/// A function available the user client that sets the coalescing window for button reports, with 0 turning coalescing off.
+/// The window is changed on this controller's own queue, since that is where `coalescer` is used.
+/// See its use in `XboxOneUserClient`.
+void XboxOneInputInterface::SetCoalescing(uint32_t windowMicroseconds)
 {
-	bool result = false;
-
-	TraceLog(">> HandleGuideReport()");
+	TraceLog(">> SetCoalescing()");
 
-	result = HandleReportGeneric(data, actualByteCount, completionTimestamp, XBOXONE_IN_GUIDE, XBOXONE_GUIDE_REPORT_SIZE);
-	if (result == true)
+	if (ivars == nullptr || ivars->queue == nullptr)
 	{
-		DebugLog("HandleGuideReport() - Handled");
+		TraceLog("<< SetCoalescing()");
+		return;
+	}
 
-		xboxone_guide_report* report = (xboxone_guide_report*)data;
+	uint32_t numer = (ivars->timebase.denom != 0) ? ivars->timebase.numer : 1;
+	uint32_t denom = (ivars->timebase.denom != 0) ? ivars->timebase.denom : 1;
+	uint64_t window = (uint64_t)windowMicroseconds * 1000 * denom / numer;
 
-		if (report->header.version == 0x30)
-		{
-			xboxone_guide_response response = {
-				.header = {
-					.packetType = 0x01,
-					.version = 0x20,
-					.counter = 0x00,
-					.size = 0x09,
-				},
-				.constData = { 0x00, 0x07, 0x20, 0x02 },
-				.padding = {},
-			};
+	// Keep the driver alive until the window has been changed.
+	this->retain();
+	ivars->queue->DispatchAsync(^{
+		XboxOneCoalescerSetWindow(&ivars->coalescer, window);
 
-			SendInterruptData((const uint8_t*)(&response), XBOXONE_GUIDE_RESPONSE_SIZE);
+		// With coalescing off there may be no later report to push a held one out, so it is delivered now.
+		if (window == 0)
+		{
+			FlushCoalescedReport();
 		}
+		this->release();
+	});
+
+	TraceLog("<< SetCoalescing()");
+}
+
+/// A function available the user client that reads the link quality results.
+/// `stats` is an `xboxone_link_stats`.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::CopyLinkStats(void* stats, uint32_t length)
+{
+	TraceLog(">> CopyLinkStats()");
+
+	if (ivars == nullptr || stats == nullptr || length != sizeof(xboxone_link_stats))
+	{
+		TraceLog("<< CopyLinkStats()");
+		return kIOReturnBadArgument;
 	}
 
-	TraceLog("<< HandleGuideReport()");
+	// The monitor is only changed on the controller's queue, so it is read one word at a time rather than copied.
+	XboxOneLinkMonitorRead(&ivars->linkMonitor, (xboxone_link_stats*)stats);
 
-	return result;
+	TraceLog("<< CopyLinkStats()");
+	return kIOReturnSuccess;
 }
 
-/// Called when input data received.
-/// This only works because a read was established in `RequestAsyncInterruptData` and this function was established as a callback via `CreateActionGotData`.
-void XboxOneInputInterface::GotData_Impl(OSAction* action, kern_return_t status, uint32_t actualByteCount, uint64_t completionTimestamp)
+/// A function available the user client that reads the latency percentiles of the input path.
+/// `stats` is an `xboxone_latency_stats`.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::CopyLatencyStats(void* stats, uint32_t length)
 {
-	(void)action;
+	TraceLog(">> CopyLatencyStats()");
+
+	if (ivars == nullptr || stats == nullptr || length != sizeof(xboxone_latency_stats))
+	{
+		TraceLog("<< CopyLatencyStats()");
+		return kIOReturnBadArgument;
+	}
 
-	bool handled = false;
-	xboxone_report_header* header = nullptr;
+	XboxOneLatencySummarize(&ivars->latency, ivars->timebase.numer, ivars->timebase.denom, (xboxone_latency_stats*)stats);
 
-	TraceLog(">> GotData()");
+	TraceLog("<< CopyLatencyStats()");
+	return kIOReturnSuccess;
+}
 
-	if (status != kIOReturnSuccess)
+/// A function available the user client that shares the raw packet ring, and starts appending packets to it.
+/// `memory` is retained for the caller.
+///
+/// The ring has a single consumer, which advances its `tail`, so only `client` may map it until it calls `ReleasePacketStream`.
+/// Any other client is refused, rather than racing it on `tail`. The same client may map the ring again.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::CopyPacketStream(IOUserClient* client, IOMemoryDescriptor** memory)
+{
+	IOUserClient* owner = nullptr;
+
+	TraceLog(">> CopyPacketStream()");
+
+	if (ivars == nullptr || memory == nullptr || ivars->packetStream == nullptr)
 	{
-		DebugLog("GotData() - Called with error: 0x%08x.", status);
-		goto Exit;
+		TraceLog("<< CopyPacketStream()");
+		return kIOReturnNotReady;
 	}
 
-	if (ivars->enabled == false)
+	if (client == nullptr)
 	{
-		DebugLog("GotData() - Disabled, ignoring packet.");
-		goto Exit;
+		TraceLog("<< CopyPacketStream()");
+		return kIOReturnBadArgument;
 	}
 
-	header = (xboxone_report_header*)ivars->inPipe.memory.address;
-	DebugLog("GotData() - packetType 0x%x, packetSize %d", header->packetType, header->size);
-
-	handled = HandleControllerReport(header, actualByteCount, completionTimestamp);
-	if (handled == true)
+	// User clients run on their own queues, so the claim has to be atomic.
+	if (__atomic_compare_exchange_n(&ivars->packetStreamClient, &owner, client, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == false && owner != client)
 	{
-		DebugLog("GotData() - Reported controller packet.");
-		goto Exit;
+		Log("CopyPacketStream() - The packet stream is already mapped by another client.");
+		TraceLog("<< CopyPacketStream()");
+		return kIOReturnExclusiveAccess;
 	}
 
-	handled = HandleGuideReport(header, actualByteCount, completionTimestamp);
-	if (handled == true)
+	ivars->packetStream->retain();
+	*memory = ivars->packetStream;
+
+	TraceLog("<< CopyPacketStream()");
+	return kIOReturnSuccess;
+}
+
+/// A function available the user client that stops appending packets to the raw packet ring, if `client` is the one that mapped it,
+/// so another client can map it.
+/// See its use in `XboxOneUserClient`.
+void XboxOneInputInterface::ReleasePacketStream(IOUserClient* client)
+{
+	IOUserClient* owner = client;
+
+	TraceLog(">> ReleasePacketStream()");
+
+	if (ivars != nullptr && client != nullptr)
 	{
-		DebugLog("GotData() - Reported guide packet.");
-		goto Exit;
+		__atomic_compare_exchange_n(&ivars->packetStreamClient, &owner, nullptr, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
 	}
 
-Exit:
-	RequestAsyncInterruptData();
-	TraceLog("<< GotData()");
+	TraceLog("<< ReleasePacketStream()");
 }
 
+/// A function available the user client that shares the controller state page.
+/// `memory` is retained for the caller.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::CopyStatePage(IOMemoryDescriptor** memory)
+{
+	TraceLog(">> CopyStatePage()");
 
+	if (ivars == nullptr || memory == nullptr || ivars->statePage == nullptr)
+	{
+		TraceLog("<< CopyStatePage()");
+		return kIOReturnNotReady;
+	}
 
+	ivars->statePage->retain();
+	*memory = ivars->statePage;
 
-// MARK: Interface Communication - Data to Device
+	TraceLog("<< CopyStatePage()");
+	return kIOReturnSuccess;
+}
 
-/// Sends data on the `OUT` interrupt pipe to the Xbox One controller.
-kern_return_t XboxOneInputInterface::SendInterruptData(const uint8_t* data, uint8_t size)
+/// A function available the user client that shares the binary trace ring.
+/// `memory` is retained for the caller.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::CopyTraceRing(IOMemoryDescriptor** memory)
 {
-	kern_return_t ret = kIOReturnSuccess;
-	uint32_t bytesTransferred = 0;
+	TraceLog(">> CopyTraceRing()");
+
+	if (ivars == nullptr || memory == nullptr || ivars->traceBuffer == nullptr)
+	{
+		TraceLog("<< CopyTraceRing()");
+		return kIOReturnNotReady;
+	}
+
+	ivars->traceBuffer->retain();
+	*memory = ivars->traceBuffer;
+
+	TraceLog("<< CopyTraceRing()");
+	return kIOReturnSuccess;
+}
 
-	TraceLog(">> SendInterruptData()");
+/// A function available the user client that shares the button event ring.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::CopyButtonEvents(IOMemoryDescriptor** memory)
+{
+	TraceLog(">> CopyButtonEvents()");
 
-	if (size > ivars->outPipe.memory.length)
+	if (ivars == nullptr || memory == nullptr || ivars->buttonEventBuffer == nullptr)
 	{
-		// NOTE: This is a pretty cowardly thing to do. But its safe to assume that no packet requires more than one packet size.
-		Log("SendInterruptData() - Size of requested packet (%d) is larger than the max packet size allowed for this pipe (%llu). Refusing to send packet.", size, ivars->outPipe.memory.length);
-		return kIOReturnBadArgument;
+		TraceLog("<< CopyButtonEvents()");
+		return kIOReturnNotReady;
 	}
 
-	// The Xbox One controller protocol includes a counter that is incremented every time a packet is sent to the Xbox One controller.
-	// This code handles incrementing that counter.
-	memcpy(ivars->outPipe.memory.address, data, size);
-	ivars->outPipe.memory.address[2] = ivars->outCounter++;
+	ivars->buttonEventBuffer->retain();
+	*memory = ivars->buttonEventBuffer;
 
-	ret = ivars->outPipe.pipe->IO(ivars->outPipe.memory.buffer, size, &bytesTransferred, 0);
-	if (ret != kIOReturnSuccess)
+	TraceLog("<< CopyButtonEvents()");
+	return kIOReturnSuccess;
+}
+
+/// A function available the user client that completes `action` once the button event ring holds more than `cursor` events.
+/// This lets a client sleep until a button is pressed or released, rather than polling the ring.
+/// The wait is added on this controller's own queue, since that is where events are recorded.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::WaitForButtonEvents(IOUserClient* client, OSAction* action, uint64_t cursor)
+{
+	TraceLog(">> WaitForButtonEvents()");
+
+	if (ivars == nullptr || ivars->queue == nullptr || ivars->buttonEventBuffer == nullptr)
 	{
-		Log("SendInterruptData() - Failed to send init packet with error: 0x%08x.", ret);
-		goto Exit;
+		TraceLog("<< WaitForButtonEvents()");
+		return kIOReturnNotReady;
 	}
 
-	if (bytesTransferred != size)
+	if (client == nullptr || action == nullptr)
 	{
-		DebugLog("SendInterruptData() - Expected to send %d bytes, instead sent %d bytes.", size, (uint8_t)bytesTransferred);
+		TraceLog("<< WaitForButtonEvents()");
+		return kIOReturnBadArgument;
 	}
-	DebugLog("SendInterruptData() - Transferred %u bytes.", bytesTransferred);
 
-Exit:
-	DebugLog("SendInterruptData() - Result of 0x%08x.", ret);
-	TraceLog("<< SendInterruptData()");
-	return ret;
+	// Keep the driver, the client, and its completion alive until the wait is completed.
+	this->retain();
+	client->retain();
+	action->retain();
+	ivars->queue->DispatchAsync(^{
+		IOUserClientAsyncArgumentsArray arguments = {};
+		kern_return_t status = kIOReturnSuccess;
+
+		// A wait added after `Stop` would never be completed.
+		if (ivars->inputPath.recovery.stats.state == PIPE_RECOVERY_STOPPED)
+		{
+			status = kIOReturnAborted;
+		}
+		else if (ivars->buttonEventWaiterCount == kXboxOneMaxButtonEventWaiters)
+		{
+			status = kIOReturnNoResources;
+		}
+
+		if (status != kIOReturnSuccess)
+		{
+			client->AsyncCompletion(action, status, arguments, 0);
+			action->release();
+			client->release();
+		}
+		else
+		{
+			ivars->buttonEventWaiters[ivars->buttonEventWaiterCount++] = {
+				.client = client,
+				.action = action,
+				.cursor = cursor,
+			};
+
+			// Events the client has not read yet complete the wait straight away.
+			CompleteButtonEventWaits(client, kIOReturnSuccess);
+		}
+		this->release();
+	});
+
+	TraceLog("<< WaitForButtonEvents()");
+	return kIOReturnSuccess;
 }
 
+/// A function available the user client that completes every wait of `client` as aborted, since the client is going away.
+/// See its use in `XboxOneUserClient`.
+void XboxOneInputInterface::CancelButtonEventWaits(IOUserClient* client)
+{
+	TraceLog(">> CancelButtonEventWaits()");
 
+	if (ivars == nullptr || ivars->queue == nullptr || client == nullptr)
+	{
+		TraceLog("<< CancelButtonEventWaits()");
+		return;
+	}
 
+	this->retain();
+	client->retain();
+	ivars->queue->DispatchAsync(^{
+		CompleteButtonEventWaits(client, kIOReturnAborted);
+		client->release();
+		this->release();
+	});
 
-// MARK: - UserClient Communication
+	TraceLog("<< CancelButtonEventWaits()");
+}
 
-/// Called by DriverKit when a new UserClient connects to the driver.
-kern_return_t XboxOneInputInterface::NewUserClient_Impl(uint32_t type, IOUserClient** userClient)
+/// A function available the user client that switches trace categories on and off.
+/// `categories` is a mask of `xboxone_trace_category`.
+/// See its use in `XboxOneUserClient`.
+void XboxOneInputInterface::SetTraceCategories(uint32_t categories)
 {
-	(void)type;
+	TraceLog(">> SetTraceCategories()");
 
-	kern_return_t ret = kIOReturnSuccess;
-	IOService* client = nullptr;
+	if (ivars != nullptr)
+	{
+		TraceRingSetCategories(&ivars->trace, categories & XBOXONE_TRACE_ALL);
+	}
 
-	TraceLog(">> NewUserClient()");
+	TraceLog("<< SetTraceCategories()");
+}
 
-	ret = Create(this, "UserClientProperties", &client);
-	if (ret != kIOReturnSuccess)
+/// A function available the user client that reads every operational counter in one go.
+/// `stats` is an `xboxone_metrics_stats`.
+/// See its use in `XboxOneUserClient`.
+kern_return_t XboxOneInputInterface::CopyMetrics(void* stats, uint32_t length)
+{
+	TraceLog(">> CopyMetrics()");
+
+	if (ivars == nullptr || ivars->metrics == nullptr || stats == nullptr || length != sizeof(xboxone_metrics_stats))
 	{
-		Log("NewUserClient() - Failed to create UserClientProperties with error: 0x%08x.", ret);
-		goto Exit;
+		TraceLog("<< CopyMetrics()");
+		return kIOReturnBadArgument;
 	}
 
-	*userClient = OSDynamicCast(XboxOneUserClient, client);
-	if (*userClient == NULL)
+	uint32_t numer = (ivars->timebase.denom != 0) ? ivars->timebase.numer : 1;
+	uint32_t denom = (ivars->timebase.denom != 0) ? ivars->timebase.denom : 1;
+
+	uint64_t now = mach_absolute_time();
+	xboxone_metrics_stats* metrics = (xboxone_metrics_stats*)stats;
+
+	XboxOneMetricsRead(ivars->metrics, now * numer / denom, metrics);
+	XboxOneCoalescerRead(&ivars->coalescer, &metrics->coalescing);
+
+	// The time since the last change is only added here, so the driver does not have to update it on every wakeup.
+	uint32_t enabled = __atomic_load_n(&ivars->inputPath.enabled, __ATOMIC_RELAXED) ? 1 : 0;
+	uint64_t enabledSince = __atomic_load_n(&ivars->enabledSince, __ATOMIC_RELAXED);
+	if (now > enabledSince)
 	{
-		Log("NewUserClient() - Failed to cast new client.");
-		client->release();
-		ret = kIOReturnError;
-		goto Exit;
+		metrics->input.enableTime[enabled] += now - enabledSince;
+	}
+	for (uint32_t state = 0; state < 2; ++state)
+	{
+		metrics->input.enableTime[state] = metrics->input.enableTime[state] * numer / denom;
 	}
 
-	// Gives the user client a pointer back to this object.
-	((XboxOneUserClient*)(*userClient))->SetInputInterface(this);
-
-	TraceLog("<< NewUserClient()");
+	PipeRecoveryRead(&ivars->inputPath.recovery, now, &metrics->recovery);
+	for (uint32_t state = 0; state < PIPE_RECOVERY_STATE_COUNT; ++state)
+	{
+		metrics->recovery.stateTime[state] = metrics->recovery.stateTime[state] * numer / denom;
+	}
 
-Exit:
-	return ret;
+	TraceLog("<< CopyMetrics()");
+	return kIOReturnSuccess;
 }
 
-/// A function available the user client that can enable or disable the driver.
-/// See its use in `XboxOneUserClient`.
-void XboxOneInputInterface::SetEnable(bool enabled)
+/// A function available the user client that reports how many string descriptors the device description had to read from the device,
+/// and whether the descriptor cache saved reading them. See its use in `XboxOneUserClient`.
+void XboxOneInputInterface::CopyDescriptorCacheStats(bool* hit, uint64_t* stringsRead, uint64_t* savedNanoseconds, uint64_t* descriptionNanoseconds)
 {
-	TraceLog(">> SetEnable()");
+	TraceLog(">> CopyDescriptorCacheStats()");
+
+	*hit = false;
+	*stringsRead = 0;
+	*savedNanoseconds = 0;
+	*descriptionNanoseconds = 0;
 
 	if (ivars != nullptr)
 	{
-		ivars->enabled = enabled;
+		uint32_t numer = (ivars->timebase.denom != 0) ? ivars->timebase.numer : 1;
+		uint32_t denom = (ivars->timebase.denom != 0) ? ivars->timebase.denom : 1;
+
+		*hit = ivars->descriptorCacheHit;
+		*stringsRead = ivars->descriptorStringsRead;
+		*savedNanoseconds = ivars->descriptorCacheSavedTicks * numer / denom;
+		*descriptionNanoseconds = ivars->descriptionTicks * numer / denom;
 	}
 
-	TraceLog("<< SetEnable()");
+	TraceLog("<< CopyDescriptorCacheStats()");
 }
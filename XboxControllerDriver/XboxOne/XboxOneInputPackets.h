@@ -12,6 +12,8 @@
 #ifndef XboxOneInputPackets_h
 #define XboxOneInputPackets_h
 
+#include <stdint.h>
+
 // MARK: - Shared Packet Structure
 
 /// Enumeration defining all of the different packet types the driver will handle.
@@ -62,6 +64,19 @@ typedef struct {
 } xboxone_button_report;
 constexpr uint8_t XBOXONE_BUTTON_REPORT_SIZE = sizeof(xboxone_button_report) - XBOXONE_REPORT_HEADER_SIZE;
 
+/// Enumeration indexing the analog values of the `xboxone_button_report`.
+///
+/// Used wherever a setting applies to each axis individually, such as thresholds or curves.
+typedef enum {
+	XBOXONE_AXIS_TRIGGER_LEFT = 0,
+	XBOXONE_AXIS_TRIGGER_RIGHT,
+	XBOXONE_AXIS_LEFT_X,
+	XBOXONE_AXIS_LEFT_Y,
+	XBOXONE_AXIS_RIGHT_X,
+	XBOXONE_AXIS_RIGHT_Y,
+	XBOXONE_AXIS_COUNT,
+} xboxone_axis;
+
 /// The structure of a button "guide" button report sent from the Xbox One controller.
 ///
 /// Whenever the glowing "guide" or "xbox button" is pressed, a separate packet is sent from the standard button packet.
@@ -107,6 +122,18 @@ typedef enum {
 
 // MARK: - Packets to Controller
 
+/// Enumeration of the priority classes of packets sent to the Xbox One controller, most urgent first.
+///
+/// `XBOXONE_OUTPUT_HANDSHAKE` - Packets that bring the controller up, such as the init packet.
+/// `XBOXONE_OUTPUT_ACK` - Responses the controller is waiting on, such as the guide response.
+/// `XBOXONE_OUTPUT_RUMBLE` - Rumble and other effects, which are the first to be refused when the queue is full.
+typedef enum {
+	XBOXONE_OUTPUT_HANDSHAKE = 0,
+	XBOXONE_OUTPUT_ACK,
+	XBOXONE_OUTPUT_RUMBLE,
+	XBOXONE_OUTPUT_PRIORITY_COUNT,
+} xboxone_output_priority;
+
 /// The structure of a button "guide" button response sent to the Xbox One controller.
 ///
 /// When the controller sends a "guide" button packet. It expects a response in this format.
@@ -120,4 +147,28 @@ typedef struct {
 } xboxone_guide_response;
 constexpr uint8_t XBOXONE_GUIDE_RESPONSE_SIZE = sizeof(xboxone_guide_response) - XBOXONE_REPORT_HEADER_SIZE;
 
+/// The structure of a rumble packet sent to the Xbox One controller.
+///
+/// `header` - Packet type 0x09, version 0x00, and a size of 0x09.
+/// `reserved` - Always 0.
+/// `motors` - A bitmask of the motors to drive: 0x01 right, 0x02 left, 0x04 right trigger, 0x08 left trigger.
+/// `leftTrigger`, `rightTrigger`, `left`, `right` - The strength of each motor, from 0 to 100.
+/// `duration` - How long each pulse lasts, in units of 10 ms. 0xFF means until the next rumble packet.
+/// `delay` - How long to wait between pulses, in units of 10 ms.
+/// `repeat` - How many more times the pulse repeats. 0xFF means forever.
+typedef struct {
+	xboxone_report_header header;
+
+	uint8_t reserved;
+	uint8_t motors;
+	uint8_t leftTrigger;
+	uint8_t rightTrigger;
+	uint8_t left;
+	uint8_t right;
+	uint8_t duration;
+	uint8_t delay;
+	uint8_t repeat;
+} xboxone_rumble_packet;
+constexpr uint8_t XBOXONE_RUMBLE_PACKET_SIZE = sizeof(xboxone_rumble_packet);
+
 #endif /* XboxOneInputPackets_h */
@@ -0,0 +1,155 @@
+//
+//  XboxOneLatency.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Latency measurements of the input path of the Xbox One controller driver.
+// One histogram covers the time from the read completing to `handleReport` returning,
+// and one histogram covers each stage of the input path.
+// The time taken by each phase of startup, up to the first report being delivered, is recorded once.
+// This code is not specific to DriverKit in any way, and is simply part of the driver functionality.
+//
+
+#ifndef XboxOneLatency_h
+#define XboxOneLatency_h
+
+#include <stdint.h>
+
+#include <LatencyHistogram.h>
+
+/// Enumeration of the measurements taken on the input path.
+///
+/// `XBOXONE_LATENCY_END_TO_END` - From the completion timestamp of the read to `handleReport` returning.
+/// `XBOXONE_LATENCY_DISPATCH` - Looking up the handler for a packet.
+/// `XBOXONE_LATENCY_VALIDATION` - Checking a packet against the previous one.
+/// `XBOXONE_LATENCY_TRANSFORM` - Smoothing, deadzones, curves, remapping and filtering of a report.
+/// `XBOXONE_LATENCY_DELIVERY` - Handing a report to the HID event system with `handleReport`.
+/// `XBOXONE_LATENCY_REARM` - Submitting the next read on the pipe.
+typedef enum {
+	XBOXONE_LATENCY_END_TO_END = 0,
+	XBOXONE_LATENCY_DISPATCH,
+	XBOXONE_LATENCY_VALIDATION,
+	XBOXONE_LATENCY_TRANSFORM,
+	XBOXONE_LATENCY_DELIVERY,
+	XBOXONE_LATENCY_REARM,
+	XBOXONE_LATENCY_COUNT,
+} xboxone_latency_stage;
+
+/// Enumeration of the phases of startup, in the order they complete.
+///
+/// `XBOXONE_STARTUP_HID` - `IOUserHIDDevice` has started, including building the device description.
+/// `XBOXONE_STARTUP_DESCRIPTORS` - The configuration and interface descriptors were read.
+/// `XBOXONE_STARTUP_PIPES` - The interrupt pipes were found.
+/// `XBOXONE_STARTUP_BUFFERS` - Every buffer and completion action was created.
+/// `XBOXONE_STARTUP_ARMED` - Every input read was submitted.
+/// `XBOXONE_STARTUP_HANDSHAKE` - The init packets were queued.
+/// `XBOXONE_STARTUP_FIRST_REPORT` - The first report was handed to `handleReport`.
+typedef enum {
+	XBOXONE_STARTUP_HID = 0,
+	XBOXONE_STARTUP_DESCRIPTORS,
+	XBOXONE_STARTUP_PIPES,
+	XBOXONE_STARTUP_BUFFERS,
+	XBOXONE_STARTUP_ARMED,
+	XBOXONE_STARTUP_HANDSHAKE,
+	XBOXONE_STARTUP_FIRST_REPORT,
+	XBOXONE_STARTUP_COUNT,
+} xboxone_startup_phase;
+
+/// Percentiles of a single measurement, in nanoseconds.
+///
+/// `count` - The number of values recorded.
+/// `p50` - The median.
+/// `p99` - The 99th percentile.
+/// `p999` - The 99.9th percentile.
+/// `max` - The largest value recorded.
+typedef struct {
+	uint64_t count;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t max;
+} xboxone_latency_summary;
+
+/// Latency results, as returned through the user client.
+///
+/// `stages` - The summary of each measurement, indexed by `xboxone_latency_stage`.
+/// `startup` - The time from `Start` to the end of each phase in nanoseconds, or 0 if the phase has not completed. Indexed by `xboxone_startup_phase`.
+typedef struct {
+	xboxone_latency_summary stages[XBOXONE_LATENCY_COUNT];
+	uint64_t startup[XBOXONE_STARTUP_COUNT];
+} xboxone_latency_stats;
+
+/// The histograms of every measurement, recorded in absolute time ticks.
+///
+/// `startTicks` - When `Start` was called.
+/// `startupTicks` - When each phase of startup completed, or 0 if it has not.
+typedef struct {
+	latency_histogram stages[XBOXONE_LATENCY_COUNT];
+	uint64_t startTicks;
+	uint64_t startupTicks[XBOXONE_STARTUP_COUNT];
+} xboxone_latency_monitor;
+
+/// Records the time between two absolute time readings for a stage.
+inline void XboxOneLatencyRecord(xboxone_latency_monitor* monitor, xboxone_latency_stage stage, uint64_t start, uint64_t end)
+{
+	LatencyHistogramRecord(&monitor->stages[stage], (end > start) ? end - start : 0);
+}
+
+/// Records the time since `*start` for a stage, and starts timing the next stage at `now`.
+inline void XboxOneLatencyLap(xboxone_latency_monitor* monitor, xboxone_latency_stage stage, uint64_t* start, uint64_t now)
+{
+	XboxOneLatencyRecord(monitor, stage, *start, now);
+	*start = now;
+}
+
+/// Records the start of startup.
+inline void XboxOneStartupBegin(xboxone_latency_monitor* monitor, uint64_t now)
+{
+	__atomic_store_n(&monitor->startTicks, now, __ATOMIC_RELAXED);
+}
+
+/// Records the completion of a startup phase, returning false if it had already been recorded.
+inline bool XboxOneStartupMark(xboxone_latency_monitor* monitor, xboxone_startup_phase phase, uint64_t now)
+{
+	if (__atomic_load_n(&monitor->startupTicks[phase], __ATOMIC_RELAXED) != 0)
+	{
+		return false;
+	}
+
+	__atomic_store_n(&monitor->startupTicks[phase], now, __ATOMIC_RELAXED);
+	return true;
+}
+
+/// Summarizes every measurement, converting ticks to nanoseconds with the ratio `numer / denom`.
+inline void XboxOneLatencySummarize(const xboxone_latency_monitor* monitor, uint32_t numer, uint32_t denom, xboxone_latency_stats* stats)
+{
+	if (denom == 0)
+	{
+		numer = 1;
+		denom = 1;
+	}
+
+	for (uint32_t stage = 0; stage < XBOXONE_LATENCY_COUNT; ++stage)
+	{
+		const latency_histogram* histogram = &monitor->stages[stage];
+		xboxone_latency_summary* summary = &stats->stages[stage];
+
+		summary->count = __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+		summary->p50 = LatencyHistogramPercentile(histogram, 500) * numer / denom;
+		summary->p99 = LatencyHistogramPercentile(histogram, 990) * numer / denom;
+		summary->p999 = LatencyHistogramPercentile(histogram, 999) * numer / denom;
+		summary->max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED) * numer / denom;
+	}
+
+	for (uint32_t phase = 0; phase < XBOXONE_STARTUP_COUNT; ++phase)
+	{
+		uint64_t start = __atomic_load_n(&monitor->startTicks, __ATOMIC_RELAXED);
+		uint64_t end = __atomic_load_n(&monitor->startupTicks[phase], __ATOMIC_RELAXED);
+
+		stats->startup[phase] = (end > start) ? (end - start) * numer / denom : 0;
+	}
+}
+
+#endif /* XboxOneLatency_h */
@@ -0,0 +1,152 @@
+//
+//  XboxOneLinkMonitor.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Tracks the quality of the USB link to the Xbox One controller,
+// using the counter in every packet header and the completion timestamp of every read.
+// This separates latency that comes from the link from latency that comes from the driver.
+// This code is not specific to DriverKit in any way, and is simply part of the driver functionality.
+//
+
+#ifndef XboxOneLinkMonitor_h
+#define XboxOneLinkMonitor_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "XboxOneInputPackets.h"
+
+/// The number of buckets in the interval jitter histogram.
+/// Bucket `n` counts arrivals whose distance from the nearest polling frame boundary is `n / 16` of an interval, up to half an interval.
+constexpr uint32_t XBOXONE_JITTER_BUCKETS = 9;
+
+/// Link quality results, as returned through the user client.
+///
+/// `packets` - The number of packets seen.
+/// `droppedPackets` - The number of packets skipped over by the header counter.
+/// `repeatedPackets` - The number of packets that repeated the previous counter.
+/// `outOfOrderPackets` - The number of packets whose counter went backwards.
+/// `missedFrames` - Polling frames in which the controller had a packet that never arrived.
+/// `intervalTicks` - The polling interval, in completion timestamp ticks.
+/// `maxArrivalTicks` - The longest time between two packets, in completion timestamp ticks.
+/// `jitterHistogram` - How far arrivals were from a multiple of the polling interval. See `XBOXONE_JITTER_BUCKETS`.
+typedef struct {
+	uint64_t packets;
+	uint64_t droppedPackets;
+	uint64_t repeatedPackets;
+	uint64_t outOfOrderPackets;
+	uint64_t missedFrames;
+	uint64_t intervalTicks;
+	uint64_t maxArrivalTicks;
+	uint64_t jitterHistogram[XBOXONE_JITTER_BUCKETS];
+} xboxone_link_stats;
+
+/// The state of the link monitor.
+///
+/// The controller numbers each packet type separately, so the last counter is kept for every type.
+/// Only one thread may change it, but `XboxOneLinkMonitorRead` may be called from any thread.
+/// `stats` - The results so far.
+/// `lastTimestamp` - The completion timestamp of the previous packet, or 0 if there was none.
+/// `lastCounter` - The counter of the previous packet of each type.
+/// `counterValid` - A bitmask of which entries of `lastCounter` hold a counter.
+typedef struct {
+	xboxone_link_stats stats;
+	uint64_t lastTimestamp;
+	uint8_t lastCounter[256];
+	uint32_t counterValid[256 / 32];
+} xboxone_link_monitor;
+
+/// Resets the monitor for a pipe polled every `intervalTicks`.
+inline void XboxOneLinkMonitorInit(xboxone_link_monitor* monitor, uint64_t intervalTicks)
+{
+	memset(monitor, 0, sizeof(*monitor));
+	monitor->stats.intervalTicks = intervalTicks;
+}
+
+/// Adds to a counter of the results. Only the thread changing the state may call this.
+inline void XboxOneLinkMonitorAdd(uint64_t* counter, uint64_t amount)
+{
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+/// Records a packet that was successfully read from the controller.
+inline void XboxOneLinkMonitorRecord(xboxone_link_monitor* monitor, const xboxone_report_header* header, uint64_t timestamp)
+{
+	xboxone_link_stats* stats = &monitor->stats;
+	uint64_t interval = stats->intervalTicks;
+	uint64_t frames = 1;
+	uint8_t type = header->packetType;
+	uint32_t validBit = 1u << (type % 32);
+	int32_t gap = 1;
+
+	XboxOneLinkMonitorAdd(&stats->packets, 1);
+
+	if (monitor->lastTimestamp != 0 && timestamp >= monitor->lastTimestamp && interval != 0)
+	{
+		uint64_t arrival = timestamp - monitor->lastTimestamp;
+		uint64_t phase = arrival % interval;
+		uint64_t jitter = (phase > interval / 2) ? (interval - phase) : phase;
+		uint64_t bucket = (jitter * 16) / interval;
+
+		frames = (arrival + interval / 2) / interval;
+		XboxOneLinkMonitorAdd(&stats->jitterHistogram[bucket < XBOXONE_JITTER_BUCKETS ? bucket : XBOXONE_JITTER_BUCKETS - 1], 1);
+		if (arrival > stats->maxArrivalTicks)
+		{
+			__atomic_store_n(&stats->maxArrivalTicks, arrival, __ATOMIC_RELAXED);
+		}
+	}
+	monitor->lastTimestamp = timestamp;
+
+	if ((monitor->counterValid[type / 32] & validBit) != 0)
+	{
+		// The counter wraps at 256, so the difference is read as a signed 8-bit value.
+		gap = (int8_t)(header->counter - monitor->lastCounter[type]);
+	}
+
+	if (gap == 0)
+	{
+		XboxOneLinkMonitorAdd(&stats->repeatedPackets, 1);
+		return;
+	}
+
+	if (gap < 0)
+	{
+		// Keep the newer counter, so the stream recovers once packets arrive in order again.
+		XboxOneLinkMonitorAdd(&stats->outOfOrderPackets, 1);
+		return;
+	}
+
+	if (gap > 1)
+	{
+		uint64_t lost = (uint64_t)(gap - 1);
+
+		XboxOneLinkMonitorAdd(&stats->droppedPackets, lost);
+		// Only count the frames that actually passed without a packet, in case the lost packets were never polled for.
+		if (frames > 1)
+		{
+			XboxOneLinkMonitorAdd(&stats->missedFrames, (frames - 1 < lost) ? frames - 1 : lost);
+		}
+	}
+
+	monitor->lastCounter[type] = header->counter;
+	monitor->counterValid[type / 32] |= validBit;
+}
+
+/// Copies the results, one word at a time.
+inline void XboxOneLinkMonitorRead(const xboxone_link_monitor* monitor, xboxone_link_stats* stats)
+{
+	const uint64_t* source = (const uint64_t*)&monitor->stats;
+	uint64_t* destination = (uint64_t*)stats;
+
+	static_assert(sizeof(xboxone_link_stats) % sizeof(uint64_t) == 0, "xboxone_link_stats must be a whole number of words.");
+
+	for (uint32_t word = 0; word < sizeof(xboxone_link_stats) / sizeof(uint64_t); ++word)
+	{
+		destination[word] = __atomic_load_n(&source[word], __ATOMIC_RELAXED);
+	}
+}
+
+#endif /* XboxOneLinkMonitor_h */
@@ -0,0 +1,198 @@
+//
+//  XboxOneMetrics.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Operational counters of a single Xbox One controller, read in one call through the user client.
+// Each counter only ever has one writer, the controller's own queue, so counting is a plain increment with no locked instructions.
+// The counters of the input path and the output path are kept on separate cache lines,
+// so that a client reading them, or the other path updating its own, never contends for the lines the input path writes.
+// This code is not specific to DriverKit in any way, so clients can use the same header to read the counters.
+//
+
+#ifndef XboxOneMetrics_h
+#define XboxOneMetrics_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include <PipeRecovery.h>
+
+#include "XboxOneCoalescer.h"
+
+/// The size of a cache line, which each group of counters is aligned to.
+constexpr uint32_t XBOXONE_METRICS_ALIGNMENT = 64;
+/// The number of packet types counted separately. Every value of `xboxone_report_header::packetType` has its own counter.
+constexpr uint32_t XBOXONE_METRICS_PACKET_TYPES = 256;
+/// The number of distinct error statuses counted separately on each pipe. Any further statuses are counted together.
+constexpr uint32_t XBOXONE_METRICS_STATUSES = 8;
+
+/// How many times a transfer failed with a particular status.
+///
+/// `status` - The `IOReturn` of the transfer, or 0 if the entry is unused.
+/// `count` - The number of transfers that failed with `status`.
+typedef struct {
+	uint32_t status;
+	uint32_t reserved;
+	uint64_t count;
+} xboxone_status_count;
+
+/// The errors of a single pipe, by status.
+///
+/// `statuses` - The first `XBOXONE_METRICS_STATUSES` distinct statuses seen, in the order they were first seen.
+/// `otherCount` - The number of errors whose status did not fit in `statuses`.
+typedef struct {
+	xboxone_status_count statuses[XBOXONE_METRICS_STATUSES];
+	uint64_t otherCount;
+} xboxone_status_counts;
+
+/// Counters of the input path.
+///
+/// `packets` - The number of packets read, indexed by packet type.
+/// `bytes` - The number of bytes read.
+/// `errors` - Reads that completed with an error, and reads that could not be submitted, by status.
+/// `rearmFailures` - The number of times a slot could not be re-armed after its read completed.
+/// `disabledDrops` - The number of packets dropped because the driver was disabled.
+/// `reportFailures` - The number of reports `handleReport` refused.
+/// `wakeups` - The number of completions and timer callbacks the controller's queue woke up for, indexed by whether the driver was enabled.
+/// `enableTime` - The time spent disabled and enabled, indexed like `wakeups`.
+/// The driver keeps it in absolute time ticks up to the last change, and returns it in nanoseconds up to the read.
+typedef struct {
+	alignas(XBOXONE_METRICS_ALIGNMENT) uint64_t packets[XBOXONE_METRICS_PACKET_TYPES];
+	uint64_t bytes;
+	xboxone_status_counts errors;
+	uint64_t rearmFailures;
+	uint64_t disabledDrops;
+	uint64_t reportFailures;
+	uint64_t wakeups[2];
+	uint64_t enableTime[2];
+} xboxone_input_metrics;
+
+/// Counters of the output path.
+///
+/// `packets` - The number of packets sent successfully.
+/// `bytes` - The number of bytes sent successfully.
+/// `errors` - Transfers that completed with an error, and transfers that could not be started, by status.
+/// `queueDrops` - The number of packets refused because their priority class of the output queue was full.
+/// `queueDepth` - The number of packets waiting in the output queue.
+/// `queueHighWater` - The largest `queueDepth` seen.
+typedef struct {
+	alignas(XBOXONE_METRICS_ALIGNMENT) uint64_t packets;
+	uint64_t bytes;
+	xboxone_status_counts errors;
+	uint64_t queueDrops;
+	uint64_t queueDepth;
+	uint64_t queueHighWater;
+} xboxone_output_metrics;
+
+/// Every counter of a controller, as kept by the driver.
+///
+/// A zeroed structure is valid. It must be placed at a multiple of `XBOXONE_METRICS_ALIGNMENT`.
+/// `input` - Counters of the input path.
+/// `output` - Counters of the output path.
+typedef struct {
+	xboxone_input_metrics input;
+	xboxone_output_metrics output;
+} xboxone_metrics;
+
+static_assert(sizeof(xboxone_input_metrics) % XBOXONE_METRICS_ALIGNMENT == 0, "Input counters must fill whole cache lines.");
+static_assert(sizeof(xboxone_output_metrics) % XBOXONE_METRICS_ALIGNMENT == 0, "Output counters must fill whole cache lines.");
+
+/// Every counter of a controller, as returned through the user client.
+///
+/// `timestamp` - When the counters were read, in nanoseconds of uptime. The difference between two reads gives the period for rates.
+/// `input` - Counters of the input path.
+/// `output` - Counters of the output path.
+/// `recovery` - How the `IN` pipe has recovered from errors, with its times in nanoseconds.
+/// `coalescing` - How many button reports were coalesced, including the HID deliveries saved.
+typedef struct {
+	uint64_t timestamp;
+	xboxone_input_metrics input;
+	xboxone_output_metrics output;
+	pipe_recovery_stats recovery;
+	xboxone_coalescer_stats coalescing;
+} xboxone_metrics_stats;
+
+/// Adds to a counter. Must only be called by the counter's single writer.
+///
+/// The store is atomic so that a concurrent reader never sees a torn value, but it is not a locked read-modify-write.
+inline void XboxOneMetricsAdd(uint64_t* counter, uint64_t amount)
+{
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+/// Counts a packet read from the controller.
+inline void XboxOneMetricsCountInput(xboxone_metrics* metrics, const uint8_t* packet, uint32_t length)
+{
+	if (length > 0)
+	{
+		XboxOneMetricsAdd(&metrics->input.packets[packet[0]], 1);
+	}
+	XboxOneMetricsAdd(&metrics->input.bytes, length);
+}
+
+/// Counts a transfer that failed with `status`.
+inline void XboxOneMetricsCountError(xboxone_status_counts* counts, uint32_t status)
+{
+	for (uint32_t index = 0; index < XBOXONE_METRICS_STATUSES; ++index)
+	{
+		xboxone_status_count* entry = &counts->statuses[index];
+
+		if (entry->status == status)
+		{
+			XboxOneMetricsAdd(&entry->count, 1);
+			return;
+		}
+		if (entry->status == 0)
+		{
+			// The count is set before the status, so a reader never sees a status with a count from a previous use.
+			__atomic_store_n(&entry->count, 1, __ATOMIC_RELAXED);
+			__atomic_store_n(&entry->status, status, __ATOMIC_RELEASE);
+			return;
+		}
+	}
+
+	XboxOneMetricsAdd(&counts->otherCount, 1);
+}
+
+/// Counts a wakeup of the controller's queue.
+inline void XboxOneMetricsCountWakeup(xboxone_metrics* metrics, bool enabled)
+{
+	XboxOneMetricsAdd(&metrics->input.wakeups[enabled ? 1 : 0], 1);
+}
+
+/// Records the current depth of the output queue.
+inline void XboxOneMetricsSetQueueDepth(xboxone_metrics* metrics, uint64_t depth)
+{
+	__atomic_store_n(&metrics->output.queueDepth, depth, __ATOMIC_RELAXED);
+	if (depth > metrics->output.queueHighWater)
+	{
+		__atomic_store_n(&metrics->output.queueHighWater, depth, __ATOMIC_RELAXED);
+	}
+}
+
+/// Copies every counter, a word at a time, while the writer may still be counting.
+///
+/// Each counter is read atomically, but the counters are not read at a single instant, so related counters may differ by a packet or two.
+inline void XboxOneMetricsRead(const xboxone_metrics* metrics, uint64_t timestamp, xboxone_metrics_stats* stats)
+{
+	const uint64_t* source = (const uint64_t*)metrics;
+	xboxone_metrics copy;
+	uint64_t* destination = (uint64_t*)&copy;
+
+	static_assert(sizeof(xboxone_metrics) % sizeof(uint64_t) == 0, "xboxone_metrics must be a whole number of words.");
+
+	for (uint32_t word = 0; word < sizeof(xboxone_metrics) / sizeof(uint64_t); ++word)
+	{
+		destination[word] = __atomic_load_n(&source[word], __ATOMIC_RELAXED);
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	stats->timestamp = timestamp;
+	memcpy(&stats->input, &copy.input, sizeof(stats->input));
+	memcpy(&stats->output, &copy.output, sizeof(stats->output));
+}
+
+#endif /* XboxOneMetrics_h */
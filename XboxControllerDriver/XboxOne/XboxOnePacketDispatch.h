@@ -0,0 +1,153 @@
+//
+//  XboxOnePacketDispatch.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Classification of packets from the Xbox One controller.
+// A table indexed by packet type is built at compile time from the registry below, once for each controller model,
+// so each packet costs a single lookup and size check before it is handed to its handler.
+// This code is not specific to DriverKit in any way, and is simply part of the driver functionality.
+//
+
+#ifndef XboxOnePacketDispatch_h
+#define XboxOnePacketDispatch_h
+
+#include <stdint.h>
+
+#include "XboxOneInputPackets.h"
+
+/// Enumeration of the handlers a packet can be dispatched to.
+///
+/// `XBOXONE_HANDLER_NONE` - The packet is unknown or malformed, and should be ignored.
+/// `XBOXONE_HANDLER_BUTTON` - The packet is an `xboxone_button_report`.
+/// `XBOXONE_HANDLER_GUIDE` - The packet is an `xboxone_guide_report`.
+typedef enum : uint8_t {
+	XBOXONE_HANDLER_NONE = 0,
+	XBOXONE_HANDLER_BUTTON,
+	XBOXONE_HANDLER_GUIDE,
+} xboxone_packet_handler;
+
+/// An entry in the handler registry.
+///
+/// `packetType` - The first byte of the packet, see `xboxone_in_packet_type`.
+/// `minSize` - The smallest size the packet's header may report, not including the header itself.
+/// `maxSize` - The largest size the packet's header may report, not including the header itself.
+/// `handler` - The handler the packet is dispatched to.
+typedef struct {
+	uint8_t packetType;
+	uint8_t minSize;
+	uint8_t maxSize;
+	xboxone_packet_handler handler;
+} xboxone_packet_registration;
+
+/// Every packet type the driver handles, with the sizes allowed by the controller model `Traits`. See `xboxone_traits`.
+/// Supporting a new packet only needs a new entry here, and a case for its handler.
+template <typename Traits>
+constexpr xboxone_packet_registration XBOXONE_PACKET_REGISTRY[] = {
+	{ XBOXONE_IN_BUTTON, Traits::buttonReportMinSize, Traits::buttonReportMaxSize, XBOXONE_HANDLER_BUTTON },
+	{ XBOXONE_IN_GUIDE, XBOXONE_GUIDE_REPORT_SIZE, XBOXONE_GUIDE_REPORT_SIZE, XBOXONE_HANDLER_GUIDE },
+};
+
+/// The dispatch table, with one entry for every possible packet type.
+///
+/// `handler` - The handler for the packet type, or `XBOXONE_HANDLER_NONE`.
+/// `minSize` - The smallest size the packet's header may report.
+/// `maxSize` - The largest size the packet's header may report.
+typedef struct {
+	struct {
+		xboxone_packet_handler handler;
+		uint8_t minSize;
+		uint8_t maxSize;
+	} entries[256];
+} xboxone_packet_dispatch_table;
+
+/// Expands `XBOXONE_PACKET_REGISTRY` for a controller model into a table indexed by packet type, without checking it.
+template <typename Traits>
+constexpr xboxone_packet_dispatch_table XboxOneExpandPacketRegistry(void)
+{
+	xboxone_packet_dispatch_table table = {};
+
+	for (const xboxone_packet_registration& registration : XBOXONE_PACKET_REGISTRY<Traits>)
+	{
+		table.entries[registration.packetType].handler = registration.handler;
+		table.entries[registration.packetType].minSize = registration.minSize;
+		table.entries[registration.packetType].maxSize = registration.maxSize;
+	}
+
+	return table;
+}
+
+/// Whether the registry of a controller model expands into a table that routes every packet type as registered.
+///
+/// Every entry must have a handler and a size range that is not empty, and no packet type may be registered twice,
+/// since a later entry would silently replace an earlier one in the table. Every other packet type must be ignored.
+template <typename Traits>
+constexpr bool XboxOnePacketRegistryIsValid(void)
+{
+	constexpr xboxone_packet_dispatch_table table = XboxOneExpandPacketRegistry<Traits>();
+	uint32_t registered = 0;
+
+	for (const xboxone_packet_registration& registration : XBOXONE_PACKET_REGISTRY<Traits>)
+	{
+		const auto& entry = table.entries[registration.packetType];
+
+		if (registration.handler == XBOXONE_HANDLER_NONE || registration.minSize > registration.maxSize)
+		{
+			return false;
+		}
+		if (entry.handler != registration.handler || entry.minSize != registration.minSize || entry.maxSize != registration.maxSize)
+		{
+			return false;
+		}
+	}
+
+	for (uint32_t packetType = 0; packetType < 256; ++packetType)
+	{
+		registered += (table.entries[packetType].handler != XBOXONE_HANDLER_NONE) ? 1 : 0;
+	}
+
+	return registered == sizeof(XBOXONE_PACKET_REGISTRY<Traits>) / sizeof(XBOXONE_PACKET_REGISTRY<Traits>[0]);
+}
+
+/// Expands `XBOXONE_PACKET_REGISTRY` for a controller model into a table indexed by packet type, failing to compile if it is not valid.
+template <typename Traits>
+constexpr xboxone_packet_dispatch_table XboxOneBuildPacketDispatchTable(void)
+{
+	static_assert(XboxOnePacketRegistryIsValid<Traits>(), "Every registered packet type must be unique, with a handler and a size range that is not empty.");
+	static_assert(XboxOneExpandPacketRegistry<Traits>().entries[XBOXONE_IN_BUTTON].handler == XBOXONE_HANDLER_BUTTON, "Button reports must be dispatched to the button handler.");
+	static_assert(XboxOneExpandPacketRegistry<Traits>().entries[XBOXONE_IN_GUIDE].handler == XBOXONE_HANDLER_GUIDE, "Guide reports must be dispatched to the guide handler.");
+
+	return XboxOneExpandPacketRegistry<Traits>();
+}
+
+/// The dispatch table of a controller model.
+template <typename Traits>
+constexpr xboxone_packet_dispatch_table XBOXONE_PACKET_DISPATCH = XboxOneBuildPacketDispatchTable<Traits>();
+
+// The table is indexed by the packet type byte, and is small enough to stay in cache next to the packet.
+static_assert(sizeof(xboxone_packet_dispatch_table) == 256 * 3, "The dispatch table must hold exactly one 3 byte entry for every packet type.");
+
+/// Looks up the handler for a packet in the dispatch table of the connected model, and validates its size.
+///
+/// Returns `XBOXONE_HANDLER_NONE` for unknown packet types, or if the header size or the number of bytes read do not match the table.
+inline xboxone_packet_handler XboxOneClassifyPacket(const xboxone_packet_dispatch_table* table, const uint8_t* data, uint32_t length)
+{
+	if (length < XBOXONE_REPORT_HEADER_SIZE)
+	{
+		return XBOXONE_HANDLER_NONE;
+	}
+
+	const xboxone_report_header* header = (const xboxone_report_header*)data;
+	const auto& entry = table->entries[header->packetType];
+
+	if (header->size < entry.minSize || header->size > entry.maxSize || length < (uint32_t)XBOXONE_REPORT_HEADER_SIZE + header->size)
+	{
+		return XBOXONE_HANDLER_NONE;
+	}
+
+	return entry.handler;
+}
+
+#endif /* XboxOnePacketDispatch_h */
@@ -0,0 +1,204 @@
+//
+//  XboxOneProtocol.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// The decisions the driver makes about each packet of the Xbox One controller protocol, kept apart from how packets are moved.
+// This covers validating and dispatching packets, dropping repeated button reports, smoothing, transforming, remapping, and filtering them,
+// how much of each report is handed to the HID stack, the response to the "guide" button, and the counter of outgoing packets.
+// The driver only moves packets between the pipes, this code, and `handleReport`.
+// This code is not specific to DriverKit in any way, so the whole protocol can be run and profiled without a device.
+//
+
+#ifndef XboxOneProtocol_h
+#define XboxOneProtocol_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include <ConfigSnapshot.h>
+
+#include "XboxOneAxisTransform.h"
+#include "XboxOneConfig.h"
+#include "XboxOneInputPackets.h"
+#include "XboxOneLatency.h"
+#include "XboxOnePacketDispatch.h"
+#include "XboxOneRemap.h"
+#include "XboxOneReportFilter.h"
+#include "XboxOneStickFilter.h"
+#include "XboxOneTraits.h"
+
+/// Enumeration of what should be done with a packet.
+///
+/// `XBOXONE_VERDICT_IGNORE` - The packet is unknown or malformed.
+/// `XBOXONE_VERDICT_REPEATED` - The packet repeats the last button report, and should be dropped.
+/// `XBOXONE_VERDICT_SUPPRESSED` - The packet updates the controller state, but barely differs from the last report delivered, so should not be delivered.
+/// `XBOXONE_VERDICT_DELIVER` - The packet updates the controller state, and should be delivered.
+typedef enum : uint8_t {
+	XBOXONE_VERDICT_IGNORE = 0,
+	XBOXONE_VERDICT_REPEATED,
+	XBOXONE_VERDICT_SUPPRESSED,
+	XBOXONE_VERDICT_DELIVER,
+} xboxone_packet_verdict;
+
+/// The outcome of processing a packet.
+///
+/// `handler` - The handler the packet was dispatched to.
+/// `verdict` - What should be done with the packet.
+/// `reportLength` - How many bytes of the packet should be handed to the HID stack.
+typedef struct {
+	xboxone_packet_handler handler;
+	xboxone_packet_verdict verdict;
+	uint32_t reportLength;
+} xboxone_protocol_result;
+
+/// The protocol state of a single controller.
+///
+/// A zeroed structure is valid, but `XboxOneProtocolInit` must be called before the first packet is processed.
+/// `model` - The packet tables and handshake of the connected controller model.
+/// `latency` - Where the time taken by each stage is recorded, or `nullptr` to not record it.
+/// `clock` - Reads the current time in the units of `latency`.
+/// `lastButtonCounter` - The counter of the last button report accepted, used to drop repeated packets.
+/// `lastButtonCounterValid` - Whether `lastButtonCounter` holds an accepted counter yet.
+/// `outCounter` - The counter to stamp into the next packet sent to the controller.
+/// `config` - The current `xboxone_config`, which is replaced as a whole when the user client changes it.
+/// `configGeneration` - The generation of the configuration the last button report was processed with.
+/// `reportFilter` - The state of the filter that drops button reports that barely differ from the last one delivered.
+/// `stickFilter` - The state of the filter that smooths stick jitter.
+typedef struct {
+	const xboxone_model_info* model;
+	xboxone_latency_monitor* latency;
+	uint64_t (*clock)(void);
+	uint8_t lastButtonCounter;
+	bool lastButtonCounterValid;
+	uint8_t outCounter;
+	config_snapshot config;
+	uint64_t configGeneration;
+	xboxone_report_filter reportFilter;
+	xboxone_stick_filter stickFilter;
+} xboxone_protocol;
+
+/// Resets the protocol state for a newly connected controller.
+///
+/// `latency` and `clock` may both be `nullptr`, in which case nothing is timed.
+/// The configuration starts out as `XBOXONE_DEFAULT_CONFIG`.
+inline void XboxOneProtocolInit(xboxone_protocol* protocol, const xboxone_model_info* model, xboxone_latency_monitor* latency, uint64_t (*clock)(void))
+{
+	memset(protocol, 0, sizeof(*protocol));
+	ConfigSnapshotInit(&protocol->config, &XBOXONE_DEFAULT_CONFIG);
+	protocol->model = model;
+	protocol->latency = (clock != nullptr) ? latency : nullptr;
+	protocol->clock = clock;
+}
+
+/// Records the time since `*start` against a stage, if the protocol is being timed.
+inline void XboxOneProtocolLap(xboxone_protocol* protocol, xboxone_latency_stage stage, uint64_t* start)
+{
+	if (protocol->latency != nullptr)
+	{
+		XboxOneLatencyLap(protocol->latency, stage, start, protocol->clock());
+	}
+}
+
+/// Decides what to do with a packet read from the controller.
+///
+/// Button reports are transformed in place, so `packet` holds the report that should be published and delivered.
+/// Packets must be processed in the order they were read, and `timestamp` is when the packet was read, in the units of `clock`.
+inline void XboxOneProtocolProcess(xboxone_protocol* protocol, uint8_t* packet, uint32_t length, uint64_t timestamp, xboxone_protocol_result* result)
+{
+	uint64_t stageStart = (protocol->latency != nullptr) ? protocol->clock() : 0;
+	xboxone_report_header* header = (xboxone_report_header*)packet;
+	const xboxone_config* config = nullptr;
+
+	// A single table lookup both identifies the packet and validates its size.
+	result->handler = XboxOneClassifyPacket(protocol->model->dispatch, packet, length);
+	result->verdict = XBOXONE_VERDICT_IGNORE;
+	result->reportLength = 0;
+	XboxOneProtocolLap(protocol, XBOXONE_LATENCY_DISPATCH, &stageStart);
+
+	switch (result->handler)
+	{
+		case XBOXONE_HANDLER_BUTTON:
+			// Reads are delivered in the order they were submitted, so a repeated counter can only be a repeated packet.
+			if (protocol->lastButtonCounterValid == true && header->counter == protocol->lastButtonCounter)
+			{
+				result->verdict = XBOXONE_VERDICT_REPEATED;
+				break;
+			}
+
+			protocol->lastButtonCounter = header->counter;
+			protocol->lastButtonCounterValid = true;
+			XboxOneProtocolLap(protocol, XBOXONE_LATENCY_VALIDATION, &stageStart);
+
+			// The configuration is read once, so the whole report is processed with the same one even if it is replaced meanwhile.
+			config = (const xboxone_config*)ConfigSnapshotRead(&protocol->config);
+			if (config->generation != protocol->configGeneration)
+			{
+				// Start the filters over, so the next report is compared against state from the same configuration.
+				protocol->reportFilter.hasLast = false;
+				protocol->stickFilter.primed = false;
+				protocol->configGeneration = config->generation;
+			}
+
+			// Deadzones and curves are applied first, so the filter compares the values that would actually be delivered.
+			// Jitter and deadzones belong to the physical sticks, so they are dealt with before the sticks are moved by the remap.
+			XboxOneApplyStickFilter(&protocol->stickFilter, &config->stickFilter, (xboxone_button_report*)packet, timestamp);
+			XboxOneApplyAxisTransform(&config->axisTransform, (xboxone_button_report*)packet);
+			XboxOneApplyRemap(&config->remap, (xboxone_button_report*)packet);
+			if (XboxOneReportFilterShouldForward(&protocol->reportFilter, &config->reportFilter, (const xboxone_button_report*)packet) == true)
+			{
+				result->verdict = XBOXONE_VERDICT_DELIVER;
+			}
+			else
+			{
+				result->verdict = XBOXONE_VERDICT_SUPPRESSED;
+			}
+			XboxOneProtocolLap(protocol, XBOXONE_LATENCY_TRANSFORM, &stageStart);
+
+			// Newer models append inputs that the report descriptor does not describe, so only the common part of the report is delivered.
+			result->reportLength = (length < protocol->model->hidButtonReportSize) ? length : protocol->model->hidButtonReportSize;
+			break;
+
+		case XBOXONE_HANDLER_GUIDE:
+			result->verdict = XBOXONE_VERDICT_DELIVER;
+			result->reportLength = length;
+			break;
+
+		case XBOXONE_HANDLER_NONE:
+			break;
+	}
+}
+
+/// Builds the response the controller expects to a "guide" button report, returning false if the report needs none.
+inline bool XboxOneProtocolGuideResponse(const xboxone_guide_report* report, xboxone_guide_response* response)
+{
+	if (report->header.version != 0x30)
+	{
+		return false;
+	}
+
+	*response = {
+		.header = {
+			.packetType = 0x01,
+			.version = 0x20,
+			.counter = 0x00,
+			.size = 0x09,
+		},
+		.constData = { 0x00, 0x07, 0x20, 0x02 },
+		.padding = {},
+	};
+	return true;
+}
+
+/// Stamps the next outgoing counter into a packet that is about to be sent to the controller.
+///
+/// The controller expects the counter to increase with every packet it receives,
+/// so this should be called in the order packets go out on the pipe rather than the order they were queued.
+inline void XboxOneProtocolStampOutPacket(xboxone_protocol* protocol, uint8_t* packet)
+{
+	((xboxone_report_header*)packet)->counter = protocol->outCounter++;
+}
+
+#endif /* XboxOneProtocol_h */
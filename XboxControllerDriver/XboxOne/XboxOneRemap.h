@@ -0,0 +1,206 @@
+//
+//  XboxOneRemap.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Button remapping, stick and trigger swaps, stick inversion, and triggers acting as buttons, applied by the driver itself.
+// Remapping in the driver saves a user-space remapper that reads HID reports and injects new ones, which roughly doubles the latency.
+// A configuration is compiled into lookup tables when it is uploaded,
+// so all 16 buttons are remapped with two table lookups and an OR, and the axes without branches.
+// This code is not specific to DriverKit in any way, so clients can use the same header to build configurations.
+//
+
+#ifndef XboxOneRemap_h
+#define XboxOneRemap_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "XboxOneAxisTransform.h"
+#include "XboxOneInputPackets.h"
+
+// MARK: - Configuration
+
+/// The version of `xboxone_remap_config` this driver understands.
+constexpr uint32_t XBOXONE_REMAP_VERSION = 1;
+/// The number of bits of `xboxone_button_report::buttons`.
+constexpr uint32_t XBOXONE_REMAP_BUTTONS = 16;
+
+/// The configuration uploaded through the user client.
+///
+/// The four stick lanes are in report order: left X, left Y, right X, right Y.
+/// `version` - Must be `XBOXONE_REMAP_VERSION`.
+/// `enabled` - Whether reports are remapped at all.
+/// `stickInvert` - A bit for each stick lane, set to invert the lane after it is moved.
+/// `buttons` - The output buttons each input button presses, indexed by input bit. 0 drops the button.
+/// `stickSource` - The input lane each output lane takes its value from.
+/// `triggerSource` - The input trigger each output trigger takes its value from, 0 for left and 1 for right.
+/// `triggerThresholds` - The value at which each output trigger also presses `triggerButtons`, up to 1023. 0 means never.
+/// `triggerButtons` - The output buttons each output trigger presses, in the bits of `xboxone_buttons`.
+typedef struct {
+	uint32_t version;
+	uint8_t enabled;
+	uint8_t stickInvert;
+	uint8_t _reserved1[2];
+	uint16_t buttons[XBOXONE_REMAP_BUTTONS];
+	uint8_t stickSource[4];
+	uint8_t triggerSource[2];
+	uint8_t _reserved2[2];
+	uint16_t triggerThresholds[2];
+	uint16_t triggerButtons[2];
+} xboxone_remap_config;
+
+/// Fills in a configuration that leaves every button and axis where it is, as a starting point for changes.
+inline void XboxOneRemapConfigInit(xboxone_remap_config* config)
+{
+	memset(config, 0, sizeof(*config));
+	config->version = XBOXONE_REMAP_VERSION;
+	config->enabled = 1;
+
+	for (uint32_t bit = 0; bit < XBOXONE_REMAP_BUTTONS; ++bit)
+	{
+		config->buttons[bit] = (uint16_t)(1u << bit);
+	}
+	for (uint8_t lane = 0; lane < 4; ++lane)
+	{
+		config->stickSource[lane] = lane;
+	}
+	config->triggerSource[0] = 0;
+	config->triggerSource[1] = 1;
+}
+
+
+
+
+// MARK: - Compiled Plan
+
+/// The lookup tables compiled from an `xboxone_remap_config`.
+///
+/// `enabled` - Whether reports are remapped at all.
+/// `buttonLut` - The output buttons for each value of the low byte and the high byte of the input buttons.
+/// `stickSource` - The input lane of each output lane.
+/// `stickInvert` - -1 for output lanes that are inverted, 0 otherwise.
+/// `triggerSource` - The input trigger of each output trigger.
+/// `triggerThresholds` - The value at which each output trigger presses its buttons.
+/// `triggerButtons` - The output buttons each output trigger presses, or 0 if it presses none.
+typedef struct {
+	bool enabled;
+	uint16_t buttonLut[2][256];
+	uint8_t stickSource[4];
+	int32_t stickInvert[4];
+	uint8_t triggerSource[2];
+	uint16_t triggerThresholds[2];
+	uint16_t triggerButtons[2];
+} xboxone_remap_plan;
+
+/// Compiles a configuration into lookup tables.
+///
+/// Returns false if the configuration is not a version this driver understands, or names a lane or trigger that does not exist.
+inline bool XboxOneCompileRemap(const xboxone_remap_config* config, xboxone_remap_plan* plan)
+{
+	if (config->version != XBOXONE_REMAP_VERSION)
+	{
+		return false;
+	}
+
+	for (uint32_t lane = 0; lane < 4; ++lane)
+	{
+		if (config->stickSource[lane] >= 4)
+		{
+			return false;
+		}
+	}
+	for (uint32_t trigger = 0; trigger < 2; ++trigger)
+	{
+		if (config->triggerSource[trigger] >= 2 || config->triggerThresholds[trigger] > XBOXONE_TRIGGER_MAX)
+		{
+			return false;
+		}
+	}
+
+	memset(plan, 0, sizeof(*plan));
+
+	// Each entry is the OR of the outputs of every input bit set in its index, so a whole byte of buttons is remapped in one lookup.
+	for (uint32_t half = 0; half < 2; ++half)
+	{
+		for (uint32_t value = 0; value < 256; ++value)
+		{
+			uint16_t output = 0;
+
+			for (uint32_t bit = 0; bit < 8; ++bit)
+			{
+				if ((value & (1u << bit)) != 0)
+				{
+					output |= config->buttons[half * 8 + bit];
+				}
+			}
+			plan->buttonLut[half][value] = output;
+		}
+	}
+
+	for (uint32_t lane = 0; lane < 4; ++lane)
+	{
+		plan->stickSource[lane] = config->stickSource[lane];
+		plan->stickInvert[lane] = ((config->stickInvert & (1u << lane)) != 0) ? -1 : 0;
+	}
+
+	for (uint32_t trigger = 0; trigger < 2; ++trigger)
+	{
+		plan->triggerSource[trigger] = config->triggerSource[trigger];
+		plan->triggerThresholds[trigger] = config->triggerThresholds[trigger];
+		// A threshold of 0 would always be reached, so it switches the trigger's buttons off instead.
+		plan->triggerButtons[trigger] = (config->triggerThresholds[trigger] != 0) ? config->triggerButtons[trigger] : 0;
+	}
+
+	plan->enabled = (config->enabled != 0);
+	return true;
+}
+
+
+
+
+// MARK: - Hot Path
+
+/// Remaps the buttons, sticks, and triggers of a report in place.
+inline void XboxOneRemapReport(const xboxone_remap_plan* plan, xboxone_button_report* report)
+{
+	const int32_t sticks[4] = { report->leftX, report->leftY, report->rightX, report->rightY };
+	const uint16_t triggers[2] = { report->trigL, report->trigR };
+	int32_t output[4] = {};
+	uint16_t buttons = (uint16_t)(plan->buttonLut[0][report->buttons & 0xff] | plan->buttonLut[1][report->buttons >> 8]);
+
+	for (uint32_t lane = 0; lane < 4; ++lane)
+	{
+		int32_t mask = plan->stickInvert[lane];
+		int32_t value = (sticks[plan->stickSource[lane]] ^ mask) - mask;
+
+		// Inverting -32768 would overflow the report, so it is clamped to the full scale of the other direction.
+		output[lane] = XboxOneMin(value, XBOXONE_STICK_MAX);
+	}
+
+	report->trigL = triggers[plan->triggerSource[0]];
+	report->trigR = triggers[plan->triggerSource[1]];
+	buttons |= plan->triggerButtons[0] & (uint16_t)(0u - (uint32_t)(report->trigL >= plan->triggerThresholds[0]));
+	buttons |= plan->triggerButtons[1] & (uint16_t)(0u - (uint32_t)(report->trigR >= plan->triggerThresholds[1]));
+
+	report->buttons = buttons;
+	report->leftX = (int16_t)output[0];
+	report->leftY = (int16_t)output[1];
+	report->rightX = (int16_t)output[2];
+	report->rightY = (int16_t)output[3];
+}
+
+/// Remaps a report in place, if the plan is enabled.
+inline void XboxOneApplyRemap(const xboxone_remap_plan* plan, xboxone_button_report* report)
+{
+	if (plan->enabled == false)
+	{
+		return;
+	}
+
+	XboxOneRemapReport(plan, report);
+}
+
+#endif /* XboxOneRemap_h */
@@ -0,0 +1,247 @@
+//
+//  XboxOneReplay.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// Replays a packet capture through the protocol core, exactly as `GotData` would have handed the packets to it.
+// A capture can be replayed as fast as possible to measure the cost of each packet,
+// or at its original timing to reproduce a problem that depends on when packets arrive.
+// Every delivered report is folded into a hash, so two replays of the same capture can be compared for correctness.
+// Button reports can also be coalesced on the capture's own timestamps, to measure how many deliveries a window saves and the latency it adds.
+// This code is not specific to DriverKit in any way, so captures can be replayed without a device.
+//
+
+#ifndef XboxOneReplay_h
+#define XboxOneReplay_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include <PacketCapture.h>
+
+#include "XboxOneCoalescer.h"
+#include "XboxOneInputPackets.h"
+#include "XboxOneProtocol.h"
+
+/// Enumeration of the ways a capture can be replayed.
+///
+/// `XBOXONE_REPLAY_FULL_SPEED` - Each packet is processed as soon as the last one is done.
+/// `XBOXONE_REPLAY_ORIGINAL_TIMING` - Each packet is processed when it was read, relative to the first packet.
+typedef enum : uint8_t {
+	XBOXONE_REPLAY_FULL_SPEED = 0,
+	XBOXONE_REPLAY_ORIGINAL_TIMING,
+} xboxone_replay_mode;
+
+/// How to replay a capture.
+///
+/// `mode` - How fast to replay.
+/// `clock` - Reads the current time, in the same units as the capture's timestamps.
+/// `waitUntil` - Waits until `clock` reaches a deadline. Only used for `XBOXONE_REPLAY_ORIGINAL_TIMING`.
+/// `numer`, `denom` - The ratio of clock ticks to nanoseconds, as from `mach_timebase_info`.
+/// `coalesceWindow` - The coalescing window for button reports, in the units of the capture's timestamps, or 0 to deliver every report.
+/// The coalescer runs on the capture's timestamps whatever the mode, so its results do not depend on how fast the replay runs.
+typedef struct {
+	xboxone_replay_mode mode;
+	uint64_t (*clock)(void);
+	void (*waitUntil)(uint64_t deadline);
+	uint32_t numer;
+	uint32_t denom;
+	uint64_t coalesceWindow;
+} xboxone_replay_config;
+
+/// The results of a replay.
+///
+/// `packets` - The number of records replayed.
+/// `errors` - Records of reads that failed, which are skipped just like the driver skips them.
+/// `delivered`, `suppressed`, `repeated`, `ignored` - The number of packets given each `xboxone_packet_verdict`.
+/// `responses` - The number of guide responses that would have been sent.
+/// `handleReports` - The number of reports that would have been handed to `handleReport`, after coalescing.
+/// `coalescing` - The results of coalescing, all zero but `offered` and `delivered` if `coalesceWindow` is 0.
+/// `addedLatencyNanoseconds` - The total latency coalescing added, from the first report of each window being read to the window's report being delivered.
+/// `maxAddedLatencyNanoseconds` - The most latency coalescing added to a window.
+/// `lateNanoseconds` - The total time packets were processed after their original timing, only counted for `XBOXONE_REPLAY_ORIGINAL_TIMING`.
+/// `maxLateNanoseconds` - The furthest a packet was processed after its original timing.
+/// `reportHash` - A hash of every report handed to `handleReport`, in order. Two replays that deliver the same reports have the same hash.
+/// `elapsedNanoseconds` - How long the replay took.
+/// `packetsPerSecond` - `packets` over `elapsedNanoseconds`.
+/// `nanosecondsPerPacket` - `elapsedNanoseconds` over `packets`.
+typedef struct {
+	uint64_t packets;
+	uint64_t errors;
+	uint64_t delivered;
+	uint64_t suppressed;
+	uint64_t repeated;
+	uint64_t ignored;
+	uint64_t responses;
+	uint64_t handleReports;
+	xboxone_coalescer_stats coalescing;
+	uint64_t addedLatencyNanoseconds;
+	uint64_t maxAddedLatencyNanoseconds;
+	uint64_t lateNanoseconds;
+	uint64_t maxLateNanoseconds;
+	uint64_t reportHash;
+	uint64_t elapsedNanoseconds;
+	uint64_t packetsPerSecond;
+	uint64_t nanosecondsPerPacket;
+} xboxone_replay_stats;
+
+/// Folds a report that would have been handed to `handleReport` into the results.
+inline void XboxOneReplayDeliver(xboxone_replay_stats* stats, const uint8_t* report, uint32_t length)
+{
+	stats->handleReports++;
+	for (uint32_t byte = 0; byte < length; ++byte)
+	{
+		stats->reportHash ^= report[byte];
+		stats->reportHash *= 0x100000001b3;
+	}
+}
+
+/// Delivers the report held by the coalescer, as the driver's timer would at `deadline`.
+inline void XboxOneReplayFlush(xboxone_coalescer* coalescer, uint64_t deadline, const xboxone_replay_config* config, xboxone_replay_stats* stats)
+{
+	xboxone_button_report report = {};
+	uint32_t length = 0;
+	uint64_t timestamp = 0;
+	uint64_t since = 0;
+	uint64_t held = 0;
+
+	if (XboxOneCoalescerFlush(coalescer, deadline, (uint8_t*)&report, &length, &timestamp, &since) == false)
+	{
+		return;
+	}
+
+	XboxOneReplayDeliver(stats, (const uint8_t*)&report, length);
+
+	held = (deadline > since) ? deadline - since : 0;
+	held = (config->denom != 0) ? held * config->numer / config->denom : held;
+	stats->addedLatencyNanoseconds += held;
+	if (held > stats->maxAddedLatencyNanoseconds)
+	{
+		stats->maxAddedLatencyNanoseconds = held;
+	}
+}
+
+/// Feeds `count` records through the protocol core, in order.
+///
+/// `protocol` should be freshly initialized for the model in the capture's header, with the configuration the bug report was made with published in its `config`.
+inline void XboxOneReplay(xboxone_protocol* protocol, const packet_capture_record* records, uint64_t count, const xboxone_replay_config* config, xboxone_replay_stats* stats)
+{
+	uint8_t packet[PACKET_RING_MAX_DATA];
+	xboxone_protocol_result result = {};
+	xboxone_guide_response response = {};
+	xboxone_coalescer coalescer = {};
+	bool flushScheduled = false;
+	uint64_t flushDeadline = 0;
+	uint64_t start = config->clock();
+	uint64_t elapsed = 0;
+	uint64_t late = 0;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->reportHash = PacketCaptureHash(nullptr, 0);
+	XboxOneCoalescerSetWindow(&coalescer, config->coalesceWindow);
+
+	for (uint64_t index = 0; index < count; ++index)
+	{
+		const packet_capture_record* record = &records[index];
+		uint32_t length = (record->length < PACKET_RING_MAX_DATA) ? record->length : PACKET_RING_MAX_DATA;
+
+		if (config->mode == XBOXONE_REPLAY_ORIGINAL_TIMING && config->waitUntil != nullptr)
+		{
+			uint64_t deadline = start + (record->timestamp - records[0].timestamp);
+
+			config->waitUntil(deadline);
+
+			// A packet is late when the last one took longer than the gap between them, or when the wait overshoots.
+			late = config->clock();
+			late = (late > deadline) ? late - deadline : 0;
+			late = (config->denom != 0) ? late * config->numer / config->denom : late;
+			stats->lateNanoseconds += late;
+			if (late > stats->maxLateNanoseconds)
+			{
+				stats->maxLateNanoseconds = late;
+			}
+		}
+
+		// The driver's timer would have delivered a held report before this packet arrived.
+		if (flushScheduled == true && flushDeadline <= record->timestamp)
+		{
+			XboxOneReplayFlush(&coalescer, flushDeadline, config, stats);
+			flushScheduled = false;
+		}
+
+		stats->packets++;
+		if (record->status != 0)
+		{
+			stats->errors++;
+			continue;
+		}
+
+		// The core transforms reports in place, so each packet is copied out first just as `GotData` copies it into `inPipe.memory`.
+		memcpy(packet, record->data, length);
+		XboxOneProtocolProcess(protocol, packet, length, record->timestamp, &result);
+
+		switch (result.verdict)
+		{
+			case XBOXONE_VERDICT_DELIVER:
+				stats->delivered++;
+				if (result.handler == XBOXONE_HANDLER_BUTTON)
+				{
+					switch (XboxOneCoalescerOffer(&coalescer, packet, result.reportLength, record->timestamp, record->timestamp, &flushDeadline))
+					{
+						case XBOXONE_COALESCE_DELIVER:
+							XboxOneReplayDeliver(stats, packet, result.reportLength);
+							break;
+
+						case XBOXONE_COALESCE_SCHEDULE:
+							flushScheduled = true;
+							break;
+
+						case XBOXONE_COALESCE_HOLD:
+							break;
+					}
+					break;
+				}
+
+				XboxOneReplayDeliver(stats, packet, result.reportLength);
+				if (result.handler == XBOXONE_HANDLER_GUIDE && XboxOneProtocolGuideResponse((const xboxone_guide_report*)packet, &response) == true)
+				{
+					stats->responses++;
+				}
+				break;
+
+			case XBOXONE_VERDICT_SUPPRESSED:
+				stats->suppressed++;
+				break;
+
+			case XBOXONE_VERDICT_REPEATED:
+				stats->repeated++;
+				break;
+
+			case XBOXONE_VERDICT_IGNORE:
+				stats->ignored++;
+				break;
+		}
+	}
+
+	if (flushScheduled == true)
+	{
+		XboxOneReplayFlush(&coalescer, flushDeadline, config, stats);
+	}
+	XboxOneCoalescerRead(&coalescer, &stats->coalescing);
+
+	elapsed = config->clock() - start;
+	stats->elapsedNanoseconds = (config->denom != 0) ? elapsed * config->numer / config->denom : elapsed;
+
+	if (stats->elapsedNanoseconds != 0)
+	{
+		stats->packetsPerSecond = stats->packets * 1000000000 / stats->elapsedNanoseconds;
+	}
+	if (stats->packets != 0)
+	{
+		stats->nanosecondsPerPacket = stats->elapsedNanoseconds / stats->packets;
+	}
+}
+
+#endif /* XboxOneReplay_h */
@@ -0,0 +1,99 @@
+//
+//  XboxOneReportFilter.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// An optional filter that drops button reports which do not meaningfully differ from the last report delivered.
+// The controller sends a new report for every tiny stick movement, and each one wakes the HID event system.
+// This code is not specific to DriverKit in any way, and is simply part of the driver functionality.
+//
+
+#ifndef XboxOneReportFilter_h
+#define XboxOneReportFilter_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "XboxOneInputPackets.h"
+
+/// The configuration of the change-threshold filter.
+///
+/// A zeroed structure is a disabled filter that forwards every report.
+/// `enabled` - Whether reports are filtered at all.
+/// `thresholds` - How far each axis must move from the last delivered report before a report is forwarded, indexed by `xboxone_axis`.
+typedef struct {
+	bool enabled;
+	uint16_t thresholds[XBOXONE_AXIS_COUNT];
+} xboxone_report_filter_config;
+
+/// The state of the change-threshold filter.
+///
+/// A zeroed structure is valid.
+/// Only one thread may change it, but `XboxOneReportFilterRead` may be called from any thread.
+/// `hasLast` - Whether `last` holds a delivered report yet.
+/// `last` - The last report that was forwarded.
+/// `forwarded` - The number of reports that were forwarded.
+/// `suppressed` - The number of reports that were dropped.
+typedef struct {
+	bool hasLast;
+	xboxone_button_report last;
+	uint64_t forwarded;
+	uint64_t suppressed;
+} xboxone_report_filter;
+
+/// Adds one to a counter of the filter. Only the thread changing the state may call this.
+inline void XboxOneReportFilterCount(uint64_t* counter)
+{
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+/// Whether `current` has moved more than `threshold` away from `previous`.
+inline bool XboxOneAxisExceeds(int32_t current, int32_t previous, uint16_t threshold)
+{
+	int32_t delta = current - previous;
+	return (uint32_t)(delta < 0 ? -delta : delta) > threshold;
+}
+
+/// Decides whether a button report should be forwarded to `handleReport`, and records it as delivered if so.
+///
+/// Any button change is forwarded without looking at the axes.
+/// Otherwise the report is only forwarded if a trigger or stick moved more than its threshold.
+inline bool XboxOneReportFilterShouldForward(xboxone_report_filter* filter, const xboxone_report_filter_config* config, const xboxone_button_report* report)
+{
+	const xboxone_button_report* last = &filter->last;
+	const uint16_t* thresholds = config->thresholds;
+	bool forward = true;
+
+	if (config->enabled == true && filter->hasLast == true && report->buttons == last->buttons)
+	{
+		forward =
+			XboxOneAxisExceeds(report->trigL, last->trigL, thresholds[XBOXONE_AXIS_TRIGGER_LEFT]) ||
+			XboxOneAxisExceeds(report->trigR, last->trigR, thresholds[XBOXONE_AXIS_TRIGGER_RIGHT]) ||
+			XboxOneAxisExceeds(report->leftX, last->leftX, thresholds[XBOXONE_AXIS_LEFT_X]) ||
+			XboxOneAxisExceeds(report->leftY, last->leftY, thresholds[XBOXONE_AXIS_LEFT_Y]) ||
+			XboxOneAxisExceeds(report->rightX, last->rightX, thresholds[XBOXONE_AXIS_RIGHT_X]) ||
+			XboxOneAxisExceeds(report->rightY, last->rightY, thresholds[XBOXONE_AXIS_RIGHT_Y]);
+	}
+
+	if (forward == false)
+	{
+		XboxOneReportFilterCount(&filter->suppressed);
+		return false;
+	}
+
+	memcpy(&filter->last, report, sizeof(filter->last));
+	filter->hasLast = true;
+	XboxOneReportFilterCount(&filter->forwarded);
+	return true;
+}
+
+/// Reads how many reports the filter forwarded and suppressed.
+inline void XboxOneReportFilterRead(const xboxone_report_filter* filter, uint64_t* forwarded, uint64_t* suppressed)
+{
+	*forwarded = __atomic_load_n(&filter->forwarded, __ATOMIC_RELAXED);
+	*suppressed = __atomic_load_n(&filter->suppressed, __ATOMIC_RELAXED);
+}
+
+#endif /* XboxOneReportFilter_h */
@@ -0,0 +1,151 @@
+//
+//  XboxOneStatePage.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// The latest decoded state of the Xbox One controller, published in memory shared read-only with any number of clients.
+// The page is protected by a sequence lock: the driver never waits for readers,
+// and a reader simply retries if the driver updated the state while it was being copied.
+// This code is not specific to DriverKit in any way, so clients can use the same header to read the page.
+//
+
+#ifndef XboxOneStatePage_h
+#define XboxOneStatePage_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "XboxOneInputPackets.h"
+
+/// The layout version of `xboxone_state_page`. A client should refuse a page with any other version.
+constexpr uint32_t XBOXONE_STATE_PAGE_VERSION = 1;
+
+/// The decoded state of the controller.
+///
+/// `timestamp` - The completion timestamp of the packet that last changed the state, in absolute time ticks.
+/// `buttons` - A bitfield of the buttons, see `xboxone_buttons`.
+/// `trigL` - How depressed the left trigger is from 0 - 1023.
+/// `trigR` - How depressed the right trigger is from 0 - 1023.
+/// `leftX`, `leftY`, `rightX`, `rightY` - The orientation of the sticks, after any axis transform.
+/// `guide` - 1 if the guide button is pressed.
+/// `counter` - The header counter of the packet that last changed the state.
+typedef struct {
+	uint64_t timestamp;
+	uint16_t buttons;
+	uint16_t trigL, trigR;
+	int16_t leftX, leftY, rightX, rightY;
+	uint8_t guide;
+	uint8_t counter;
+} xboxone_controller_state;
+
+/// The number of 64-bit words the state is copied in.
+constexpr uint32_t XBOXONE_STATE_WORDS = sizeof(xboxone_controller_state) / sizeof(uint64_t);
+
+static_assert(sizeof(xboxone_controller_state) % sizeof(uint64_t) == 0, "xboxone_controller_state must be a whole number of words.");
+
+/// The memory shared between the driver and its readers.
+///
+/// `version` - `XBOXONE_STATE_PAGE_VERSION`.
+/// `sequence` - Odd while the driver is writing, and incremented twice for every update.
+/// `words` - The `xboxone_controller_state`, as words so that each can be copied atomically.
+typedef struct {
+	uint32_t version;
+	uint32_t reserved;
+	alignas(64) uint32_t sequence;
+	uint64_t words[XBOXONE_STATE_WORDS];
+} xboxone_state_page;
+
+/// The driver's side of the state page.
+///
+/// `page` - The shared page.
+/// `state` - The state most recently published, which each packet updates in part.
+typedef struct {
+	xboxone_state_page* page;
+	xboxone_controller_state state;
+} xboxone_state_publisher;
+
+/// Resets the shared page and attaches the publisher to it.
+inline void XboxOneStatePageInit(xboxone_state_publisher* publisher, xboxone_state_page* page)
+{
+	memset(page, 0, sizeof(*page));
+	page->version = XBOXONE_STATE_PAGE_VERSION;
+
+	memset(publisher, 0, sizeof(*publisher));
+	publisher->page = page;
+}
+
+/// Writes the publisher's state to the page. Must only be called from a single thread at a time.
+inline void XboxOneStatePagePublish(xboxone_state_publisher* publisher)
+{
+	xboxone_state_page* page = publisher->page;
+	uint64_t words[XBOXONE_STATE_WORDS];
+	uint32_t sequence = __atomic_load_n(&page->sequence, __ATOMIC_RELAXED);
+
+	memcpy(words, &publisher->state, sizeof(words));
+
+	__atomic_store_n(&page->sequence, sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	for (uint32_t word = 0; word < XBOXONE_STATE_WORDS; ++word)
+	{
+		__atomic_store_n(&page->words[word], words[word], __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&page->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+/// Publishes the contents of a button report.
+inline void XboxOneStatePagePublishButtons(xboxone_state_publisher* publisher, const xboxone_button_report* report, uint64_t timestamp)
+{
+	xboxone_controller_state* state = &publisher->state;
+
+	state->timestamp = timestamp;
+	state->buttons = report->buttons;
+	state->trigL = report->trigL;
+	state->trigR = report->trigR;
+	state->leftX = report->leftX;
+	state->leftY = report->leftY;
+	state->rightX = report->rightX;
+	state->rightY = report->rightY;
+	state->counter = report->header.counter;
+
+	XboxOneStatePagePublish(publisher);
+}
+
+/// Publishes the contents of a guide report.
+inline void XboxOneStatePagePublishGuide(xboxone_state_publisher* publisher, const xboxone_guide_report* report, uint64_t timestamp)
+{
+	xboxone_controller_state* state = &publisher->state;
+
+	state->timestamp = timestamp;
+	state->guide = report->guide;
+	state->counter = report->header.counter;
+
+	XboxOneStatePagePublish(publisher);
+}
+
+/// Takes a consistent copy of the published state, retrying while the driver is writing.
+///
+/// Returns the sequence number of the copy, which a reader can compare against a previous call to see if anything changed.
+inline uint32_t XboxOneStatePageRead(const xboxone_state_page* page, xboxone_controller_state* state)
+{
+	uint64_t words[XBOXONE_STATE_WORDS];
+	uint32_t before = 0;
+	uint32_t after = 0;
+
+	do
+	{
+		before = __atomic_load_n(&page->sequence, __ATOMIC_ACQUIRE);
+		for (uint32_t word = 0; word < XBOXONE_STATE_WORDS; ++word)
+		{
+			words[word] = __atomic_load_n(&page->words[word], __ATOMIC_RELAXED);
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&page->sequence, __ATOMIC_RELAXED);
+	} while ((before & 1) != 0 || before != after);
+
+	memcpy(state, words, sizeof(words));
+	return after;
+}
+
+#endif /* XboxOneStatePage_h */
@@ -0,0 +1,214 @@
+//
+//  XboxOneStickFilter.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// An optional adaptive low-pass filter for the sticks of the Xbox One controller, in the style of the One Euro filter.
+// Worn sticks jitter by a few hundred counts around where they rest, which makes the controller send a constant stream of button reports.
+// The filter smooths each stick axis heavily while it moves slowly, and less and less as it moves faster,
+// so jitter is removed without adding noticeable lag to deliberate movements.
+// Everything is done in fixed point, using the time between reports as read from the controller.
+// This code is not specific to DriverKit in any way, so the filter can be measured against synthetic or replayed input.
+//
+
+#ifndef XboxOneStickFilter_h
+#define XboxOneStickFilter_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "XboxOneInputPackets.h"
+
+// MARK: - Configuration
+
+/// The version of `xboxone_stick_filter_config` this driver understands.
+constexpr uint32_t XBOXONE_STICK_FILTER_VERSION = 1;
+/// The highest cutoff frequency a client may set, in millihertz.
+constexpr uint32_t XBOXONE_STICK_FILTER_MAX_CUTOFF = 100000;
+/// The longest time between two reports the filter accounts for, in microseconds.
+/// A report after a longer pause is filtered as if it came this long after the last one.
+constexpr uint32_t XBOXONE_STICK_FILTER_MAX_INTERVAL = 100000;
+/// The number of fractional bits of the filtered values and of smoothing factors.
+constexpr uint32_t XBOXONE_STICK_FILTER_FRACTION_BITS = 16;
+
+/// The configuration uploaded through the user client.
+///
+/// The four stick lanes are in report order: left X, left Y, right X, right Y.
+/// `version` - Must be `XBOXONE_STICK_FILTER_VERSION`.
+/// `enabled` - Whether the sticks are filtered at all.
+/// `lanes` - A bit for each stick lane, set to filter the lane.
+/// `minCutoff` - The cutoff frequency while the stick is still, in millihertz. Lower removes more jitter, but lags more.
+/// `beta` - How much the cutoff rises with the speed of the stick, in microhertz per count per second. Higher lags less when moving fast.
+/// `derivativeCutoff` - The cutoff frequency of the speed estimate, in millihertz.
+/// Both cutoffs must be from 1 to `XBOXONE_STICK_FILTER_MAX_CUTOFF`.
+typedef struct {
+	uint32_t version;
+	uint8_t enabled;
+	uint8_t lanes;
+	uint8_t _reserved[2];
+	uint32_t minCutoff;
+	uint32_t beta;
+	uint32_t derivativeCutoff;
+} xboxone_stick_filter_config;
+
+
+
+
+// MARK: - Compiled Plan
+
+/// The parameters compiled from an `xboxone_stick_filter_config`.
+///
+/// `enabled` - Whether the sticks are filtered at all.
+/// `laneMask` - -1 for lanes that are filtered, 0 otherwise.
+/// `minCutoff` - The cutoff frequency while the stick is still, in millihertz.
+/// `beta` - How much the cutoff rises with the speed of the stick, in microhertz per count per second.
+/// `derivativeCutoff` - The cutoff frequency of the speed estimate, in millihertz.
+/// `ticksToMicroseconds` - Converts a time between reports from the caller's clock to microseconds, as a fraction with 32 fractional bits.
+/// `maxIntervalTicks` - `XBOXONE_STICK_FILTER_MAX_INTERVAL` in the caller's clock.
+typedef struct {
+	bool enabled;
+	int32_t laneMask[4];
+	uint32_t minCutoff;
+	uint32_t beta;
+	uint32_t derivativeCutoff;
+	uint64_t ticksToMicroseconds;
+	uint64_t maxIntervalTicks;
+} xboxone_stick_filter_plan;
+
+/// Compiles a configuration for a clock with the ratio of ticks to nanoseconds `numer` over `denom`, as from `mach_timebase_info`.
+///
+/// Returns false if the configuration is not a version this driver understands, or a cutoff is out of range.
+inline bool XboxOneCompileStickFilter(const xboxone_stick_filter_config* config, uint32_t numer, uint32_t denom, xboxone_stick_filter_plan* plan)
+{
+	if (config->version != XBOXONE_STICK_FILTER_VERSION || numer == 0 || denom == 0)
+	{
+		return false;
+	}
+	if (config->minCutoff == 0 || config->minCutoff > XBOXONE_STICK_FILTER_MAX_CUTOFF ||
+		config->derivativeCutoff == 0 || config->derivativeCutoff > XBOXONE_STICK_FILTER_MAX_CUTOFF)
+	{
+		return false;
+	}
+
+	memset(plan, 0, sizeof(*plan));
+
+	for (uint32_t lane = 0; lane < 4; ++lane)
+	{
+		plan->laneMask[lane] = ((config->lanes & (1u << lane)) != 0) ? -1 : 0;
+	}
+
+	plan->minCutoff = config->minCutoff;
+	plan->beta = config->beta;
+	plan->derivativeCutoff = config->derivativeCutoff;
+	plan->ticksToMicroseconds = ((uint64_t)numer << 32) / ((uint64_t)denom * 1000);
+	plan->maxIntervalTicks = (uint64_t)XBOXONE_STICK_FILTER_MAX_INTERVAL * 1000 * denom / numer;
+	plan->enabled = (config->enabled != 0);
+	return true;
+}
+
+
+
+
+// MARK: - Hot Path
+
+/// The state of the filter for one controller.
+///
+/// A zeroed structure is valid, and starts over from the next report.
+/// `primed` - Whether the filter has seen a report yet.
+/// `timestamp` - When the last report was read, in the caller's clock.
+/// `value` - The filtered value of each stick lane, with `XBOXONE_STICK_FILTER_FRACTION_BITS` fractional bits.
+/// `speed` - The filtered speed of each stick lane, in counts per second.
+typedef struct {
+	bool primed;
+	uint64_t timestamp;
+	int32_t value[4];
+	int64_t speed[4];
+} xboxone_stick_filter;
+
+/// The smoothing factor of a low-pass filter with a cutoff of `cutoff` millihertz, for samples `interval` microseconds apart.
+///
+/// This is `1 / (1 + 1 / (2π · cutoff · interval))`, with `XBOXONE_STICK_FILTER_FRACTION_BITS` fractional bits.
+inline int64_t XboxOneStickFilterAlpha(uint64_t cutoff, uint64_t interval)
+{
+	// 2π · cutoff · interval, scaled by 10^9 to undo the milli and micro units. At most about 6.3 · 10^10.
+	uint64_t angle = cutoff * interval * 6283 / 1000;
+
+	return (int64_t)((angle << XBOXONE_STICK_FILTER_FRACTION_BITS) / (angle + 1000000000));
+}
+
+/// Filters the sticks of a report in place, using `timestamp` as when it was read.
+inline void XboxOneStickFilterReport(xboxone_stick_filter* filter, const xboxone_stick_filter_plan* plan, xboxone_button_report* report, uint64_t timestamp)
+{
+	const int32_t input[4] = { report->leftX, report->leftY, report->rightX, report->rightY };
+	int32_t output[4] = {};
+
+	// The first report after starting over is passed through, and becomes what the next one is smoothed toward.
+	if (filter->primed == false)
+	{
+		for (uint32_t lane = 0; lane < 4; ++lane)
+		{
+			filter->value[lane] = input[lane] * (1 << XBOXONE_STICK_FILTER_FRACTION_BITS);
+			filter->speed[lane] = 0;
+		}
+		filter->timestamp = timestamp;
+		filter->primed = true;
+		return;
+	}
+
+	uint64_t ticks = timestamp - filter->timestamp;
+	ticks = (ticks < plan->maxIntervalTicks) ? ticks : plan->maxIntervalTicks;
+	// Rounded, since the fraction is a little short, and truncating would make a millisecond between reports 999 µs.
+	uint64_t interval = (ticks * plan->ticksToMicroseconds + (1ULL << 31)) >> 32;
+	interval = (interval != 0) ? interval : 1;
+	filter->timestamp = timestamp;
+
+	// Shared by every lane: the rate that turns a change into counts per second, and the smoothing of the speed estimate.
+	const int64_t rate = (int64_t)((1000000ULL << XBOXONE_STICK_FILTER_FRACTION_BITS) / interval);
+	const int64_t speedAlpha = XboxOneStickFilterAlpha(plan->derivativeCutoff, interval);
+
+	for (uint32_t lane = 0; lane < 4; ++lane)
+	{
+		int32_t previous = filter->value[lane];
+		int64_t change = (int64_t)input[lane] * (1 << XBOXONE_STICK_FILTER_FRACTION_BITS) - previous;
+		// Counts per second. The change carries the fractional bits, and so does the rate, so both are shifted out.
+		int64_t speed = ((change >> XBOXONE_STICK_FILTER_FRACTION_BITS) * rate) >> XBOXONE_STICK_FILTER_FRACTION_BITS;
+
+		filter->speed[lane] += ((speed - filter->speed[lane]) * speedAlpha) >> XBOXONE_STICK_FILTER_FRACTION_BITS;
+
+		// The faster the stick moves, the higher the cutoff, and the less the movement lags.
+		// No real stick moves anywhere near 2^32 counts per second, so capping the speed there only keeps the product in range.
+		int64_t magnitude = filter->speed[lane] < 0 ? -filter->speed[lane] : filter->speed[lane];
+		magnitude = (magnitude < (int64_t)UINT32_MAX) ? magnitude : (int64_t)UINT32_MAX;
+		uint64_t cutoff = plan->minCutoff + ((uint64_t)magnitude * plan->beta) / 1000;
+		cutoff = (cutoff < XBOXONE_STICK_FILTER_MAX_CUTOFF) ? cutoff : XBOXONE_STICK_FILTER_MAX_CUTOFF;
+
+		int32_t value = previous + (int32_t)((change * XboxOneStickFilterAlpha(cutoff, interval)) >> XBOXONE_STICK_FILTER_FRACTION_BITS);
+		filter->value[lane] = value;
+
+		// Rounded to the nearest count, and only used for the lanes being filtered.
+		int32_t filtered = (value + (1 << (XBOXONE_STICK_FILTER_FRACTION_BITS - 1))) >> XBOXONE_STICK_FILTER_FRACTION_BITS;
+		output[lane] = (filtered & plan->laneMask[lane]) | (input[lane] & ~plan->laneMask[lane]);
+	}
+
+	report->leftX = (int16_t)output[0];
+	report->leftY = (int16_t)output[1];
+	report->rightX = (int16_t)output[2];
+	report->rightY = (int16_t)output[3];
+}
+
+/// Filters the sticks of a report in place, if the plan is enabled.
+///
+/// The filter only runs when a report arrives, so the output only moves the rest of the way to where a stick stopped as further reports arrive.
+inline void XboxOneApplyStickFilter(xboxone_stick_filter* filter, const xboxone_stick_filter_plan* plan, xboxone_button_report* report, uint64_t timestamp)
+{
+	if (plan->enabled == false)
+	{
+		return;
+	}
+
+	XboxOneStickFilterReport(filter, plan, report, timestamp);
+}
+
+#endif /* XboxOneStickFilter_h */
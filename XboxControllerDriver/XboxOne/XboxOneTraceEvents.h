@@ -0,0 +1,130 @@
+//
+//  XboxOneTraceEvents.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// The events the Xbox One controller driver records in its trace ring, and how to decode them.
+// Each event ID carries its category in its top byte, so whether an event is recorded is decided at compile time down to a single mask test.
+// Clients decode records with `XboxOneTraceFormat`, so the driver itself never formats a trace string.
+// This code is not specific to DriverKit in any way, so clients can use the same header to decode traces.
+//
+
+#ifndef XboxOneTraceEvents_h
+#define XboxOneTraceEvents_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <TraceRing.h>
+
+/// Enumeration of the categories that can be switched on and off, as bits of a mask.
+///
+/// `XBOXONE_TRACE_INPUT` - Reads on the `IN` pipe.
+/// `XBOXONE_TRACE_PACKET` - What the protocol core decided about each packet.
+/// `XBOXONE_TRACE_REPORT` - Reports delivered to the HID stack.
+/// `XBOXONE_TRACE_OUTPUT` - Packets queued and sent on the `OUT` pipe.
+typedef enum : uint32_t {
+	XBOXONE_TRACE_INPUT = 1u << 0,
+	XBOXONE_TRACE_PACKET = 1u << 1,
+	XBOXONE_TRACE_REPORT = 1u << 2,
+	XBOXONE_TRACE_OUTPUT = 1u << 3,
+	XBOXONE_TRACE_ALL = XBOXONE_TRACE_INPUT | XBOXONE_TRACE_PACKET | XBOXONE_TRACE_REPORT | XBOXONE_TRACE_OUTPUT,
+} xboxone_trace_category;
+
+/// Builds an event ID from the index of its category bit and a number unique within the category.
+constexpr uint32_t XboxOneTraceEventID(uint32_t categoryBit, uint32_t number)
+{
+	return (categoryBit << 24) | number;
+}
+
+/// Enumeration of the events, with the meaning of their three arguments.
+///
+/// `XBOXONE_TRACE_READ_COMPLETE` - A read completed. Slot, status, byte count.
+/// `XBOXONE_TRACE_READ_PARKED` - A slot was parked because staging was full. Slot.
+/// `XBOXONE_TRACE_READ_FAILED` - A read could not be submitted. Slot, status.
+/// `XBOXONE_TRACE_READ_RECOVERY` - A slot was held back after a failed read. Slot, `pipe_recovery_action`, status.
+/// `XBOXONE_TRACE_READ_RESUME` - The pipe resumed after recovering. Slots held back, failures in a row.
+/// `XBOXONE_TRACE_READ_ENABLE` - The driver was enabled or disabled, so the pipe started reading or went idle. Enabled, slots idle.
+/// `XBOXONE_TRACE_PACKET_ERROR` - A packet was skipped because its read failed. Status.
+/// `XBOXONE_TRACE_PACKET_DISABLED` - A packet was skipped because the driver is disabled. Byte count.
+/// `XBOXONE_TRACE_PACKET_VERDICT` - The protocol core decided what to do with a packet. Handler, verdict, header counter.
+/// `XBOXONE_TRACE_REPORT_DELIVERED` - A report was handed to `handleReport`. Byte count, status.
+/// `XBOXONE_TRACE_REPORT_BUTTONS` - The contents of a delivered button report. Buttons, left trigger, right trigger.
+/// `XBOXONE_TRACE_REPORT_GUIDE` - The contents of a delivered guide report. Guide, header version.
+/// `XBOXONE_TRACE_SEND_QUEUED` - A packet was queued to be sent. Priority, byte count, status.
+/// `XBOXONE_TRACE_SEND_STARTED` - A transfer started on the `OUT` pipe. Slot, byte count, header counter.
+/// `XBOXONE_TRACE_SEND_COMPLETE` - A transfer on the `OUT` pipe completed. Slot, status, byte count.
+typedef enum : uint32_t {
+	XBOXONE_TRACE_READ_COMPLETE = XboxOneTraceEventID(0, 1),
+	XBOXONE_TRACE_READ_PARKED = XboxOneTraceEventID(0, 2),
+	XBOXONE_TRACE_READ_FAILED = XboxOneTraceEventID(0, 3),
+	XBOXONE_TRACE_READ_RECOVERY = XboxOneTraceEventID(0, 4),
+	XBOXONE_TRACE_READ_RESUME = XboxOneTraceEventID(0, 5),
+	XBOXONE_TRACE_READ_ENABLE = XboxOneTraceEventID(0, 6),
+	XBOXONE_TRACE_PACKET_ERROR = XboxOneTraceEventID(1, 1),
+	XBOXONE_TRACE_PACKET_DISABLED = XboxOneTraceEventID(1, 2),
+	XBOXONE_TRACE_PACKET_VERDICT = XboxOneTraceEventID(1, 3),
+	XBOXONE_TRACE_REPORT_DELIVERED = XboxOneTraceEventID(2, 1),
+	XBOXONE_TRACE_REPORT_BUTTONS = XboxOneTraceEventID(2, 2),
+	XBOXONE_TRACE_REPORT_GUIDE = XboxOneTraceEventID(2, 3),
+	XBOXONE_TRACE_SEND_QUEUED = XboxOneTraceEventID(3, 1),
+	XBOXONE_TRACE_SEND_STARTED = XboxOneTraceEventID(3, 2),
+	XBOXONE_TRACE_SEND_COMPLETE = XboxOneTraceEventID(3, 3),
+} xboxone_trace_event;
+
+/// The category an event belongs to.
+constexpr uint32_t XboxOneTraceCategory(uint32_t event)
+{
+	return 1u << (event >> 24);
+}
+
+static_assert(XboxOneTraceCategory(XBOXONE_TRACE_READ_COMPLETE) == XBOXONE_TRACE_INPUT, "Input events must be in the input category.");
+static_assert(XboxOneTraceCategory(XBOXONE_TRACE_PACKET_VERDICT) == XBOXONE_TRACE_PACKET, "Packet events must be in the packet category.");
+static_assert(XboxOneTraceCategory(XBOXONE_TRACE_REPORT_DELIVERED) == XBOXONE_TRACE_REPORT, "Report events must be in the report category.");
+static_assert(XboxOneTraceCategory(XBOXONE_TRACE_SEND_STARTED) == XBOXONE_TRACE_OUTPUT, "Output events must be in the output category.");
+
+/// How to print an event.
+///
+/// `event` - The event.
+/// `format` - A `printf` format for the name and the three arguments.
+typedef struct {
+	uint32_t event;
+	const char* format;
+} xboxone_trace_description;
+
+/// The description of every event.
+constexpr xboxone_trace_description XBOXONE_TRACE_DESCRIPTIONS[] = {
+	{ XBOXONE_TRACE_READ_COMPLETE, "read complete slot=%u status=0x%08x length=%u" },
+	{ XBOXONE_TRACE_READ_PARKED, "read parked slot=%u" },
+	{ XBOXONE_TRACE_READ_FAILED, "read failed slot=%u status=0x%08x" },
+	{ XBOXONE_TRACE_READ_RECOVERY, "read recovery slot=%u action=%u status=0x%08x" },
+	{ XBOXONE_TRACE_READ_RESUME, "read resume idle=0x%02x failures=%u" },
+	{ XBOXONE_TRACE_READ_ENABLE, "read enable %u idle=0x%02x" },
+	{ XBOXONE_TRACE_PACKET_ERROR, "packet error status=0x%08x" },
+	{ XBOXONE_TRACE_PACKET_DISABLED, "packet disabled length=%u" },
+	{ XBOXONE_TRACE_PACKET_VERDICT, "packet handler=%u verdict=%u counter=%u" },
+	{ XBOXONE_TRACE_REPORT_DELIVERED, "report length=%u status=0x%08x" },
+	{ XBOXONE_TRACE_REPORT_BUTTONS, "buttons 0x%04x trigL=%u trigR=%u" },
+	{ XBOXONE_TRACE_REPORT_GUIDE, "guide %u version=0x%02x" },
+	{ XBOXONE_TRACE_SEND_QUEUED, "send queued priority=%u length=%u status=0x%08x" },
+	{ XBOXONE_TRACE_SEND_STARTED, "send started slot=%u length=%u counter=%u" },
+	{ XBOXONE_TRACE_SEND_COMPLETE, "send complete slot=%u status=0x%08x length=%u" },
+};
+
+/// Prints a record as text, as `snprintf` does. Unknown events are printed with their raw ID and arguments.
+inline int XboxOneTraceFormat(const trace_record* record, char* buffer, size_t size)
+{
+	for (const xboxone_trace_description& description : XBOXONE_TRACE_DESCRIPTIONS)
+	{
+		if (description.event == record->event)
+		{
+			return snprintf(buffer, size, description.format, record->args[0], record->args[1], record->args[2]);
+		}
+	}
+
+	return snprintf(buffer, size, "event 0x%08x args=%u,%u,%u", record->event, record->args[0], record->args[1], record->args[2]);
+}
+
+#endif /* XboxOneTraceEvents_h */
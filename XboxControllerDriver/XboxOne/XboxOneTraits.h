@@ -0,0 +1,156 @@
+//
+//  XboxOneTraits.h
+//  XboxControllerDriver
+//
+// See the LICENSE.txt file for this sample’s licensing information.
+//
+// Abstract:
+// The differences between the controller models that speak the Xbox One protocol.
+// Each model has a traits specialization, and everything that depends on the model is generated from it at compile time.
+// The model is looked up once when the driver starts, so the input path only follows the tables of that model and never checks which model it is.
+// Supporting a new model only needs a new traits specialization, an entry in `XBOXONE_MODELS`, and its product ID in the `Info.plist` matching.
+// This code is not specific to DriverKit in any way, and is simply part of the driver functionality.
+//
+
+#ifndef XboxOneTraits_h
+#define XboxOneTraits_h
+
+#include <stdint.h>
+
+#include "XboxOneInputPackets.h"
+#include "XboxOnePacketDispatch.h"
+
+/// Enumeration of the supported controller models.
+typedef enum : uint8_t {
+	XBOXONE_MODEL_ONE_S = 0,
+	XBOXONE_MODEL_SERIES,
+	XBOXONE_MODEL_ELITE_2,
+	XBOXONE_MODEL_COUNT,
+} xboxone_model;
+
+/// A packet sent to the controller when it starts up.
+///
+/// `data` - The packet. Its counter byte is filled in when it is sent.
+/// `size` - The size of `data`.
+typedef struct {
+	const uint8_t* data;
+	uint8_t size;
+} xboxone_handshake_packet;
+
+constexpr uint8_t XBOXONE_INIT_PACKET[] = { 0x05, 0x20, 0x00, 0x01, 0x00 };
+constexpr uint8_t XBOXONE_SWAP_TO_WIRED_PACKET[] = { 0x05, 0x20, 0x00, 0x0f, 0x06 };
+
+/// The packets every model needs to start sending input.
+constexpr xboxone_handshake_packet XBOXONE_DEFAULT_HANDSHAKE[] = {
+	{ XBOXONE_INIT_PACKET, sizeof(XBOXONE_INIT_PACKET) },
+	{ XBOXONE_SWAP_TO_WIRED_PACKET, sizeof(XBOXONE_SWAP_TO_WIRED_PACKET) },
+};
+
+/// The traits of a controller model.
+///
+/// `name` - A name for logging.
+/// `productID` - The USB `idProduct` of the model.
+/// `buttonReportMinSize` - The smallest size a button report header may report. Every model starts with the `xboxone_button_report` layout.
+/// `buttonReportMaxSize` - The largest size a button report header may report. Newer models and firmware append extra inputs.
+/// `hidButtonReportSize` - How many bytes of a button report are described by the report descriptor, and so are passed to `handleReport`.
+/// `handshake` - The packets sent to the controller when it starts up, in order.
+template <xboxone_model Model>
+struct xboxone_traits;
+
+/// The Xbox One and Xbox One S controllers.
+template <>
+struct xboxone_traits<XBOXONE_MODEL_ONE_S> {
+	static constexpr const char* name = "Xbox One S";
+	static constexpr uint16_t productID = 0x02ea;
+	static constexpr uint8_t buttonReportMinSize = XBOXONE_BUTTON_REPORT_SIZE;
+	static constexpr uint8_t buttonReportMaxSize = XBOXONE_BUTTON_REPORT_SIZE;
+	static constexpr uint32_t hidButtonReportSize = sizeof(xboxone_button_report);
+	static constexpr const xboxone_handshake_packet (&handshake)[2] = XBOXONE_DEFAULT_HANDSHAKE;
+};
+
+/// The Xbox Series X|S controller, which appends the share button and other inputs to the button report.
+template <>
+struct xboxone_traits<XBOXONE_MODEL_SERIES> {
+	static constexpr const char* name = "Xbox Series X|S";
+	static constexpr uint16_t productID = 0x0b12;
+	static constexpr uint8_t buttonReportMinSize = XBOXONE_BUTTON_REPORT_SIZE;
+	static constexpr uint8_t buttonReportMaxSize = 60;
+	static constexpr uint32_t hidButtonReportSize = sizeof(xboxone_button_report);
+	static constexpr const xboxone_handshake_packet (&handshake)[2] = XBOXONE_DEFAULT_HANDSHAKE;
+};
+
+/// The Xbox Elite Series 2 controller, which appends the paddles and profile to the button report.
+template <>
+struct xboxone_traits<XBOXONE_MODEL_ELITE_2> {
+	static constexpr const char* name = "Xbox Elite Series 2";
+	static constexpr uint16_t productID = 0x0b00;
+	static constexpr uint8_t buttonReportMinSize = XBOXONE_BUTTON_REPORT_SIZE;
+	static constexpr uint8_t buttonReportMaxSize = 60;
+	static constexpr uint32_t hidButtonReportSize = sizeof(xboxone_button_report);
+	static constexpr const xboxone_handshake_packet (&handshake)[2] = XBOXONE_DEFAULT_HANDSHAKE;
+};
+
+/// Everything the driver needs to know about the connected model, generated from its traits.
+///
+/// `model` - The model.
+/// `name` - A name for logging.
+/// `productID` - The USB `idProduct` of the model.
+/// `dispatch` - The packet dispatch table of the model.
+/// `hidButtonReportSize` - How many bytes of a button report are passed to `handleReport`.
+/// `handshake` - The packets sent to the controller when it starts up, in order.
+/// `handshakeCount` - The number of packets in `handshake`.
+typedef struct {
+	xboxone_model model;
+	const char* name;
+	uint16_t productID;
+	const xboxone_packet_dispatch_table* dispatch;
+	uint32_t hidButtonReportSize;
+	const xboxone_handshake_packet* handshake;
+	uint32_t handshakeCount;
+} xboxone_model_info;
+
+/// Generates the model info of a model from its traits.
+template <xboxone_model Model>
+constexpr xboxone_model_info XboxOneMakeModelInfo(void)
+{
+	using Traits = xboxone_traits<Model>;
+
+	static_assert(Traits::buttonReportMinSize >= XBOXONE_BUTTON_REPORT_SIZE, "Every model must send at least the common button report.");
+	static_assert(Traits::buttonReportMinSize <= Traits::buttonReportMaxSize, "The button report size range is empty.");
+	static_assert(Traits::hidButtonReportSize <= (uint32_t)XBOXONE_REPORT_HEADER_SIZE + Traits::buttonReportMinSize, "The report descriptor describes more than the smallest button report.");
+
+	return {
+		.model = Model,
+		.name = Traits::name,
+		.productID = Traits::productID,
+		.dispatch = &XBOXONE_PACKET_DISPATCH<Traits>,
+		.hidButtonReportSize = Traits::hidButtonReportSize,
+		.handshake = Traits::handshake,
+		.handshakeCount = sizeof(Traits::handshake) / sizeof(Traits::handshake[0]),
+	};
+}
+
+/// Every supported model, indexed by `xboxone_model`.
+constexpr xboxone_model_info XBOXONE_MODELS[] = {
+	XboxOneMakeModelInfo<XBOXONE_MODEL_ONE_S>(),
+	XboxOneMakeModelInfo<XBOXONE_MODEL_SERIES>(),
+	XboxOneMakeModelInfo<XBOXONE_MODEL_ELITE_2>(),
+};
+
+static_assert(sizeof(XBOXONE_MODELS) / sizeof(XBOXONE_MODELS[0]) == XBOXONE_MODEL_COUNT, "Every xboxone_model needs an entry in XBOXONE_MODELS.");
+
+/// Finds the model with a USB `idProduct`, or returns `nullptr` if it is not supported.
+inline const xboxone_model_info* XboxOneFindModel(uint16_t productID)
+{
+	for (const xboxone_model_info& info : XBOXONE_MODELS)
+	{
+		if (info.productID == productID)
+		{
+			return &info;
+		}
+	}
+
+	return nullptr;
+}
+
+#endif /* XboxOneTraits_h */
@@ -17,6 +17,16 @@
 
 #include "XboxOneUserClient.h"
 #include "XboxOneInputInterface.h"
+#include "XboxOneInputPackets.h"
+#include "XboxOneAxisTransform.h"
+#include "XboxOneCoalescer.h"
+#include "XboxOneCommands.h"
+#include "XboxOneLinkMonitor.h"
+#include "XboxOneLatency.h"
+#include "XboxOneMetrics.h"
+#include "XboxOneRemap.h"
+#include "XboxOneStickFilter.h"
+#include "XboxOneTraceEvents.h"
 
 #define Log(fmt, ...) os_log(OS_LOG_DEFAULT, "Xbox UserClient - " fmt "\n", ##__VA_ARGS__)
 
@@ -39,9 +49,35 @@ typedef enum
 {
 	ExternalMethodType_Unknown = 0,
 	ExternalMethodType_Licensing = 1,
+	ExternalMethodType_SetReportFilter = 2,
+	ExternalMethodType_GetReportFilterStats = 3,
+	ExternalMethodType_SetAxisTransform = 4,
+	ExternalMethodType_GetLinkStats = 5,
+	ExternalMethodType_GetLatencyStats = 6,
+	ExternalMethodType_GetDescriptorCacheStats = 7,
+	ExternalMethodType_SetTraceCategories = 8,
+	ExternalMethodType_GetMetrics = 9,
+	ExternalMethodType_ApplyCommands = 10,
+	ExternalMethodType_SetCoalescing = 11,
+	ExternalMethodType_WaitForButtonEvents = 12,
+	ExternalMethodType_SetRemap = 13,
+	ExternalMethodType_SetStickFilter = 14,
 	kNumberOfExternalMethods
 } ExternalMethodType;
 
+/// Enumeration of the memory types that a client can map with `IOConnectMapMemory64`.
+///
+/// `ClientMemoryType_PacketStream` - The raw packet ring, laid out as a `packet_ring` from `PacketRing.h`.
+/// `ClientMemoryType_StatePage` - The latest controller state, laid out as an `xboxone_state_page` from `XboxOneStatePage.h`. Mapped read-only.
+/// `ClientMemoryType_TraceRing` - The binary trace ring, laid out as a `trace_ring` from `TraceRing.h`. Mapped read-only.
+/// `ClientMemoryType_ButtonEvents` - Button presses and releases, laid out as a `trace_ring` of events from `XboxOneButtonEvents.h`. Mapped read-only.
+typedef enum
+{
+	ClientMemoryType_PacketStream = 0,
+	ClientMemoryType_StatePage = 1,
+	ClientMemoryType_TraceRing = 2,
+	ClientMemoryType_ButtonEvents = 3,
+} ClientMemoryType;
 
 /// Array defining the external methods that the driver supports.
 ///
@@ -50,7 +86,25 @@ typedef enum
 /// In this case, the licensing function takes a single scalar input, and returns a single scalar input,
 /// calling the `StaticHandleLicensing` when a call is made on the `ExternalMethodType_Licensing` selector (1).
 ///
-/// Note that this array contains 2 (`kNumberOfExternalMethods`) elements, where index 0 (`ExternalMethodType_Unknown`) is not populated.
+/// The report filter functions take an enable flag followed by one threshold per `xboxone_axis`,
+/// and return the number of reports forwarded and suppressed.
+/// The axis transform function takes an `xboxone_axis_transform_config` as its structure input.
+/// The link stats function returns an `xboxone_link_stats` as its structure output.
+/// The latency stats function returns an `xboxone_latency_stats` as its structure output.
+/// The descriptor cache stats function returns whether the device description came from the cache,
+/// the nanoseconds saved by the cache, the nanoseconds spent gathering the description,
+/// and the number of string descriptors read from the device.
+/// The trace categories function takes a mask of `xboxone_trace_category` to record.
+/// The metrics function returns an `xboxone_metrics_stats` as its structure output.
+/// The commands function takes a command buffer from `XboxOneCommands.h` of any size up to `XBOXONE_COMMAND_BUFFER_MAX_SIZE`,
+/// and returns an `xboxone_command_results` as its structure output.
+/// The coalescing function takes the coalescing window for button reports in microseconds, with 0 turning coalescing off.
+/// The button event function is asynchronous. It takes the number of button events the client has read,
+/// and completes with the number recorded once there are more, so a client can sleep until a button changes.
+/// The remap function takes an `xboxone_remap_config` as its structure input.
+/// The stick filter function takes an `xboxone_stick_filter_config` as its structure input.
+///
+/// Note that this array contains `kNumberOfExternalMethods` elements, where index 0 (`ExternalMethodType_Unknown`) is not populated.
 const IOUserClientMethodDispatch externalMethodChecks[kNumberOfExternalMethods] =
 {
 	[ExternalMethodType_Licensing] =
@@ -62,6 +116,123 @@ const IOUserClientMethodDispatch externalMethodChecks[kNumberOfExternalMethods]
 		.checkScalarOutputCount = 1,
 		.checkStructureOutputSize = 0,
 	},
+	[ExternalMethodType_SetReportFilter] =
+	{
+		.function = (IOUserClientMethodFunction) &XboxOneUserClient::StaticHandleSetReportFilter,
+		.checkCompletionExists = false,
+		.checkScalarInputCount = 1 + XBOXONE_AXIS_COUNT,
+		.checkStructureInputSize = 0,
+		.checkScalarOutputCount = 0,
+		.checkStructureOutputSize = 0,
+	},
+	[ExternalMethodType_GetReportFilterStats] =
+	{
+		.function = (IOUserClientMethodFunction) &XboxOneUserClient::StaticHandleGetReportFilterStats,
+		.checkCompletionExists = false,
+		.checkScalarInputCount = 0,
+		.checkStructureInputSize = 0,
+		.checkScalarOutputCount = 2,
+		.checkStructureOutputSize = 0,
+	},
+	[ExternalMethodType_SetAxisTransform] =
+	{
+		.function = (IOUserClientMethodFunction) &XboxOneUserClient::StaticHandleSetAxisTransform,
+		.checkCompletionExists = false,
+		.checkScalarInputCount = 0,
+		.checkStructureInputSize = sizeof(xboxone_axis_transform_config),
+		.checkScalarOutputCount = 0,
+		.checkStructureOutputSize = 0,
+	},
+	[ExternalMethodType_GetLinkStats] =
+	{
+		.function = (IOUserClientMethodFunction) &XboxOneUserClient::StaticHandleGetLinkStats,
+		.checkCompletionExists = false,
+		.checkScalarInputCount = 0,
+		.checkStructureInputSize = 0,
+		.checkScalarOutputCount = 0,
+		.checkStructureOutputSize = sizeof(xboxone_link_stats),
+	},
+	[ExternalMethodType_GetLatencyStats] =
+	{
+		.function = (IOUserClientMethodFunction) &XboxOneUserClient::StaticHandleGetLatencyStats,
+		.checkCompletionExists = false,
+		.checkScalarInputCount = 0,
+		.checkStructureInputSize = 0,
+		.checkScalarOutputCount = 0,
+		.checkStructureOutputSize = sizeof(xboxone_latency_stats),
+	},
+	[ExternalMethodType_GetDescriptorCacheStats] =
+	{
+		.function = (IOUserClientMethodFunction) &XboxOneUserClient::StaticHandleGetDescriptorCacheStats,
+		.checkCompletionExists = false,
+		.checkScalarInputCount = 0,
+		.checkStructureInputSize = 0,
+		.checkScalarOutputCount = 4,
+		.checkStructureOutputSize = 0,
+	},
+	[ExternalMethodType_SetTraceCategories] =
+	{
+		.function = (IOUserClientMethodFunction) &XboxOneUserClient::StaticHandleSetTraceCategories,
+		.checkCompletionExists = false,
+		.checkScalarInputCount = 1,
+		.checkStructureInputSize = 0,
+		.checkScalarOutputCount = 0,
+		.checkStructureOutputSize = 0,
+	},
+	[ExternalMethodType_GetMetrics] =
+	{
+		.function = (IOUserClientMethodFunction) &XboxOneUserClient::StaticHandleGetMetrics,
+		.checkCompletionExists = false,
+		.checkScalarInputCount = 0,
+		.checkStructureInputSize = 0,
+		.checkScalarOutputCount = 0,
+		.checkStructureOutputSize = sizeof(xboxone_metrics_stats),
+	},
+	[ExternalMethodType_ApplyCommands] =
+	{
+		.function = (IOUserClientMethodFunction) &XboxOneUserClient::StaticHandleApplyCommands,
+		.checkCompletionExists = false,
+		.checkScalarInputCount = 0,
+		.checkStructureInputSize = kIOUserClientVariableStructureSize,
+		.checkScalarOutputCount = 0,
+		.checkStructureOutputSize = sizeof(xboxone_command_results),
+	},
+	[ExternalMethodType_SetCoalescing] =
+	{
+		.function = (IOUserClientMethodFunction) &XboxOneUserClient::StaticHandleSetCoalescing,
+		.checkCompletionExists = false,
+		.checkScalarInputCount = 1,
+		.checkStructureInputSize = 0,
+		.checkScalarOutputCount = 0,
+		.checkStructureOutputSize = 0,
+	},
+	[ExternalMethodType_WaitForButtonEvents] =
+	{
+		.function = (IOUserClientMethodFunction) &XboxOneUserClient::StaticHandleWaitForButtonEvents,
+		.checkCompletionExists = true,
+		.checkScalarInputCount = 1,
+		.checkStructureInputSize = 0,
+		.checkScalarOutputCount = 0,
+		.checkStructureOutputSize = 0,
+	},
+	[ExternalMethodType_SetRemap] =
+	{
+		.function = (IOUserClientMethodFunction) &XboxOneUserClient::StaticHandleSetRemap,
+		.checkCompletionExists = false,
+		.checkScalarInputCount = 0,
+		.checkStructureInputSize = sizeof(xboxone_remap_config),
+		.checkScalarOutputCount = 0,
+		.checkStructureOutputSize = 0,
+	},
+	[ExternalMethodType_SetStickFilter] =
+	{
+		.function = (IOUserClientMethodFunction) &XboxOneUserClient::StaticHandleSetStickFilter,
+		.checkCompletionExists = false,
+		.checkScalarInputCount = 0,
+		.checkStructureInputSize = sizeof(xboxone_stick_filter_config),
+		.checkScalarOutputCount = 0,
+		.checkStructureOutputSize = 0,
+	},
 };
 
 
@@ -165,6 +336,14 @@ kern_return_t XboxOneUserClient::Stop_Impl(IOService* provider)
 
 	TraceLog(">> Stop()");
 
+	// A client waiting on a button event would otherwise keep this object alive until the next button change,
+	// and a client that mapped the packet stream would keep any other client from mapping it.
+	if (ivars->inputInterface != nullptr)
+	{
+		ivars->inputInterface->CancelButtonEventWaits(this);
+		ivars->inputInterface->ReleasePacketStream(this);
+	}
+
 	ret = Stop(provider, SUPERDISPATCH);
 	if (ret != kIOReturnSuccess)
 	{
@@ -222,6 +401,64 @@ kern_return_t XboxOneUserClient::ExternalMethod(uint64_t selector, IOUserClientM
 	return ret;
 }
 
+/// Handler for a client mapping memory from the user client interface.
+///
+/// This code should not be called directly by any other driver code, and is instead called by DriverKit when the client calls `IOConnectMapMemory64`.
+/// The packet stream is shared writable, since the client advances the ring's `tail` as it reads, so only one client may map it at a time.
+/// The state page and trace ring are shared read-only, since any number of clients may map them at once.
+kern_return_t XboxOneUserClient::CopyClientMemoryForType_Impl(uint64_t type, uint64_t* options, IOMemoryDescriptor** memory)
+{
+	kern_return_t ret = kIOReturnSuccess;
+
+	TraceLog(">> CopyClientMemoryForType()");
+	DebugLog("CopyClientMemoryForType() - Type: %llu", type);
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("CopyClientMemoryForType() - Input interface is null.");
+		ret = kIOReturnNotAttached;
+		goto Exit;
+	}
+
+	switch (type)
+	{
+		case ClientMemoryType_PacketStream:
+			ret = ivars->inputInterface->CopyPacketStream(this, memory);
+			*options = 0;
+			break;
+
+		case ClientMemoryType_StatePage:
+			ret = ivars->inputInterface->CopyStatePage(memory);
+			*options = kIOUserClientMemoryReadOnly;
+			break;
+
+		case ClientMemoryType_TraceRing:
+			ret = ivars->inputInterface->CopyTraceRing(memory);
+			*options = kIOUserClientMemoryReadOnly;
+			break;
+
+		case ClientMemoryType_ButtonEvents:
+			ret = ivars->inputInterface->CopyButtonEvents(memory);
+			*options = kIOUserClientMemoryReadOnly;
+			break;
+
+		default:
+			Log("CopyClientMemoryForType() - Unknown memory type %llu.", type);
+			ret = kIOReturnBadArgument;
+			goto Exit;
+	}
+
+	if (ret != kIOReturnSuccess)
+	{
+		Log("CopyClientMemoryForType() - Failed to copy memory of type %llu with error: 0x%08x.", type, ret);
+		goto Exit;
+	}
+
+Exit:
+	TraceLog("<< CopyClientMemoryForType()");
+	return ret;
+}
+
 /// Static callback that calls back `HandleLicensing` using the context provided in `reference`
 ///
 /// This code should not be called directly by any other driver code, and is instead called by DriverKit when the appropriate selector is called on the user client interface.
@@ -267,3 +504,689 @@ kern_return_t XboxOneUserClient::HandleLicensing(void* reference, IOUserClientMe
 
 	return ret;
 }
+
+/// Static callback that calls back `HandleSetReportFilter` using the context provided in `reference`
+kern_return_t XboxOneUserClient::StaticHandleSetReportFilter(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
+{
+	TraceLog("StaticHandleSetReportFilter()");
+
+	if (target == nullptr)
+	{
+		return kIOReturnError;
+	}
+
+	return ((XboxOneUserClient*)target)->HandleSetReportFilter(reference, arguments);
+}
+
+/// Enables or disables the change-threshold report filter, and sets the threshold of each axis.
+///
+/// The first scalar is the enable flag, followed by one threshold per `xboxone_axis`.
+kern_return_t XboxOneUserClient::HandleSetReportFilter(void* reference, IOUserClientMethodArguments* arguments)
+{
+	(void)reference;
+
+	uint16_t thresholds[XBOXONE_AXIS_COUNT] = {};
+
+	TraceLog(">> HandleSetReportFilter()");
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("HandleSetReportFilter() - Input interface is null.");
+		return kIOReturnNotAttached;
+	}
+
+	for (uint32_t axis = 0; axis < XBOXONE_AXIS_COUNT; ++axis)
+	{
+		uint64_t threshold = arguments->scalarInput[1 + axis];
+		thresholds[axis] = (threshold > UINT16_MAX) ? UINT16_MAX : (uint16_t)threshold;
+	}
+
+	ivars->inputInterface->SetReportFilter((bool)(arguments->scalarInput[0]), thresholds, XBOXONE_AXIS_COUNT);
+
+	TraceLog("<< HandleSetReportFilter()");
+
+	return kIOReturnSuccess;
+}
+
+/// Static callback that calls back `HandleGetReportFilterStats` using the context provided in `reference`
+kern_return_t XboxOneUserClient::StaticHandleGetReportFilterStats(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
+{
+	TraceLog("StaticHandleGetReportFilterStats()");
+
+	if (target == nullptr)
+	{
+		return kIOReturnError;
+	}
+
+	return ((XboxOneUserClient*)target)->HandleGetReportFilterStats(reference, arguments);
+}
+
+/// Returns the number of reports the change-threshold filter forwarded and suppressed, in that order.
+kern_return_t XboxOneUserClient::HandleGetReportFilterStats(void* reference, IOUserClientMethodArguments* arguments)
+{
+	(void)reference;
+
+	TraceLog(">> HandleGetReportFilterStats()");
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("HandleGetReportFilterStats() - Input interface is null.");
+		return kIOReturnNotAttached;
+	}
+
+	ivars->inputInterface->CopyReportFilterStats(&arguments->scalarOutput[0], &arguments->scalarOutput[1]);
+
+	TraceLog("<< HandleGetReportFilterStats()");
+
+	return kIOReturnSuccess;
+}
+
+/// Static callback that calls back `HandleSetAxisTransform` using the context provided in `reference`
+kern_return_t XboxOneUserClient::StaticHandleSetAxisTransform(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
+{
+	TraceLog("StaticHandleSetAxisTransform()");
+
+	if (target == nullptr)
+	{
+		return kIOReturnError;
+	}
+
+	return ((XboxOneUserClient*)target)->HandleSetAxisTransform(reference, arguments);
+}
+
+/// Uploads deadzones and response curves, passed as an `xboxone_axis_transform_config` structure.
+kern_return_t XboxOneUserClient::HandleSetAxisTransform(void* reference, IOUserClientMethodArguments* arguments)
+{
+	(void)reference;
+
+	kern_return_t ret = kIOReturnSuccess;
+
+	TraceLog(">> HandleSetAxisTransform()");
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("HandleSetAxisTransform() - Input interface is null.");
+		return kIOReturnNotAttached;
+	}
+
+	if (arguments->structureInput == nullptr)
+	{
+		Log("HandleSetAxisTransform() - Missing structure input.");
+		return kIOReturnBadArgument;
+	}
+
+	ret = ivars->inputInterface->SetAxisTransform(arguments->structureInput->getBytesNoCopy(), (uint32_t)arguments->structureInput->getLength());
+
+	TraceLog("<< HandleSetAxisTransform()");
+
+	return ret;
+}
+
+/// Static callback that calls back `HandleGetLinkStats` using the context provided in `reference`
+kern_return_t XboxOneUserClient::StaticHandleGetLinkStats(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
+{
+	TraceLog("StaticHandleGetLinkStats()");
+
+	if (target == nullptr)
+	{
+		return kIOReturnError;
+	}
+
+	return ((XboxOneUserClient*)target)->HandleGetLinkStats(reference, arguments);
+}
+
+/// Returns the link quality results as an `xboxone_link_stats` structure.
+kern_return_t XboxOneUserClient::HandleGetLinkStats(void* reference, IOUserClientMethodArguments* arguments)
+{
+	(void)reference;
+
+	kern_return_t ret = kIOReturnSuccess;
+	xboxone_link_stats stats = {};
+
+	TraceLog(">> HandleGetLinkStats()");
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("HandleGetLinkStats() - Input interface is null.");
+		return kIOReturnNotAttached;
+	}
+
+	ret = ivars->inputInterface->CopyLinkStats(&stats, sizeof(stats));
+	if (ret != kIOReturnSuccess)
+	{
+		Log("HandleGetLinkStats() - Failed to copy link stats with error: 0x%08x.", ret);
+		return ret;
+	}
+
+	arguments->structureOutput = OSData::withBytes(&stats, sizeof(stats));
+	if (arguments->structureOutput == nullptr)
+	{
+		Log("HandleGetLinkStats() - Failed to create structure output.");
+		return kIOReturnNoMemory;
+	}
+
+	TraceLog("<< HandleGetLinkStats()");
+
+	return ret;
+}
+
+/// Static callback that calls back `HandleGetLatencyStats` using the context provided in `reference`
+kern_return_t XboxOneUserClient::StaticHandleGetLatencyStats(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
+{
+	TraceLog("StaticHandleGetLatencyStats()");
+
+	if (target == nullptr)
+	{
+		return kIOReturnError;
+	}
+
+	return ((XboxOneUserClient*)target)->HandleGetLatencyStats(reference, arguments);
+}
+
+/// Returns the latency percentiles of the input path as an `xboxone_latency_stats` structure.
+kern_return_t XboxOneUserClient::HandleGetLatencyStats(void* reference, IOUserClientMethodArguments* arguments)
+{
+	(void)reference;
+
+	kern_return_t ret = kIOReturnSuccess;
+	xboxone_latency_stats stats = {};
+
+	TraceLog(">> HandleGetLatencyStats()");
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("HandleGetLatencyStats() - Input interface is null.");
+		return kIOReturnNotAttached;
+	}
+
+	ret = ivars->inputInterface->CopyLatencyStats(&stats, sizeof(stats));
+	if (ret != kIOReturnSuccess)
+	{
+		Log("HandleGetLatencyStats() - Failed to copy latency stats with error: 0x%08x.", ret);
+		return ret;
+	}
+
+	arguments->structureOutput = OSData::withBytes(&stats, sizeof(stats));
+	if (arguments->structureOutput == nullptr)
+	{
+		Log("HandleGetLatencyStats() - Failed to create structure output.");
+		return kIOReturnNoMemory;
+	}
+
+	TraceLog("<< HandleGetLatencyStats()");
+
+	return ret;
+}
+
+/// Static callback that calls back `HandleGetDescriptorCacheStats` using the context provided in `reference`
+kern_return_t XboxOneUserClient::StaticHandleGetDescriptorCacheStats(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
+{
+	TraceLog("StaticHandleGetDescriptorCacheStats()");
+
+	if (target == nullptr)
+	{
+		return kIOReturnError;
+	}
+
+	return ((XboxOneUserClient*)target)->HandleGetDescriptorCacheStats(reference, arguments);
+}
+
+/// Returns whether the descriptor cache saved reading string descriptors for the device description, how many had to be read from the device, and the time it saved.
+kern_return_t XboxOneUserClient::HandleGetDescriptorCacheStats(void* reference, IOUserClientMethodArguments* arguments)
+{
+	(void)reference;
+
+	bool hit = false;
+
+	TraceLog(">> HandleGetDescriptorCacheStats()");
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("HandleGetDescriptorCacheStats() - Input interface is null.");
+		return kIOReturnNotAttached;
+	}
+
+	ivars->inputInterface->CopyDescriptorCacheStats(&hit, &arguments->scalarOutput[3], &arguments->scalarOutput[1], &arguments->scalarOutput[2]);
+	arguments->scalarOutput[0] = hit;
+
+	TraceLog("<< HandleGetDescriptorCacheStats()");
+
+	return kIOReturnSuccess;
+}
+
+/// Static callback that calls back `HandleSetTraceCategories` using the context provided in `reference`
+kern_return_t XboxOneUserClient::StaticHandleSetTraceCategories(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
+{
+	TraceLog("StaticHandleSetTraceCategories()");
+
+	if (target == nullptr)
+	{
+		return kIOReturnError;
+	}
+
+	return ((XboxOneUserClient*)target)->HandleSetTraceCategories(reference, arguments);
+}
+
+/// Switches the categories of the binary trace ring on and off.
+///
+/// The scalar is a mask of `xboxone_trace_category`. Unknown bits are ignored.
+kern_return_t XboxOneUserClient::HandleSetTraceCategories(void* reference, IOUserClientMethodArguments* arguments)
+{
+	(void)reference;
+
+	TraceLog(">> HandleSetTraceCategories()");
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("HandleSetTraceCategories() - Input interface is null.");
+		return kIOReturnNotAttached;
+	}
+
+	ivars->inputInterface->SetTraceCategories((uint32_t)arguments->scalarInput[0]);
+
+	TraceLog("<< HandleSetTraceCategories()");
+
+	return kIOReturnSuccess;
+}
+
+/// Static callback that calls back `HandleGetMetrics` using the context provided in `reference`
+kern_return_t XboxOneUserClient::StaticHandleGetMetrics(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
+{
+	TraceLog("StaticHandleGetMetrics()");
+
+	if (target == nullptr)
+	{
+		return kIOReturnError;
+	}
+
+	return ((XboxOneUserClient*)target)->HandleGetMetrics(reference, arguments);
+}
+
+/// Returns every operational counter of the controller as an `xboxone_metrics_stats` structure.
+///
+/// The structure carries the time it was read, so a client polling this can turn the counters into rates.
+kern_return_t XboxOneUserClient::HandleGetMetrics(void* reference, IOUserClientMethodArguments* arguments)
+{
+	(void)reference;
+
+	kern_return_t ret = kIOReturnSuccess;
+	xboxone_metrics_stats stats = {};
+
+	TraceLog(">> HandleGetMetrics()");
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("HandleGetMetrics() - Input interface is null.");
+		return kIOReturnNotAttached;
+	}
+
+	ret = ivars->inputInterface->CopyMetrics(&stats, sizeof(stats));
+	if (ret != kIOReturnSuccess)
+	{
+		Log("HandleGetMetrics() - Failed to copy metrics with error: 0x%08x.", ret);
+		return ret;
+	}
+
+	arguments->structureOutput = OSData::withBytes(&stats, sizeof(stats));
+	if (arguments->structureOutput == nullptr)
+	{
+		Log("HandleGetMetrics() - Failed to create structure output.");
+		return kIOReturnNoMemory;
+	}
+
+	TraceLog("<< HandleGetMetrics()");
+
+	return ret;
+}
+
+/// Static callback that calls back `HandleApplyCommands` using the context provided in `reference`
+kern_return_t XboxOneUserClient::StaticHandleApplyCommands(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
+{
+	TraceLog("StaticHandleApplyCommands()");
+
+	if (target == nullptr)
+	{
+		return kIOReturnError;
+	}
+
+	return ((XboxOneUserClient*)target)->HandleApplyCommands(reference, arguments);
+}
+
+/// Applies every command in a command buffer, in order, and returns the result of each as an `xboxone_command_results` structure.
+///
+/// The call only fails as a whole if the buffer itself is unusable. Otherwise each command succeeds or fails on its own,
+/// and a command that runs past the end of the buffer fails along with every command after it.
+/// Every configuration command changes the same copy of the configuration, which is published once after the last command,
+/// so the input path never sees a configuration halfway through the batch, and nothing is published if every configuration command failed.
+kern_return_t XboxOneUserClient::HandleApplyCommands(void* reference, IOUserClientMethodArguments* arguments)
+{
+	(void)reference;
+
+	xboxone_command_buffer_header header = {};
+	xboxone_command_results results = {};
+	xboxone_config* config = nullptr;
+	bool configChanged = false;
+	const uint8_t* buffer = nullptr;
+	uint32_t size = 0;
+	xboxone_parsed_command commands[XBOXONE_COMMAND_MAX] = {};
+
+	TraceLog(">> HandleApplyCommands()");
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("HandleApplyCommands() - Input interface is null.");
+		return kIOReturnNotAttached;
+	}
+
+	// Buffers larger than the inline limit would arrive as a descriptor instead, and are refused.
+	if (arguments->structureInput == nullptr)
+	{
+		Log("HandleApplyCommands() - Missing structure input, or larger than %u bytes.", XBOXONE_COMMAND_BUFFER_MAX_SIZE);
+		return kIOReturnBadArgument;
+	}
+
+	buffer = (const uint8_t*)arguments->structureInput->getBytesNoCopy();
+	size = (uint32_t)arguments->structureInput->getLength();
+
+	if (XboxOneCommandReadHeader(buffer, size, &header) == false)
+	{
+		Log("HandleApplyCommands() - Unsupported command buffer of %u bytes, version %u, with %u commands.", size, header.version, header.count);
+		return kIOReturnUnsupported;
+	}
+
+	results.version = XBOXONE_COMMAND_VERSION;
+	results.count = header.count;
+	XboxOneCommandParse(buffer, size, header.count, commands);
+
+	for (uint32_t index = 0; index < header.count; ++index)
+	{
+		const xboxone_parsed_command* parsed = &commands[index];
+
+		switch (parsed->status)
+		{
+			case XBOXONE_COMMAND_VALID:
+				results.results[index] = ApplyCommand(parsed->command.tag, parsed->payload, parsed->command.length, &config, &configChanged);
+				break;
+
+			case XBOXONE_COMMAND_UNKNOWN:
+				DebugLog("HandleApplyCommands() - Unknown command %u.", parsed->command.tag);
+				results.results[index] = kIOReturnUnsupported;
+				break;
+
+			case XBOXONE_COMMAND_BAD_LENGTH:
+				DebugLog("HandleApplyCommands() - Command %u expected %u bytes, got %u.", parsed->command.tag,
+						 XboxOneCommandPayloadSize(parsed->command.tag), parsed->command.length);
+				results.results[index] = kIOReturnBadArgument;
+				break;
+
+			default:
+				results.results[index] = kIOReturnBadArgument;
+				break;
+		}
+	}
+
+	if (config != nullptr)
+	{
+		ivars->inputInterface->EndConfigUpdate(config, configChanged);
+	}
+
+	arguments->structureOutput = OSData::withBytes(&results, sizeof(results));
+	if (arguments->structureOutput == nullptr)
+	{
+		Log("HandleApplyCommands() - Failed to create structure output.");
+		return kIOReturnNoMemory;
+	}
+
+	TraceLog("<< HandleApplyCommands()");
+
+	return kIOReturnSuccess;
+}
+
+/// Applies a single command from a command buffer, which `XboxOneCommandParse` found to have a known tag and the payload size it expects.
+///
+/// Each command does exactly what its individual selector does, so a batch leaves the driver in the same state as the equivalent calls.
+/// Configuration commands change `*config` instead of publishing on their own, starting the change on the first of them,
+/// and set `*configChanged` when they succeed. The caller publishes it with `EndConfigUpdate`.
+kern_return_t XboxOneUserClient::ApplyCommand(uint16_t tag, const uint8_t* payload, uint32_t length, xboxone_config** config, bool* configChanged)
+{
+	kern_return_t ret = kIOReturnSuccess;
+
+	if (XboxOneCommandChangesConfig(tag) == true && *config == nullptr)
+	{
+		*config = ivars->inputInterface->BeginConfigUpdate();
+		if (*config == nullptr)
+		{
+			return kIOReturnNoMemory;
+		}
+	}
+
+	switch (tag)
+	{
+		case XBOXONE_COMMAND_SET_ENABLE:
+		{
+			xboxone_enable_command enable = {};
+
+			memcpy(&enable, payload, sizeof(enable));
+			ivars->inputInterface->SetEnable(enable.enabled != 0);
+			return kIOReturnSuccess;
+		}
+
+		case XBOXONE_COMMAND_SET_REPORT_FILTER:
+		{
+			xboxone_report_filter_command filter = {};
+
+			memcpy(&filter, payload, sizeof(filter));
+			ivars->inputInterface->UpdateReportFilter(*config, filter.enabled != 0, filter.thresholds, XBOXONE_AXIS_COUNT);
+			break;
+		}
+
+		case XBOXONE_COMMAND_SET_AXIS_TRANSFORM:
+			ret = ivars->inputInterface->UpdateAxisTransform(*config, payload, length);
+			break;
+
+		case XBOXONE_COMMAND_SET_TRACE_CATEGORIES:
+		{
+			xboxone_trace_categories_command trace = {};
+
+			memcpy(&trace, payload, sizeof(trace));
+			ivars->inputInterface->SetTraceCategories(trace.categories);
+			return kIOReturnSuccess;
+		}
+
+		case XBOXONE_COMMAND_RUMBLE:
+			return ivars->inputInterface->SendRumble(payload, length);
+
+		case XBOXONE_COMMAND_SET_COALESCING:
+		{
+			xboxone_coalescing_command coalescing = {};
+
+			memcpy(&coalescing, payload, sizeof(coalescing));
+			if (coalescing.windowMicroseconds > XBOXONE_COALESCE_MAX_WINDOW_MICROSECONDS)
+			{
+				return kIOReturnBadArgument;
+			}
+			ivars->inputInterface->SetCoalescing(coalescing.windowMicroseconds);
+			return kIOReturnSuccess;
+		}
+
+		case XBOXONE_COMMAND_SET_REMAP:
+			ret = ivars->inputInterface->UpdateRemap(*config, payload, length);
+			break;
+
+		case XBOXONE_COMMAND_SET_STICK_FILTER:
+			ret = ivars->inputInterface->UpdateStickFilter(*config, payload, length);
+			break;
+
+		default:
+			return kIOReturnUnsupported;
+	}
+
+	// Only configuration commands get here.
+	if (ret == kIOReturnSuccess)
+	{
+		*configChanged = true;
+	}
+
+	return ret;
+}
+
+/// Static callback that calls back `HandleSetCoalescing` using the context provided in `reference`
+kern_return_t XboxOneUserClient::StaticHandleSetCoalescing(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
+{
+	TraceLog("StaticHandleSetCoalescing()");
+
+	if (target == nullptr)
+	{
+		return kIOReturnError;
+	}
+
+	return ((XboxOneUserClient*)target)->HandleSetCoalescing(reference, arguments);
+}
+
+/// Sets the coalescing window for button reports.
+///
+/// The scalar is the window in microseconds, with 0 turning coalescing off. Windows longer than a second are refused.
+kern_return_t XboxOneUserClient::HandleSetCoalescing(void* reference, IOUserClientMethodArguments* arguments)
+{
+	(void)reference;
+
+	TraceLog(">> HandleSetCoalescing()");
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("HandleSetCoalescing() - Input interface is null.");
+		return kIOReturnNotAttached;
+	}
+
+	if (arguments->scalarInput[0] > XBOXONE_COALESCE_MAX_WINDOW_MICROSECONDS)
+	{
+		DebugLog("HandleSetCoalescing() - Window of %llu microseconds is too long.", arguments->scalarInput[0]);
+		return kIOReturnBadArgument;
+	}
+
+	ivars->inputInterface->SetCoalescing((uint32_t)arguments->scalarInput[0]);
+
+	TraceLog("<< HandleSetCoalescing()");
+
+	return kIOReturnSuccess;
+}
+
+/// Static callback that calls back `HandleWaitForButtonEvents` using the context provided in `reference`
+kern_return_t XboxOneUserClient::StaticHandleWaitForButtonEvents(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
+{
+	TraceLog("StaticHandleWaitForButtonEvents()");
+
+	if (target == nullptr)
+	{
+		return kIOReturnError;
+	}
+
+	return ((XboxOneUserClient*)target)->HandleWaitForButtonEvents(reference, arguments);
+}
+
+/// Waits for the next button event.
+///
+/// The scalar is the number of events the client has read. The call returns at once,
+/// and its completion is called with the number of events recorded as soon as that is more.
+kern_return_t XboxOneUserClient::HandleWaitForButtonEvents(void* reference, IOUserClientMethodArguments* arguments)
+{
+	(void)reference;
+
+	kern_return_t ret = kIOReturnSuccess;
+
+	TraceLog(">> HandleWaitForButtonEvents()");
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("HandleWaitForButtonEvents() - Input interface is null.");
+		return kIOReturnNotAttached;
+	}
+
+	ret = ivars->inputInterface->WaitForButtonEvents(this, arguments->completion, arguments->scalarInput[0]);
+
+	TraceLog("<< HandleWaitForButtonEvents()");
+
+	return ret;
+}
+
+/// Static callback that calls back `HandleSetRemap` using the context provided in `reference`
+kern_return_t XboxOneUserClient::StaticHandleSetRemap(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
+{
+	TraceLog("StaticHandleSetRemap()");
+
+	if (target == nullptr)
+	{
+		return kIOReturnError;
+	}
+
+	return ((XboxOneUserClient*)target)->HandleSetRemap(reference, arguments);
+}
+
+/// Uploads button remapping and axis swaps, passed as an `xboxone_remap_config` structure.
+kern_return_t XboxOneUserClient::HandleSetRemap(void* reference, IOUserClientMethodArguments* arguments)
+{
+	(void)reference;
+
+	kern_return_t ret = kIOReturnSuccess;
+
+	TraceLog(">> HandleSetRemap()");
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("HandleSetRemap() - Input interface is null.");
+		return kIOReturnNotAttached;
+	}
+
+	if (arguments->structureInput == nullptr)
+	{
+		Log("HandleSetRemap() - Missing structure input.");
+		return kIOReturnBadArgument;
+	}
+
+	ret = ivars->inputInterface->SetRemap(arguments->structureInput->getBytesNoCopy(), (uint32_t)arguments->structureInput->getLength());
+
+	TraceLog("<< HandleSetRemap()");
+
+	return ret;
+}
+
+/// Static callback that calls back `HandleSetStickFilter` using the context provided in `reference`
+kern_return_t XboxOneUserClient::StaticHandleSetStickFilter(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
+{
+	TraceLog("StaticHandleSetStickFilter()");
+
+	if (target == nullptr)
+	{
+		return kIOReturnError;
+	}
+
+	return ((XboxOneUserClient*)target)->HandleSetStickFilter(reference, arguments);
+}
+
+/// Configures the smoothing of stick jitter, passed as an `xboxone_stick_filter_config` structure.
+kern_return_t XboxOneUserClient::HandleSetStickFilter(void* reference, IOUserClientMethodArguments* arguments)
+{
+	(void)reference;
+
+	kern_return_t ret = kIOReturnSuccess;
+
+	TraceLog(">> HandleSetStickFilter()");
+
+	if (ivars->inputInterface == nullptr)
+	{
+		Log("HandleSetStickFilter() - Input interface is null.");
+		return kIOReturnNotAttached;
+	}
+
+	if (arguments->structureInput == nullptr)
+	{
+		Log("HandleSetStickFilter() - Missing structure input.");
+		return kIOReturnBadArgument;
+	}
+
+	ret = ivars->inputInterface->SetStickFilter(arguments->structureInput->getBytesNoCopy(), (uint32_t)arguments->structureInput->getLength());
+
+	TraceLog("<< HandleSetStickFilter()");
+
+	return ret;
+}